@@ -0,0 +1,366 @@
+/**
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk.h>
+
+static bool globa_break = false;
+static void int_handler(int dummy) { globa_break = true; }
+static void start_example(int argc, char **argv);
+
+#ifdef WSTK_OS_WIN
+static BOOL WINAPI cons_handler(DWORD type) {
+    switch(type) {
+        case CTRL_C_EVENT:
+            int_handler(0);
+        break;
+        case CTRL_BREAK_EVENT:
+            int_handler(0);
+        break;
+    }
+    return TRUE;
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifndef WSTK_OS_WIN
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, int_handler);
+#else
+    if(!SetConsoleCtrlHandler((PHANDLER_ROUTINE)cons_handler, TRUE)) {
+        WSTK_DBG_PRINT("ERROR: SetConsoleCtrlHandler()");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    if(wstk_core_init() != WSTK_STATUS_SUCCESS) {
+        exit(1);
+    }
+
+    setbuf(stderr, NULL);
+    setbuf(stdout, NULL);
+
+    start_example(argc, argv);
+
+    wstk_core_shutdown();
+    exit(0);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// example code
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+#define BENCH_OPS 500000
+
+static const char *req_sample =
+    "POST /rpc/MyService1?debug=1&x=%20y HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=7d1b2c3f4e5a; theme=dark\r\n"
+    "Content-Type: application/json; charset=UTF-8\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "{\"id\":1,\"method\":\"hello\"}";
+
+#define PL_ARG(pl) (int)(pl).l, ((pl).p ? (pl).p : "")
+
+typedef wstk_status_t (*decoder_t)(wstk_http_msg_t *msg, wstk_mbuf_t *mbuf);
+
+/* ----------------------------------------------------------------------- */
+/* the former regex based decoder, kept here to compare with               */
+/* ----------------------------------------------------------------------- */
+static wstk_status_t legacy_hdr_put(wstk_http_msg_t *msg, wstk_pl_t *name, wstk_pl_t *value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    char tname[0xff] = {0};
+    char *tval = NULL;
+
+    if(!msg) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(!msg->headers && wstk_hash_init(&msg->headers) != WSTK_STATUS_SUCCESS) {
+        return WSTK_STATUS_MEM_FAIL;
+    }
+    if(!name || !name->l || name->l >= sizeof(tname)) {
+        return WSTK_STATUS_OUTOFRANGE;
+    }
+    if(!value || !value->l || value->l > 4096) {
+        return WSTK_STATUS_OUTOFRANGE;
+    }
+
+    memcpy((char *)tname, name->p, name->l);
+    tname[name->l] = '\0';
+
+    if(wstk_str_casecmp((char *)tname, "Content-Type") == 0) {
+        const char *cend = (value->p + value->l);
+        const char *cptr = wstk_strnstr(value->p, value->l, "charset=");
+        if(cptr) {
+            uint32_t sep_ofs = 0;
+            for(sep_ofs=0; sep_ofs <= value->l; sep_ofs++) {
+                if(value->p[sep_ofs] == ';') { break;}
+            }
+            if(sep_ofs >= value->l) {
+                msg->ctype.l = value->l;
+                msg->ctype.p = value->p;
+            } else {
+                msg->charset.l = (cend - (cptr + 8));
+                msg->charset.p = (msg->charset.l ? (void *)(cptr + 8) : NULL);
+                msg->ctype.l = sep_ofs;
+                msg->ctype.p = value->p;
+            }
+        } else {
+            msg->ctype.l = value->l;
+            msg->ctype.p = value->p;
+        }
+
+        goto out;
+    }
+    if(wstk_str_casecmp((char *)tname, "Content-Length") == 0) {
+        msg->clen = wstk_pl_u32(value);
+        goto out;
+    }
+
+    status = wstk_pl_strdup(&tval, value);
+    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+
+    status = wstk_hash_insert_ex(msg->headers, (char *)tname, (char *)tval, true);
+    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(tval);
+    }
+    return status;
+}
+
+static wstk_status_t legacy_decode(wstk_http_msg_t *msg, wstk_mbuf_t *mbuf) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_pl_t b = {0}, s = {0}, e = {0}, name = {0}, value = {0};
+    uint32_t ws=0, lf=0;
+    bool comsep=false, quote=false;
+    const char *p, *cv;
+    size_t l = 0;
+
+    if(!msg || !mbuf) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    msg->clen = 0;
+
+    p = (const char *)wstk_mbuf_buf(mbuf);
+    l = wstk_mbuf_left(mbuf);
+
+    status = wstk_regex(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1", &b, &s, NULL, &e);
+    if(status != WSTK_STATUS_SUCCESS) {
+        if(l > mbuf->size) {
+            wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+        }
+        wstk_goto_status(WSTK_STATUS_NODATA, out);
+    }
+
+    status = wstk_regex(s.p, s.l, "[a-z]+ [^? ]+[^ ]* HTTP/[0-9.]+", &msg->method, &msg->path, &msg->params, &msg->version);
+    if(status != WSTK_STATUS_SUCCESS || msg->method.p != s.p) {
+        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+    }
+    if(msg->params.p && msg->params.l > 1) {
+        if(*msg->params.p == '?') {
+            msg->params.p++;
+            msg->params.l--;
+        }
+    }
+
+    l -= e.p + e.l - p;
+    p = e.p + e.l;
+
+    name.p = cv = NULL;
+    name.l = ws = lf = 0;
+    comsep = false;
+    quote = false;
+
+    for(; l > 0; p++, l--) {
+        switch(*p) {
+            case ' ':
+            case '\t':
+                lf = 0; /* folding */
+                ++ws;
+                break;
+            case '\r':
+                ++ws;
+                break;
+            case '\n':
+                ++ws;
+                if(!name.p) {
+                    ++p; --l; /* no headers */
+                    goto out;
+                }
+                if(!lf++) {
+                    break;
+                }
+                ++p; --l;     /* eoh */
+                /*fallthrough*/
+            default:
+                if(lf || (*p == ',' && comsep && !quote)) {
+                    if(!name.l) {
+                        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                    }
+
+                    value.p = (cv ? cv : p);
+                    value.l = (cv ? p - cv - ws : 0);
+                    legacy_hdr_put(msg, &name, &value);
+
+                    if(!lf) { /* comma separated */
+                        cv = NULL;
+                        break;
+                    }
+                    if(lf > 1) { /* eoh */
+                        goto out;
+                    }
+
+                    comsep = false;
+                    name.p = NULL;
+                    cv = NULL;
+                    lf = 0;
+                }
+                if(!name.p) {
+                    name.p = p;
+                    name.l = 0;
+                    ws = 0;
+                }
+                if(!name.l) {
+                    if(*p != ':') {
+                        ws = 0;
+                        break;
+                    }
+                    name.l = MAX((int)(p - name.p - ws), 0);
+                    if(!name.l) {
+                        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                    }
+                    comsep = false;
+                    break;
+                }
+
+                if(!cv) {
+                    quote = false;
+                    cv = p;
+                }
+
+                if(*p == '"') {
+                    quote = !quote;
+                }
+
+                ws = 0;
+                break;
+        }
+    }
+    status = WSTK_STATUS_NODATA;
+
+out:
+    if(status == WSTK_STATUS_SUCCESS || status == WSTK_STATUS_NODATA) {
+        mbuf->pos = (mbuf->end - l);
+    }
+    return status;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* returns requests/sec */
+static uint64_t bench_run(decoder_t decoder, wstk_mbuf_t *mbuf) {
+    wstk_http_msg_t *msg = NULL;
+    uint64_t ts = 0;
+
+    ts = wstk_time_micro_now();
+    for(uint32_t i = 0; i < BENCH_OPS; i++) {
+        if(wstk_http_msg_alloc(&msg) != WSTK_STATUS_SUCCESS) {
+            return 0;
+        }
+        wstk_mbuf_set_pos(mbuf, 0);
+        decoder(msg, mbuf);
+        wstk_mem_deref(msg);
+    }
+    ts = (wstk_time_micro_now() - ts);
+
+    return (ts ? ((uint64_t)BENCH_OPS * 1000000 / ts) : 0);
+}
+
+static void print_msg(const char *title, wstk_http_msg_t *msg, wstk_mbuf_t *mbuf) {
+    const char *host = NULL;
+    wstk_pl_t conn = {0}, agent = {0};
+
+    wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_CONNECTION, &conn);
+    wstk_http_msg_header_get_pl(msg, "user-agent", &agent);
+    WSTK_DBG_PRINT("%s: hdrs_count=%d, connection=[%.*s], user-agent=[%.*s] (zero-copy)", title, (int)msg->hdrs_count, PL_ARG(conn), PL_ARG(agent));
+
+    wstk_http_msg_header_get(msg, "Host", &host);
+    WSTK_DBG_PRINT("%s: method=[%.*s], path=[%.*s], params=[%.*s], version=[%.*s], ctype=[%.*s], charset=[%.*s], clen=%d, host=[%s], body=[%.*s]",
+                   title, PL_ARG(msg->method), PL_ARG(msg->path), PL_ARG(msg->params), PL_ARG(msg->version), PL_ARG(msg->ctype), PL_ARG(msg->charset),
+                   msg->clen, (host ? host : ""), (int)wstk_mbuf_left(mbuf), (char *)wstk_mbuf_buf(mbuf));
+}
+
+void start_example(int argc, char **argv) {
+    wstk_http_msg_t *msg = NULL;
+    wstk_mbuf_t *mbuf = NULL;
+    wstk_status_t st = WSTK_STATUS_SUCCESS;
+    size_t len = strlen(req_sample);
+    uint32_t calls = 0;
+
+    WSTK_DBG_PRINT("Test http-msg decoder (wstk-version: %s)", WSTK_VERSION_STR);
+
+    if(wstk_mbuf_alloc(&mbuf, len + 1) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_mbuf_alloc()");
+        return;
+    }
+
+    /* the whole request */
+    wstk_mbuf_write_mem(mbuf, (const uint8_t *)req_sample, len);
+    wstk_mbuf_set_pos(mbuf, 0);
+    wstk_http_msg_alloc(&msg);
+    st = wstk_http_msg_decode(msg, mbuf);
+    WSTK_DBG_PRINT("decode: status=%d (expected 0)", (int)st);
+    print_msg("new", msg, mbuf);
+    msg = wstk_mem_deref(msg);
+
+    wstk_mbuf_set_pos(mbuf, 0);
+    wstk_http_msg_alloc(&msg);
+    legacy_decode(msg, mbuf);
+    print_msg("old", msg, mbuf);
+    msg = wstk_mem_deref(msg);
+
+    /* byte by byte, each call resumes */
+    wstk_mbuf_rewind(mbuf);
+    wstk_http_msg_alloc(&msg);
+    for(size_t i = 0; i < len; i++) {
+        wstk_mbuf_set_pos(mbuf, wstk_mbuf_end(mbuf));
+        wstk_mbuf_write_u8(mbuf, (uint8_t)req_sample[i]);
+        wstk_mbuf_set_pos(mbuf, 0);
+        calls++;
+        if((st = wstk_http_msg_decode(msg, mbuf)) != WSTK_STATUS_NODATA) {
+            break;
+        }
+    }
+    WSTK_DBG_PRINT("partial: status=%d after %d calls (hdr_scan=%d)", (int)st, calls, (int)msg->hdr_scan);
+    wstk_mbuf_set_end(mbuf, len);
+    print_msg("new", msg, mbuf);
+    msg = wstk_mem_deref(msg);
+
+    /* malformed */
+    wstk_mbuf_rewind(mbuf);
+    wstk_mbuf_write_str(mbuf, "GET /\x01 HTTP/1.1\r\n\r\n");
+    wstk_mbuf_set_pos(mbuf, 0);
+    wstk_http_msg_alloc(&msg);
+    st = wstk_http_msg_decode(msg, mbuf);
+    WSTK_DBG_PRINT("malformed: status=%d (expected %d)", (int)st, (int)WSTK_STATUS_BAD_REQUEST);
+    msg = wstk_mem_deref(msg);
+
+    WSTK_DBG_PRINT("-----------------------------------------------");
+    WSTK_DBG_PRINT("benchmark: %d requests of %d bytes (alloc + decode + deref)", BENCH_OPS, (int)len);
+    wstk_mbuf_rewind(mbuf);
+    wstk_mbuf_write_mem(mbuf, (const uint8_t *)req_sample, len);
+
+    uint64_t old_rps = bench_run(legacy_decode, mbuf);
+    uint64_t new_rps = bench_run(wstk_http_msg_decode, mbuf);
+    WSTK_DBG_PRINT("regex decoder=%llu req/sec, state-machine decoder=%llu req/sec", (unsigned long long)old_rps, (unsigned long long)new_rps);
+
+    wstk_mem_deref(mbuf);
+}
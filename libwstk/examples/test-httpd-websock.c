@@ -54,6 +54,8 @@ void my_auth_handler(wstk_httpd_auth_request_t *req, wstk_httpd_auth_response_t
     rsp->permitted = true;
 }
 
+static wstk_servlet_websock_t *websock_servlet = NULL;
+
 bool my_websock_on_accept(wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *ctx) {
     WSTK_DBG_PRINT("--> websock_on_accept() conn=%p, ctx=%p", conn, ctx);
 
@@ -65,10 +67,18 @@ void my_websock_on_close(wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *ctx) {
 }
 
 void my_websock_on_message(wstk_servlet_websock_conn_t *conn, wstk_mbuf_t *mbuf) {
+    uint32_t delivered = 0, dropped = 0;
     char *str = NULL;
 
     WSTK_DBG_PRINT("--> websock_on_message() ws-opcode=%d, ws-len=%d, sec-ctx=%p, sec-token=[%s]", conn->header->opcode, (int)conn->header->len, conn->sec_ctx, conn->sec_ctx->token);
 
+    /* 'all:...' goes to everyone */
+    if(conn->header->len > 4 && !strncmp((char *)wstk_mbuf_buf(mbuf), "all:", 4)) {
+        wstk_servlet_websock_broadcast(websock_servlet, NULL, NULL, WEBSOCK_TEXT, mbuf, &delivered, &dropped);
+        WSTK_DBG_PRINT("--> ws-broadcast: delivered=%d, dropped=%d", delivered, dropped);
+        return;
+    }
+
     wstk_mbuf_strdup(mbuf, &str, conn->header->len);
     WSTK_DBG_PRINT("--> ws-echo: [%s]", str);
 
@@ -79,7 +89,6 @@ void my_websock_on_message(wstk_servlet_websock_conn_t *conn, wstk_mbuf_t *mbuf)
 void start_example(int argc, char **argv) {
     wstk_sockaddr_t sa = {0};
     wstk_httpd_t *httpd = NULL;
-    wstk_servlet_websock_t *websock_servlet = NULL;
     char *home = NULL;
     char *host = NULL;
     char *charset = "UTF-8";
@@ -128,6 +137,12 @@ void start_example(int argc, char **argv) {
         return;
     }
 
+    /* a slow client gets up to 256K queued, the messages above that are dropped (till it reads it down to 64K) */
+    if((wstk_httpd_set_outq(httpd, 262144, 65536, WSTK_TCP_SRV_OUTQ_DROP, 0)) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_httpd_set_outq()");
+        return;
+    }
+
     // websocket
     if(wstk_httpd_register_servlet_websock(httpd, "/ws/", &websock_servlet) != WSTK_STATUS_SUCCESS) {
         WSTK_DBG_PRINT("FAIL: wstk_httpd_register_servlet_websock()");
@@ -136,6 +151,8 @@ void start_example(int argc, char **argv) {
     wstk_servlet_websock_set_on_close(websock_servlet, my_websock_on_close);
     wstk_servlet_websock_set_on_accept(websock_servlet, my_websock_on_accept);
     wstk_servlet_websock_set_on_message(websock_servlet, my_websock_on_message);
+    /* permessage-deflate (needs zlib): 64 bytes and more, up to 128K of the windows per connection */
+    wstk_servlet_websock_set_deflate(websock_servlet, true, -1, 64, 131072, false);
 
 
     // start httpd
@@ -75,6 +75,13 @@ void my_servlet_handler2(wstk_http_conn_t *conn, wstk_http_msg_t *msg, void *uda
     WSTK_DBG_PRINT("SLEEP - DONE (conn=%p)", conn);
 }
 
+void my_servlet_handler3(wstk_http_conn_t *conn, wstk_http_msg_t *msg, void *udata) {
+    wstk_pl_t id = { 0 };
+
+    wstk_http_msg_path_param(msg, "id", &id);
+    wstk_httpd_creply(conn, 200, NULL, "text/plain", "user: %r\n", &id);
+}
+
 wstk_servlet_jsonrpc_handler_result_t *my_service_handler(wstk_httpd_sec_ctx_t *ctx, const char *method, const cJSON *params) {
     /*if(1) {
         char *ttt=NULL;
@@ -256,6 +263,16 @@ void start_example(int argc, char **argv) {
         return;
     }
 
+    if((wstk_httpd_set_cache(httpd, 16 * 1024 * 1024, 0, 0)) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_httpd_set_cache()");
+        return;
+    }
+
+    if((wstk_httpd_set_compression(httpd, 1024, -1, true)) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_httpd_set_compression()");
+        return;
+    }
+
 
     // test servlets
     if(wstk_httpd_register_servlet(httpd, "/test1/", my_servlet_handler1, NULL, false) != WSTK_STATUS_SUCCESS) {
@@ -266,6 +283,10 @@ void start_example(int argc, char **argv) {
         WSTK_DBG_PRINT("FAIL: wstk_httpd_register_servlet()");
         return;
     }
+    if(wstk_httpd_register_servlet(httpd, "/users/:id/profile", my_servlet_handler3, NULL, false) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_httpd_register_servlet()");
+        return;
+    }
 
 
     // upload servlet
@@ -49,22 +49,178 @@ int main(int argc, char **argv) {
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // example code
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+#define BENCH_OPS_PER_THREAD 200000
+#define BENCH_THREADS_MAX    32
+#define BENCH_CACHE_LINE     64
+
+/* the consumer's own counters, a cache line each */
+typedef struct {
+    uint64_t        consumed;
+    uint64_t        checksum;
+    char            pad[BENCH_CACHE_LINE - 2 * sizeof(uint64_t)];
+} bench_counter_t;
+
+typedef struct {
+    wstk_queue_t    *queue;
+    uint32_t        ops;            // per producer
+    uint32_t        producers;
+    uint32_t        ready;          // threads at the start barrier
+    uint32_t        go;             // barrier released
+    uint32_t        producers_done;
+    char            pad0[BENCH_CACHE_LINE];
+    bench_counter_t counters[BENCH_THREADS_MAX];
+} bench_ctx_t;
+
+typedef struct {
+    bench_ctx_t     *ctx;
+    uint32_t        id;
+} bench_thread_t;
+
+static void bench_barrier(bench_ctx_t *ctx) {
+    wstk_atomic_seq_add(&ctx->ready, 1);
+    while(!wstk_atomic_acq(&ctx->go)) {
+        wstk_thread_yield();
+    }
+}
+
+static void bench_producer(wstk_thread_t *th, void *udata) {
+    bench_ctx_t *ctx = ((bench_thread_t *)udata)->ctx;
+
+    bench_barrier(ctx);
+
+    for(uintptr_t i = 1; i <= ctx->ops; i++) {
+        while(wstk_queue_push(ctx->queue, (void *)i) != WSTK_STATUS_SUCCESS) {
+            wstk_thread_yield();
+        }
+    }
+
+    wstk_atomic_seq_add(&ctx->producers_done, 1);
+}
+
+static void bench_consumer(wstk_thread_t *th, void *udata) {
+    bench_ctx_t *ctx = ((bench_thread_t *)udata)->ctx;
+    bench_counter_t *cnt = &ctx->counters[((bench_thread_t *)udata)->id];
+    void *pop = NULL;
+
+    bench_barrier(ctx);
+
+    while(true) {
+        if(wstk_queue_pop(ctx->queue, &pop) == WSTK_STATUS_SUCCESS) {
+            cnt->checksum += (uintptr_t)pop;
+            cnt->consumed++;
+            continue;
+        }
+        /* the producers are done and the queue is empty */
+        if(wstk_atomic_seq(&ctx->producers_done) == ctx->producers) {
+            if(wstk_queue_pop(ctx->queue, &pop) != WSTK_STATUS_SUCCESS) {
+                break;
+            }
+            cnt->checksum += (uintptr_t)pop;
+            cnt->consumed++;
+            continue;
+        }
+        wstk_thread_yield();
+    }
+}
+
+/* N producers + N consumers, returns ops/sec (the clock starts when the barrier releases all the threads) */
+static uint64_t bench_run(uint32_t qflags, uint32_t threads) {
+    wstk_thread_t *thr[BENCH_THREADS_MAX * 2] = { 0 };
+    bench_thread_t args[BENCH_THREADS_MAX * 2] = { 0 };
+    bench_ctx_t *ctx = NULL;
+    uint64_t ts = 0, total = 0, expected = 0, consumed = 0, checksum = 0, ops_sec = 0;
+    uint32_t started = 0, producers = 0;
+
+    if(threads > BENCH_THREADS_MAX) {
+        threads = BENCH_THREADS_MAX;
+    }
+    if(wstk_mem_zalloc((void *)&ctx, sizeof(bench_ctx_t), NULL) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_mem_zalloc()");
+        return 0;
+    }
+    if(wstk_queue_create_ex(&ctx->queue, 1024, qflags) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_queue_create_ex()");
+        wstk_mem_deref(ctx);
+        return 0;
+    }
+
+    ctx->ops = BENCH_OPS_PER_THREAD;
+    total = (uint64_t)ctx->ops * threads;
+    expected = ((uint64_t)ctx->ops * (ctx->ops + 1) / 2) * threads;
+
+    for(uint32_t i = 0; i < threads; i++) {
+        args[i * 2].ctx = ctx;
+        args[i * 2].id = i;
+        args[i * 2 + 1].ctx = ctx;
+        args[i * 2 + 1].id = i;
+        if(wstk_thread_create(&thr[i * 2], bench_producer, &args[i * 2], 0) == WSTK_STATUS_SUCCESS) { started++; producers++; }
+        if(wstk_thread_create(&thr[i * 2 + 1], bench_consumer, &args[i * 2 + 1], 0) == WSTK_STATUS_SUCCESS) { started++; }
+    }
+    while(wstk_atomic_seq(&ctx->ready) < started) {
+        wstk_thread_yield();
+    }
+
+    ctx->producers = producers;
+    ts = wstk_time_micro_now();
+    wstk_atomic_rls_set(&ctx->go, 1);
+
+    for(uint32_t i = 0; i < threads * 2; i++) {
+        if(thr[i]) {
+            wstk_thread_join(thr[i]);
+            wstk_mem_deref(thr[i]);
+        }
+    }
+    ts = (wstk_time_micro_now() - ts);
+
+    for(uint32_t i = 0; i < threads; i++) {
+        consumed += ctx->counters[i].consumed;
+        checksum += ctx->counters[i].checksum;
+    }
+    ops_sec = (ts ? (consumed * 1000000 / ts) : 0);
+
+    if(consumed != total || checksum != expected) {
+        WSTK_DBG_PRINT("FAIL: checksum mismatch (lockfree=%d, threads=%d)", (qflags & WSTK_QUEUE_LOCKFREE ? 1 : 0), threads);
+    }
+
+    wstk_mem_deref(ctx->queue);
+    wstk_mem_deref(ctx);
+    return ops_sec;
+}
+
 void start_example(int argc, char **argv) {
+    uint32_t threads[] = { 1, 4, 16 };
     wstk_queue_t  *queue;
-    void *pop;
+    void *items[4] = { 0 };
+    void *pop = NULL;
+    uint32_t n = 0;
+
+    WSTK_DBG_PRINT("Test queue (wstk-version: %s)", WSTK_VERSION_STR);
 
-    if(wstk_queue_create(&queue, 64) != WSTK_STATUS_SUCCESS) {
+    if(wstk_queue_create(&queue, 2) != WSTK_STATUS_SUCCESS) {
         WSTK_DBG_PRINT("FAIL: wstk_queue_create()");
         return;
     }
 
-    wstk_queue_push(queue, "test 1");
-    wstk_queue_push(queue, "test 2");
-    wstk_queue_push(queue, "test 3");
+    /* wraps around */
+    for(int i = 0; i < 5; i++) {
+        wstk_queue_push(queue, "test 1");
+        wstk_queue_push(queue, "test 2");
+        wstk_queue_pop(queue, &pop);
+        wstk_queue_pop(queue, &pop);
+    }
+    items[0] = "test 1"; items[1] = "test 2"; items[2] = "test 3";
+    wstk_queue_push_n(queue, items, 3, &n);
+    WSTK_DBG_PRINT("push_n: pushed=%d (expected 2)", n);
+    wstk_queue_pop_n(queue, items, 4, &n);
+    WSTK_DBG_PRINT("pop_n: popped=%d [%s, %s]", n, (char *)items[0], (char *)items[1]);
+    wstk_mem_deref(queue);
 
-    stwstk_queue_pop(queue, &pop);
-    stwstk_queue_pop(queue, &pop);
-    stwstk_queue_pop(queue, &pop);
+    WSTK_DBG_PRINT("-----------------------------------------------");
+    WSTK_DBG_PRINT("benchmark: %d ops per producer, N producers + N consumers", BENCH_OPS_PER_THREAD);
+    for(int i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        uint64_t mtx = bench_run(0x0, threads[i]);
+        uint64_t lfr = bench_run(WSTK_QUEUE_LOCKFREE, threads[i]);
 
+        WSTK_DBG_PRINT("N=%02d: mutex=%llu ops/sec, lock-free=%llu ops/sec", threads[i], (unsigned long long)mtx, (unsigned long long)lfr);
+    }
 }
-
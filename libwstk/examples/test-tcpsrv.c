@@ -105,9 +105,11 @@ void start_example(int argc, char **argv) {
     wstk_tcp_srv_t *srv = NULL;
     char *host = NULL;
     uint32_t port = 0;
+    uint32_t reactors = 1;
+    int32_t affinity = -1;
 
     if(!argc || argc < 2) {
-        WSTK_DBG_PRINT("usage: %s ip port", argv[0]);
+        WSTK_DBG_PRINT("usage: %s ip port [reactors] [affinity-threads]", argv[0]);
         return;
     }
 
@@ -116,6 +118,13 @@ void start_example(int argc, char **argv) {
     host = argv[1];
     port = atoi(argv[2]);
 
+    if(argc > 3) {
+        reactors = atoi(argv[3]);
+    }
+    if(argc > 4) {
+        affinity = atoi(argv[4]);
+    }
+
     if(wstk_sa_set_str(&sa, host, port) != WSTK_STATUS_SUCCESS) {
         WSTK_DBG_PRINT("FAIL: wstk_sa_set_str()");
         return;
@@ -127,6 +136,16 @@ void start_example(int argc, char **argv) {
         return;
     }
 
+    if(wstk_tcp_srv_set_reactors(srv, reactors) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_tcp_srv_set_reactors()");
+        return;
+    }
+
+    if(affinity >= 0 && wstk_tcp_srv_set_affinity(srv, affinity, true) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_tcp_srv_set_affinity()");
+        return;
+    }
+
     if(wstk_tcp_srv_start(srv) != WSTK_STATUS_SUCCESS) {
         WSTK_DBG_PRINT("FAIL: wstk_tcp_srv_start()");
         return;
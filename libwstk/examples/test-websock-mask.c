@@ -0,0 +1,116 @@
+/**
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk.h>
+
+static bool globa_break = false;
+static void int_handler(int dummy) { globa_break = true; }
+static void start_example(int argc, char **argv);
+
+#ifdef WSTK_OS_WIN
+static BOOL WINAPI cons_handler(DWORD type) {
+    switch(type) {
+        case CTRL_C_EVENT:
+            int_handler(0);
+        break;
+        case CTRL_BREAK_EVENT:
+            int_handler(0);
+        break;
+    }
+    return TRUE;
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifndef WSTK_OS_WIN
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, int_handler);
+#else
+    if(!SetConsoleCtrlHandler((PHANDLER_ROUTINE)cons_handler, TRUE)) {
+        WSTK_DBG_PRINT("ERROR: SetConsoleCtrlHandler()");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    if(wstk_core_init() != WSTK_STATUS_SUCCESS) {
+        exit(1);
+    }
+
+    setbuf(stderr, NULL);
+    setbuf(stdout, NULL);
+
+    start_example(argc, argv);
+
+    wstk_core_shutdown();
+    exit(0);
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// example code
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/* the way it was done before (byte by byte) */
+static void mask_bytes(uint8_t *data, size_t len, const uint8_t *mkey, size_t offset) {
+    size_t i;
+    for(i = 0; i < len; i++) {
+        data[i] = data[i] ^ mkey[(offset + i) % 4];
+    }
+}
+
+static double mbps(uint64_t bytes, uint64_t usec) {
+    return (usec ? ((double)bytes / (double)usec) : 0.0);
+}
+
+void start_example(int argc, char **argv) {
+    const size_t sizes[] = { 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576 };
+    const uint64_t total = 256 * 1048576;
+    uint8_t mkey[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    uint8_t *data = NULL, *ref = NULL;
+    uint64_t t0 = 0, t1 = 0, t2 = 0, rounds = 0, r = 0;
+    size_t i = 0, len = 0, off = 0, skew = 0;
+
+    if(wstk_mem_zalloc((void *)&data, 1048576 + 64, NULL) != WSTK_STATUS_SUCCESS || wstk_mem_zalloc((void *)&ref, 1048576 + 64, NULL) != WSTK_STATUS_SUCCESS) {
+        WSTK_DBG_PRINT("FAIL: wstk_mem_zalloc()");
+        goto out;
+    }
+
+    WSTK_DBG_PRINT("websock masking (kernel: %s)", wstk_websock_mask_kernel());
+
+    /* the same result for any length, alignment and payload offset */
+    for(len = 0; len < 300; len++) {
+        for(skew = 0; skew < 8; skew++) {
+            for(off = 0; off < 4; off++) {
+                for(i = 0; i < len; i++) { data[skew + i] = ref[skew + i] = (uint8_t)(i * 7 + len); }
+                mask_bytes(ref + skew, len, mkey, off);
+                wstk_websock_mask(data + skew, len, mkey, off);
+                if(memcmp(data + skew, ref + skew, len)) {
+                    WSTK_DBG_PRINT("FAIL: wrong result (len=%d, skew=%d, offset=%d)", (int)len, (int)skew, (int)off);
+                    goto out;
+                }
+            }
+        }
+    }
+    WSTK_DBG_PRINT("check: OK");
+
+    WSTK_DBG_PRINT("%10s %12s %12s %8s", "payload", "bytes MB/s", "kernel MB/s", "x");
+    for(i = 0; i < ARRAY_SIZE(sizes); i++) {
+        len = sizes[i];
+        rounds = total / len;
+
+        t0 = wstk_time_micro_now();
+        for(r = 0; r < rounds; r++) {
+            mask_bytes(ref, len, mkey, 0);
+        }
+        t1 = wstk_time_micro_now();
+        for(r = 0; r < rounds; r++) {
+            wstk_websock_mask(data, len, mkey, 0);
+        }
+        t2 = wstk_time_micro_now();
+
+        WSTK_DBG_PRINT("%10d %12.1f %12.1f %8.1f", (int)len, mbps(total, t1 - t0), mbps(total, t2 - t1), (t2 > t1 ? (double)(t1 - t0) / (double)(t2 - t1) : 0.0));
+    }
+
+out:
+    wstk_mem_deref(data);
+    wstk_mem_deref(ref);
+}
@@ -71,10 +71,16 @@ static void my_worker_handler(wstk_worker_t *worker, void *qdata) {
 
 void start_example(int argc, char **argv) {
     wstk_worker_t *worker = NULL;
+    uint32_t flags = 0;
 
-    WSTK_DBG_PRINT("Test worker (wstk-version: %s)", WSTK_VERSION_STR);
+    /* ./test-worker.bin stealing */
+    if(argc > 1 && !strcmp(argv[1], "stealing")) {
+        flags |= WSTK_WORKER_STEALING;
+    }
+
+    WSTK_DBG_PRINT("Test worker (wstk-version: %s, stealing=%d)", WSTK_VERSION_STR, (flags & WSTK_WORKER_STEALING ? 1 : 0));
 
-    if(wstk_worker_create(&worker, 3, 10, 128, 15, my_worker_handler) != WSTK_STATUS_SUCCESS) {
+    if(wstk_worker_create_ex(&worker, 3, 10, 128, 15, flags, my_worker_handler) != WSTK_STATUS_SUCCESS) {
         WSTK_DBG_PRINT("FAIL: wstk_worker_create()");
         return;
     }
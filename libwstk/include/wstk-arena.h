@@ -0,0 +1,31 @@
+/**
+ ** bump-pointer arena
+ ** allocations are never freed one by one, the whole arena is reset at once
+ **
+ ** (C)2024 aks
+ **/
+#ifndef WSTK_ARENA_H
+#define WSTK_ARENA_H
+#include <wstk-core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wstk_arena_s wstk_arena_t;
+
+wstk_status_t wstk_arena_create(wstk_arena_t **arena, size_t chunk_size);
+wstk_status_t wstk_arena_reset(wstk_arena_t *arena);
+size_t wstk_arena_used(wstk_arena_t *arena);
+
+wstk_status_t wstk_arena_alloc(wstk_arena_t *arena, void **mem, size_t size);
+wstk_status_t wstk_arena_zalloc(wstk_arena_t *arena, void **mem, size_t size);
+wstk_status_t wstk_arena_strdup(wstk_arena_t *arena, char **str, const char *src);
+wstk_status_t wstk_arena_strndup(wstk_arena_t *arena, char **str, const char *src, size_t len);
+wstk_status_t wstk_arena_printf(wstk_arena_t *arena, char **str, const char *fmt, ...);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
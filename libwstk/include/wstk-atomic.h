@@ -23,6 +23,14 @@
 #define wstk_atomic_seq_add(_a, _v) re_atomic_seq_add(_a, _v)
 #define wstk_atomic_seq_sub(_a, _v) re_atomic_seq_sub(_a, _v)
 
+#define wstk_atomic_rlx_cas(_a, _e, _v) re_atomic_compare_exchange_weak(_a, _e, _v, re_memory_order_relaxed, re_memory_order_relaxed)
+#define wstk_atomic_seq_cas(_a, _e, _v) re_atomic_compare_exchange_strong(_a, _e, _v, re_memory_order_seq_cst, re_memory_order_relaxed)
+
+#if defined(__GNUC__) || defined(__clang__)
+ #define wstk_atomic_fence_seq() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+ #define WSTK_HAVE_ATOMIC_FENCE
+#endif
+
 #endif
 
 
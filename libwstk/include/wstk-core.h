@@ -53,6 +53,9 @@ extern "C" {
  #define WSTK_OS_NAME "linux"
  #define WSTK_HAVE_SYSLOG
  #define WSTK_HAVE_EPOLL
+ #define WSTK_HAVE_REUSEPORT
+ #define WSTK_HAVE_CPU_AFFINITY
+ #define WSTK_HAVE_SENDFILE
  #define WSTK_HAVE_GMTIME_R
  #define WSTK_HAVE_LOCALTIME_R
  #define WSTK_HAVE_ATOMIC
@@ -0,0 +1,36 @@
+/**
+ **
+ ** (C)2024 aks
+ **/
+#ifndef WSTK_DEFLATE_H
+#define WSTK_DEFLATE_H
+#include <wstk-core.h>
+#include <wstk-mbuf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wstk_deflate_stream_s wstk_deflate_stream_t;
+
+typedef enum {
+    WSTK_DEFLATE_RAW = 0,           // raw deflate stream
+    WSTK_DEFLATE_ZLIB,              // zlib wrapper (http 'deflate')
+    WSTK_DEFLATE_GZIP               // gzip wrapper (http 'gzip')
+} wstk_deflate_format_e;
+
+bool wstk_deflate_is_supported();
+wstk_status_t wstk_deflate_mbuf(wstk_mbuf_t *out, const void *data, size_t len, wstk_deflate_format_e format, int level);
+
+wstk_status_t wstk_deflate_stream_create(wstk_deflate_stream_t **stream, wstk_deflate_format_e format, int level, int wbits, int mem_level);
+wstk_status_t wstk_inflate_stream_create(wstk_deflate_stream_t **stream, wstk_deflate_format_e format, int wbits);
+wstk_status_t wstk_deflate_stream_write(wstk_deflate_stream_t *stream, wstk_mbuf_t *out, const void *data, size_t len, bool flush);
+wstk_status_t wstk_inflate_stream_write(wstk_deflate_stream_t *stream, wstk_mbuf_t *out, const void *data, size_t len, size_t max_len);
+wstk_status_t wstk_deflate_stream_reset(wstk_deflate_stream_t *stream);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
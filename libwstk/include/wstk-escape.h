@@ -12,6 +12,7 @@ extern "C" {
 
 wstk_status_t wstk_escape(char **out, const char *str, size_t str_len);
 wstk_status_t wstk_unescape(char **out, const char *str, size_t str_len);
+wstk_status_t wstk_unescape2(char *buf, size_t buf_size, const char *str, size_t str_len);
 
 
 
@@ -42,6 +42,7 @@ wstk_status_t wstk_file_open(wstk_file_t *file, const char *filename, const char
 wstk_status_t wstk_file_close(wstk_file_t *file);
 wstk_status_t wstk_file_seek(wstk_file_t *file, size_t ofs);
 wstk_status_t wstk_file_tell(wstk_file_t *file, size_t *pos);
+wstk_status_t wstk_file_fd(wstk_file_t *file, int *fd);
 wstk_status_t wstk_file_read(wstk_file_t *file, wstk_mbuf_t *mbuf);
 wstk_status_t wstk_file_write(wstk_file_t *file, wstk_mbuf_t *mbuf);
 
@@ -5,15 +5,45 @@
 #ifndef WSTK_HTTP_MSG_H
 #define WSTK_HTTP_MSG_H
 #include <wstk-core.h>
+#include <wstk-arena.h>
 #include <wstk-mbuf.h>
+#include <wstk-pl.h>
 #include <wstk-hashtable.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define WSTK_HTTP_MSG_HEADERS_MAX   64
+#define WSTK_HTTP_MSG_PATH_PARAMS_MAX 8
+
+/* the headers that have own slots in the message */
+typedef enum {
+    WSTK_HTTP_HDR_HOST = 0,
+    WSTK_HTTP_HDR_CONNECTION,
+    WSTK_HTTP_HDR_UPGRADE,
+    WSTK_HTTP_HDR_AUTHORIZATION,
+    WSTK_HTTP_HDR_COOKIE,
+    WSTK_HTTP_HDR_SEC_WEBSOCKET_KEY,
+    WSTK_HTTP_HDR_SEC_WEBSOCKET_VERSION,
+    WSTK_HTTP_HDR_SEC_WEBSOCKET_PROTOCOL,
+    WSTK_HTTP_HDR_SEC_WEBSOCKET_EXTENSIONS,
+    WSTK_HTTP_HDR_IF_MODIFIED_SINCE,
+    WSTK_HTTP_HDR_IF_NONE_MATCH,
+    WSTK_HTTP_HDR_IF_RANGE,
+    WSTK_HTTP_HDR_RANGE,
+    WSTK_HTTP_HDR_TRANSFER_ENCODING,
+    WSTK_HTTP_HDR_ACCEPT_ENCODING,
+    WSTK_HTTP_HDR_COMMON_MAX
+} wstk_http_hdr_e;
+
 typedef struct {
-    wstk_hash_t     *headers;           // headers
+    wstk_pl_t       name;
+    wstk_pl_t       value;
+} wstk_http_hdr_t;
+
+typedef struct {
+    wstk_hash_t     *headers;           // name => value view, built on the first header_get/add/del (use header_get_pl to avoid it)
     wstk_pl_t       scheme;             // http / https
     wstk_pl_t       version;            // http version
     wstk_pl_t       method;             // regusest method
@@ -22,17 +52,30 @@ typedef struct {
     wstk_pl_t       ctype;              // content type
     wstk_pl_t       charset;            // content charset
     uint32_t        clen;               // content lenght
+    size_t          hdr_scan;           // decoder: bytes already scanned for the end of headers (a partial request resumes from there)
+    wstk_arena_t    *arena;             // NULL or refs to the per-request arena (the view values are kept there)
+    uint32_t        hdrs_count;
+    wstk_http_hdr_t hdrs[WSTK_HTTP_MSG_HEADERS_MAX];        // decoded headers, point to the request buffer
+    wstk_pl_t       hdr_common[WSTK_HTTP_HDR_COMMON_MAX];   // the common headers (wstk_http_hdr_e)
+    uint32_t        path_params_count;
+    wstk_http_hdr_t path_params[WSTK_HTTP_MSG_PATH_PARAMS_MAX]; // the ':name' segments of the servlet path (set by the router)
 } wstk_http_msg_t;
 
 wstk_status_t wstk_http_msg_alloc(wstk_http_msg_t **msg);
 wstk_status_t wstk_http_msg_decode(wstk_http_msg_t *msg, wstk_mbuf_t *buf);
 wstk_status_t wstk_http_msg_dump(wstk_http_msg_t *msg);
+wstk_status_t wstk_http_msg_chunked_decode(wstk_mbuf_t *mbuf, size_t *body_len, size_t *enc_len);
 
 wstk_status_t wstk_http_msg_header_add(wstk_http_msg_t *msg, const char *name, const char *value);
 wstk_status_t wstk_http_msg_header_get(wstk_http_msg_t *msg, const char *name, const char **value);
 wstk_status_t wstk_http_msg_header_del(wstk_http_msg_t *msg, const char *name);
+wstk_status_t wstk_http_msg_header_get_pl(wstk_http_msg_t *msg, const char *name, wstk_pl_t *value);
+wstk_status_t wstk_http_msg_header_common(wstk_http_msg_t *msg, wstk_http_hdr_e id, wstk_pl_t *value);
 
 bool wstk_http_msg_header_exists(wstk_http_msg_t *msg, const char *name);
+bool wstk_http_msg_header_has_token(wstk_http_msg_t *msg, wstk_http_hdr_e id, const char *token);
+
+wstk_status_t wstk_http_msg_path_param(wstk_http_msg_t *msg, const char *name, wstk_pl_t *value);
 
 
 
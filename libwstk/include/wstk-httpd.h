@@ -10,6 +10,7 @@
 #include <wstk-hashtable.h>
 #include <wstk-pl.h>
 #include <wstk-mbuf.h>
+#include <wstk-arena.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,13 +18,27 @@ extern "C" {
 
 typedef struct wstk_httpd_s wstk_httpd_t;
 
+/* content codings (Accept-Encoding) */
+#define WSTK_HTTPD_CODING_GZIP          0x01
+#define WSTK_HTTPD_CODING_DEFLATE       0x02
+#define WSTK_HTTPD_CODING_BR            0x04
+
 typedef struct {
     wstk_httpd_t            *server;            // refs to httpd instance
     wstk_tcp_srv_conn_t     *tcp_conn;          // refs to the tcp connection
     wstk_mbuf_t             *buffer;            // refs to the tcp connection internal buffer
+    wstk_arena_t            *arena;             // per-request arena, reset when the request is done (don't keep pointers to it)
+    wstk_mbuf_t             *obuf;              // output buffer, the replies are collected there (see wstk_httpd_flush)
+    size_t                  hdr_scan;           // decoder state of a partial request (see wstk_http_msg_t)
+    size_t                  chunk_start;        // offset of the open chunk in obuf (streaming)
     uint32_t                conn_id;            // connection id (the same as tcp_conn_id)
+    uint32_t                codings;            // content codings accepted by the request (WSTK_HTTPD_CODING_*)
     bool                    websock;            // true if a websocket connection
     bool                    tls;                // true if a secure connection
+    bool                    fl_wrhold;          // the worker is performing requests, the replies are flushed when it's done
+    bool                    fl_stream;          // a streaming reply is in progress (see wstk_httpd_stream_begin)
+    bool                    fl_chunk_open;      // obuf ends with the open chunk
+    bool                    fl_http10;          // the request is HTTP/1.0, no chunked replies
 } wstk_http_conn_t;
 
 typedef struct {
@@ -56,6 +71,7 @@ typedef struct {
 } wstk_httpd_auth_response_t;
 
 typedef wstk_status_t (*wstk_httpd_blob_reader_callback_t)(void *udata, wstk_mbuf_t *buf);
+typedef wstk_status_t (*wstk_httpd_blob_seek_callback_t)(void *udata, size_t offset);
 typedef void (*wstk_httpd_servlet_handler_t)(wstk_http_conn_t *conn, wstk_http_msg_t *msg, void *udata);
 typedef void (*wstk_httpd_authentication_handler_t)(wstk_httpd_auth_request_t *req, wstk_httpd_auth_response_t *rsp);
 
@@ -72,6 +88,12 @@ wstk_status_t wstk_httpd_unregister_servlet(wstk_httpd_t *srv, const char *path)
 wstk_status_t wstk_httpd_charset(wstk_httpd_t *srv, const char **charset);
 wstk_status_t wstk_httpd_listen_address(wstk_httpd_t *srv, wstk_sockaddr_t **laddr);
 wstk_status_t wstk_httpd_set_ident(wstk_httpd_t *srv, const char *server_name);
+wstk_status_t wstk_httpd_set_reactors(wstk_httpd_t *srv, uint32_t n);
+wstk_status_t wstk_httpd_set_edge_triggered(wstk_httpd_t *srv, bool enable);
+wstk_status_t wstk_httpd_set_affinity(wstk_httpd_t *srv, uint32_t threads, bool cpu_pin);
+wstk_status_t wstk_httpd_set_outq(wstk_httpd_t *srv, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy, uint32_t timeout);
+wstk_status_t wstk_httpd_set_cache(wstk_httpd_t *srv, size_t max_size, size_t max_file_size, uint32_t ttl);
+wstk_status_t wstk_httpd_set_compression(wstk_httpd_t *srv, size_t min_size, int level, bool precompressed);
 wstk_status_t wstk_httpd_set_authenticator(wstk_httpd_t *srv, wstk_httpd_authentication_handler_t handler, bool replace);
 wstk_status_t wstk_httpd_autheticate(wstk_http_conn_t *conn, wstk_http_msg_t *msg, wstk_httpd_sec_ctx_t *ctx);
 
@@ -79,6 +101,13 @@ wstk_status_t wstk_httpd_reply(wstk_http_conn_t *conn, uint32_t scode, const cha
 wstk_status_t wstk_httpd_creply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype, const char *fmt, ...);
 wstk_status_t wstk_httpd_ereply(wstk_http_conn_t *conn, uint32_t scode, const char *reason);
 wstk_status_t wstk_httpd_breply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, void *udata);
+wstk_status_t wstk_httpd_breply2(wstk_http_conn_t *conn, wstk_http_msg_t *msg, uint32_t scode, const char *reason, const char *ctype, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, wstk_httpd_blob_seek_callback_t scallback, void *udata);
+wstk_status_t wstk_httpd_printf(wstk_http_conn_t *conn, const char *fmt, ...);
+wstk_status_t wstk_httpd_flush(wstk_http_conn_t *conn);
+
+wstk_status_t wstk_httpd_stream_begin(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype);
+wstk_status_t wstk_httpd_stream_write(wstk_http_conn_t *conn, const void *data, size_t len);
+wstk_status_t wstk_httpd_stream_end(wstk_http_conn_t *conn);
 
 wstk_http_conn_t *wstk_httpd_conn_lookup(wstk_httpd_t *srv, uint32_t id);
 wstk_status_t wstk_httpd_conn_take(wstk_http_conn_t *conn);
@@ -95,6 +124,9 @@ typedef struct {
 
 wstk_status_t wstk_httpd_content_type_by_file_ext(wstk_httpd_ctype_info_t *ctype, char *filename);
 const char *wstk_httpd_reason_by_code(uint32_t scode);
+wstk_status_t wstk_httpd_etag(char *buf, size_t buf_len, size_t size, time_t mtime);
+uint32_t wstk_httpd_accepted_codings(wstk_http_msg_t *msg);
+bool wstk_httpd_ctype_is_compressible(const char *ctype);
 
 bool wstk_httpd_is_valid_path(char *path, size_t len);
 bool wstk_httpd_is_valid_filename(char *filename, size_t len);
@@ -103,6 +135,45 @@ wstk_status_t wstk_httpd_browse_dir(wstk_http_conn_t *conn, char *dir, char *tit
 wstk_status_t wstk_httpd_sec_ctx_clean(wstk_httpd_sec_ctx_t *sec_ctx);
 wstk_status_t wstk_httpd_sec_ctx_clone(wstk_httpd_sec_ctx_t **new_ctx, wstk_httpd_sec_ctx_t *sec_ctx);
 
+/* wstk-httpd-cache.c */
+typedef struct wstk_httpd_cache_s wstk_httpd_cache_t;
+
+#define WSTK_HTTPD_CACHE_VARY           0x01    // the content depends on Accept-Encoding
+#define WSTK_HTTPD_CACHE_GZIP           0x02    // the file is compressed when it's loaded
+
+typedef struct {
+    char                    *key;               // request path
+    char                    *file;              // file name
+    char                    *headers;           // pre-rendered headers (Last-Modified, ETag, Content-Type, Content-Length and the empty line)
+    wstk_mbuf_t             *body;              // content (as it's sent, see flags)
+    size_t                  size;               // file size
+    time_t                  mtime;              // file modification time
+    time_t                  checked;            // the last validation
+    char                    etag[48];           // quoted entity tag
+    void                    *lru_prev;          // cache links
+    void                    *lru_next;          //
+    bool                    fl_linked;          //
+} wstk_httpd_cache_entry_t;
+
+wstk_status_t wstk_httpd_cache_create(wstk_httpd_cache_t **cache, size_t max_size, size_t max_file_size, uint32_t ttl);
+wstk_status_t wstk_httpd_cache_lookup(wstk_httpd_cache_t *cache, const char *key, wstk_httpd_cache_entry_t **entry);
+wstk_status_t wstk_httpd_cache_add(wstk_httpd_cache_t *cache, const char *key, const char *file, const char *ctype, size_t size, time_t mtime, wstk_httpd_cache_entry_t **entry);
+wstk_status_t wstk_httpd_cache_add2(wstk_httpd_cache_t *cache, const char *key, const char *file, const char *ctype, const char *cenc, uint32_t flags, size_t size, time_t mtime, wstk_httpd_cache_entry_t **entry);
+wstk_status_t wstk_httpd_cache_del(wstk_httpd_cache_t *cache, const char *key);
+wstk_status_t wstk_httpd_cache_clear(wstk_httpd_cache_t *cache);
+wstk_status_t wstk_httpd_cache_usage(wstk_httpd_cache_t *cache, size_t *size, uint32_t *count);
+
+/* wstk-httpd-router.c */
+typedef struct wstk_httpd_router_s wstk_httpd_router_t;
+
+#define WSTK_HTTPD_ROUTER_PARAMS_MAX    WSTK_HTTP_MSG_PATH_PARAMS_MAX
+
+wstk_status_t wstk_httpd_router_create(wstk_httpd_router_t **router);
+wstk_status_t wstk_httpd_router_add(wstk_httpd_router_t *router, const char *path, void *value);
+wstk_status_t wstk_httpd_router_del(wstk_httpd_router_t *router, const char *path, void **value);
+wstk_status_t wstk_httpd_router_lookup(wstk_httpd_router_t *router, const char *path, wstk_arena_t *arena, wstk_http_hdr_t *params, uint32_t *params_count, void **value);
+bool wstk_httpd_router_is_empty(wstk_httpd_router_t *router);
+
 
 
 #ifdef __cplusplus
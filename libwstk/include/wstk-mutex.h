@@ -17,6 +17,17 @@ wstk_status_t wstk_mutex_lock(wstk_mutex_t *mtx);
 wstk_status_t wstk_mutex_trylock(wstk_mutex_t *mtx);
 wstk_status_t wstk_mutex_unlock(wstk_mutex_t *mtx);
 
+/**
+ ** condition variable
+ ** wait should be called with the mutex locked once, spurious wakeups are possible
+ **/
+typedef struct wstk_cond_s wstk_cond_t;
+
+wstk_status_t wstk_cond_create(wstk_cond_t **cond);
+wstk_status_t wstk_cond_wait(wstk_cond_t *cond, wstk_mutex_t *mtx, uint32_t timeout);
+wstk_status_t wstk_cond_signal(wstk_cond_t *cond);
+wstk_status_t wstk_cond_broadcast(wstk_cond_t *cond);
+
 
 
 #ifdef __cplusplus
@@ -84,6 +84,13 @@ typedef struct {
     uint32_t        pmask;              // poll mask (wstk_poll_mask_e)
     uint32_t        rderr;              // helper to detect tcp eof without poll
     time_t          expiry;             // idle timeout
+    void            *twheel;            // expiry wheel of the poll (wstk_poll_twheel_t)
+    void            *tw_prev;           // wheel slot links
+    void            *tw_next;           //
+    void            *tw_fnext;          // expired chain (wheel perform), apart from the slot links
+    uint32_t        tw_slot;            //
+    bool            fl_twlinked;        //
+    bool            fl_twfiring;        // on the expired chain
     bool            fl_connected;       // uses by client
     bool            fl_destroyed;       // destroyed but has refs
     bool            fl_adestroy_udata;  // destroy udata when socket closing
@@ -102,6 +109,7 @@ wstk_status_t wstk_sock_set_expiry(wstk_socket_t *sock, uint32_t timeout);
 wstk_status_t wstk_sock_set_blocking(wstk_socket_t *sock, bool blocking);
 wstk_status_t wstk_sock_set_reuse(wstk_socket_t *sock, bool reuse);
 wstk_status_t wstk_sock_set_nodelay(wstk_socket_t *sock, bool val);
+wstk_status_t wstk_sock_set_cork(wstk_socket_t *sock, bool val);
 
 /* UDP */
 wstk_status_t wstk_udp_connect(wstk_socket_t **sock, const wstk_sockaddr_t *peer);
@@ -121,6 +129,7 @@ wstk_status_t wstk_tcp_accept(wstk_socket_t *sock, wstk_socket_t **soc_new, uint
 
 wstk_status_t wstk_tcp_write(wstk_socket_t *sock, wstk_mbuf_t *mbuf, uint32_t timeout);
 wstk_status_t wstk_tcp_read(wstk_socket_t *sock, wstk_mbuf_t *mbuf, uint32_t timeout);
+wstk_status_t wstk_tcp_sendfile(wstk_socket_t *sock, int fd, size_t *offset, size_t len, uint32_t timeout);
 
 wstk_status_t wstk_tcp_printf(wstk_socket_t *sock, const char *fmt, ...);
 wstk_status_t wstk_tcp_vprintf(wstk_socket_t *sock, const char *fmt, va_list ap);
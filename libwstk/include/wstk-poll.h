@@ -36,7 +36,8 @@ typedef enum {
 } wstk_poll_socket_event_e;
 
 typedef enum {
-    WSTK_POLL_FYIELD_ON_EMPTY   = (1<<0) // yield or 1s pause
+    WSTK_POLL_FYIELD_ON_EMPTY   = (1<<0), // yield or 1s pause
+    WSTK_POLL_FEDGE_TRIGGERED   = (1<<1)  // edge-triggered mode (epoll), the handler has to drain the socket
 } wstk_poll_flags_e;
 
 typedef void (*wstk_poll_handler_t)(wstk_socket_t *socket, int event, void *udata);
@@ -50,6 +51,7 @@ wstk_status_t wstk_poll_space(wstk_poll_t *poll, uint32_t *space);
 wstk_status_t wstk_poll_create(wstk_poll_t **poll, wstk_polling_method_e method, uint32_t size, uint32_t timeout, uint32_t flags, wstk_poll_handler_t handler, void *udata);
 wstk_status_t wstk_poll_add(wstk_poll_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_del(wstk_poll_t *poll, wstk_socket_t *socket);
+wstk_status_t wstk_poll_update(wstk_poll_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_polling(wstk_poll_t *poll);
 
 typedef struct {
@@ -58,10 +60,20 @@ typedef struct {
 } wstk_poll_auto_conf_t;
 wstk_poll_auto_conf_t wstk_poll_auto_conf(wstk_polling_method_e method, uint32_t size);
 
+/* expiry wheel (shared by the backends) */
+typedef struct wstk_poll_twheel_s wstk_poll_twheel_t;
+wstk_status_t wstk_poll_twheel_create(wstk_poll_twheel_t **twheel);
+wstk_status_t wstk_poll_twheel_add(wstk_poll_twheel_t *twheel, wstk_socket_t *socket);
+wstk_status_t wstk_poll_twheel_del(wstk_poll_twheel_t *twheel, wstk_socket_t *socket);
+wstk_status_t wstk_poll_twheel_reschedule(wstk_poll_twheel_t *twheel, wstk_socket_t *socket, time_t expiry);
+wstk_status_t wstk_poll_twheel_perform(wstk_poll_twheel_t *twheel, wstk_poll_handler_t handler, void *udata);
+
+
 /* select */
 typedef struct wstk_poll_select_s wstk_poll_select_t;
 bool wstk_poll_select_is_supported();
 bool wstk_poll_select_is_empty(wstk_poll_select_t *poll);
+wstk_status_t wstk_poll_select_interrupt(wstk_poll_select_t *poll);
 uint32_t wstk_poll_select_max_size();
 wstk_status_t wstk_poll_select_size(wstk_poll_select_t *poll, uint32_t *size);
 wstk_status_t wstk_poll_select_space(wstk_poll_select_t *poll, uint32_t *space);
@@ -81,6 +93,7 @@ wstk_status_t wstk_poll_kqueue_space(wstk_poll_kqueue_t *poll, uint32_t *space);
 wstk_status_t wstk_poll_kqueue_create(wstk_poll_kqueue_t **poll, uint32_t size, uint32_t timeout, uint32_t flags, wstk_poll_handler_t handler, void *udata);
 wstk_status_t wstk_poll_kqueue_add(wstk_poll_kqueue_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_kqueue_del(wstk_poll_kqueue_t *poll, wstk_socket_t *socket);
+wstk_status_t wstk_poll_kqueue_update(wstk_poll_kqueue_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_kqueue_polling(wstk_poll_kqueue_t *poll);
 
 
@@ -94,6 +107,7 @@ wstk_status_t wstk_poll_epoll_space(wstk_poll_epoll_t *poll, uint32_t *space);
 wstk_status_t wstk_poll_epoll_create(wstk_poll_epoll_t **poll, uint32_t size, uint32_t timeout, uint32_t flags, wstk_poll_handler_t handler, void *udata);
 wstk_status_t wstk_poll_epoll_add(wstk_poll_epoll_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_epoll_del(wstk_poll_epoll_t *poll, wstk_socket_t *socket);
+wstk_status_t wstk_poll_epoll_update(wstk_poll_epoll_t *poll, wstk_socket_t *socket);
 wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll);
 
 
@@ -13,7 +13,12 @@ extern "C" {
 
 typedef struct wstk_queue_s  wstk_queue_t;
 
+typedef enum {
+    WSTK_QUEUE_LOCKFREE = (1<<0)    // bounded lock-free mpmc ring (size rounds up to a power of 2)
+} wstk_queue_flags_e;
+
 wstk_status_t wstk_queue_create(wstk_queue_t **queue, uint32_t size);
+wstk_status_t wstk_queue_create_ex(wstk_queue_t **queue, uint32_t size, uint32_t flags);
 
 bool wstk_queue_is_empty(wstk_queue_t *queue);
 bool wstk_queue_is_full(wstk_queue_t *queue);
@@ -22,6 +27,9 @@ wstk_status_t wstk_queue_push(wstk_queue_t *queue, void *data);
 wstk_status_t wstk_queue_pop(wstk_queue_t *queue, void **data);
 wstk_status_t wstk_queue_len(wstk_queue_t *queue, uint32_t *len);
 
+wstk_status_t wstk_queue_push_n(wstk_queue_t *queue, void **items, uint32_t count, uint32_t *pushed);
+wstk_status_t wstk_queue_pop_n(wstk_queue_t *queue, void **items, uint32_t count, uint32_t *popped);
+
 
 
 #ifdef __cplusplus
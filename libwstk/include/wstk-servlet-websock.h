@@ -22,15 +22,18 @@ typedef struct {
 typedef void (*wstk_servlet_websock_on_close_t)(wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *ctx);
 typedef bool (*wstk_servlet_websock_on_accept_t)(wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *ctx);
 typedef void (*wstk_servlet_websock_on_message_t)(wstk_servlet_websock_conn_t *conn, wstk_mbuf_t *mbuf);
+typedef bool (*wstk_servlet_websock_filter_t)(wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *ctx, void *udata);
 
 wstk_status_t wstk_httpd_register_servlet_websock(wstk_httpd_t *srv, char *path, wstk_servlet_websock_t **servlet);
 
 wstk_status_t wstk_servlet_websock_set_on_close(wstk_servlet_websock_t *servlet, wstk_servlet_websock_on_close_t handler);
 wstk_status_t wstk_servlet_websock_set_on_accept(wstk_servlet_websock_t *servlet, wstk_servlet_websock_on_accept_t handler);
 wstk_status_t wstk_servlet_websock_set_on_message(wstk_servlet_websock_t *servlet, wstk_servlet_websock_on_message_t handler);
+wstk_status_t wstk_servlet_websock_set_deflate(wstk_servlet_websock_t *servlet, bool enable, int level, size_t min_size, size_t mem_max, bool no_context);
 
 wstk_status_t wstk_servlet_websock_send(wstk_http_conn_t *conn, websock_opcode_e opcode, const char *fmt, ...);
 wstk_status_t wstk_servlet_websock_send2(wstk_servlet_websock_t *servlet, uint32_t conn_id, websock_opcode_e opcode, const char *fmt, ...);
+wstk_status_t wstk_servlet_websock_broadcast(wstk_servlet_websock_t *servlet, wstk_servlet_websock_filter_t filter, void *udata, websock_opcode_e opcode, wstk_mbuf_t *mbuf, uint32_t *delivered, uint32_t *dropped);
 
 
 
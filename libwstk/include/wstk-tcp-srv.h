@@ -19,9 +19,21 @@ typedef struct wstk_tcp_srv_s wstk_tcp_srv_t;
 typedef struct wstk_tcp_srv_conn_s wstk_tcp_srv_conn_t;
 
 typedef void (*wstk_tcp_srv_handler_t)(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf);
+typedef void (*wstk_tcp_srv_on_drain_t)(wstk_tcp_srv_conn_t *conn, void *udata);
+
+/* what the output queue does with the data above the high watermark */
+typedef enum {
+    WSTK_TCP_SRV_OUTQ_BLOCK = 0,    // the sender waits till the queue goes below the low watermark (or the timeout)
+    WSTK_TCP_SRV_OUTQ_DROP,         // the data is refused (WSTK_STATUS_NOSPACE)
+    WSTK_TCP_SRV_OUTQ_CLOSE         // the connection is closed (WSTK_STATUS_CONN_DISCON)
+} wstk_tcp_srv_outq_policy_e;
 
 wstk_status_t wstk_tcp_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address, uint32_t max_conns, uint32_t max_idle, uint32_t buffer_size, wstk_tcp_srv_handler_t handler);
 wstk_status_t wstk_tcp_ssl_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address, char *cert, uint32_t max_conns, uint32_t max_idle, uint32_t buffer_size, wstk_tcp_srv_handler_t handler);
+wstk_status_t wstk_tcp_srv_set_reactors(wstk_tcp_srv_t *srv, uint32_t n);
+wstk_status_t wstk_tcp_srv_set_edge_triggered(wstk_tcp_srv_t *srv, bool enable);
+wstk_status_t wstk_tcp_srv_set_affinity(wstk_tcp_srv_t *srv, uint32_t threads, bool cpu_pin);
+wstk_status_t wstk_tcp_srv_set_outq(wstk_tcp_srv_t *srv, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy, uint32_t timeout);
 wstk_status_t wstk_tcp_srv_start(wstk_tcp_srv_t *srv);
 
 wstk_status_t wstk_tcp_srv_id(wstk_tcp_srv_t *srv, uint32_t *id);
@@ -47,7 +59,13 @@ wstk_status_t wstk_tcp_srv_conn_server(wstk_tcp_srv_conn_t *conn, wstk_tcp_srv_t
 wstk_status_t wstk_tcp_srv_conn_write(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf, uint32_t timeout);
 wstk_status_t wstk_tcp_srv_conn_read(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf, uint32_t timeout);
 
+wstk_status_t wstk_tcp_srv_conn_send(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf, bool copy);
+wstk_status_t wstk_tcp_srv_conn_set_outq(wstk_tcp_srv_conn_t *conn, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy);
+wstk_status_t wstk_tcp_srv_conn_set_on_drain(wstk_tcp_srv_conn_t *conn, wstk_tcp_srv_on_drain_t handler, void *udata);
+wstk_status_t wstk_tcp_srv_conn_outq_size(wstk_tcp_srv_conn_t *conn, size_t *size);
+
 wstk_status_t wstk_tcp_srv_conn_rdlock(wstk_tcp_srv_conn_t *conn, bool flag);
+wstk_status_t wstk_tcp_srv_conn_keep_unread(wstk_tcp_srv_conn_t *conn, bool flag);
 
 wstk_status_t wstk_tcp_srv_attr_add(wstk_tcp_srv_t *srv, const char *name, void *value, bool auto_destroy);
 wstk_status_t wstk_tcp_srv_attr_get(wstk_tcp_srv_t *srv, const char *name, void **value);
@@ -12,6 +12,8 @@ extern "C" {
 #endif
 
 #define WSTK_SCHED_YIELD(t) { wstk_thread_yield(); wstk_msleep(t > 0 ? t : 250); }
+/* for the short waits (refs to be released and so on): a few yields, then 1ms naps */
+#define WSTK_SCHED_BACKOFF(n) { if((n) < 64) { (n)++; wstk_thread_yield(); } else { wstk_msleep(1); } }
 
 typedef struct wstk_thread_s wstk_thread_t;
 /**
@@ -104,6 +106,24 @@ wstk_status_t wstk_thread_set_uflags(wstk_thread_t *th, uint32_t flags);
  **/
 bool wstk_thread_is_canceled(wstk_thread_t *th);
 
+/**
+ * Number of online processors
+ *
+ * @param cpus      - the amount
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_thread_cpus(uint32_t *cpus);
+
+/**
+ * Bind the calling thread to the processor
+ *
+ * @param cpu       - processor number (0..cpus-1)
+ *
+ * @return sucesss or WSTK_STATUS_UNSUPPORTED
+ **/
+wstk_status_t wstk_thread_bind_cpu(uint32_t cpu);
+
 /**
  * When the user function finished
  *
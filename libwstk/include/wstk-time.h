@@ -25,6 +25,7 @@ wstk_status_t wstk_gmtime(time_t time, struct tm *tm);
 
 /* Wed, 21 Oct 2015 07:28:00 GMT */
 wstk_status_t wstk_time_to_str_rfc822(time_t time, char *buf, size_t buf_len);
+wstk_status_t wstk_time_from_str_rfc822(time_t *time, const char *str, size_t str_len);
 
 /* DD-MM-YYYY HH:MM:SS */
 wstk_status_t wstk_time_to_str(time_t time, char *buf, size_t buf_len);
@@ -47,8 +47,13 @@ typedef struct {
 } wstk_websock_hdr_t;
 
 wstk_status_t wstk_websock_decode(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb);
+wstk_status_t wstk_websock_decode_hdr(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb);
 wstk_status_t wstk_websock_encode(wstk_mbuf_t *mb, bool fin, websock_opcode_e opcode, bool mask, size_t len);
 
+void wstk_websock_mask(uint8_t *data, size_t len, const uint8_t *mkey, size_t offset);
+const char *wstk_websock_mask_kernel();
+
+wstk_status_t wstk_websock_vencode(wstk_mbuf_t **frame, websock_opcode_e opcode, websock_scode_e scode, bool server, const char *fmt, va_list ap);
 wstk_status_t wstk_websock_vsend(wstk_socket_t *sock, websock_opcode_e opcode, websock_scode_e scode, bool server, const char *fmt, va_list ap);
 
 wstk_status_t wstk_websock_s2c_send(wstk_socket_t *sock, websock_opcode_e opcode, const char *fmt, ...);
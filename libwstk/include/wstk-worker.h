@@ -14,8 +14,16 @@ extern "C" {
 typedef struct wstk_worker_s  wstk_worker_t;
 typedef void (*wstk_worker_handler_t)(wstk_worker_t *worker, void *qdata);
 
+typedef enum {
+    WSTK_WORKER_STEALING = (1<<0),  // per-thread deques + work stealing
+    WSTK_WORKER_AFFINITY = (1<<1),  // per-thread queues, the jobs are distributed by a key (wstk_worker_perform_key)
+    WSTK_WORKER_CPU_PIN  = (1<<2)   // bind the sub-threads to the processors (with STEALING or AFFINITY)
+} wstk_worker_flags_e;
+
 wstk_status_t wstk_worker_create(wstk_worker_t **worker, uint32_t min, uint32_t max, uint32_t qsize, uint32_t idle, wstk_worker_handler_t handler);
+wstk_status_t wstk_worker_create_ex(wstk_worker_t **worker, uint32_t min, uint32_t max, uint32_t qsize, uint32_t idle, uint32_t flags, wstk_worker_handler_t handler);
 wstk_status_t wstk_worker_perform(wstk_worker_t *worker, void *data);
+wstk_status_t wstk_worker_perform_key(wstk_worker_t *worker, uint32_t key, void *data);
 bool wstk_worker_is_ready(wstk_worker_t *worker);
 
 
@@ -25,6 +25,7 @@
 #include <wstk-list.h>
 #include <wstk-mbuf.h>
 #include <wstk-mem.h>
+#include <wstk-arena.h>
 #include <wstk-pid.h>
 #include <wstk-pl.h>
 #include <wstk-queue.h>
@@ -0,0 +1,268 @@
+/**
+ ** bump-pointer arena
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk-arena.h>
+#include <wstk-log.h>
+#include <wstk-mem.h>
+#include <wstk-fmt.h>
+
+#define ARENA_DEF_CHUNK_SIZE    4096
+#define ARENA_ALIGN             (sizeof(void *) * 2)
+#define ARENA_ALIGN_SIZE(s)     (((s) + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1))
+
+typedef struct arena_chunk_s {
+    struct arena_chunk_s    *next;
+    size_t                  size;
+    size_t                  pos;
+    size_t                  pad;            // keeps data aligned
+    uint8_t                 data[];
+} arena_chunk_t;
+
+struct wstk_arena_s {
+    arena_chunk_t           *head;          // current chunk
+    arena_chunk_t           *first;         // comes with the arena, survives reset
+    size_t                  chunk_size;
+    size_t                  used;
+};
+
+static void arena_free_chunks(wstk_arena_t *arena) {
+    arena_chunk_t *chunk = arena->head;
+
+    while(chunk && chunk != arena->first) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->head = arena->first;
+}
+
+static void destructor__wstk_arena_t(void *data) {
+    wstk_arena_t *arena = (wstk_arena_t *)data;
+
+    arena_free_chunks(arena);
+}
+
+static int print_handler_count(const char *p, size_t size, void *arg) {
+    size_t *len = (size_t *)arg;
+
+    (void)p;
+    (*len) += size;
+    return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// public
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/**
+ * Create a new arena
+ * the first chunk comes in the same allocation
+ *
+ * @param arena         - a new arena
+ * @param chunk_size    - chunk size (default: 4096)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_create(wstk_arena_t **arena, size_t chunk_size) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_arena_t *arena_local = NULL;
+
+    if(!arena) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    chunk_size = ARENA_ALIGN_SIZE(chunk_size ? chunk_size : ARENA_DEF_CHUNK_SIZE);
+
+    status = wstk_mem_alloc((void *)&arena_local, ARENA_ALIGN_SIZE(sizeof(wstk_arena_t)) + sizeof(arena_chunk_t) + chunk_size, destructor__wstk_arena_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    arena_local->first = (arena_chunk_t *)(void *)((uint8_t *)arena_local + ARENA_ALIGN_SIZE(sizeof(wstk_arena_t)));
+    arena_local->first->next = NULL;
+    arena_local->first->size = chunk_size;
+    arena_local->first->pos = 0;
+    arena_local->head = arena_local->first;
+    arena_local->chunk_size = chunk_size;
+    arena_local->used = 0;
+
+    *arena = arena_local;
+    return status;
+}
+
+/**
+ * Release everything allocated from the arena
+ * (the extra chunks go back to the system, the first one is reused)
+ *
+ * @param arena - the arena
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_reset(wstk_arena_t *arena) {
+    if(!arena) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    arena_free_chunks(arena);
+    arena->first->pos = 0;
+    arena->used = 0;
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Bytes allocated since the last reset
+ *
+ * @param arena - the arena
+ *
+ * @return the amount
+ **/
+size_t wstk_arena_used(wstk_arena_t *arena) {
+    return (arena ? arena->used : 0);
+}
+
+/**
+ * Allocate a block
+ * the block can't be passed to wstk_mem_ref/wstk_mem_deref
+ *
+ * @param arena - the arena
+ * @param mem   - the block
+ * @param size  - block size
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_alloc(wstk_arena_t *arena, void **mem, size_t size) {
+    arena_chunk_t *chunk = NULL;
+
+    if(!arena || !mem) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    size = ARENA_ALIGN_SIZE(size ? size : 1);
+    chunk = arena->head;
+
+    if(chunk->size - chunk->pos < size) {
+        size_t csize = (size > arena->chunk_size ? size : arena->chunk_size);
+
+        if(!(chunk = malloc(sizeof(arena_chunk_t) + csize))) {
+            return WSTK_STATUS_MEM_FAIL;
+        }
+        chunk->size = csize;
+        chunk->pos = 0;
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    *mem = (chunk->data + chunk->pos);
+    chunk->pos += size;
+    arena->used += size;
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Allocate a block filled with zeros
+ *
+ * @param arena - the arena
+ * @param mem   - the block
+ * @param size  - block size
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_zalloc(wstk_arena_t *arena, void **mem, size_t size) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if((status = wstk_arena_alloc(arena, mem, size)) == WSTK_STATUS_SUCCESS) {
+        memset(*mem, 0x0, size);
+    }
+
+    return status;
+}
+
+/**
+ * Duplicate a string
+ *
+ * @param arena - the arena
+ * @param str   - the copy
+ * @param src   - the string
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_strdup(wstk_arena_t *arena, char **str, const char *src) {
+    if(!src) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    return wstk_arena_strndup(arena, str, src, strlen(src));
+}
+
+/**
+ * Duplicate a part of string
+ *
+ * @param arena - the arena
+ * @param str   - the copy (zero terminated)
+ * @param src   - the string
+ * @param len   - length to copy
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_strndup(wstk_arena_t *arena, char **str, const char *src, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    char *str_local = NULL;
+
+    if(!str || (!src && len)) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if((status = wstk_arena_alloc(arena, (void *)&str_local, len + 1)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    if(len) {
+        memcpy(str_local, src, len);
+    }
+    str_local[len] = '\0';
+
+    *str = str_local;
+    return status;
+}
+
+/**
+ * Print a formatted string into the arena
+ *
+ * @param arena - the arena
+ * @param str   - the string
+ * @param fmt   - format (wstk_printf)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_arena_printf(wstk_arena_t *arena, char **str, const char *fmt, ...) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    char *str_local = NULL;
+    size_t len = 0;
+    va_list ap;
+
+    if(!arena || !str || !fmt) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    va_start(ap, fmt);
+    status = wstk_vhprintf(fmt, ap, print_handler_count, &len);
+    va_end(ap);
+    if(status != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    if((status = wstk_arena_alloc(arena, (void *)&str_local, len + 1)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    va_start(ap, fmt);
+    wstk_vsnprintf(str_local, len + 1, fmt, ap);
+    va_end(ap);
+
+    *str = str_local;
+    return status;
+}
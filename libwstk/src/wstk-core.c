@@ -15,6 +15,7 @@ extern wstk_status_t wstk_pvt_net_shutdown();
 extern wstk_status_t wstk_pvt_codepage_init();
 extern wstk_status_t wstk_pvt_ssl_init();
 extern wstk_status_t wstk_pvt_ssl_shutdown();
+extern wstk_status_t wstk_pvt_websock_init();
 
 static bool core_init;
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -51,6 +52,10 @@ wstk_status_t wstk_core_init() {
         goto out;
     }
 
+    if((status = wstk_pvt_websock_init()) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
     core_init = true;
 out:
     return status;
@@ -0,0 +1,369 @@
+/**
+ ** deflate/gzip by zlib (build with WSTK_USE_ZLIB)
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk-deflate.h>
+#include <wstk-log.h>
+#include <wstk-mbuf.h>
+#include <wstk-mem.h>
+
+#ifdef WSTK_USE_ZLIB
+#include <zlib.h>
+
+#define DEFLATE_STREAM_OUT_MIN  4096
+
+struct wstk_deflate_stream_s {
+    z_stream    zs;
+    bool        fl_inflate;
+    bool        fl_ready;
+};
+
+static int format_wbits(wstk_deflate_format_e format, int wbits) {
+    switch(format) {
+        case WSTK_DEFLATE_RAW:  return -wbits;
+        case WSTK_DEFLATE_ZLIB: return wbits;
+        case WSTK_DEFLATE_GZIP: return wbits + 16;
+    }
+    return wbits;
+}
+
+static void desctuctor__wstk_deflate_stream_t(void *ptr) {
+    wstk_deflate_stream_t *stream = (wstk_deflate_stream_t *)ptr;
+
+    if(!stream || !stream->fl_ready) {
+        return;
+    }
+    stream->fl_ready = false;
+
+    if(stream->fl_inflate) {
+        inflateEnd(&stream->zs);
+    } else {
+        deflateEnd(&stream->zs);
+    }
+}
+
+/* at least 'len' bytes of space after pos */
+static wstk_status_t out_reserve(wstk_mbuf_t *out, size_t len) {
+    if(wstk_mbuf_size(out) - wstk_mbuf_pos(out) >= len) {
+        return WSTK_STATUS_SUCCESS;
+    }
+    return wstk_mbuf_resize(out, wstk_mbuf_pos(out) + MAX(len, wstk_mbuf_size(out) / 2));
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// public
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool wstk_deflate_is_supported() {
+#ifdef WSTK_USE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Compress the data
+ * the result is written to out at its current position (the buffer grows if needed)
+ *
+ * @param out       - the buffer
+ * @param data      - the data
+ * @param len       - data length
+ * @param format    - output format
+ * @param level     - 1..9 or -1 (default)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_deflate_mbuf(wstk_mbuf_t *out, const void *data, size_t len, wstk_deflate_format_e format, int level) {
+#ifdef WSTK_USE_ZLIB
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    z_stream zs = { 0 };
+    size_t bound = 0;
+    int err = 0;
+
+    if(!out || (!data && len) || len > UINT32_MAX) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    err = deflateInit2(&zs, (level < 0 || level > 9 ? Z_DEFAULT_COMPRESSION : level), Z_DEFLATED, format_wbits(format, MAX_WBITS), 8, Z_DEFAULT_STRATEGY);
+    if(err != Z_OK) {
+        log_error("deflateInit2 failed (err=%d)", err);
+        return (err == Z_MEM_ERROR ? WSTK_STATUS_MEM_FAIL : WSTK_STATUS_FALSE);
+    }
+
+    /* one pass, the output is never bigger than the bound */
+    bound = deflateBound(&zs, (uLong)len);
+    if(wstk_mbuf_size(out) < wstk_mbuf_pos(out) + bound) {
+        if((status = wstk_mbuf_resize(out, wstk_mbuf_pos(out) + bound)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+    }
+
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)wstk_mbuf_buf(out);
+    zs.avail_out = (uInt)bound;
+
+    if((err = deflate(&zs, Z_FINISH)) != Z_STREAM_END) {
+        log_error("deflate failed (err=%d)", err);
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+
+    wstk_mbuf_advance(out, zs.total_out);
+    if(wstk_mbuf_pos(out) > wstk_mbuf_end(out)) {
+        wstk_mbuf_set_end(out, wstk_mbuf_pos(out));
+    }
+out:
+    deflateEnd(&zs);
+    return status;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
+/**
+ * Create the compression stream
+ * the data is compressed by parts sharing the same window (see wstk_deflate_stream_write)
+ *
+ * @param stream    - a new stream
+ * @param format    - output format
+ * @param level     - 1..9 or -1 (default)
+ * @param wbits     - window size (9..15), the memory is (1 << (wbits + 2)) + (1 << (mem_level + 9))
+ * @param mem_level - 1..9 or 0 (default)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_deflate_stream_create(wstk_deflate_stream_t **stream, wstk_deflate_format_e format, int level, int wbits, int mem_level) {
+#ifdef WSTK_USE_ZLIB
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_deflate_stream_t *stream_local = NULL;
+    int err = 0;
+
+    if(!stream || wbits < 9 || wbits > MAX_WBITS || mem_level < 0 || mem_level > MAX_MEM_LEVEL) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&stream_local, sizeof(wstk_deflate_stream_t), desctuctor__wstk_deflate_stream_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    err = deflateInit2(&stream_local->zs, (level < 0 || level > 9 ? Z_DEFAULT_COMPRESSION : level), Z_DEFLATED, format_wbits(format, wbits), (mem_level ? mem_level : 8), Z_DEFAULT_STRATEGY);
+    if(err != Z_OK) {
+        log_error("deflateInit2 failed (err=%d)", err);
+        wstk_goto_status((err == Z_MEM_ERROR ? WSTK_STATUS_MEM_FAIL : WSTK_STATUS_FALSE), out);
+    }
+    stream_local->fl_ready = true;
+
+    *stream = stream_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(stream_local);
+    }
+    return status;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
+/**
+ * Create the decompression stream
+ *
+ * @param stream    - a new stream
+ * @param format    - input format
+ * @param wbits     - window size (8..15), not less than the compressor used
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_inflate_stream_create(wstk_deflate_stream_t **stream, wstk_deflate_format_e format, int wbits) {
+#ifdef WSTK_USE_ZLIB
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_deflate_stream_t *stream_local = NULL;
+    int err = 0;
+
+    if(!stream || wbits < 8 || wbits > MAX_WBITS) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&stream_local, sizeof(wstk_deflate_stream_t), desctuctor__wstk_deflate_stream_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    stream_local->fl_inflate = true;
+    err = inflateInit2(&stream_local->zs, format_wbits(format, wbits));
+    if(err != Z_OK) {
+        log_error("inflateInit2 failed (err=%d)", err);
+        wstk_goto_status((err == Z_MEM_ERROR ? WSTK_STATUS_MEM_FAIL : WSTK_STATUS_FALSE), out);
+    }
+    stream_local->fl_ready = true;
+
+    *stream = stream_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(stream_local);
+    }
+    return status;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
+/**
+ * Compress the next part
+ * the result is written to out at its current position (the buffer grows if needed),
+ * with the flush the output ends on a byte boundary with an empty stored block (00 00 ff ff)
+ *
+ * @param stream    - the compression stream
+ * @param out       - the buffer
+ * @param data      - the data
+ * @param len       - data length
+ * @param flush     - flush the output (Z_SYNC_FLUSH)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_deflate_stream_write(wstk_deflate_stream_t *stream, wstk_mbuf_t *out, const void *data, size_t len, bool flush) {
+#ifdef WSTK_USE_ZLIB
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    z_stream *zs = NULL;
+    size_t n = 0;
+    int err = 0;
+
+    if(!stream || !out || stream->fl_inflate || (!data && len) || len > UINT32_MAX) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    zs = &stream->zs;
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+
+    /* usually it's one pass */
+    if((status = out_reserve(out, len + (len >> 10) + 64)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+    while(true) {
+        if((status = out_reserve(out, DEFLATE_STREAM_OUT_MIN)) != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+
+        n = MIN(wstk_mbuf_size(out) - wstk_mbuf_pos(out), UINT32_MAX);
+        zs->next_out = (Bytef *)wstk_mbuf_buf(out);
+        zs->avail_out = (uInt)n;
+
+        err = deflate(zs, (flush ? Z_SYNC_FLUSH : Z_NO_FLUSH));
+        wstk_mbuf_advance(out, n - zs->avail_out);
+
+        if(err != Z_OK && err != Z_BUF_ERROR) {
+            log_error("deflate failed (err=%d)", err);
+            status = WSTK_STATUS_FALSE;
+            break;
+        }
+        if(!zs->avail_in && zs->avail_out) {
+            break;
+        }
+    }
+
+    if(wstk_mbuf_pos(out) > wstk_mbuf_end(out)) {
+        wstk_mbuf_set_end(out, wstk_mbuf_pos(out));
+    }
+    return status;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
+/**
+ * Decompress the next part
+ * the result is written to out at its current position (the buffer grows if needed),
+ * the end of a (raw) stream starts the new one
+ *
+ * @param stream    - the decompression stream
+ * @param out       - the buffer
+ * @param data      - the data
+ * @param len       - data length
+ * @param max_len   - the output limit or 0 (no limit)
+ *
+ * @return sucesss, WSTK_STATUS_NOSPACE (over the limit), WSTK_STATUS_INVALID_VALUE (corrupted data) or some error
+ **/
+wstk_status_t wstk_inflate_stream_write(wstk_deflate_stream_t *stream, wstk_mbuf_t *out, const void *data, size_t len, size_t max_len) {
+#ifdef WSTK_USE_ZLIB
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    z_stream *zs = NULL;
+    size_t n = 0, total = 0;
+    int err = 0;
+
+    if(!stream || !out || !stream->fl_inflate || (!data && len) || len > UINT32_MAX) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    zs = &stream->zs;
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+
+    while(true) {
+        if((status = out_reserve(out, MAX(DEFLATE_STREAM_OUT_MIN, MIN(len * 4, max_len ? max_len - total + 1 : len * 4)))) != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+
+        n = MIN(wstk_mbuf_size(out) - wstk_mbuf_pos(out), UINT32_MAX);
+        zs->next_out = (Bytef *)wstk_mbuf_buf(out);
+        zs->avail_out = (uInt)n;
+
+        err = inflate(zs, Z_SYNC_FLUSH);
+        wstk_mbuf_advance(out, n - zs->avail_out);
+        total += (n - zs->avail_out);
+
+        if(max_len && total > max_len) {
+            status = WSTK_STATUS_NOSPACE;
+            break;
+        }
+        if(err == Z_STREAM_END) {
+            if(!zs->avail_in) {
+                break;
+            }
+            inflateReset(zs);
+            continue;
+        }
+        if(err != Z_OK && err != Z_BUF_ERROR) {
+#ifdef WSTK_DEFLATE_DEBUG
+            WSTK_DBG_PRINT("inflate failed (err=%d)", err);
+#endif
+            status = (err == Z_MEM_ERROR ? WSTK_STATUS_MEM_FAIL : WSTK_STATUS_INVALID_VALUE);
+            break;
+        }
+        if(!zs->avail_in && zs->avail_out) {
+            break;
+        }
+    }
+
+    if(wstk_mbuf_pos(out) > wstk_mbuf_end(out)) {
+        wstk_mbuf_set_end(out, wstk_mbuf_pos(out));
+    }
+    return status;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
+/**
+ * Reset the stream (drops the window)
+ *
+ * @param stream    - the stream
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_deflate_stream_reset(wstk_deflate_stream_t *stream) {
+#ifdef WSTK_USE_ZLIB
+    int err = 0;
+
+    if(!stream || !stream->fl_ready) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    err = (stream->fl_inflate ? inflateReset(&stream->zs) : deflateReset(&stream->zs));
+    return (err == Z_OK ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
@@ -122,3 +122,43 @@ wstk_status_t wstk_unescape(char **out, const char *str, size_t str_len) {
 
     return st;
 }
+
+/**
+ * Unescape string into the buffer
+ * (the result is never longer than the source, so str_len + 1 is always enough)
+ *
+ * @param buf       - the buffer
+ * @param buf_size  - buffer size
+ * @param str       - the string
+ * @param str_len   - str len
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_unescape2(char *buf, size_t buf_size, const char *str, size_t str_len) {
+    uint32_t  i = 0, j = 0;
+
+    if(!buf || !str || !str_len) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    for(i=0; i < str_len; i++) {
+        if(j + 1 >= buf_size) {
+            return WSTK_STATUS_OUTOFRANGE;
+        }
+        if(str[i] == '%') {
+            if(i + 2 < str_len) {
+                const uint8_t hi = wstk_ch_hex(str[++i]);
+                const uint8_t lo = wstk_ch_hex(str[++i]);
+                buf[j++] = (char)(hi<<4 | lo);
+            } else {
+                log_error("malformed escape sequence");
+                return WSTK_STATUS_FALSE;
+            }
+        } else {
+            buf[j++] = str[i];
+        }
+    }
+    buf[j] = '\0';
+
+    return WSTK_STATUS_SUCCESS;
+}
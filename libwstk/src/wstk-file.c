@@ -328,6 +328,24 @@ wstk_status_t wstk_file_tell(wstk_file_t *file, size_t *pos) {
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Get the os descriptor of the file
+ * (for the calls that bypass stdio, the position is not changed by them)
+ *
+ * @param file      - the descriptor
+ * @param fd        - the result
+ *
+ * @return success or some error
+ **/
+wstk_status_t wstk_file_fd(wstk_file_t *file, int *fd) {
+    if(!file || !file->fh || !fd) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    *fd = fileno(file->fh);
+    return (*fd >= 0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
+
 /**
  * Read block from file
  *
@@ -10,9 +10,25 @@
 #include <wstk-str.h>
 #include <wstk-fmt.h>
 #include <wstk-pl.h>
-#include <wstk-regex.h>
 #include <wstk-hashtable.h>
 
+#define HTTP_MSG_HEADERS_MAX_SIZE   65536
+#define HTTP_MSG_CHUNK_LINE_MAX     4096    // chunk size line with extensions or a trailer line
+#define HTTP_MSG_HDR_VALUE_MAX      4096
+#define IS_CTL(c)                   ((uint8_t)(c) <= 0x20 || (uint8_t)(c) == 0x7f)
+
+typedef enum {
+    PS_METHOD = 0,
+    PS_PATH,
+    PS_PARAMS,
+    PS_PROTO,
+    PS_VERSION,
+    PS_EOL,
+    PS_LINE,
+    PS_NAME,
+    PS_VALUE
+} parser_state_e;
+
 static void desctuctor__wstk_http_msg_t(void *ptr) {
     wstk_http_msg_t *msg = (wstk_http_msg_t *)ptr;
 
@@ -31,64 +47,212 @@ static void desctuctor__wstk_http_msg_t(void *ptr) {
 #endif
 }
 
+static void hdr_content_type(wstk_http_msg_t *msg, wstk_pl_t *value) {
+    const char *cend = (value->p + value->l);
+    const char *cptr = wstk_strnstr(value->p, value->l, "charset=");
+    uint32_t sep_ofs = 0;
+
+    if(cptr) {
+        for(sep_ofs=0; sep_ofs < value->l; sep_ofs++) {
+            if(value->p[sep_ofs] == ';') { break;}
+        }
+        if(sep_ofs < value->l) {
+            msg->charset.l = (cend - (cptr + 8));
+            msg->charset.p = (msg->charset.l ? (void *)(cptr + 8) : NULL);
+            msg->ctype.l = sep_ofs;
+            msg->ctype.p = value->p;
+            return;
+        }
+    }
+
+    msg->ctype.l = value->l;
+    msg->ctype.p = value->p;
+}
+
+/*
+ * the common headers have different lengths,
+ * so the length picks the only candidate and one compare confirms it
+ */
+static int hdr_common_id(const wstk_pl_t *name) {
+    switch(name->l) {
+        case 4:  return (wstk_pl_strcasecmp(name, "Host") == 0 ? WSTK_HTTP_HDR_HOST : -1);
+        case 5:  return (wstk_pl_strcasecmp(name, "Range") == 0 ? WSTK_HTTP_HDR_RANGE : -1);
+        case 6:  return (wstk_pl_strcasecmp(name, "Cookie") == 0 ? WSTK_HTTP_HDR_COOKIE : -1);
+        case 7:  return (wstk_pl_strcasecmp(name, "Upgrade") == 0 ? WSTK_HTTP_HDR_UPGRADE : -1);
+        case 8:  return (wstk_pl_strcasecmp(name, "If-Range") == 0 ? WSTK_HTTP_HDR_IF_RANGE : -1);
+        case 10: return (wstk_pl_strcasecmp(name, "Connection") == 0 ? WSTK_HTTP_HDR_CONNECTION : -1);
+        case 13:
+            if(wstk_pl_strcasecmp(name, "Authorization") == 0) { return WSTK_HTTP_HDR_AUTHORIZATION; }
+            return (wstk_pl_strcasecmp(name, "If-None-Match") == 0 ? WSTK_HTTP_HDR_IF_NONE_MATCH : -1);
+        case 15: return (wstk_pl_strcasecmp(name, "Accept-Encoding") == 0 ? WSTK_HTTP_HDR_ACCEPT_ENCODING : -1);
+        case 17:
+            if(wstk_pl_strcasecmp(name, "Sec-WebSocket-Key") == 0) { return WSTK_HTTP_HDR_SEC_WEBSOCKET_KEY; }
+            if(wstk_pl_strcasecmp(name, "Transfer-Encoding") == 0) { return WSTK_HTTP_HDR_TRANSFER_ENCODING; }
+            return (wstk_pl_strcasecmp(name, "If-Modified-Since") == 0 ? WSTK_HTTP_HDR_IF_MODIFIED_SINCE : -1);
+        case 21: return (wstk_pl_strcasecmp(name, "Sec-WebSocket-Version") == 0 ? WSTK_HTTP_HDR_SEC_WEBSOCKET_VERSION : -1);
+        case 22: return (wstk_pl_strcasecmp(name, "Sec-WebSocket-Protocol") == 0 ? WSTK_HTTP_HDR_SEC_WEBSOCKET_PROTOCOL : -1);
+        case 24: return (wstk_pl_strcasecmp(name, "Sec-WebSocket-Extensions") == 0 ? WSTK_HTTP_HDR_SEC_WEBSOCKET_EXTENSIONS : -1);
+    }
+    return -1;
+}
+
+/* a repeated Content-Length is accepted only with the same value (a conflicting one is a smuggling attempt) */
+static bool hdr_clen_conflict(wstk_http_msg_t *msg, const wstk_pl_t *value) {
+    for(uint32_t i = 0; i < msg->hdrs_count; i++) {
+        wstk_http_hdr_t *hdr = &msg->hdrs[i];
+        if(hdr->name.l == 14 && wstk_pl_strcasecmp(&hdr->name, "Content-Length") == 0) {
+            return (wstk_pl_cmp(&hdr->value, value) != 0);
+        }
+    }
+    return false;
+}
+
+/* keeps the pointers to the buffer, nothing is copied (an empty value is kept as well) */
 static wstk_status_t hdr_put(wstk_http_msg_t *msg, wstk_pl_t *name, wstk_pl_t *value) {
+    wstk_http_hdr_t *hdr = NULL;
+    int id = 0;
+
+    if(!name->l || name->l >= 0xff || value->l > HTTP_MSG_HDR_VALUE_MAX) {
+        return WSTK_STATUS_BAD_REQUEST;
+    }
+    if(msg->hdrs_count >= WSTK_HTTP_MSG_HEADERS_MAX) {
+        return WSTK_STATUS_BAD_REQUEST;
+    }
+    if(name->l == 14 && wstk_pl_strcasecmp(name, "Content-Length") == 0) {
+        for(size_t i = 0; i < value->l; i++) {
+            if(value->p[i] < '0' || value->p[i] > '9') { return WSTK_STATUS_BAD_REQUEST; }
+        }
+        if(!value->l || hdr_clen_conflict(msg, value)) {
+            return WSTK_STATUS_BAD_REQUEST;
+        }
+    }
+
+    hdr = &msg->hdrs[msg->hdrs_count++];
+    hdr->name = *name;
+    hdr->value = *value;
+
+    if((id = hdr_common_id(name)) >= 0) {
+        msg->hdr_common[id] = *value;
+    } else if(name->l == 12 && wstk_pl_strcasecmp(name, "Content-Type") == 0) {
+        hdr_content_type(msg, value);
+    } else if(name->l == 14 && wstk_pl_strcasecmp(name, "Content-Length") == 0) {
+        msg->clen = wstk_pl_u32(value);
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* name => value map for the string getters, the last duplicate wins */
+static wstk_status_t hdr_view_build(wstk_http_msg_t *msg) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     char tname[0xff] = {0};
     char *tval = NULL;
+    uint32_t i = 0;
 
-    if(!msg || !msg->headers) {
-        return WSTK_STATUS_INVALID_PARAM;
-    }
-    if(!name || !name->l || name->l >= sizeof(tname)) {
-        return WSTK_STATUS_OUTOFRANGE;
+    if(msg->headers) {
+        return WSTK_STATUS_SUCCESS;
     }
-    if(!value || !value->l || value->l > 4096) {
-        return WSTK_STATUS_OUTOFRANGE;
+    if((status = wstk_hash_init_nocase(&msg->headers)) != WSTK_STATUS_SUCCESS) {
+        return status;
     }
 
-    memcpy((char *)tname, name->p, name->l);
-    tname[name->l] = '\0';
+    for(i = 0; i < msg->hdrs_count; i++) {
+        wstk_http_hdr_t *hdr = &msg->hdrs[i];
 
-    if(wstk_str_casecmp((char *)tname, "Content-Type") == 0) {
-        const char *cend = (value->p + value->l);
-        const char *cptr = wstk_strnstr(value->p, value->l, "charset=");
-        if(cptr) {
-            uint32_t sep_ofs = 0;
-            for(sep_ofs=0; sep_ofs <= value->l; sep_ofs++) {
-                if(value->p[sep_ofs] == ';') { break;}
-            }
-            if(sep_ofs >= value->l) {
-                msg->ctype.l = value->l;
-                msg->ctype.p = value->p;
-            } else {
-                msg->charset.l = (cend - (cptr + 8));
-                msg->charset.p = (msg->charset.l ? (void *)(cptr + 8) : NULL);
-                msg->ctype.l = sep_ofs;
-                msg->ctype.p = value->p;
-            }
+        if(!hdr->name.l) { continue; }
+
+        memcpy((char *)tname, hdr->name.p, hdr->name.l);
+        tname[hdr->name.l] = '\0';
+
+        if(msg->arena) {
+            status = wstk_arena_strndup(msg->arena, &tval, hdr->value.p, hdr->value.l);
+            if(status != WSTK_STATUS_SUCCESS) { break; }
+
+            status = wstk_hash_insert_ex(msg->headers, (char *)tname, (char *)tval, false);
+            if(status != WSTK_STATUS_SUCCESS) { break; }
         } else {
-            msg->ctype.l = value->l;
-            msg->ctype.p = value->p;
+            status = wstk_pl_strdup(&tval, &hdr->value);
+            if(status != WSTK_STATUS_SUCCESS) { break; }
+
+            status = wstk_hash_insert_ex(msg->headers, (char *)tname, (char *)tval, true);
+            if(status != WSTK_STATUS_SUCCESS) { wstk_mem_deref(tval); break; }
         }
+    }
 
-        goto out;
+    if(status != WSTK_STATUS_SUCCESS) {
+        msg->headers = wstk_mem_deref(msg->headers);
     }
-    if(wstk_str_casecmp((char *)tname, "Content-Length") == 0) {
-        msg->clen = wstk_pl_u32(value);
-        goto out;
+    return status;
+}
+
+/* walks the chunked body [start...end), dst == NULL only validates, otherwise the data are moved to dst (dst <= start) */
+static wstk_status_t chunked_scan(const char *start, const char *end, char *dst, size_t *body_len, size_t *enc_len) {
+    const char *p = start, *q = NULL;
+    size_t size = 0, blen = 0;
+    int digits = 0, c = 0;
+
+    while(true) {
+        size = 0; digits = 0;
+        while(p < end && isxdigit((unsigned char)*p)) {
+            if(size > (SIZE_MAX >> 4)) {
+                return WSTK_STATUS_BAD_REQUEST;
+            }
+            c = (unsigned char)*p++;
+            size = (size << 4) | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+            digits++;
+        }
+        if(p >= end) {
+            return WSTK_STATUS_NODATA;
+        }
+        if(!digits || (*p != ';' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')) {
+            return WSTK_STATUS_BAD_REQUEST;
+        }
+        /* extensions are ignored */
+        if(!(q = memchr(p, '\n', end - p))) {
+            return ((size_t)(end - p) > HTTP_MSG_CHUNK_LINE_MAX ? WSTK_STATUS_BAD_REQUEST : WSTK_STATUS_NODATA);
+        }
+        p = q + 1;
+        if(!size) {
+            break;
+        }
+        if((size_t)(end - p) < size) {
+            return WSTK_STATUS_NODATA;
+        }
+        if(blen + size < blen) {
+            return WSTK_STATUS_BAD_REQUEST;
+        }
+        if(dst) {
+            memmove(dst + blen, p, size);
+        }
+        blen += size;
+        p += size;
+        if(p < end && *p == '\r') {
+            p++;
+        }
+        if(p >= end) {
+            return WSTK_STATUS_NODATA;
+        }
+        if(*p++ != '\n') {
+            return WSTK_STATUS_BAD_REQUEST;
+        }
     }
 
-    status = wstk_pl_strdup(&tval, value);
-    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+    /* trailers up to the empty line */
+    while(true) {
+        if(!(q = memchr(p, '\n', end - p))) {
+            return ((size_t)(end - p) > HTTP_MSG_CHUNK_LINE_MAX ? WSTK_STATUS_BAD_REQUEST : WSTK_STATUS_NODATA);
+        }
+        if(q == p || (q == p + 1 && *p == '\r')) {
+            p = q + 1;
+            break;
+        }
+        p = q + 1;
+    }
 
-    status = wstk_hash_insert_ex(msg->headers, (char *)tname, (char *)tval, true);
-    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+    *body_len = blen;
+    *enc_len = (p - start);
 
-out:
-    if(status != WSTK_STATUS_SUCCESS) {
-        wstk_mem_deref(tval);
-    }
-    return status;
+    return WSTK_STATUS_SUCCESS;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -112,9 +276,6 @@ wstk_status_t wstk_http_msg_alloc(wstk_http_msg_t **msg) {
     if((status = wstk_mem_zalloc((void *)&msg_local, sizeof(wstk_http_msg_t), desctuctor__wstk_http_msg_t)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
-    if((status = wstk_hash_init(&msg_local->headers)) != WSTK_STATUS_SUCCESS) {
-        goto out;
-    }
 
     *msg = msg_local;
 
@@ -127,140 +288,253 @@ out:
 
 /**
  * Decode mbuf with to message
+ * single pass, when the request is incomplete returns NODATA and remembers
+ * how far it got, so the next call (with the same msg and more data in the buffer) resumes from there
+ * mbuf->pos should point to the message start, on success it's moved to the body
  *
  * @param msg   - new message
  * @param mbuf  - http request
  *
- * @return sucesss or some error
+ * @return sucesss, NODATA (need more data) or some error
  **/
 wstk_status_t wstk_http_msg_decode(wstk_http_msg_t *msg, wstk_mbuf_t *mbuf) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_pl_t b = {0}, s = {0}, e = {0}, name = {0}, value = {0};
-    uint32_t ws=0, lf=0;
-    bool comsep=false, quote=false;
-    const char *p, *cv;
-    size_t l = 0;
+    wstk_pl_t name = {0}, value = {0};
+    const char *start, *end, *eoh, *p, *q, *vend = NULL;
+    parser_state_e state = PS_METHOD;
 
     if(!msg || !mbuf) {
         return WSTK_STATUS_INVALID_PARAM;
     }
 
-    msg->clen = 0;
+    start = (const char *)wstk_mbuf_buf(mbuf);
+    end = start + wstk_mbuf_left(mbuf);
 
-    p = (const char *)wstk_mbuf_buf(mbuf);
-    l = wstk_mbuf_left(mbuf);
+    /* skip empty lines before the request */
+    while(start < end && (*start == '\r' || *start == '\n')) {
+        start++;
+    }
 
-    status = wstk_regex(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1", &b, &s, NULL, &e);
-    if(status != WSTK_STATUS_SUCCESS) {
-        if(l > mbuf->size) {
+    /* look for the end of headers (an empty line), starts where the previous call stopped */
+    eoh = NULL;
+    p = start + (msg->hdr_scan < (size_t)(end - start) ? msg->hdr_scan : (size_t)(end - start));
+    while(p < end) {
+        if(!(q = memchr(p, '\n', end - p))) {
+            p = end;
+            break;
+        }
+        if(q + 1 >= end || (q[1] == '\r' && q + 2 >= end)) {
+            p = q;
+            break;
+        }
+        if(q[1] == '\n') {
+            eoh = q + 2;
+            break;
+        }
+        if(q[1] == '\r' && q[2] == '\n') {
+            eoh = q + 3;
+            break;
+        }
+        p = q + 1;
+    }
+    if(!eoh) {
+        msg->hdr_scan = (p - start);
+        if((size_t)(end - start) > HTTP_MSG_HEADERS_MAX_SIZE) {
             wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
         }
         wstk_goto_status(WSTK_STATUS_NODATA, out);
     }
+    msg->hdr_scan = 0;
+
+    memset(&msg->method, 0x0, sizeof(wstk_pl_t));
+    memset(&msg->path, 0x0, sizeof(wstk_pl_t));
+    memset(&msg->params, 0x0, sizeof(wstk_pl_t));
+    memset(&msg->version, 0x0, sizeof(wstk_pl_t));
+    memset(&msg->ctype, 0x0, sizeof(wstk_pl_t));
+    memset(&msg->charset, 0x0, sizeof(wstk_pl_t));
+    memset(msg->hdr_common, 0x0, sizeof(msg->hdr_common));
+    msg->hdrs_count = 0;
+    msg->clen = 0;
 
-    status = wstk_regex(s.p, s.l, "[a-z]+ [^? ]+[^ ]* HTTP/[0-9.]+", &msg->method, &msg->path, &msg->params, &msg->version);
-    if(status != WSTK_STATUS_SUCCESS || msg->method.p != s.p) {
-        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
-    }
-    if(msg->params.p && msg->params.l > 1) {
-        if(*msg->params.p == '?') {
-            msg->params.p++;
-            msg->params.l--;
-        }
+    if(msg->headers) {
+        msg->headers = wstk_mem_deref(msg->headers);
     }
 
-    l -= e.p + e.l - p;
-    p = e.p + e.l;
+    msg->method.p = start;
+    for(p = start; p < eoh; p++) {
+        const char c = *p;
 
-    name.p = cv = NULL;
-    name.l = ws = lf = 0;
-    comsep = false;
-    quote = false;
+        switch(state) {
+            case PS_METHOD:
+                if((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+                    break;
+                }
+                if(c != ' ' || p == start) {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                }
+                msg->method.l = (p - start);
+                msg->path.p = (p + 1);
+                state = PS_PATH;
+                break;
 
-    for(; l > 0; p++, l--) {
-        switch(*p) {
-            case ' ':
-            case '\t':
-                lf = 0; /* folding */
-                ++ws;
+            case PS_PATH:
+                if(c == ' ' || c == '?') {
+                    if(!(msg->path.l = (p - msg->path.p))) {
+                        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                    }
+                    if(c == '?') {
+                        msg->params.p = (p + 1);
+                        state = PS_PARAMS;
+                    } else {
+                        state = PS_PROTO;
+                    }
+                    break;
+                }
+                if(IS_CTL(c)) {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                }
                 break;
-            case '\r':
-                ++ws;
+
+            case PS_PARAMS:
+                if(c == ' ') {
+                    msg->params.l = (p - msg->params.p);
+                    state = PS_PROTO;
+                    break;
+                }
+                if(IS_CTL(c)) {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                }
                 break;
-            case '\n':
-                ++ws;
-                if(!name.p) {
-                    ++p; --l; /* no headers */
-                    goto out;
+
+            case PS_PROTO:
+                if(eoh - p < 5 || strncasecmp(p, "HTTP/", 5) != 0) {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
                 }
-                if(!lf++) {
+                p += 4;
+                msg->version.p = (p + 1);
+                state = PS_VERSION;
+                break;
+
+            case PS_VERSION:
+                if((c >= '0' && c <= '9') || c == '.') {
                     break;
                 }
-                ++p; --l;     /* eoh */
-                /*fallthrough*/
-            default:
-                if(lf || (*p == ',' && comsep && !quote)) {
-                    if(!name.l) {
-                        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
-                    }
+                if((c != '\r' && c != '\n') || !(msg->version.l = (p - msg->version.p))) {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                }
+                state = (c == '\r' ? PS_EOL : PS_LINE);
+                break;
 
-                    value.p = (cv ? cv : p);
-                    value.l = (cv ? p - cv - ws : 0);
-                    hdr_put(msg, &name, &value);
+            case PS_EOL:
+                if(c != '\n') {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
+                }
+                state = PS_LINE;
+                break;
 
-                    if(!lf) { /* comma separated */
-                        cv = NULL;
-                        break;
+            case PS_LINE:
+                if(c == ' ' || c == '\t') { /* folding, the value goes on */
+                    if(!name.p) {
+                        wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
                     }
-                    if(lf > 1) { /* eoh */
+                    state = PS_VALUE;
+                    break;
+                }
+                if(name.p) {
+                    if(value.p) {
+                        value.l = (vend - value.p);
+                    } else {
+                        value.p = (name.p + name.l);
+                        value.l = 0;
+                    }
+                    if((status = hdr_put(msg, &name, &value)) != WSTK_STATUS_SUCCESS) {
                         goto out;
                     }
-
-                    comsep = false;
                     name.p = NULL;
-                    cv = NULL;
-                    lf = 0;
                 }
-                if(!name.p) {
-                    name.p = p;
-                    name.l = 0;
-                    ws = 0;
+                if(c == '\r' || c == '\n') { /* eoh */
+                    p = eoh;
+                    goto out;
                 }
-                if(!name.l) {
-                    if(*p != ':') {
-                        ws = 0;
-                        break;
-                    }
-                    name.l = MAX((int)(p - name.p - ws), 0);
-                    if(!name.l) {
+                name.p = p;
+                name.l = 0;
+                value.p = vend = NULL;
+                state = PS_NAME;
+                break;
+
+            case PS_NAME:
+                if(c == ':') {
+                    for(q = p; q > name.p && (q[-1] == ' ' || q[-1] == '\t'); q--);
+                    if(!(name.l = (q - name.p))) {
                         wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
                     }
-                    comsep = false;
+                    state = PS_VALUE;
                     break;
                 }
-
-                if(!cv) {
-                    quote = false;
-                    cv = p;
+                if(c == '\r' || c == '\n') {
+                    wstk_goto_status(WSTK_STATUS_BAD_REQUEST, out);
                 }
+                break;
 
-                if(*p == '"') {
-                    quote = !quote;
+            case PS_VALUE:
+                if(c == '\r') {
+                    state = PS_EOL;
+                    break;
                 }
-
-                ws = 0;
+                if(c == '\n') {
+                    state = PS_LINE;
+                    break;
+                }
+                if(c == ' ' || c == '\t') {
+                    break;
+                }
+                if(!value.p) {
+                    value.p = p;
+                }
+                vend = (p + 1);
                 break;
         }
     }
-    status = WSTK_STATUS_NODATA;
+
+    /* never gets here, eoh is always an empty line */
+    status = WSTK_STATUS_BAD_REQUEST;
 
 out:
-    if(status == WSTK_STATUS_SUCCESS || status == WSTK_STATUS_NODATA) {
-        mbuf->pos = (mbuf->end - l);
+    if(status == WSTK_STATUS_SUCCESS) {
+        mbuf->pos = (p - (const char *)mbuf->buf);
     }
     return status;
 }
 
+/**
+ * Decode the chunked body (Transfer-Encoding: chunked) in place
+ * mbuf->pos should point to the body start, the buffer is left untouched until the whole body is there,
+ * after that the data are joined at mbuf->pos (the chunk sizes, extensions and trailers are dropped)
+ *
+ * @param mbuf      - the buffer
+ * @param body_len  - decoded body length
+ * @param enc_len   - length of the encoded body (the next message starts there)
+ *
+ * @return sucesss, NODATA (need more data) or BAD_REQUEST
+ **/
+wstk_status_t wstk_http_msg_chunked_decode(wstk_mbuf_t *mbuf, size_t *body_len, size_t *enc_len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    const char *start = NULL, *end = NULL;
+
+    if(!mbuf || !body_len || !enc_len) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    start = (const char *)wstk_mbuf_buf(mbuf);
+    end = start + wstk_mbuf_left(mbuf);
+
+    if((status = chunked_scan(start, end, NULL, body_len, enc_len)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    return chunked_scan(start, end, (char *)start, body_len, enc_len);
+}
+
 /**
  * Is the header exists in the map
  *
@@ -270,11 +544,9 @@ out:
  * @return true/false
  **/
 bool wstk_http_msg_header_exists(wstk_http_msg_t *msg, const char *name) {
-    if(!msg || !name) {
-        return false;
-    }
+    wstk_pl_t value = {0};
 
-    return (wstk_hash_find(msg->headers, name) ? true : false);
+    return (wstk_http_msg_header_get_pl(msg, name, &value) == WSTK_STATUS_SUCCESS);
 }
 
 /**
@@ -288,21 +560,41 @@ bool wstk_http_msg_header_exists(wstk_http_msg_t *msg, const char *name) {
  **/
 wstk_status_t wstk_http_msg_header_add(wstk_http_msg_t *msg, const char *name, const char *value) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_pl_t tname = {0};
+    char *tval = NULL;
+    int id = 0;
 
     if(!msg || !name || !value) {
         return WSTK_STATUS_INVALID_PARAM;
     }
-
+    if((status = hdr_view_build(msg)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
     if(wstk_hash_find(msg->headers, name)) {
-        status = WSTK_STATUS_ALREADY_EXISTS;
-    } else {
-        status = wstk_hash_insert_ex(msg->headers, name, value, true);
+        return WSTK_STATUS_ALREADY_EXISTS;
     }
-    return status;
+    if(!(tval = wstk_str_dup(value))) {
+        return WSTK_STATUS_MEM_FAIL;
+    }
+
+    status = wstk_hash_insert_ex(msg->headers, name, tval, true);
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(tval);
+        return status;
+    }
+
+    wstk_pl_set_str(&tname, name);
+    if((id = hdr_common_id(&tname)) >= 0) {
+        wstk_pl_set_str(&msg->hdr_common[id], tval);
+    }
+
+    return WSTK_STATUS_SUCCESS;
 }
 
 /**
  * Get header value
+ * the first call builds a view of the headers (strings copies),
+ * use wstk_http_msg_header_get_pl() or wstk_http_msg_header_common() to avoid it
  *
  * @param msg   - the message
  * @param name  - header name
@@ -311,11 +603,15 @@ wstk_status_t wstk_http_msg_header_add(wstk_http_msg_t *msg, const char *name, c
  * @return sucesss or some error
  **/
 wstk_status_t wstk_http_msg_header_get(wstk_http_msg_t *msg, const char *name, const char **value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
     void *v = NULL;
 
     if(!msg || !name) {
         return WSTK_STATUS_INVALID_PARAM;
     }
+    if((status = hdr_view_build(msg)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
 
     v = wstk_hash_find(msg->headers, name);
     if(v == NULL) {
@@ -326,6 +622,102 @@ wstk_status_t wstk_http_msg_header_get(wstk_http_msg_t *msg, const char *name, c
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Get header value without copying
+ * value points to the request buffer (or to the view after header_add)
+ *
+ * @param msg   - the message
+ * @param name  - header name
+ * @param value - header value
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_http_msg_header_get_pl(wstk_http_msg_t *msg, const char *name, wstk_pl_t *value) {
+    wstk_pl_t tname = {0};
+    uint32_t i = 0;
+    int id = 0;
+
+    if(!msg || !name || !value) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if(msg->headers) {
+        const char *v = wstk_hash_find(msg->headers, name);
+        if(!v) {
+            return WSTK_STATUS_NOT_FOUND;
+        }
+        return wstk_pl_set_str(value, v);
+    }
+
+    wstk_pl_set_str(&tname, name);
+    if((id = hdr_common_id(&tname)) >= 0) {
+        return wstk_http_msg_header_common(msg, (wstk_http_hdr_e)id, value);
+    }
+
+    for(i = msg->hdrs_count; i > 0; i--) {
+        wstk_http_hdr_t *hdr = &msg->hdrs[i - 1];
+        if(hdr->name.l == tname.l && wstk_pl_casecmp(&hdr->name, &tname) == 0) {
+            *value = hdr->value;
+            return WSTK_STATUS_SUCCESS;
+        }
+    }
+
+    return WSTK_STATUS_NOT_FOUND;
+}
+
+/**
+ * Get one of the common headers (the slot is filled by the decoder)
+ *
+ * @param msg   - the message
+ * @param id    - header id
+ * @param value - header value
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_http_msg_header_common(wstk_http_msg_t *msg, wstk_http_hdr_e id, wstk_pl_t *value) {
+    if(!msg || !value || id < 0 || id >= WSTK_HTTP_HDR_COMMON_MAX) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(!msg->hdr_common[id].l) {
+        return WSTK_STATUS_NOT_FOUND;
+    }
+
+    *value = msg->hdr_common[id];
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Is the common header (a comma separated list, e.g.: 'Connection: keep-alive, Upgrade') contains the token
+ * case insensitive
+ *
+ * @param msg   - the message
+ * @param id    - header id
+ * @param token - the token
+ *
+ * @return true/false
+ **/
+bool wstk_http_msg_header_has_token(wstk_http_msg_t *msg, wstk_http_hdr_e id, const char *token) {
+    wstk_pl_t val = {0};
+    size_t tlen = 0, i = 0, s = 0, e = 0;
+
+    if(!token || wstk_http_msg_header_common(msg, id, &val) != WSTK_STATUS_SUCCESS) {
+        return false;
+    }
+
+    tlen = strlen(token);
+    for(i = 0; i <= val.l; i++) {
+        if(i < val.l && val.p[i] != ',') { continue; }
+        while(s < i && (val.p[s] == ' ' || val.p[s] == '\t')) { s++; }
+        if(i - s >= tlen && strncasecmp(val.p + s, token, tlen) == 0) {
+            for(e = s + tlen; e < i && (val.p[e] == ' ' || val.p[e] == '\t'); e++);
+            if(e == i) { return true; }
+        }
+        s = i + 1;
+    }
+
+    return false;
+}
+
 /**
  * Delete header
  *
@@ -335,15 +727,60 @@ wstk_status_t wstk_http_msg_header_get(wstk_http_msg_t *msg, const char *name, c
  * @return sucesss or some error
  **/
 wstk_status_t wstk_http_msg_header_del(wstk_http_msg_t *msg, const char *name) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_pl_t tname = {0};
+    uint32_t i = 0;
+    int id = 0;
+
     if(!msg || !name) {
         return WSTK_STATUS_INVALID_PARAM;
     }
+    if((status = hdr_view_build(msg)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
 
     wstk_hash_delete(msg->headers, name);
+
+    wstk_pl_set_str(&tname, name);
+    if((id = hdr_common_id(&tname)) >= 0) {
+        memset(&msg->hdr_common[id], 0x0, sizeof(wstk_pl_t));
+    }
+    for(i = 0; i < msg->hdrs_count; i++) {
+        wstk_http_hdr_t *hdr = &msg->hdrs[i];
+        if(hdr->name.l == tname.l && wstk_pl_casecmp(&hdr->name, &tname) == 0) {
+            memset(hdr, 0x0, sizeof(wstk_http_hdr_t));
+        }
+    }
+
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Get a path param
+ * (the ':name' segment of the servlet path, see wstk_httpd_register_servlet)
+ *
+ * @param msg   - the message
+ * @param name  - param name (without ':')
+ * @param value - the value (points to the request path)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_FOUND or some error
+ **/
+wstk_status_t wstk_http_msg_path_param(wstk_http_msg_t *msg, const char *name, wstk_pl_t *value) {
+    uint32_t i = 0;
+
+    if(!msg || !name || !value) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
 
+    for(i = 0; i < msg->path_params_count; i++) {
+        if(wstk_pl_strcmp(&msg->path_params[i].name, name) == 0) {
+            *value = msg->path_params[i].value;
+            return WSTK_STATUS_SUCCESS;
+        }
+    }
+
+    return WSTK_STATUS_NOT_FOUND;
+}
 
 /**
  * Dump message
@@ -375,13 +812,19 @@ wstk_status_t wstk_http_msg_dump(wstk_http_msg_t *msg) {
     wstk_mbuf_printf(tbuf, "charset.....%r\n", (wstk_pl_t *) &msg->charset);
     wstk_mbuf_printf(tbuf, "clen........%d\n", msg->clen);
 
-    if(!wstk_hash_is_empty(msg->headers)) {
+    if(msg->headers) {
         wstk_hash_index_t *hidx = NULL;
         char *key = NULL, *val = NULL;
         for(hidx = wstk_hash_first_iter(msg->headers, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
             wstk_hash_this(hidx, (void *)&key, NULL, (void *)&val);
             wstk_mbuf_printf(tbuf, "HEADER: [%s] => [%s]\n", key, val);
         }
+    } else {
+        uint32_t i = 0;
+        for(i = 0; i < msg->hdrs_count; i++) {
+            if(!msg->hdrs[i].name.l) { continue; }
+            wstk_mbuf_printf(tbuf, "HEADER: [%r] => [%r]\n", &msg->hdrs[i].name, &msg->hdrs[i].value);
+        }
     }
 
 out:
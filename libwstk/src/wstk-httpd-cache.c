@@ -0,0 +1,460 @@
+/**
+ ** Static content cache of httpd
+ **
+ ** the small files from www_home are kept in memory together with their pre-rendered headers
+ ** (the encoded variants are the separate entries with own keys),
+ ** the least recently used entries are dropped when the memory limit is reached;
+ ** an entry is validated by the file mtime/size not often than once per ttl
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk-httpd.h>
+#include <wstk-log.h>
+#include <wstk-mem.h>
+#include <wstk-mbuf.h>
+#include <wstk-str.h>
+#include <wstk-fmt.h>
+#include <wstk-time.h>
+#include <wstk-file.h>
+#include <wstk-mutex.h>
+#include <wstk-hashtable.h>
+#include <wstk-deflate.h>
+
+#define CACHE_DEFAULT_MAX_FILE_SIZE     262144
+#define CACHE_DEFAULT_TTL               2
+
+struct wstk_httpd_cache_s {
+    wstk_mutex_t                *mutex;
+    wstk_hash_t                 *entries;       // key => entry (the entries are owned by the lru list)
+    wstk_httpd_cache_entry_t    *lru_head;      // the most recently used
+    wstk_httpd_cache_entry_t    *lru_tail;      // the candidate to drop
+    size_t                      max_size;
+    size_t                      max_file_size;
+    size_t                      size;
+    uint32_t                    ttl;
+    bool                        fl_destroyed;
+};
+
+static void desctuctor__wstk_httpd_cache_entry_t(void *ptr) {
+    wstk_httpd_cache_entry_t *entry = (wstk_httpd_cache_entry_t *)ptr;
+
+    if(!entry) {
+        return;
+    }
+
+    entry->key = wstk_mem_deref(entry->key);
+    entry->file = wstk_mem_deref(entry->file);
+    entry->headers = wstk_mem_deref(entry->headers);
+    entry->body = wstk_mem_deref(entry->body);
+}
+
+static size_t entry_size(wstk_httpd_cache_entry_t *entry) {
+    return sizeof(wstk_httpd_cache_entry_t) + wstk_mbuf_size(entry->body) + strlen(entry->headers) + strlen(entry->key) + strlen(entry->file);
+}
+
+static void lru_link(wstk_httpd_cache_t *cache, wstk_httpd_cache_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if(cache->lru_head) { cache->lru_head->lru_prev = entry; }
+    cache->lru_head = entry;
+    if(!cache->lru_tail) { cache->lru_tail = entry; }
+    entry->fl_linked = true;
+}
+
+static void lru_unlink(wstk_httpd_cache_t *cache, wstk_httpd_cache_entry_t *entry) {
+    wstk_httpd_cache_entry_t *prev = (wstk_httpd_cache_entry_t *)entry->lru_prev;
+    wstk_httpd_cache_entry_t *next = (wstk_httpd_cache_entry_t *)entry->lru_next;
+
+    if(!entry->fl_linked) {
+        return;
+    }
+
+    if(prev) { prev->lru_next = next; } else { cache->lru_head = next; }
+    if(next) { next->lru_prev = prev; } else { cache->lru_tail = prev; }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+    entry->fl_linked = false;
+}
+
+/* should be called under the lock, releases the cache reference */
+static void entry_remove(wstk_httpd_cache_t *cache, wstk_httpd_cache_entry_t *entry) {
+    if(!entry->fl_linked) {
+        return;
+    }
+
+    if(wstk_hash_find(cache->entries, entry->key) == entry) {
+        wstk_hash_delete(cache->entries, entry->key);
+    }
+    lru_unlink(cache, entry);
+
+    cache->size -= MIN(cache->size, entry_size(entry));
+    wstk_mem_deref(entry);
+}
+
+static void desctuctor__wstk_httpd_cache_t(void *ptr) {
+    wstk_httpd_cache_t *cache = (wstk_httpd_cache_t *)ptr;
+
+    if(!cache || cache->fl_destroyed) {
+        return;
+    }
+    cache->fl_destroyed = true;
+
+    wstk_mutex_lock(cache->mutex);
+    while(cache->lru_head) {
+        entry_remove(cache, cache->lru_head);
+    }
+    cache->entries = wstk_mem_deref(cache->entries);
+    wstk_mutex_unlock(cache->mutex);
+
+    cache->mutex = wstk_mem_deref(cache->mutex);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// public
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/**
+ * Create a new cache
+ *
+ * @param cache         - the cache
+ * @param max_size      - memory limit (all entries)
+ * @param max_file_size - bigger files are not cached (0 = 256K)
+ * @param ttl           - seconds between the validations of an entry (0 = 2s)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_cache_create(wstk_httpd_cache_t **cache, size_t max_size, size_t max_file_size, uint32_t ttl) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_httpd_cache_t *cache_local = NULL;
+
+    if(!cache || !max_size) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&cache_local, sizeof(wstk_httpd_cache_t), desctuctor__wstk_httpd_cache_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    if((status = wstk_mutex_create(&cache_local->mutex)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_hash_init(&cache_local->entries)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    cache_local->max_size = max_size;
+    cache_local->max_file_size = (max_file_size ? MIN(max_file_size, max_size) : MIN(CACHE_DEFAULT_MAX_FILE_SIZE, max_size));
+    cache_local->ttl = (ttl ? ttl : CACHE_DEFAULT_TTL);
+
+    *cache = cache_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(cache_local);
+    }
+    return status;
+}
+
+/**
+ * Lookup for an entry
+ * the entry is validated when its ttl is up (the changed or removed files are dropped)
+ *
+ * @param cache     - the cache
+ * @param key       - request path
+ * @param entry     - the result (referenced, should be released by wstk_mem_deref)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_FOUND or some error
+ **/
+wstk_status_t wstk_httpd_cache_lookup(wstk_httpd_cache_t *cache, const char *key, wstk_httpd_cache_entry_t **entry) {
+    wstk_httpd_cache_entry_t *entry_local = NULL;
+    wstk_file_meta_t meta = { 0 };
+    time_t now = 0;
+    bool fl_validate = false;
+
+    if(!cache || !key || !entry) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(cache->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    now = wstk_time_epoch_now();
+
+    wstk_mutex_lock(cache->mutex);
+    if((entry_local = wstk_hash_find(cache->entries, key)) != NULL) {
+        if(cache->lru_head != entry_local) {
+            lru_unlink(cache, entry_local);
+            lru_link(cache, entry_local);
+        }
+        if(now >= entry_local->checked + cache->ttl) {
+            entry_local->checked = now; /* the others keep using it meanwhile */
+            fl_validate = true;
+        }
+        wstk_mem_ref(entry_local);
+    }
+    wstk_mutex_unlock(cache->mutex);
+
+    if(!entry_local) {
+        return WSTK_STATUS_NOT_FOUND;
+    }
+
+    if(fl_validate) {
+        if(wstk_file_get_meta(entry_local->file, &meta) != WSTK_STATUS_SUCCESS || meta.isdir || meta.mtime != entry_local->mtime || meta.size != entry_local->size) {
+#ifdef WSTK_HTTPD_DEBUG
+            WSTK_DBG_PRINT("cache entry outdated: key=%s, file=%s", entry_local->key, entry_local->file);
+#endif
+            wstk_mutex_lock(cache->mutex);
+            entry_remove(cache, entry_local);
+            wstk_mutex_unlock(cache->mutex);
+
+            wstk_mem_deref(entry_local);
+            return WSTK_STATUS_NOT_FOUND;
+        }
+    }
+
+    *entry = entry_local;
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Load the file into the cache
+ * the previous entry with the same key is replaced, the old ones are dropped if the memory limit is reached
+ *
+ * @param cache     - the cache
+ * @param key       - request path
+ * @param file      - file name
+ * @param ctype     - content type
+ * @param size      - file size
+ * @param mtime     - file modification time
+ * @param entry     - the new entry (referenced, should be released by wstk_mem_deref) or NULL
+ *
+ * @return sucesss, WSTK_STATUS_NOSPACE if the file is too big or some error
+ **/
+wstk_status_t wstk_httpd_cache_add(wstk_httpd_cache_t *cache, const char *key, const char *file, const char *ctype, size_t size, time_t mtime, wstk_httpd_cache_entry_t **entry) {
+    return wstk_httpd_cache_add2(cache, key, file, ctype, NULL, 0, size, mtime, entry);
+}
+
+/**
+ * Load the file into the cache (an encoded variant)
+ * the same as wstk_httpd_cache_add() plus:
+ *  - cenc: the file is already encoded (e.g. a precompressed sibling), goes as Content-Encoding
+ *  - WSTK_HTTPD_CACHE_GZIP: the content is compressed here (cenc is 'gzip' then, the tag differs from the plain one)
+ *  - WSTK_HTTPD_CACHE_VARY: the reply depends on Accept-Encoding (always so for the encoded ones)
+ *
+ * @param cache     - the cache
+ * @param key       - the key (request path and the variant)
+ * @param file      - file name
+ * @param ctype     - content type
+ * @param cenc      - content coding or NULL
+ * @param flags     - WSTK_HTTPD_CACHE_*
+ * @param size      - file size
+ * @param mtime     - file modification time
+ * @param entry     - the new entry (referenced, should be released by wstk_mem_deref) or NULL
+ *
+ * @return sucesss, WSTK_STATUS_NOSPACE if the file is too big or some error
+ **/
+wstk_status_t wstk_httpd_cache_add2(wstk_httpd_cache_t *cache, const char *key, const char *file, const char *ctype, const char *cenc, uint32_t flags, size_t size, time_t mtime, wstk_httpd_cache_entry_t **entry) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_httpd_cache_entry_t *entry_local = NULL, *entry_old = NULL;
+    wstk_mbuf_t *zbody = NULL;
+    char tbuff[128] = {0};
+    char xhdrs[128] = {0};
+    size_t esize = 0, elen = 0;
+
+    if(!cache || !key || !file || !ctype) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(cache->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(size > cache->max_file_size) {
+        return WSTK_STATUS_NOSPACE;
+    }
+    if((flags & WSTK_HTTPD_CACHE_GZIP) && !wstk_deflate_is_supported()) {
+        return WSTK_STATUS_NOT_IMPL;
+    }
+
+    status = wstk_mem_zalloc((void *)&entry_local, sizeof(wstk_httpd_cache_entry_t), desctuctor__wstk_httpd_cache_entry_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    if((status = wstk_str_dup2(&entry_local->key, key)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_str_dup2(&entry_local->file, file)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    /* the content (should be the same as it was stated) */
+    if((status = wstk_mbuf_alloc(&entry_local->body, (size ? size : 1))) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(size) {
+        if((status = wstk_file_content_read(file, entry_local->body, 0)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if(wstk_mbuf_end(entry_local->body) != size) {
+            wstk_goto_status(WSTK_STATUS_OUTDATE, out);
+        }
+    }
+
+    if((status = wstk_httpd_etag((char *)entry_local->etag, sizeof(entry_local->etag), size, mtime)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    /* the compressed one replaces the content, the tag gets a suffix ("...-gz") */
+    if(flags & WSTK_HTTPD_CACHE_GZIP) {
+        if((status = wstk_mbuf_alloc(&zbody, (size / 2) + 64)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if((status = wstk_deflate_mbuf(zbody, entry_local->body->buf, size, WSTK_DEFLATE_GZIP, -1)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        wstk_mbuf_resize(zbody, wstk_mbuf_end(zbody));
+        wstk_mem_deref(entry_local->body);
+        entry_local->body = zbody;
+        zbody = NULL;
+
+        elen = strlen(entry_local->etag);
+        if(elen + 3 >= sizeof(entry_local->etag)) {
+            wstk_goto_status(WSTK_STATUS_NOSPACE, out);
+        }
+        memcpy(entry_local->etag + elen - 1, "-gz\"", 5);
+        cenc = "gzip";
+    }
+
+    /* headers */
+    if((status = wstk_time_to_str_rfc822(mtime, (char *)tbuff, sizeof(tbuff))) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(cenc) {
+        wstk_snprintf(xhdrs, sizeof(xhdrs), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", cenc);
+    } else if(flags & WSTK_HTTPD_CACHE_VARY) {
+        wstk_snprintf(xhdrs, sizeof(xhdrs), "Vary: Accept-Encoding\r\n");
+    }
+    status = wstk_sdprintf(&entry_local->headers,
+                "Last-Modified: %s\r\n"
+                "ETag: %s\r\n"
+                "Content-Type: %s\r\n"
+                "%s"
+                "Content-Length: %zu\r\n"
+                "\r\n",
+                (char *)tbuff,
+                (char *)entry_local->etag,
+                ctype,
+                (char *)xhdrs,
+                wstk_mbuf_end(entry_local->body)
+            );
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    entry_local->size = size;
+    entry_local->mtime = mtime;
+    entry_local->checked = wstk_time_epoch_now();
+
+    /* link it, the cache holds a reference */
+    esize = entry_size(entry_local);
+
+    wstk_mutex_lock(cache->mutex);
+    if((entry_old = wstk_hash_find(cache->entries, key)) != NULL) {
+        entry_remove(cache, entry_old);
+    }
+    while(cache->lru_tail && cache->size + esize > cache->max_size) {
+#ifdef WSTK_HTTPD_DEBUG
+        WSTK_DBG_PRINT("cache entry evicted: key=%s", cache->lru_tail->key);
+#endif
+        entry_remove(cache, cache->lru_tail);
+    }
+    if(esize <= cache->max_size && wstk_hash_insert(cache->entries, entry_local->key, entry_local) == WSTK_STATUS_SUCCESS) {
+        lru_link(cache, wstk_mem_ref(entry_local));
+        cache->size += esize;
+    }
+    wstk_mutex_unlock(cache->mutex);
+
+    if(entry) {
+        *entry = entry_local;
+        entry_local = NULL;
+    }
+out:
+    wstk_mem_deref(zbody);
+    wstk_mem_deref(entry_local);
+    return status;
+}
+
+/**
+ * Drop the entry
+ *
+ * @param cache     - the cache
+ * @param key       - request path
+ *
+ * @return sucesss, WSTK_STATUS_NOT_FOUND or some error
+ **/
+wstk_status_t wstk_httpd_cache_del(wstk_httpd_cache_t *cache, const char *key) {
+    wstk_httpd_cache_entry_t *entry = NULL;
+
+    if(!cache || !key) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(cache->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(cache->mutex);
+    if((entry = wstk_hash_find(cache->entries, key)) != NULL) {
+        entry_remove(cache, entry);
+    }
+    wstk_mutex_unlock(cache->mutex);
+
+    return (entry ? WSTK_STATUS_SUCCESS : WSTK_STATUS_NOT_FOUND);
+}
+
+/**
+ * Drop all entries
+ *
+ * @param cache     - the cache
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_cache_clear(wstk_httpd_cache_t *cache) {
+    if(!cache) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(cache->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(cache->mutex);
+    while(cache->lru_head) {
+        entry_remove(cache, cache->lru_head);
+    }
+    wstk_mutex_unlock(cache->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Get the cache usage
+ *
+ * @param cache     - the cache
+ * @param size      - memory used by the entries
+ * @param count     - entries amount
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_cache_usage(wstk_httpd_cache_t *cache, size_t *size, uint32_t *count) {
+    if(!cache) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(cache->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(cache->mutex);
+    if(size) { *size = cache->size; }
+    if(count) { *count = wstk_hash_size(cache->entries); }
+    wstk_mutex_unlock(cache->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
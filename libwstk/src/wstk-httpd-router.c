@@ -0,0 +1,526 @@
+/**
+ ** Servlet router of httpd
+ **
+ ** a compressed radix tree of the registered paths, matched in one pass (the longest route wins):
+ **  - '/path'     - exact match
+ **  - '/path/'    - the path and everything below it
+ **  - '/a/:id/b'  - ':name' matches one non-empty segment, the static edges are preferred
+ **
+ ** the tree is immutable, register/unregister build a new one and swap it (copy-on-write),
+ ** the readers don't take locks, the old tree is dropped when the readers of its epoch are gone
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk-httpd.h>
+#include <wstk-log.h>
+#include <wstk-mem.h>
+#include <wstk-str.h>
+#include <wstk-mutex.h>
+#include <wstk-thread.h>
+#include <wstk-hashtable.h>
+
+typedef struct router_node_s {
+    char                    *label;         // static edge (the compressed part of the path) or the param name
+    size_t                  label_len;      //
+    struct router_node_s    *children;      // static children (their labels start with different chars)
+    struct router_node_s    *next;          // sibling
+    struct router_node_s    *param_child;   // ':name' child
+    void                    *value;         // refs to the route value or NULL
+    bool                    fl_param;       // the node is a ':name' segment
+    bool                    fl_prefix;      // the route ends with '/' and matches the subtree
+} router_node_t;
+
+struct wstk_httpd_router_s {
+    wstk_mutex_t            *mutex;         // writers (and the readers if there are no atomics)
+    wstk_hash_t             *routes;        // path => value (the tree is built from it)
+    router_node_t           *root;          // the published tree
+    uint32_t                readers[2];     // active readers by epoch
+    uint32_t                epoch;          //
+    bool                    fl_destroyed;
+};
+
+typedef struct {
+    const char              *path;
+    size_t                  len;
+    router_node_t           *best;
+    size_t                  best_len;
+    uint32_t                params_count;
+    uint32_t                best_params_count;
+    router_node_t           *params_nodes[WSTK_HTTPD_ROUTER_PARAMS_MAX];
+    wstk_pl_t               params_values[WSTK_HTTPD_ROUTER_PARAMS_MAX];
+    router_node_t           *best_params_nodes[WSTK_HTTPD_ROUTER_PARAMS_MAX];
+    wstk_pl_t               best_params_values[WSTK_HTTPD_ROUTER_PARAMS_MAX];
+} router_match_t;
+
+static void desctuctor__router_node_t(void *ptr) {
+    router_node_t *node = (router_node_t *)ptr;
+
+    if(!node) {
+        return;
+    }
+
+    node->label = wstk_mem_deref(node->label);
+    node->value = wstk_mem_deref(node->value);
+    node->param_child = wstk_mem_deref(node->param_child);
+    node->children = wstk_mem_deref(node->children);
+    node->next = wstk_mem_deref(node->next);
+}
+
+static void desctuctor__wstk_httpd_router_t(void *ptr) {
+    wstk_httpd_router_t *router = (wstk_httpd_router_t *)ptr;
+
+    if(!router || router->fl_destroyed) {
+        return;
+    }
+    router->fl_destroyed = true;
+
+    wstk_mutex_lock(router->mutex);
+    router->root = wstk_mem_deref(router->root);
+    router->routes = wstk_mem_deref(router->routes);
+    wstk_mutex_unlock(router->mutex);
+
+    router->mutex = wstk_mem_deref(router->mutex);
+}
+
+static wstk_status_t node_create(router_node_t **node, const char *label, size_t label_len, bool param) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    router_node_t *node_local = NULL;
+
+    status = wstk_mem_zalloc((void *)&node_local, sizeof(router_node_t), desctuctor__router_node_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_mem_zalloc((void *)&node_local->label, label_len + 1, NULL)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    memcpy(node_local->label, label, label_len);
+    node_local->label_len = label_len;
+    node_local->fl_param = param;
+
+    *node = node_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(node_local);
+    }
+    return status;
+}
+
+/* ':' is a param only at the segment start */
+static inline bool path_is_param(const char *path, size_t pos) {
+    return (pos > 0 && path[pos] == ':' && path[pos - 1] == '/');
+}
+
+static wstk_status_t tree_insert(router_node_t *root, const char *path, void *value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    router_node_t *node = root, *child = NULL, *mid = NULL, **link = NULL;
+    size_t len = strlen(path), pos = 0, end = 0, k = 0;
+    uint32_t params = 0;
+
+    while(pos < len) {
+        if(path_is_param(path, pos)) {
+            for(end = pos + 1; end < len && path[end] != '/'; end++);
+            if(end == pos + 1 || ++params > WSTK_HTTPD_ROUTER_PARAMS_MAX) {
+                return WSTK_STATUS_INVALID_PARAM;
+            }
+
+            if(!node->param_child) {
+                if((status = node_create(&node->param_child, path + pos + 1, end - pos - 1, true)) != WSTK_STATUS_SUCCESS) {
+                    return status;
+                }
+            } else if(node->param_child->label_len != end - pos - 1 || memcmp(node->param_child->label, path + pos + 1, end - pos - 1)) {
+                log_error("Conflicting route params: ':%s' and '%s'", node->param_child->label, path);
+                return WSTK_STATUS_INVALID_PARAM;
+            }
+
+            node = node->param_child;
+            pos = end;
+            continue;
+        }
+
+        /* the static part up to the next param */
+        for(end = pos + 1; end < len && !path_is_param(path, end); end++);
+
+        for(link = &node->children; *link; link = &(*link)->next) {
+            if((*link)->label[0] == path[pos]) { break; }
+        }
+        if(!(child = *link)) {
+            if((status = node_create(link, path + pos, end - pos, false)) != WSTK_STATUS_SUCCESS) {
+                return status;
+            }
+            node = *link;
+            pos = end;
+            continue;
+        }
+
+        for(k = 1; k < child->label_len && pos + k < end && child->label[k] == path[pos + k]; k++);
+        if(k < child->label_len) {
+            /* split the edge: mid(label[0..k]) -> child(label[k..]) */
+            if((status = node_create(&mid, child->label, k, false)) != WSTK_STATUS_SUCCESS) {
+                return status;
+            }
+            memmove(child->label, child->label + k, child->label_len - k + 1);
+            child->label_len -= k;
+
+            mid->next = child->next;
+            child->next = NULL;
+            mid->children = child;
+            *link = mid;
+            child = mid;
+        }
+
+        node = child;
+        pos += k;
+    }
+
+    if(node->value) {
+        return WSTK_STATUS_ALREADY_EXISTS;
+    }
+
+    node->value = wstk_mem_ref(value);
+    node->fl_prefix = (len > 1 && path[len - 1] == '/');
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* build a new tree from the routes (+ an extra one or - the excluded one) */
+static wstk_status_t tree_build(wstk_httpd_router_t *router, router_node_t **root, const char *extra_path, void *extra_value, const char *excluded_path) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_hash_index_t *hidx = NULL;
+    router_node_t *root_local = NULL;
+    const char *path = NULL;
+    void *value = NULL;
+
+    if((status = node_create(&root_local, "", 0, false)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    for(hidx = wstk_hash_first_iter(router->routes, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
+        wstk_hash_this(hidx, (void *)&path, NULL, (void *)&value);
+        if(excluded_path && !strcmp(path, excluded_path)) {
+            continue;
+        }
+        if((status = tree_insert(root_local, path, value)) != WSTK_STATUS_SUCCESS) {
+            wstk_hash_iter_free(hidx);
+            goto out;
+        }
+    }
+    if(extra_path) {
+        if((status = tree_insert(root_local, extra_path, extra_value)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+    }
+
+    if(!root_local->children && !root_local->param_child && !root_local->value) {
+        root_local = wstk_mem_deref(root_local);
+    }
+
+    *root = root_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(root_local);
+    }
+    return status;
+}
+
+/* should be called under the lock, drops the old tree when nobody reads it */
+static void tree_publish(wstk_httpd_router_t *router, router_node_t *root) {
+    router_node_t *old = router->root;
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t i = 0, e = 0, spins = 0;
+
+    wstk_atomic_seq_set(&router->root, root);
+
+    /* a reader of the old tree is counted in one of the slots since it's taken it, flipping the epoch keeps the new readers off the drained slot */
+    for(i = 0; i < 2; i++) {
+        e = router->epoch;
+        wstk_atomic_seq_set(&router->epoch, e ^ 1);
+        while(wstk_atomic_seq(&router->readers[e & 1]) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
+        }
+    }
+#else
+    router->root = root;
+#endif
+
+    wstk_mem_deref(old);
+}
+
+static void match_take(router_match_t *m, router_node_t *node, size_t pos) {
+    m->best = node;
+    m->best_len = pos;
+    m->best_params_count = m->params_count;
+    if(m->params_count) {
+        memcpy(m->best_params_nodes, m->params_nodes, m->params_count * sizeof(router_node_t *));
+        memcpy(m->best_params_values, m->params_values, m->params_count * sizeof(wstk_pl_t));
+    }
+}
+
+/* true on the exact match, otherwise keeps the longest prefix match in m->best */
+static bool match_node(router_match_t *m, router_node_t *node, size_t pos) {
+    router_node_t *child = NULL;
+    size_t end = 0;
+
+    if(node->value) {
+        if(pos == m->len) {
+            match_take(m, node, pos);
+            return true;
+        }
+        if(node->fl_prefix && (!m->best || pos > m->best_len)) {
+            match_take(m, node, pos);
+        }
+    }
+    if(pos >= m->len) {
+        return false;
+    }
+
+    for(child = node->children; child; child = child->next) {
+        if(child->label[0] != m->path[pos]) {
+            continue;
+        }
+        if(child->label_len <= m->len - pos && !memcmp(child->label, m->path + pos, child->label_len)) {
+            if(match_node(m, child, pos + child->label_len)) {
+                return true;
+            }
+        }
+        break;
+    }
+
+    if(node->param_child && pos > 0 && m->path[pos - 1] == '/' && m->params_count < WSTK_HTTPD_ROUTER_PARAMS_MAX) {
+        for(end = pos; end < m->len && m->path[end] != '/'; end++);
+        if(end > pos) {
+            m->params_nodes[m->params_count] = node->param_child;
+            m->params_values[m->params_count].p = m->path + pos;
+            m->params_values[m->params_count].l = end - pos;
+            m->params_count++;
+
+            if(match_node(m, node->param_child, end)) {
+                return true;
+            }
+            m->params_count--;
+        }
+    }
+
+    return false;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// public
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/**
+ * Create a new router
+ *
+ * @param router - the router
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_router_create(wstk_httpd_router_t **router) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_httpd_router_t *router_local = NULL;
+
+    if(!router) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&router_local, sizeof(wstk_httpd_router_t), desctuctor__wstk_httpd_router_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_mutex_create(&router_local->mutex)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_hash_init(&router_local->routes)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    *router = router_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(router_local);
+    }
+    return status;
+}
+
+/**
+ * Add a route
+ * the value should be a wstk_mem object, it's owned by the router on success (released by wstk_httpd_router_del)
+ *
+ * @param router    - the router
+ * @param path      - '/path', '/path/' (the subtree) or with ':name' segments ('/users/:id/')
+ * @param value     - the route value
+ *
+ * @return sucesss, WSTK_STATUS_ALREADY_EXISTS, WSTK_STATUS_INVALID_PARAM (bad or conflicting params) or some error
+ **/
+wstk_status_t wstk_httpd_router_add(wstk_httpd_router_t *router, const char *path, void *value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    router_node_t *root = NULL;
+
+    if(!router || !path || !value || *path != '/') {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(router->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(router->mutex);
+    if(wstk_hash_find(router->routes, path)) {
+        status = WSTK_STATUS_ALREADY_EXISTS;
+        goto out;
+    }
+    if((status = tree_build(router, &root, path, value, NULL)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_hash_insert_ex(router->routes, path, value, true)) != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(root);
+        goto out;
+    }
+    tree_publish(router, root);
+out:
+    wstk_mutex_unlock(router->mutex);
+    return status;
+}
+
+/**
+ * Remove a route
+ * the value is released when the current readers are done
+ *
+ * @param router    - the router
+ * @param path      - the same as it was added
+ * @param value     - the removed value (referenced, should be released by wstk_mem_deref) or NULL
+ *
+ * @return sucesss, WSTK_STATUS_NOT_FOUND or some error
+ **/
+wstk_status_t wstk_httpd_router_del(wstk_httpd_router_t *router, const char *path, void **value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    router_node_t *root = NULL;
+    void *value_local = NULL;
+
+    if(!router || !path) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(router->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(router->mutex);
+    if(!(value_local = wstk_hash_find(router->routes, path))) {
+        status = WSTK_STATUS_NOT_FOUND;
+        goto out;
+    }
+    if((status = tree_build(router, &root, NULL, NULL, path)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(value) {
+        *value = wstk_mem_ref(value_local);
+    }
+    tree_publish(router, root);
+    wstk_hash_delete(router->routes, path);
+out:
+    wstk_mutex_unlock(router->mutex);
+    return status;
+}
+
+/**
+ * Find the route for a request path
+ * lock free (if there are atomics), the longest match wins
+ *
+ * @param router        - the router
+ * @param path          - request path
+ * @param arena         - the param names are copied there (can be NULL if params is NULL)
+ * @param params        - ':name' params (values point to the path) or NULL
+ * @param params_count  - in: params size, out: found params
+ * @param value         - the route value (referenced, should be released by wstk_mem_deref)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_FOUND or some error
+ **/
+wstk_status_t wstk_httpd_router_lookup(wstk_httpd_router_t *router, const char *path, wstk_arena_t *arena, wstk_http_hdr_t *params, uint32_t *params_count, void **value) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    router_match_t match = { 0 };
+    router_node_t *root = NULL;
+    uint32_t i = 0, n = 0;
+    char *name = NULL;
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t e = 0;
+#endif
+
+    if(!router || !path || !value) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(params && (!params_count || !arena)) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(router->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    match.path = path;
+    match.len = strlen(path);
+
+#ifdef WSTK_HAVE_ATOMIC
+    if(!wstk_atomic_acq(&router->root)) {
+        return WSTK_STATUS_NOT_FOUND;
+    }
+    e = wstk_atomic_seq(&router->epoch) & 1;
+    wstk_atomic_seq_add(&router->readers[e], 1);
+    root = wstk_atomic_seq(&router->root);
+#else
+    wstk_mutex_lock(router->mutex);
+    root = router->root;
+#endif
+
+    if(root) {
+        match_node(&match, root, 0);
+    }
+    if(!match.best) {
+        status = WSTK_STATUS_NOT_FOUND;
+        goto out;
+    }
+
+    *value = wstk_mem_ref(match.best->value);
+
+    if(params) {
+        n = MIN(*params_count, match.best_params_count);
+        for(i = 0; i < n; i++) {
+            if(wstk_arena_strndup(arena, &name, match.best_params_nodes[i]->label, match.best_params_nodes[i]->label_len) != WSTK_STATUS_SUCCESS) {
+                break;
+            }
+            params[i].name.p = name;
+            params[i].name.l = match.best_params_nodes[i]->label_len;
+            params[i].value = match.best_params_values[i];
+        }
+        *params_count = i;
+    }
+
+out:
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_seq_sub(&router->readers[e], 1);
+#else
+    wstk_mutex_unlock(router->mutex);
+#endif
+    if(status != WSTK_STATUS_SUCCESS && params_count) {
+        *params_count = 0;
+    }
+    return status;
+}
+
+/**
+ * Check the routes
+ *
+ * @param router - the router
+ *
+ * @return true if there are no routes
+ **/
+bool wstk_httpd_router_is_empty(wstk_httpd_router_t *router) {
+    if(!router || router->fl_destroyed) {
+        return true;
+    }
+#ifdef WSTK_HAVE_ATOMIC
+    return (wstk_atomic_acq(&router->root) == NULL);
+#else
+    bool empty = false;
+    wstk_mutex_lock(router->mutex);
+    empty = (router->root == NULL);
+    wstk_mutex_unlock(router->mutex);
+    return empty;
+#endif
+}
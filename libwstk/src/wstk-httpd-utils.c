@@ -10,20 +10,21 @@
 #include <wstk-mbuf.h>
 #include <wstk-str.h>
 #include <wstk-time.h>
+#include <wstk-fmt.h>
 #include <wstk-dir.h>
 
 typedef struct {
     wstk_httpd_t     *httpd;
-    wstk_socket_t    *sock;
+    wstk_http_conn_t *conn;
 } dir_browser_cb_opt_t;
 
 static wstk_status_t xxx_dir_entry_print(wstk_dir_entry_t *dirent, void *udata) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     dir_browser_cb_opt_t *opt = (dir_browser_cb_opt_t *)udata;
-    wstk_socket_t *sock = opt->sock;
+    wstk_http_conn_t *conn = opt->conn;
     char tbuf[128] = {0};
 
-    if(!sock) {
+    if(!conn) {
         return WSTK_STATUS_FALSE;
     }
 
@@ -32,9 +33,9 @@ static wstk_status_t xxx_dir_entry_print(wstk_dir_entry_t *dirent, void *udata)
     }
 
     if(dirent->directory) {
-        status = wstk_tcp_printf(sock, "<tr><td width=\"100%%\"><a href=\"%s/\">%s/</a></td><td>%s</td><td aling=\"right\">---</td></tr>\n", dirent->name, dirent->name, (char *)tbuf);
+        status = wstk_httpd_printf(conn, "<tr><td width=\"100%%\"><a href=\"%s/\">%s/</a></td><td>%s</td><td aling=\"right\">---</td></tr>\n", dirent->name, dirent->name, (char *)tbuf);
     } else {
-        status = wstk_tcp_printf(sock, "<tr><td width=\"100%%\"><a href=\"%s\">%s</a></td><td>%s</td><td aling=\"right\">%d</td></tr>\n", dirent->name, dirent->name, (char *)tbuf, dirent->size);
+        status = wstk_httpd_printf(conn, "<tr><td width=\"100%%\"><a href=\"%s\">%s</a></td><td>%s</td><td aling=\"right\">%d</td></tr>\n", dirent->name, dirent->name, (char *)tbuf, dirent->size);
     }
 
 out:
@@ -47,11 +48,15 @@ out:
 const char *wstk_httpd_reason_by_code(uint32_t scode) {
     switch(scode) {
         case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
         case 400: return "Bad request";
         case 401: return "Unauthorized";
         case 403: return "Forbidden";
         case 404: return "Not found";
         case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
         case 500: return "Internal Server Error";
         case 501: return "Not Implemented";
         case 503: return "Service Unavailable";
@@ -108,6 +113,108 @@ wstk_status_t wstk_httpd_content_type_by_file_ext(wstk_httpd_ctype_info_t *ctype
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Make the entity tag of a file (quoted, the mtime and the size in hex)
+ *
+ * @param buf       - the result
+ * @param buf_len   - buffer size
+ * @param size      - file size
+ * @param mtime     - modification time
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_etag(char *buf, size_t buf_len, size_t size, time_t mtime) {
+    int len = 0;
+
+    if(!buf || !buf_len) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    len = wstk_snprintf(buf, buf_len, "\"%llx-%zx\"", (unsigned long long)mtime, size);
+    return (len > 0 && len < buf_len ? WSTK_STATUS_SUCCESS : WSTK_STATUS_NOSPACE);
+}
+
+/**
+ * Get the content codings accepted by the request (Accept-Encoding)
+ * the ones with q=0 are refused, '*' means any
+ *
+ * @param msg       - the request
+ *
+ * @return WSTK_HTTPD_CODING_* mask
+ **/
+uint32_t wstk_httpd_accepted_codings(wstk_http_msg_t *msg) {
+    const char *ptr = NULL, *end = NULL, *tok = NULL, *tok_end = NULL, *q = NULL;
+    uint32_t result = 0, coding = 0;
+    size_t tlen = 0;
+
+    if(!msg || !msg->hdr_common[WSTK_HTTP_HDR_ACCEPT_ENCODING].l) {
+        return 0;
+    }
+
+    ptr = msg->hdr_common[WSTK_HTTP_HDR_ACCEPT_ENCODING].p;
+    end = ptr + msg->hdr_common[WSTK_HTTP_HDR_ACCEPT_ENCODING].l;
+    while(ptr < end) {
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == ',')) { ptr++; }
+        for(tok = ptr; ptr < end && *ptr != ',' && *ptr != ';' && *ptr != ' ' && *ptr != '\t'; ptr++);
+        tok_end = ptr;
+
+        /* the weight: q=0, q=0.0, ... */
+        for(q = NULL; ptr < end && *ptr != ','; ptr++) {
+            if(!q && (*ptr == 'q' || *ptr == 'Q') && ptr + 1 < end && ptr[1] == '=') { q = ptr + 2; }
+        }
+
+        tlen = (tok_end - tok);
+        if(!tlen) {
+            continue;
+        }
+        if((tlen == 4 && strncasecmp(tok, "gzip", 4) == 0) || (tlen == 6 && strncasecmp(tok, "x-gzip", 6) == 0)) {
+            coding = WSTK_HTTPD_CODING_GZIP;
+        } else if(tlen == 7 && strncasecmp(tok, "deflate", 7) == 0) {
+            coding = WSTK_HTTPD_CODING_DEFLATE;
+        } else if(tlen == 2 && strncasecmp(tok, "br", 2) == 0) {
+            coding = WSTK_HTTPD_CODING_BR;
+        } else if(tlen == 1 && *tok == '*') {
+            coding = (WSTK_HTTPD_CODING_GZIP | WSTK_HTTPD_CODING_DEFLATE | WSTK_HTTPD_CODING_BR);
+        } else {
+            continue;
+        }
+
+        if(q && *q == '0') {
+            for(q++; q < end && (*q == '.' || *q == '0'); q++);
+            if(q >= end || *q < '1' || *q > '9') {
+                result &= ~coding;
+                continue;
+            }
+        }
+        result |= coding;
+    }
+
+    return result;
+}
+
+/**
+ * Is it worth to compress the content of the type (text, json, xml, javascript, svg)
+ *
+ * @param ctype     - content type
+ *
+ * @return true/false
+ **/
+bool wstk_httpd_ctype_is_compressible(const char *ctype) {
+    if(!ctype) {
+        return false;
+    }
+    if(strncasecmp(ctype, "text/", 5) == 0) {
+        return true;
+    }
+    if(strncasecmp(ctype, "application/", 12) == 0) {
+        return (wstk_strstr(ctype, "json") || wstk_strstr(ctype, "javascript") || wstk_strstr(ctype, "xml"));
+    }
+    if(strncasecmp(ctype, "image/svg", 9) == 0) {
+        return true;
+    }
+    return false;
+}
+
 bool wstk_httpd_is_valid_filename(char *filename, size_t len) {
     bool result = true;
     uint32_t ofs = 0;
@@ -155,44 +262,28 @@ bool wstk_httpd_is_valid_path(char *path, size_t len) {
 wstk_status_t wstk_httpd_browse_dir(wstk_http_conn_t *conn, char *dir, char *title, char *ctype, wstk_pl_t *charset) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     dir_browser_cb_opt_t cb_opt = {0};
-    wstk_socket_t *sock = NULL;
-    const char *keep_alive_str;
 
     if(!conn || !dir) {
         return WSTK_STATUS_INVALID_PARAM;
     }
 
-    if((status = wstk_tcp_srv_conn_socket(conn->tcp_conn, &sock)) != WSTK_STATUS_SUCCESS) {
-        return status;
-    }
-    if(!sock) {
-        return WSTK_STATUS_FALSE;
-    }
-
     cb_opt.httpd = conn->server;
-    cb_opt.sock = sock;
-
-    // header
-    keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
-    status = wstk_httpd_reply(conn, 200, "OK",
-                        "Connection: %s\r\n"
-                        "Content-Type: %s\r\n"
-                        "\r\n",
-                        keep_alive_str,
-                        ctype
-            );
+    cb_opt.conn = conn;
+
+    // header (the length isn't known, so the list is streamed)
+    status = wstk_httpd_stream_begin(conn, 200, "OK", ctype);
     if(status != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
     // body
-    status = wstk_tcp_printf(sock, "<html>\n<head><title>Index of %s</title>\n<style>\ntable, th, td {border: 1px solid black; border-collapse: collapse; white-space: nowrap;}\n</style>\n</head>\n<body>\n", title);
+    status = wstk_httpd_printf(conn, "<html>\n<head><title>Index of %s</title>\n<style>\ntable, th, td {border: 1px solid black; border-collapse: collapse; white-space: nowrap;}\n</style>\n</head>\n<body>\n", title);
     if(status != WSTK_STATUS_SUCCESS) { goto html_end; }
 
-    status = wstk_tcp_printf(sock, "<h1>Index of %s</h1><table width=\"100%%\"><tr><th>Name</th><th>Date</th><th>Size</th></tr>\n", title);
+    status = wstk_httpd_printf(conn, "<h1>Index of %s</h1><table width=\"100%%\"><tr><th>Name</th><th>Date</th><th>Size</th></tr>\n", title);
     if(status != WSTK_STATUS_SUCCESS) { goto html_end; }
 
-    status = wstk_tcp_printf(sock, "<tr><td colspan=\"2\"><a href=\"../\">../</a></td></tr>\n");
+    status = wstk_httpd_printf(conn, "<tr><td colspan=\"2\"><a href=\"../\">../</a></td></tr>\n");
     if(status != WSTK_STATUS_SUCCESS) { goto html_end; }
 
     status = wstk_dir_list(dir, WSTK_PATH_DELIMITER, xxx_dir_entry_print, &cb_opt);
@@ -200,15 +291,20 @@ wstk_status_t wstk_httpd_browse_dir(wstk_http_conn_t *conn, char *dir, char *tit
 
 html_end:
     if(status != WSTK_STATUS_SUCCESS) {
-        wstk_tcp_printf(sock, "\n<br>*** ERROR ***\n<br>");
+        wstk_httpd_printf(conn, "\n<br>*** ERROR ***\n<br>");
         status = WSTK_STATUS_SUCCESS;
     }
-    wstk_tcp_printf(sock, "</table></body>\n</html>\n");
+    wstk_httpd_printf(conn, "</table></body>\n</html>\n");
+    status = wstk_httpd_stream_end(conn);
 out:
     return status;
 }
 
 
+static void desctuctor__wstk_httpd_sec_ctx_t(void *ptr) {
+    wstk_httpd_sec_ctx_clean((wstk_httpd_sec_ctx_t *)ptr);
+}
+
 /**
  * helper to clean ctx
  *
@@ -230,6 +326,7 @@ wstk_status_t wstk_httpd_sec_ctx_clean(wstk_httpd_sec_ctx_t *sec_ctx) {
 
 /**
  * helper to clone ctx
+ * (the clone is cleaned on the last deref, so the holders of a reference see it whole)
  *
  **/
 wstk_status_t wstk_httpd_sec_ctx_clone(wstk_httpd_sec_ctx_t **new_ctx, wstk_httpd_sec_ctx_t *sec_ctx) {
@@ -240,7 +337,7 @@ wstk_status_t wstk_httpd_sec_ctx_clone(wstk_httpd_sec_ctx_t **new_ctx, wstk_http
         return WSTK_STATUS_INVALID_PARAM;
     }
 
-    status = wstk_mem_zalloc((void *)&lctx, sizeof(wstk_httpd_sec_ctx_t), NULL);
+    status = wstk_mem_zalloc((void *)&lctx, sizeof(wstk_httpd_sec_ctx_t), desctuctor__wstk_httpd_sec_ctx_t);
     if(status != WSTK_STATUS_SUCCESS) {
         return status;
     }
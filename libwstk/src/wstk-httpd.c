@@ -8,6 +8,7 @@
 #include <wstk-tcp-srv.h>
 #include <wstk-net.h>
 #include <wstk-mem.h>
+#include <wstk-arena.h>
 #include <wstk-mbuf.h>
 #include <wstk-pl.h>
 #include <wstk-str.h>
@@ -23,10 +24,21 @@
 #include <wstk-time.h>
 #include <wstk-file.h>
 #include <wstk-dir.h>
+#include <wstk-rand.h>
+#include <wstk-deflate.h>
 
 #define HTTPD_READ_BUFFER_SIZE          8192
 #define HTTPD_WRITE_BUFFER_SIZE         8192
+#define HTTPD_WRITE_BUFFER_MAX          65536   // the collected replies are flushed when the buffer gets bigger
+#define HTTPD_WRITE_TIMEOUT             10      // seconds, waiting for the socket to be writable
 #define HTTPD_BLOB_WRITE_BUFFER_SIZE    16384
+#define HTTPD_SENDFILE_CHUNK_SIZE       1048576
+#define HTTPD_RANGES_MAX                16      // the requests with more ranges get the whole entity
+#define HTTPD_ARENA_SIZE                4096
+#define HTTPD_BODY_BUFFER_MAX           65536   // smaller bodies are collected in the connection buffer before the request performs
+#define HTTPD_CHUNKED_BODY_MAX          1048576 // the chunked bodies are always collected, the bigger ones are rejected
+#define HTTPD_CHUNK_HDR_SIZE            10      // the reserved chunk header: 8 hex digits + CRLF
+#define HTTPD_VARY_HDR                  "Vary: Accept-Encoding\r\n"
 
 #define HTTPD_DEFAULT_SERVER_ID         "wstk-httpd/1.x"
 #define HTTPD_DEFAULT_CHARSET           "UTF-8"
@@ -40,17 +52,21 @@ static wstk_pl_t scheme_https = WSTK_PL("https");
 
 struct wstk_httpd_s {
     wstk_mutex_t                        *mutex;
-    wstk_hash_t                         *servlets;
+    wstk_httpd_router_t                 *servlets;      // path => servlet_container_t
     wstk_tcp_srv_t                      *tcp_server;
+    wstk_httpd_cache_t                  *cache;         // static content cache (see wstk_httpd_set_cache)
     const char                          *ident;
     char                                *charset;
     char                                *html_ctype;
     char                                *www_home;
     char                                *welcome_page;
     wstk_httpd_authentication_handler_t auth_handler;
+    size_t                              compress_min;   // the replies from this size are compressed (0 = never, see wstk_httpd_set_compression)
+    int                                 compress_level; //
     uint32_t                            id;
     uint32_t                            refs;
     bool                                allow_dir_browse;
+    bool                                fl_precompressed; // serve file.br / file.gz instead of file if the client accepts it
     bool                                fl_destroyed;
     bool                                fl_ready;
 };
@@ -66,9 +82,91 @@ typedef struct {
     bool                                fl_adestroy_udata;
 } servlet_container_t;
 
+typedef struct {
+    size_t                              start;
+    size_t                              len;
+} http_range_t;
+
+static wstk_status_t http_flush(wstk_http_conn_t *conn);
+static wstk_status_t stream_chunk_close(wstk_http_conn_t *conn);
+static wstk_status_t http_cached_reply(wstk_http_conn_t *conn, wstk_http_msg_t *msg, wstk_httpd_cache_entry_t *entry);
+static wstk_status_t http_breply(wstk_http_conn_t *conn, wstk_http_msg_t *msg, uint32_t scode, const char *reason, const char *ctype, const char *xhdrs, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, wstk_httpd_blob_seek_callback_t scallback, void *udata);
+static bool http_is_not_modified(wstk_http_msg_t *msg, const char *etag, time_t mtime);
+
+/* refs are atomic where it's possible, the destructors wait for 0 */
+static wstk_status_t scontainer_refs(servlet_container_t *container) {
+    if(!container || container->fl_destroyed)  {
+        return WSTK_STATUS_FALSE;
+    }
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&container->refs, 1);
+#else
+    if(container->mutex) {
+        wstk_mutex_lock(container->mutex);
+        container->refs++;
+        wstk_mutex_unlock(container->mutex);
+    }
+#endif
+    return WSTK_STATUS_SUCCESS;
+}
+static void scontainer_derefs(servlet_container_t *container) {
+    if(!container)  { return; }
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&container->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&container->refs, &v, v - 1));
+#else
+    if(container->mutex) {
+        wstk_mutex_lock(container->mutex);
+        if(container->refs > 0) container->refs--;
+        wstk_mutex_unlock(container->mutex);
+    }
+#endif
+}
+static uint32_t scontainer_refs_count(servlet_container_t *container) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&container->refs);
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(container->mutex);
+    refs = container->refs;
+    wstk_mutex_unlock(container->mutex);
+    return refs;
+#endif
+}
+static void srv_refs(wstk_httpd_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&srv->refs, 1);
+#else
+    wstk_mutex_lock(srv->mutex);
+    srv->refs++;
+    wstk_mutex_unlock(srv->mutex);
+#endif
+}
+static void srv_derefs(wstk_httpd_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&srv->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&srv->refs, &v, v - 1));
+#else
+    wstk_mutex_lock(srv->mutex);
+    if(srv->refs) srv->refs--;
+    wstk_mutex_unlock(srv->mutex);
+#endif
+}
+static uint32_t srv_refs_count(wstk_httpd_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&srv->refs);
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(srv->mutex);
+    refs = srv->refs;
+    wstk_mutex_unlock(srv->mutex);
+    return refs;
+#endif
+}
+
 static void desctuctor__servlet_container_t(void *ptr) {
     servlet_container_t *container = (servlet_container_t *)ptr;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!container || container->fl_destroyed) {
         return;
@@ -76,23 +174,15 @@ static void desctuctor__servlet_container_t(void *ptr) {
     container->fl_destroyed = true;
 
 #ifdef WSTK_HTTPD_DEBUG
-    WSTK_DBG_PRINT("destroying container: container=%p (srv=%p, refs=%d, handler=%p, udate=%p, adestroy_udata=%d)", container, container->server, container->refs, container->handler, container->udata, container->fl_adestroy_udata);
+    WSTK_DBG_PRINT("destroying container: container=%p (srv=%p, refs=%d, handler=%p, udate=%p, adestroy_udata=%d)", container, container->server, scontainer_refs_count(container), container->handler, container->udata, container->fl_adestroy_udata);
 #endif
 
     if(container->mutex) {
-        while(floop) {
-            wstk_mutex_lock(container->mutex);
-            floop = (container->refs > 0);
-            wstk_mutex_unlock(container->mutex);
-
-            WSTK_SCHED_YIELD(0);
+        while(scontainer_refs_count(container) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
         }
     }
 
-    if(container->refs) {
-        log_warn("Lost references (refs=%d)", container->refs);
-    }
-
     if(container->udata && container->fl_adestroy_udata) {
         container->udata = wstk_mem_deref(container->udata);
     }
@@ -115,6 +205,9 @@ static void desctuctor__wstk_http_conn_t(void *ptr) {
     WSTK_DBG_PRINT("destroying connection: http-conn=%p (srv=%p, tcp-conn=%p)", conn, conn->server, conn->tcp_conn);
 #endif
 
+    conn->arena = wstk_mem_deref(conn->arena);
+    conn->obuf = wstk_mem_deref(conn->obuf);
+
 #ifdef WSTK_HTTPD_DEBUG
     WSTK_DBG_PRINT("connection destroyed: http-conn=%p", conn);
 #endif
@@ -122,7 +215,7 @@ static void desctuctor__wstk_http_conn_t(void *ptr) {
 
 static void desctuctor__wstk_httpd_t(void *ptr) {
     wstk_httpd_t *srv = (wstk_httpd_t *)ptr;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!srv || srv->fl_destroyed) {
         return;
@@ -132,36 +225,25 @@ static void desctuctor__wstk_httpd_t(void *ptr) {
     srv->fl_destroyed = true;
 
 #ifdef WSTK_HTTPD_DEBUG
-    WSTK_DBG_PRINT("destroying server: srv=%p (refs=%d)", srv, srv->refs);
+    WSTK_DBG_PRINT("destroying server: srv=%p (refs=%d)", srv, srv_refs_count(srv));
 #endif
     if(srv->tcp_server) {
         srv->tcp_server = wstk_mem_deref(srv->tcp_server);
     }
 
     if(srv->mutex) {
-        while(floop) {
-            wstk_mutex_lock(srv->mutex);
-            floop = (srv->refs > 0);
-            wstk_mutex_unlock(srv->mutex);
-
-            WSTK_SCHED_YIELD(0);
+        while(srv_refs_count(srv) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
         }
     }
 
-    if(srv->refs) {
-        log_warn("Lost references (refs=%d)", srv->refs);
-    }
-
-    if(srv->servlets) {
-        wstk_mutex_lock(srv->mutex);
-        srv->servlets = wstk_mem_deref(srv->servlets);
-        wstk_mutex_unlock(srv->mutex);
-    }
+    srv->servlets = wstk_mem_deref(srv->servlets);
 
     srv->welcome_page = wstk_mem_deref(srv->welcome_page);
     srv->www_home = wstk_mem_deref(srv->www_home);
     srv->charset = wstk_mem_deref(srv->charset);
     srv->html_ctype = wstk_mem_deref(srv->html_ctype);
+    srv->cache = wstk_mem_deref(srv->cache);
     srv->mutex = wstk_mem_deref(srv->mutex);
 
 #ifdef WSTK_HTTPD_DEBUG
@@ -169,40 +251,361 @@ static void desctuctor__wstk_httpd_t(void *ptr) {
 #endif
 }
 
-static wstk_status_t scontainer_refs(servlet_container_t *container) {
-    if(!container || container->fl_destroyed)  {
+/* the same as wstk_file_name_concat but in the request arena */
+static wstk_status_t req_file_name_concat(wstk_arena_t *arena, char **path, const char *dir, const char *file) {
+    const char *fname_ptr = file;
+    size_t len = strlen(dir);
+
+    while(*fname_ptr && *fname_ptr == WSTK_PATH_DELIMITER) {
+        fname_ptr++;
+    }
+    if(!*fname_ptr) {
         return WSTK_STATUS_FALSE;
     }
-    if(container->mutex) {
-        wstk_mutex_lock(container->mutex);
-        container->refs++;
-        wstk_mutex_unlock(container->mutex);
+
+    if(len > 1 && dir[len - 1] == WSTK_PATH_DELIMITER) {
+        return wstk_arena_printf(arena, path, "%s%s", dir, fname_ptr);
     }
-    return WSTK_STATUS_SUCCESS;
+    return wstk_arena_printf(arena, path, "%s%c%s", dir, WSTK_PATH_DELIMITER, fname_ptr);
 }
-static void scontainer_derefs(servlet_container_t *container) {
-    if(!container)  { return; }
-    if(container->mutex) {
-        wstk_mutex_lock(container->mutex);
-        if(container->refs > 0) container->refs--;
-        wstk_mutex_unlock(container->mutex);
+
+/* the precompressed sibling of the file (file.gz, file.br) */
+static bool req_file_sibling(wstk_arena_t *arena, char **sfile, wstk_file_meta_t *smeta, const char *file, const char *ext) {
+    if(wstk_arena_printf(arena, sfile, "%s%s", file, ext) != WSTK_STATUS_SUCCESS) {
+        return false;
+    }
+    if(wstk_file_get_meta(*sfile, smeta) != WSTK_STATUS_SUCCESS || smeta->isdir) {
+        return false;
     }
+    return true;
 }
 
-static void tcp_handler(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf) {
-    wstk_status_t st = WSTK_STATUS_SUCCESS;
-    wstk_tcp_srv_t *tcp_srv = NULL;
-    wstk_http_conn_t *http_conn = NULL;
-    wstk_httpd_t *httpd = NULL;
+/* performs one request from mbuf[pos], on return pos points to the next one (or stays if the request is incomplete) */
+static wstk_status_t http_perform(wstk_httpd_t *httpd, wstk_http_conn_t *http_conn, wstk_mbuf_t *mbuf) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_tcp_srv_conn_t *conn = http_conn->tcp_conn;
     wstk_http_msg_t *http_msg = NULL;
     servlet_container_t *scontainer = NULL;
-    wstk_file_meta_t file_meta = { 0 };
+    wstk_httpd_cache_entry_t *centry = NULL;
+    wstk_file_meta_t file_meta = { 0 }, sfile_meta = { 0 };
     wstk_file_t blobf = { 0 };
     wstk_httpd_ctype_info_t ctype_info = { 0 };
     char ctype_buffer_st[255] = {0};
     char *ctype_ptr = NULL;
-    char *req_path = NULL, *req_file = NULL;
+    char *req_path = NULL, *req_file = NULL, *sfile = NULL, *cache_key = NULL;
+    const char *cenc = NULL, *xhdrs = NULL;
+    uint32_t codings = 0, cflags = 0;
+    size_t buf_end = wstk_mbuf_end(mbuf), msg_start = wstk_mbuf_pos(mbuf), msg_end = 0;
+    size_t body_len = 0, enc_len = 0;
     bool fl_try_to_list_dir = false;
+    bool fl_close = false;
+    bool fl_cache = false;
+    bool fl_vary = false;
+
+    /* decode http message */
+    if(wstk_http_msg_alloc(&http_msg) != WSTK_STATUS_SUCCESS) {
+        log_error("Unbable to allocate memory (http_msg)");
+        wstk_tcp_srv_conn_close(conn);
+        wstk_goto_status(WSTK_STATUS_MEM_FAIL, out);
+    }
+
+    http_msg->arena = http_conn->arena;
+    http_msg->hdr_scan = http_conn->hdr_scan;
+
+    status = wstk_http_msg_decode(http_msg, mbuf);
+    if(status == WSTK_STATUS_NODATA) {
+        http_conn->hdr_scan = http_msg->hdr_scan;
+        goto out;
+    }
+    http_conn->hdr_scan = 0;
+
+    if(status != WSTK_STATUS_SUCCESS) {
+        log_error("Unbable to decode HTTP message (err=%d)", (int)status);
+        wstk_tcp_srv_conn_close(conn);
+        wstk_httpd_ereply(http_conn, 400, NULL);
+        goto out;
+    }
+
+    /* the chunked body is collected and joined in the buffer, the handler sees it as a usual one */
+    if(http_msg->hdr_common[WSTK_HTTP_HDR_TRANSFER_ENCODING].l) {
+        if(!wstk_http_msg_header_has_token(http_msg, WSTK_HTTP_HDR_TRANSFER_ENCODING, "chunked")) {
+            wstk_tcp_srv_conn_close(conn);
+            wstk_httpd_ereply(http_conn, 501, NULL);
+            goto out;
+        }
+        status = wstk_http_msg_chunked_decode(mbuf, &body_len, &enc_len);
+        if(status == WSTK_STATUS_NODATA) {
+            if(buf_end - wstk_mbuf_pos(mbuf) > HTTPD_CHUNKED_BODY_MAX) {
+                wstk_tcp_srv_conn_close(conn);
+                wstk_httpd_ereply(http_conn, 413, NULL);
+                wstk_goto_status(WSTK_STATUS_NOSPACE, out);
+            }
+            wstk_mbuf_set_pos(mbuf, msg_start);
+            goto out;
+        }
+        if(status != WSTK_STATUS_SUCCESS || body_len > HTTPD_CHUNKED_BODY_MAX) {
+            wstk_tcp_srv_conn_close(conn);
+            wstk_httpd_ereply(http_conn, (status == WSTK_STATUS_SUCCESS ? 413 : 400), NULL);
+            goto out;
+        }
+        http_msg->clen = (uint32_t)body_len;
+        msg_end = wstk_mbuf_pos(mbuf) + enc_len;
+        wstk_mbuf_set_end(mbuf, wstk_mbuf_pos(mbuf) + body_len);
+    } else {
+        /* the body in the buffer: the handler sees only it and the next request follows, otherwise the handler reads the rest */
+        msg_end = wstk_mbuf_pos(mbuf) + http_msg->clen;
+        if(msg_end <= buf_end) {
+            wstk_mbuf_set_end(mbuf, msg_end);
+        } else if(http_msg->clen <= HTTPD_BODY_BUFFER_MAX) {
+            wstk_mbuf_set_pos(mbuf, msg_start);
+            wstk_goto_status(WSTK_STATUS_NODATA, out);
+        } else {
+            msg_end = buf_end;
+        }
+    }
+
+    /* HTTP/1.0 closes by default and knows nothing about the chunks */
+    http_conn->fl_http10 = (wstk_pl_strcmp(&http_msg->version, "1.0") == 0);
+    if(wstk_http_msg_header_has_token(http_msg, WSTK_HTTP_HDR_CONNECTION, "close")) {
+        fl_close = true;
+    } else if(http_conn->fl_http10) {
+        fl_close = !wstk_http_msg_header_has_token(http_msg, WSTK_HTTP_HDR_CONNECTION, "keep-alive");
+    }
+    http_conn->codings = (httpd->compress_min || httpd->fl_precompressed ? wstk_httpd_accepted_codings(http_msg) : 0);
+
+    /* update scheme */
+    http_msg->scheme = (http_conn->tls ? scheme_https : scheme_http);
+
+    /* slightly validate message */
+    if(!http_msg->method.p || http_msg->method.l < 3) {
+        wstk_tcp_srv_conn_close(conn);
+        wstk_httpd_ereply(http_conn, 400, NULL);
+        goto out;
+    }
+
+    if(wstk_arena_alloc(http_conn->arena, (void *)&req_path, http_msg->path.l + 1) != WSTK_STATUS_SUCCESS) {
+        log_error("Unbable to allocate memory (req_path)");
+        wstk_tcp_srv_conn_close(conn);
+        wstk_httpd_ereply(http_conn, 500, NULL);
+        goto out;
+    }
+    if(wstk_unescape2(req_path, http_msg->path.l + 1, http_msg->path.p, http_msg->path.l) != WSTK_STATUS_SUCCESS) {
+        log_error("Unable to unescape request");
+        wstk_tcp_srv_conn_close(conn);
+        wstk_httpd_ereply(http_conn, 500, NULL);
+        goto out;
+    }
+
+    /* lookup for servlet */
+    if(!wstk_httpd_router_is_empty(httpd->servlets)) {
+        char *name_ptr = req_path;
+
+        /* skip exra lead slashes if exists (////...) */
+        if(http_msg->path.l > 1 && name_ptr[1] == '/') {
+            while(name_ptr[1] == '/') { name_ptr++; }
+            if(!name_ptr[1]) {
+                wstk_tcp_srv_conn_close(conn);
+                wstk_httpd_ereply(http_conn, 400, NULL);
+                goto out;
+            }
+        }
+
+        http_msg->path_params_count = ARRAY_SIZE(http_msg->path_params);
+        wstk_httpd_router_lookup(httpd->servlets, name_ptr, http_conn->arena, http_msg->path_params, &http_msg->path_params_count, (void *)&scontainer);
+        if(scontainer && scontainer_refs(scontainer) != WSTK_STATUS_SUCCESS) {
+            scontainer = wstk_mem_deref(scontainer);
+        }
+    }
+
+
+    if(scontainer) {
+#ifdef WSTK_HTTPD_DEBUG
+        WSTK_DBG_PRINT("performing servlet: container=%p (http-conn=%p, handler=%p, udate=%p, path=%s)", scontainer, http_conn, scontainer->handler, scontainer->udata, req_path);
+#endif
+        scontainer->handler(http_conn, http_msg, scontainer->udata);
+        if(http_conn->websock) {
+            wstk_tcp_srv_conn_attr_add(conn, HTTPD_ATTR__WEBSOCK_SERVLET, scontainer, false);
+        }
+        scontainer_derefs(scontainer);
+        wstk_mem_deref(scontainer);
+        goto out;
+    }
+
+    /* browse dir or show file */
+    if(!httpd->www_home) {
+        wstk_httpd_ereply(http_conn, 404, NULL);
+        goto out;
+    }
+
+    /* the compressible content depends on Accept-Encoding, the variants are cached with own keys (path;br,gzip) */
+    if(httpd->compress_min || httpd->fl_precompressed) {
+        wstk_httpd_content_type_by_file_ext(&ctype_info, ((http_msg->path.l == 1 && httpd->welcome_page) ? httpd->welcome_page : req_path));
+        fl_vary = wstk_httpd_ctype_is_compressible(ctype_info.ctype);
+        codings = (fl_vary ? (http_conn->codings & (WSTK_HTTPD_CODING_GZIP | WSTK_HTTPD_CODING_BR)) : 0);
+    }
+    cache_key = req_path;
+    if(codings) {
+        if(wstk_arena_printf(http_conn->arena, &cache_key, "%s;%s%s%s", req_path,
+                    ((codings & WSTK_HTTPD_CODING_BR) ? "br" : ""),
+                    ((codings & WSTK_HTTPD_CODING_BR) && (codings & WSTK_HTTPD_CODING_GZIP) ? "," : ""),
+                    ((codings & WSTK_HTTPD_CODING_GZIP) ? "gzip" : "")) != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 500, NULL);
+            goto out;
+        }
+    }
+
+    /* the hot files are served without touching the filesystem (the partial requests go the usual way) */
+    fl_cache = (httpd->cache && wstk_pl_strcasecmp(&http_msg->method, "GET") == 0 && !http_msg->hdr_common[WSTK_HTTP_HDR_RANGE].l);
+    if(fl_cache) {
+        if(wstk_httpd_cache_lookup(httpd->cache, cache_key, &centry) == WSTK_STATUS_SUCCESS) {
+            if(http_cached_reply(http_conn, http_msg, centry) != WSTK_STATUS_SUCCESS) {
+                wstk_httpd_ereply(http_conn, 500, NULL);
+            }
+            goto out;
+        }
+    }
+
+    if(http_msg->path.l == 1 && http_msg->path.p[0] == '/') {
+        if(httpd->welcome_page) {
+            if(req_file_name_concat(http_conn->arena, &req_file, httpd->www_home, httpd->welcome_page) != WSTK_STATUS_SUCCESS) {
+                wstk_httpd_ereply(http_conn, 404, NULL);
+                goto out;
+            }
+            if(!wstk_file_exists(req_file)) {
+                req_file = httpd->www_home;
+            }
+        } else {
+            if(!httpd->allow_dir_browse) {
+                wstk_httpd_ereply(http_conn, 404, NULL);
+                goto out;
+            }
+        }
+        fl_try_to_list_dir = true;
+    } else {
+        if(req_file_name_concat(http_conn->arena, &req_file, httpd->www_home, req_path) != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 404, NULL);
+            goto out;
+        }
+    }
+
+    if(!wstk_httpd_is_valid_path(req_file, strlen(req_file))) {
+        wstk_httpd_ereply(http_conn, 404, NULL);
+        goto out;
+    }
+
+    if(!wstk_file_exists(req_file)) {
+        if(httpd->allow_dir_browse) {
+            fl_try_to_list_dir = wstk_dir_exists(req_file);
+        }
+        if(!fl_try_to_list_dir) {
+            wstk_httpd_ereply(http_conn, 404, NULL);
+            goto out;
+        }
+    } else {
+        fl_try_to_list_dir = false;
+    }
+
+    if(wstk_pl_strcasecmp(&http_msg->method, "GET") != 0 && (fl_try_to_list_dir || wstk_pl_strcasecmp(&http_msg->method, "HEAD") != 0)) {
+        wstk_httpd_ereply(http_conn, 405, "Expected method: GET");
+        goto out;
+    }
+
+    if(fl_try_to_list_dir) {
+        if(wstk_httpd_browse_dir(http_conn, req_file, req_path, httpd->html_ctype, (http_msg->charset.l ? &http_msg->charset : NULL)) != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 500, NULL);
+            goto out;
+        }
+    } else {
+        if(wstk_file_get_meta(req_file, &file_meta) != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 404, NULL);
+            goto out;
+        }
+
+        wstk_httpd_content_type_by_file_ext(&ctype_info, req_file);
+        if(!ctype_info.binary) {
+            wstk_snprintf(ctype_buffer_st, sizeof(ctype_buffer_st), "%s; charset=%s", ctype_info.ctype, httpd->charset);
+            ctype_ptr = (char *)ctype_buffer_st;
+        } else {
+            ctype_ptr = (char *)ctype_info.ctype;
+        }
+
+        /* the precompressed sibling goes instead (br is better), otherwise the cache can keep it gzip'ed */
+        if(codings && httpd->fl_precompressed) {
+            if((codings & WSTK_HTTPD_CODING_BR) && req_file_sibling(http_conn->arena, &sfile, &sfile_meta, req_file, ".br")) {
+                cenc = "br";
+            } else if((codings & WSTK_HTTPD_CODING_GZIP) && req_file_sibling(http_conn->arena, &sfile, &sfile_meta, req_file, ".gz")) {
+                cenc = "gzip";
+            }
+            if(cenc) {
+                req_file = sfile;
+                file_meta = sfile_meta;
+            }
+        }
+        if(!cenc && (codings & WSTK_HTTPD_CODING_GZIP) && httpd->compress_min && file_meta.size >= httpd->compress_min) {
+            cflags |= WSTK_HTTPD_CACHE_GZIP;
+        }
+        if(fl_vary) {
+            cflags |= WSTK_HTTPD_CACHE_VARY;
+        }
+
+        if(fl_cache) {
+            if(wstk_httpd_cache_add2(httpd->cache, cache_key, req_file, ctype_ptr, cenc, cflags, file_meta.size, file_meta.mtime, &centry) == WSTK_STATUS_SUCCESS) {
+                if(http_cached_reply(http_conn, http_msg, centry) != WSTK_STATUS_SUCCESS) {
+                    wstk_httpd_ereply(http_conn, 500, NULL);
+                }
+                goto out;
+            }
+        }
+
+        if(wstk_file_open(&blobf, req_file, "rb") != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 404, NULL);
+            goto out;
+        }
+
+        if(cenc) {
+            xhdrs = (strcmp(cenc, "br") == 0 ? "Content-Encoding: br\r\n" HTTPD_VARY_HDR : "Content-Encoding: gzip\r\n" HTTPD_VARY_HDR);
+        } else {
+            xhdrs = (fl_vary ? HTTPD_VARY_HDR : NULL);
+        }
+        if(http_breply(http_conn, http_msg, 200, NULL, ctype_ptr, xhdrs, file_meta.size, file_meta.mtime, (wstk_httpd_blob_reader_callback_t)wstk_file_read, (wstk_httpd_blob_seek_callback_t)wstk_file_seek, (void *)&blobf) != WSTK_STATUS_SUCCESS) {
+            wstk_httpd_ereply(http_conn, 404, NULL);
+        }
+
+        wstk_file_close(&blobf);
+#ifdef WSTK_HTTPD_DEBUG
+        WSTK_DBG_PRINT("file sent: name=%s, size=%d", req_file, (int)file_meta.size);
+#endif
+    }
+
+out:
+    /* the handler left the stream open */
+    if(http_conn->fl_stream) {
+        wstk_httpd_stream_end(http_conn);
+    }
+
+    wstk_mem_deref(centry);
+    wstk_mem_deref(http_msg);
+
+    if(status != WSTK_STATUS_NODATA) {
+        wstk_mbuf_set_end(mbuf, buf_end);
+        wstk_mbuf_set_pos(mbuf, (msg_end ? msg_end : buf_end));
+    }
+    if(fl_close) {
+        wstk_tcp_srv_conn_close(conn);
+    }
+
+    /* everything allocated for the request goes at once */
+    wstk_arena_reset(http_conn->arena);
+
+    return status;
+}
+
+static void tcp_handler(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf) {
+    wstk_status_t st = WSTK_STATUS_SUCCESS;
+    wstk_tcp_srv_t *tcp_srv = NULL;
+    wstk_http_conn_t *http_conn = NULL;
+    wstk_httpd_t *httpd = NULL;
+    servlet_container_t *scontainer = NULL;
 
     wstk_tcp_srv_conn_server(conn, &tcp_srv);
     wstk_tcp_srv_attr_get(tcp_srv, HTTPD_ATTR__HTTPD_INSTANCE, (void *)&httpd);
@@ -218,9 +621,7 @@ static void tcp_handler(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf) {
         return;
     }
 
-    wstk_mutex_lock(httpd->mutex);
-    httpd->refs++;
-    wstk_mutex_unlock(httpd->mutex);
+    srv_refs(httpd);
 
     wstk_tcp_srv_conn_attr_get(conn, HTTPD_ATTR__HTTP_CONNECTION, (void *)&http_conn);
     if(!http_conn) {
@@ -229,19 +630,37 @@ static void tcp_handler(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf) {
             wstk_tcp_srv_conn_close(conn);
             goto out;
         }
+        if(wstk_arena_create(&http_conn->arena, HTTPD_ARENA_SIZE) != WSTK_STATUS_SUCCESS) {
+            log_error("Unbable to allocate memory (arena)");
+            wstk_tcp_srv_conn_close(conn);
+            wstk_mem_deref(http_conn);
+            http_conn = NULL;
+            goto out;
+        }
         if(wstk_tcp_srv_conn_attr_add(conn, HTTPD_ATTR__HTTP_CONNECTION, http_conn, true) == WSTK_STATUS_SUCCESS) {
+            wstk_socket_t *sock = NULL;
+
             http_conn->buffer = mbuf;
             http_conn->server = httpd;
             http_conn->tcp_conn = conn;
             wstk_tcp_srv_conn_id(conn, &http_conn->conn_id);
+
+            /* a reply goes with one send, nothing to wait for */
+            if(wstk_tcp_srv_conn_socket(conn, &sock) == WSTK_STATUS_SUCCESS && sock) {
+                wstk_sock_set_nodelay(sock, true);
+            }
         } else {
             log_error("Unbable to create a new http connection");
             wstk_tcp_srv_conn_close(conn);
             wstk_mem_deref(http_conn);
+            http_conn = NULL;
             goto out;
         }
     }
 
+    /* the replies are collected and go out together when the handler is done */
+    http_conn->fl_wrhold = true;
+
     /* is a websocket */
     if(http_conn->websock) {
         wstk_tcp_srv_conn_attr_get(conn, HTTPD_ATTR__WEBSOCK_SERVLET, (void *)&scontainer);
@@ -262,213 +681,516 @@ static void tcp_handler(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf) {
         goto out;
     }
 
-    /* decode http message */
-    if(wstk_http_msg_alloc(&http_msg) != WSTK_STATUS_SUCCESS) {
-        log_error("Unbable to allocate memory (http_msg)");
-        wstk_tcp_srv_conn_close(conn);
+    /* every complete request in the buffer (pipelining), the partial one waits for the rest */
+    wstk_mbuf_set_pos(mbuf, 0);
+    while(wstk_mbuf_left(mbuf) > 0) {
+        if(httpd->fl_destroyed || wstk_tcp_srv_conn_is_closed(conn)) {
+            break;
+        }
+        st = http_perform(httpd, http_conn, mbuf);
+        if(st == WSTK_STATUS_NODATA) {
+            wstk_tcp_srv_conn_keep_unread(conn, true);
+            break;
+        }
+        if(st != WSTK_STATUS_SUCCESS || http_conn->websock) {
+            break;
+        }
+    }
+
+out:
+    /* the replies go out together */
+    if(http_conn) {
+        http_conn->fl_wrhold = false;
+        http_flush(http_conn);
+    }
+
+    srv_derefs(httpd);
+}
+
+/* writes everything (the socket is non-blocking, waits when it's full) */
+static wstk_status_t sock_write_all(wstk_socket_t *sock, wstk_mbuf_t *mbuf) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    uint32_t timeout = 0;
+
+    while(wstk_mbuf_left(mbuf) > 0) {
+        status = wstk_tcp_write(sock, mbuf, timeout);
+        if(status == WSTK_STATUS_FALSE && !timeout && (sock->err == EAGAIN || sock->err == EWOULDBLOCK)) {
+            status = WSTK_STATUS_SUCCESS;
+        }
+        if(status != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+        timeout = HTTPD_WRITE_TIMEOUT;
+    }
+
+    return status;
+}
+
+/* sends the file from its current position by the kernel, NOT_IMPL means nothing was sent and it can be done in the usual way */
+static wstk_status_t sock_sendfile_all(wstk_socket_t *sock, wstk_file_t *file, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    uint32_t timeout = 0;
+    size_t ofs = 0, start = 0, end = 0;
+    int fd = -1;
+
+    if(wstk_file_fd(file, &fd) != WSTK_STATUS_SUCCESS || wstk_file_tell(file, &ofs) != WSTK_STATUS_SUCCESS) {
+        return WSTK_STATUS_NOT_IMPL;
+    }
+
+    start = ofs;
+    end = ofs + len;
+    while(ofs < end) {
+        status = wstk_tcp_sendfile(sock, fd, &ofs, MIN(end - ofs, HTTPD_SENDFILE_CHUNK_SIZE), timeout);
+        if(status == WSTK_STATUS_FALSE && !timeout && (sock->err == EAGAIN || sock->err == EWOULDBLOCK)) {
+            status = WSTK_STATUS_SUCCESS;
+        }
+        if(status == WSTK_STATUS_NOT_IMPL && ofs > start) {
+            status = WSTK_STATUS_FALSE;
+        }
+        if(status != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+        timeout = HTTPD_WRITE_TIMEOUT;
+    }
+
+    if(status != WSTK_STATUS_NOT_IMPL) {
+        wstk_file_seek(file, ofs);
+    }
+
+    return status;
+}
+
+static wstk_status_t http_flush(wstk_http_conn_t *conn) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_socket_t *sock = NULL;
+
+    /* what's streamed so far goes out as a chunk */
+    if(stream_chunk_close(conn) != WSTK_STATUS_SUCCESS) {
+        wstk_tcp_srv_conn_close(conn->tcp_conn);
+    }
+
+    if(!conn->obuf || !wstk_mbuf_end(conn->obuf)) {
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    if((status = wstk_tcp_srv_conn_socket(conn->tcp_conn, &sock)) == WSTK_STATUS_SUCCESS && sock) {
+        wstk_mbuf_set_pos(conn->obuf, 0);
+        status = sock_write_all(sock, conn->obuf);
+    } else {
+        status = (status == WSTK_STATUS_SUCCESS ? WSTK_STATUS_FALSE : status);
+    }
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_tcp_srv_conn_close(conn->tcp_conn);
+    }
+
+    wstk_mbuf_rewind(conn->obuf);
+    if(wstk_mbuf_size(conn->obuf) > HTTPD_WRITE_BUFFER_MAX) {
+        wstk_mbuf_resize(conn->obuf, HTTPD_WRITE_BUFFER_SIZE);
+    }
+
+    return status;
+}
+
+/* appends to the output buffer */
+static wstk_status_t http_vprintf(wstk_http_conn_t *conn, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    size_t end = 0;
+
+    if(!conn->obuf) {
+        if((status = wstk_mbuf_alloc(&conn->obuf, HTTPD_WRITE_BUFFER_SIZE)) != WSTK_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    end = wstk_mbuf_end(conn->obuf);
+    wstk_mbuf_set_pos(conn->obuf, end);
+
+    if((status = wstk_mbuf_vprintf(conn->obuf, fmt, ap)) != WSTK_STATUS_SUCCESS) {
+        wstk_mbuf_set_posend(conn->obuf, end, end);
+    }
+
+    return status;
+}
+
+static wstk_status_t http_printf(wstk_http_conn_t *conn, const char *fmt, ...) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    va_list ap;
+
+    va_start(ap, fmt);
+    status = http_vprintf(conn, fmt, ap);
+    va_end(ap);
+
+    return status;
+}
+
+/* the chunk size isn't known yet, the header is reserved (fixed width, the leading zeros are legal) and filled by stream_chunk_close() */
+static wstk_status_t stream_chunk_open(wstk_http_conn_t *conn) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    size_t start = (conn->obuf ? wstk_mbuf_end(conn->obuf) : 0);
+
+    if(!conn->fl_stream || conn->fl_http10 || conn->fl_chunk_open) {
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    if((status = http_printf(conn, "00000000\r\n")) == WSTK_STATUS_SUCCESS) {
+        conn->chunk_start = start;
+        conn->fl_chunk_open = true;
+    }
+
+    return status;
+}
+
+static wstk_status_t stream_chunk_close(wstk_http_conn_t *conn) {
+    static const char hex[] = "0123456789abcdef";
+    size_t len = 0;
+    char *p = NULL;
+    int i = 0;
+
+    if(!conn->fl_chunk_open) {
+        return WSTK_STATUS_SUCCESS;
+    }
+    conn->fl_chunk_open = false;
+
+    len = wstk_mbuf_end(conn->obuf) - conn->chunk_start - HTTPD_CHUNK_HDR_SIZE;
+    if(!len) {
+        wstk_mbuf_set_posend(conn->obuf, conn->chunk_start, conn->chunk_start);
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    p = (char *)conn->obuf->buf + conn->chunk_start;
+    for(i = HTTPD_CHUNK_HDR_SIZE - 3; i >= 0; i--) {
+        p[i] = hex[len & 0xf];
+        len >>= 4;
+    }
+
+    return http_printf(conn, "\r\n");
+}
+
+/* the buffer goes out now unless the worker holds it till the handler is done */
+static wstk_status_t http_written(wstk_http_conn_t *conn) {
+    if(!conn->fl_wrhold || wstk_mbuf_end(conn->obuf) >= HTTPD_WRITE_BUFFER_MAX) {
+        return http_flush(conn);
+    }
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* formats the reply into the output buffer, it's written by: http_written() */
+static wstk_status_t http_vformat(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    const char *servert_ident = NULL;
+    char tbuff[128] = {0};
+    size_t start = 0;
+
+    if(!conn || !conn->server) {
+        return WSTK_STATUS_FALSE;
+    }
+
+    if(conn->server->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    if((status = wstk_time_to_str_rfc822(0, (char *)tbuff, sizeof(tbuff))) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    wstk_mbuf_set_pos(mbuf, 0);
-    st = wstk_http_msg_decode(http_msg, mbuf);
-    if(st != WSTK_STATUS_SUCCESS && st != WSTK_STATUS_NODATA) {
-        log_error("Unbable to decode HTTP message (err=%d)", (int)st);
-        wstk_tcp_srv_conn_close(conn);
-        wstk_httpd_ereply(http_conn, 400, NULL);
+    /* status line, headers and a small body go out with one send */
+    start = (conn->obuf ? wstk_mbuf_end(conn->obuf) : 0);
+    servert_ident = (conn->server->ident ? conn->server->ident : HTTPD_DEFAULT_SERVER_ID);
+    status = http_printf(conn,
+                         "HTTP/1.1 %u %s\r\n"
+                         "Server: %s\r\n"
+                         "Date: %s\r\n",
+                         scode, (reason ? reason : wstk_httpd_reason_by_code(scode)),
+                         servert_ident,
+                         (char *)tbuff
+            );
+    if(status != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    /* update scheme */
-    http_msg->scheme = (http_conn->tls ? scheme_https : scheme_http);
-
-    /* slightly validate message */
-    if(!http_msg->method.p || http_msg->method.l < 3) {
-        wstk_tcp_srv_conn_close(conn);
-        wstk_httpd_ereply(http_conn, 400, NULL);
-        goto out;
+    if(fmt) {
+        status = http_vprintf(conn, fmt, ap);
+    } else {
+        status = http_printf(conn, "Content-Length: 0\r\n\r\n");
     }
-
-    if(wstk_unescape(&req_path, http_msg->path.p, http_msg->path.l) != WSTK_STATUS_SUCCESS) {
-        log_error("Unable to unescape request");
-        wstk_tcp_srv_conn_close(conn);
-        wstk_httpd_ereply(http_conn, 500, NULL);
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mbuf_set_posend(conn->obuf, start, start);
         goto out;
     }
+out:
+    return status;
+}
 
-    /* lookup for servlet */
-    wstk_mutex_lock(httpd->mutex);
-    if(!wstk_hash_is_empty(httpd->servlets)) {
-        char *name_ptr = req_path;
+static wstk_status_t http_format(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *fmt, ...) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    va_list ap;
 
-        /* skip exra lead slashes if exists (////...) */
-        if(http_msg->path.l > 1 && name_ptr[1] == '/') {
-            while(*name_ptr++) {
-                if(*name_ptr != '/' || !*name_ptr) { break; }
-            }
-        }
-        if(!*name_ptr) {
-            wstk_tcp_srv_conn_close(conn);
-            wstk_httpd_ereply(http_conn, 400, NULL);
-            wstk_mutex_unlock(httpd->mutex); /* !!! */
-            goto out;
-        }
+    va_start(ap, fmt);
+    status = http_vformat(conn, scode, reason, fmt, ap);
+    va_end(ap);
 
-        /* first attempt */
-        scontainer = wstk_hash_find(httpd->servlets, name_ptr);
-        scontainer_refs(scontainer);
-
-        /* plab-b */
-        if(!scontainer) {
-            char *items[5];
-            char *req_path2 = NULL;
-            wstk_mbuf_t *tbuf = NULL;
-            uint32_t count = 0, i;
-
-            /* skip lead slash */
-            req_path2 = wstk_str_dup((*name_ptr == '/' ? ++name_ptr : name_ptr));
-            count = wstk_str_separate(req_path2, '/', items, ARRAY_SIZE(items));
-            if(count > 1) {
-                if(wstk_mbuf_alloc(&tbuf, http_msg->path.l + 10) == WSTK_STATUS_SUCCESS) {
-                    wstk_mbuf_write_u8(tbuf, '/');
-                    for(i = 0; i < count; i++) {
-                        wstk_mbuf_write_str(tbuf, items[i]);
-                        wstk_mbuf_write_u8(tbuf, '/');
-                        wstk_mbuf_write_u8(tbuf, 0x0);
-                        if((scontainer = wstk_hash_find(httpd->servlets, (char *)tbuf->buf))) {
-                            scontainer_refs(scontainer);
-                            break;
-                        }
-                        tbuf->pos--;
-                    }
-                }
-            }
-            wstk_mem_deref(tbuf);
-            wstk_mem_deref(req_path2);
-        }
+    return status;
+}
+
+static wstk_status_t http_vreply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if((status = http_vformat(conn, scode, reason, fmt, ap)) == WSTK_STATUS_SUCCESS) {
+        status = http_written(conn);
     }
-    wstk_mutex_unlock(httpd->mutex);
 
+    return status;
+}
 
-    if(scontainer) {
-#ifdef WSTK_HTTPD_DEBUG
-        WSTK_DBG_PRINT("performing servlet: container=%p (http-conn=%p, handler=%p, udate=%p, path=%s)", scontainer, http_conn, scontainer->handler, scontainer->udata, req_path);
-#endif
-        scontainer->handler(http_conn, http_msg, scontainer->udata);
-        if(http_conn->websock) {
-            wstk_tcp_srv_conn_attr_add(conn, HTTPD_ATTR__WEBSOCK_SERVLET, scontainer, false);
+/* the headers and the content are already rendered, the reply takes no file access */
+static wstk_status_t http_cached_reply(wstk_http_conn_t *conn, wstk_http_msg_t *msg, wstk_httpd_cache_entry_t *entry) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_socket_t *sock = NULL;
+    const char *keep_alive_str;
+    char tbuff[128] = {0};
+    size_t start = 0, blen = wstk_mbuf_end(entry->body);
+    bool fl_corked = false;
+
+    keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
+    start = (conn->obuf ? wstk_mbuf_end(conn->obuf) : 0);
+
+    if(http_is_not_modified(msg, entry->etag, entry->mtime)) {
+        if((status = wstk_time_to_str_rfc822(entry->mtime, (char *)tbuff, sizeof(tbuff))) == WSTK_STATUS_SUCCESS) {
+            status = wstk_httpd_reply(conn, 304, NULL, "Last-Modified: %s\r\nETag: %s\r\nConnection: %s\r\n\r\n", (char *)tbuff, (char *)entry->etag, keep_alive_str);
         }
-        scontainer_derefs(scontainer);
         goto out;
     }
 
-    /* browse dir or show file */
-    if(!httpd->www_home) {
-        wstk_httpd_ereply(http_conn, 404, NULL);
+    status = http_format(conn, 200, wstk_httpd_reason_by_code(200), "Connection: %s\r\n%s", keep_alive_str, entry->headers);
+    if(status != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    if(http_msg->path.l == 1 && http_msg->path.p[0] == '/') {
-        if(httpd->welcome_page) {
-            if(wstk_file_name_concat(&req_file, httpd->www_home, httpd->welcome_page, WSTK_PATH_DELIMITER) != WSTK_STATUS_SUCCESS) {
-                wstk_httpd_ereply(http_conn, 404, NULL);
-                goto out;
-            }
-            if(!wstk_file_exists(req_file)) {
-                wstk_mem_deref(req_file);
-                req_file = wstk_str_dup(httpd->www_home);
-            }
-        } else {
-            if(!httpd->allow_dir_browse) {
-                wstk_httpd_ereply(http_conn, 404, NULL);
-                goto out;
-            }
-        }
-        fl_try_to_list_dir = true;
-    } else {
-        if(wstk_file_name_concat(&req_file, httpd->www_home, req_path, WSTK_PATH_DELIMITER) != WSTK_STATUS_SUCCESS) {
-            wstk_httpd_ereply(http_conn, 404, NULL);
+    /* a small body goes together with the other replies */
+    if(wstk_mbuf_end(conn->obuf) + blen <= HTTPD_WRITE_BUFFER_MAX) {
+        if(blen && (status = wstk_mbuf_write_mem(conn->obuf, entry->body->buf, blen)) != WSTK_STATUS_SUCCESS) {
+            wstk_mbuf_set_posend(conn->obuf, start, start);
             goto out;
         }
+        status = http_written(conn);
+        goto out;
     }
 
-    if(!wstk_httpd_is_valid_path(req_file, strlen(req_file))) {
-        wstk_httpd_ereply(http_conn, 404, NULL);
-        goto out;
+    /* the big one straight from the entry, after the header */
+    if((status = wstk_tcp_srv_conn_socket(conn->tcp_conn, &sock)) != WSTK_STATUS_SUCCESS || !sock) {
+        wstk_mbuf_set_posend(conn->obuf, start, start);
+        wstk_goto_status((status == WSTK_STATUS_SUCCESS ? WSTK_STATUS_FALSE : status), out);
     }
 
-    if(!wstk_file_exists(req_file)) {
-        if(httpd->allow_dir_browse) {
-            fl_try_to_list_dir = wstk_dir_exists(req_file);
-        }
-        if(!fl_try_to_list_dir) {
-            wstk_httpd_ereply(http_conn, 404, NULL);
-            goto out;
+    fl_corked = (wstk_sock_set_cork(sock, true) == WSTK_STATUS_SUCCESS);
+    if((status = http_flush(conn)) == WSTK_STATUS_SUCCESS) {
+        wstk_mbuf_t body = { .buf = entry->body->buf, .size = blen, .pos = 0, .end = blen };
+
+        if((status = sock_write_all(sock, &body)) != WSTK_STATUS_SUCCESS) {
+            wstk_tcp_srv_conn_close(conn->tcp_conn);
         }
-    } else {
-        fl_try_to_list_dir = false;
     }
+out:
+    if(fl_corked) {
+        wstk_sock_set_cork(sock, false);
+    }
+    return status;
+}
 
-    if(wstk_pl_strcasecmp(&http_msg->method, "GET") != 0) {
-        wstk_httpd_ereply(http_conn, 405, "Expected method: GET");
-        goto out;
+
+/* the weak comparison with a list of tags (a, W/b, *) */
+static bool etag_list_match(const wstk_pl_t *list, const char *etag) {
+    const char *ptr = list->p, *end = list->p + list->l;
+    const char *tag = NULL, *tag_end = NULL;
+    size_t elen = strlen(etag);
+
+    while(ptr < end) {
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == ',')) { ptr++; }
+        if(ptr >= end) {
+            break;
+        }
+        for(tag = ptr; ptr < end && *ptr != ','; ptr++);
+        for(tag_end = ptr; tag_end > tag && (tag_end[-1] == ' ' || tag_end[-1] == '\t'); tag_end--);
+
+        if(tag_end - tag == 1 && *tag == '*') {
+            return true;
+        }
+        if(tag_end - tag > 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag += 2;
+        }
+        if((size_t)(tag_end - tag) == elen && memcmp(tag, etag, elen) == 0) {
+            return true;
+        }
     }
+    return false;
+}
 
-    if(fl_try_to_list_dir) {
-        wstk_tcp_srv_conn_close(conn); /* cause we don't have content lenght */
-        if(wstk_httpd_browse_dir(http_conn, req_file, req_path, httpd->html_ctype, (http_msg->charset.l ? &http_msg->charset : NULL)) != WSTK_STATUS_SUCCESS) {
-            wstk_httpd_ereply(http_conn, 500, NULL);
-            goto out;
+/* the client has the actual copy (If-None-Match takes precedence over If-Modified-Since) */
+static bool http_is_not_modified(wstk_http_msg_t *msg, const char *etag, time_t mtime) {
+    wstk_pl_t hval = { 0 };
+    time_t since = 0;
+
+    if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_IF_NONE_MATCH, &hval) == WSTK_STATUS_SUCCESS) {
+        return etag_list_match(&hval, etag);
+    }
+    if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_IF_MODIFIED_SINCE, &hval) == WSTK_STATUS_SUCCESS) {
+        if(wstk_time_from_str_rfc822(&since, hval.p, hval.l) == WSTK_STATUS_SUCCESS) {
+            return (mtime <= since);
         }
-    } else {
-        if(wstk_file_get_meta(req_file, &file_meta) != WSTK_STATUS_SUCCESS) {
-            wstk_httpd_ereply(http_conn, 404, NULL);
-            goto out;
+    }
+    return false;
+}
+
+/*
+ * Range: bytes=0-99,200-,-50
+ * NOT_FOUND - no usable ranges (the whole entity is sent), OUTOFRANGE - nothing is satisfiable
+ */
+static wstk_status_t http_ranges_parse(wstk_http_msg_t *msg, const char *etag, time_t mtime, size_t blen, http_range_t *ranges, uint32_t *count) {
+    wstk_pl_t hval = { 0 };
+    const char *ptr = NULL, *end = NULL;
+    uint64_t first = 0, last = 0;
+    bool fl_first = false, fl_last = false;
+    time_t since = 0;
+    uint32_t n = 0;
+
+    *count = 0;
+
+    if(!blen || wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_RANGE, &hval) != WSTK_STATUS_SUCCESS) {
+        return WSTK_STATUS_NOT_FOUND;
+    }
+    if(hval.l < 6 || strncasecmp(hval.p, "bytes=", 6) != 0) {
+        return WSTK_STATUS_NOT_FOUND;
+    }
+    ptr = hval.p + 6;
+    end = hval.p + hval.l;
+
+    /* the ranges are only for the same entity */
+    if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_IF_RANGE, &hval) == WSTK_STATUS_SUCCESS) {
+        if(hval.p[0] == '"' || hval.p[0] == 'W') {
+            if(wstk_pl_strcmp(&hval, etag) != 0) {
+                return WSTK_STATUS_NOT_FOUND;
+            }
+        } else if(wstk_time_from_str_rfc822(&since, hval.p, hval.l) != WSTK_STATUS_SUCCESS || since != mtime) {
+            return WSTK_STATUS_NOT_FOUND;
         }
+    }
 
-        if(wstk_file_open(&blobf, req_file, "rb") != WSTK_STATUS_SUCCESS) {
-            wstk_httpd_ereply(http_conn, 404, NULL);
-            goto out;
+    while(ptr < end) {
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == ',')) { ptr++; }
+        if(ptr >= end) {
+            break;
         }
 
+        first = last = 0;
+        fl_first = fl_last = false;
+        for(; ptr < end && isdigit(*ptr); ptr++, fl_first = true) {
+            if(first > (UINT64_MAX / 10) - 1) { return WSTK_STATUS_NOT_FOUND; }
+            first = first * 10 + (*ptr - '0');
+        }
+        if(ptr >= end || *ptr != '-') {
+            return WSTK_STATUS_NOT_FOUND;
+        }
+        for(ptr++; ptr < end && isdigit(*ptr); ptr++, fl_last = true) {
+            if(last > (UINT64_MAX / 10) - 1) { return WSTK_STATUS_NOT_FOUND; }
+            last = last * 10 + (*ptr - '0');
+        }
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t')) { ptr++; }
+        if(ptr < end && *ptr != ',') {
+            return WSTK_STATUS_NOT_FOUND;
+        }
+        if((!fl_first && !fl_last) || (fl_first && fl_last && last < first)) {
+            return WSTK_STATUS_NOT_FOUND;
+        }
 
-        wstk_httpd_content_type_by_file_ext(&ctype_info, req_file);
-        if(!ctype_info.binary) {
-            wstk_snprintf(ctype_buffer_st, sizeof(ctype_buffer_st), "%s; charset=%s", ctype_info.ctype, httpd->charset);
-            ctype_ptr = (char *)ctype_buffer_st;
+        if(!fl_first) {
+            if(!last) { continue; }
+            first = (last >= blen ? 0 : blen - last);
+            last = blen - 1;
         } else {
-            ctype_ptr = (char *)ctype_info.ctype;
+            if(first >= blen) { continue; }
+            if(!fl_last || last >= blen) { last = blen - 1; }
         }
 
-        if(wstk_httpd_breply(http_conn, 200, NULL, ctype_ptr, file_meta.size, file_meta.mtime, (wstk_httpd_blob_reader_callback_t)wstk_file_read, (void *)&blobf) != WSTK_STATUS_SUCCESS) {
-            wstk_httpd_ereply(http_conn, 404, NULL);
+        if(n >= HTTPD_RANGES_MAX) {
+            return WSTK_STATUS_NOT_FOUND;
         }
+        ranges[n].start = first;
+        ranges[n].len = (last - first) + 1;
+        n++;
+    }
 
-        wstk_file_close(&blobf);
-#ifdef WSTK_HTTPD_DEBUG
-        WSTK_DBG_PRINT("file sent: name=%s, size=%d", req_file, (int)file_meta.size);
-#endif
+    if(!n) {
+        return WSTK_STATUS_OUTOFRANGE;
     }
 
-out:
-    wstk_mem_deref(http_msg);
-    wstk_mem_deref(req_path);
-    wstk_mem_deref(req_file);
+    *count = n;
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* sends len bytes of the blob, from the offset if it's seekable (sendfile for the files) */
+static wstk_status_t http_send_blob(wstk_socket_t *sock, wstk_mbuf_t **mbuf, wstk_httpd_blob_reader_callback_t rcallback, wstk_httpd_blob_seek_callback_t scallback, void *udata, size_t offset, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if(scallback && (status = scallback(udata, offset)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    /* file-backed blobs go without copying through the userspace, the other ones (and ssl) through the buffer */
+    if(rcallback == (wstk_httpd_blob_reader_callback_t)wstk_file_read) {
+        if((status = sock_sendfile_all(sock, (wstk_file_t *)udata, len)) != WSTK_STATUS_NOT_IMPL) {
+            return status;
+        }
+        status = WSTK_STATUS_SUCCESS;
+    }
+
+    if(!*mbuf && (status = wstk_mbuf_alloc(mbuf, HTTPD_BLOB_WRITE_BUFFER_SIZE)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+    while(len > 0) {
+        wstk_mbuf_clean(*mbuf);
+
+        status = rcallback(udata, *mbuf);
+        if(status == WSTK_STATUS_NODATA)  { status = WSTK_STATUS_FALSE; break; } /* shorter than it was announced */
+        if(status != WSTK_STATUS_SUCCESS) { break; }
+        if(!wstk_mbuf_end(*mbuf)) { status = WSTK_STATUS_FALSE; break; }
+
+        if(wstk_mbuf_end(*mbuf) > len) {
+            wstk_mbuf_set_end(*mbuf, len);
+        }
+        len -= wstk_mbuf_end(*mbuf);
+
+        wstk_mbuf_set_pos(*mbuf, 0);
+        if((status = sock_write_all(sock, *mbuf)) != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+    }
 
-    wstk_mutex_lock(httpd->mutex);
-    if(httpd->refs) httpd->refs--;
-    wstk_mutex_unlock(httpd->mutex);
+    return status;
 }
 
-static wstk_status_t http_vreply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *fmt, va_list ap) {
+/* the blob reply (see wstk_httpd_breply2), xhdrs - the extra header lines (e.g. Content-Encoding) or NULL */
+static wstk_status_t http_breply(wstk_http_conn_t *conn, wstk_http_msg_t *msg, uint32_t scode, const char *reason, const char *ctype, const char *xhdrs, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, wstk_httpd_blob_seek_callback_t scallback, void *udata) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
+    const char *keep_alive_str;
+    const char *reason_local = (reason ? reason : wstk_httpd_reason_by_code(scode));
+    http_range_t ranges[HTTPD_RANGES_MAX];
+    wstk_mbuf_t *mbuf = NULL, *parts = NULL;
     wstk_socket_t *sock = NULL;
-    const char *servert_ident = (conn->server->ident ? conn->server->ident : HTTPD_DEFAULT_SERVER_ID);
     char tbuff[128] = {0};
+    char etag[48] = {0};
+    char boundary[20] = {0};
+    size_t pofs[HTTPD_RANGES_MAX + 1] = {0};
+    size_t clen = blen;
+    uint32_t rcount = 0, i = 0;
+    bool fl_corked = false;
+    bool fl_head = false;
 
-    if(!conn || !conn->server) {
-        return WSTK_STATUS_FALSE;
+    if(!conn || !conn->server || !rcallback) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(!xhdrs) {
+        xhdrs = "";
     }
-
     if(conn->server->fl_destroyed) {
         return WSTK_STATUS_DESTROYED;
     }
@@ -480,32 +1202,179 @@ static wstk_status_t http_vreply(wstk_http_conn_t *conn, uint32_t scode, const c
         return WSTK_STATUS_FALSE;
     }
 
-    if((status = wstk_time_to_str_rfc822(0, (char *)tbuff, sizeof(tbuff))) != WSTK_STATUS_SUCCESS) {
+    if(!scallback && rcallback == (wstk_httpd_blob_reader_callback_t)wstk_file_read) {
+        scallback = (wstk_httpd_blob_seek_callback_t)wstk_file_seek;
+    }
+
+    if((status = wstk_time_to_str_rfc822(mtime, (char *)tbuff, sizeof(tbuff))) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_httpd_etag((char *)etag, sizeof(etag), blen, mtime)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    status = wstk_tcp_printf(sock,
-                             "HTTP/1.1 %u %s\r\n"
-                             "Server: %s\r\n"
-                             "Date: %s\r\n",
-                             scode, reason,
-                             servert_ident,
-                             (char *)tbuff
-            );
-    if(status != WSTK_STATUS_SUCCESS) {
+    keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
+
+    /* conditional and partial requests */
+    if(msg && scode == 200) {
+        fl_head = (wstk_pl_strcasecmp(&msg->method, "HEAD") == 0);
+        if(fl_head || wstk_pl_strcasecmp(&msg->method, "GET") == 0) {
+            if(http_is_not_modified(msg, etag, mtime)) {
+                status = wstk_httpd_reply(conn, 304, NULL,
+                            "Last-Modified: %s\r\n"
+                            "ETag: %s\r\n"
+                            "Connection: %s\r\n"
+                            "%s"
+                            "\r\n",
+                            (char *)tbuff,
+                            (char *)etag,
+                            keep_alive_str,
+                            xhdrs
+                        );
+                goto out;
+            }
+            if(scallback) {
+                status = http_ranges_parse(msg, etag, mtime, blen, ranges, &rcount);
+                if(status == WSTK_STATUS_OUTOFRANGE) {
+                    status = wstk_httpd_reply(conn, 416, NULL,
+                                "Content-Range: bytes */%zu\r\n"
+                                "Connection: %s\r\n"
+                                "Content-Length: 0\r\n"
+                                "\r\n",
+                                blen,
+                                keep_alive_str
+                            );
+                    goto out;
+                }
+                status = WSTK_STATUS_SUCCESS;
+            }
+        }
+    }
+
+    // send header
+    if(rcount == 1) {
+        clen = ranges[0].len;
+        status = wstk_httpd_reply(conn, 206, NULL,
+                    "Last-Modified: %s\r\n"
+                    "ETag: %s\r\n"
+                    "Connection: %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "%s"
+                    "Content-Range: bytes %zu-%zu/%zu\r\n"
+                    "Content-Length: %zu\r\n"
+                    "\r\n",
+                    (char *)tbuff,
+                    (char *)etag,
+                    keep_alive_str,
+                    ctype,
+                    xhdrs,
+                    ranges[0].start, ranges[0].start + ranges[0].len - 1, blen,
+                    clen
+                );
+    } else if(rcount > 1) {
+        /* the part headers are rendered first, they're counted in the length */
+        if((status = wstk_mbuf_alloc(&parts, 1024)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        wstk_snprintf(boundary, sizeof(boundary), "%08x%08x", wstk_rand_u32(), wstk_rand_u32());
+
+        for(clen = 0, i = 0; i < rcount; i++) {
+            pofs[i] = wstk_mbuf_end(parts);
+            status = wstk_mbuf_printf(parts,
+                        "\r\n--%s\r\n"
+                        "Content-Type: %s\r\n"
+                        "Content-Range: bytes %zu-%zu/%zu\r\n"
+                        "\r\n",
+                        (char *)boundary,
+                        ctype,
+                        ranges[i].start, ranges[i].start + ranges[i].len - 1, blen
+                    );
+            if(status != WSTK_STATUS_SUCCESS) {
+                goto out;
+            }
+            clen += ranges[i].len;
+        }
+        pofs[rcount] = wstk_mbuf_end(parts);
+        if((status = wstk_mbuf_printf(parts, "\r\n--%s--\r\n", (char *)boundary)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        clen += wstk_mbuf_end(parts);
+
+        status = wstk_httpd_reply(conn, 206, NULL,
+                    "Last-Modified: %s\r\n"
+                    "ETag: %s\r\n"
+                    "Connection: %s\r\n"
+                    "Content-Type: multipart/byteranges; boundary=%s\r\n"
+                    "%s"
+                    "Content-Length: %zu\r\n"
+                    "\r\n",
+                    (char *)tbuff,
+                    (char *)etag,
+                    keep_alive_str,
+                    (char *)boundary,
+                    xhdrs,
+                    clen
+                );
+    } else {
+        status = wstk_httpd_reply(conn, scode, reason_local,
+                    "Last-Modified: %s\r\n"
+                    "ETag: %s\r\n"
+                    "Connection: %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "%s"
+                    "Content-Length: %zu\r\n"
+                    "\r\n",
+                    (char *)tbuff,
+                    (char *)etag,
+                    keep_alive_str,
+                    ctype,
+                    xhdrs,
+                    blen
+                );
+    }
+    if(status != WSTK_STATUS_SUCCESS || fl_head || !clen) {
         goto out;
     }
 
-    if(fmt) {
-        status = wstk_tcp_vprintf(sock, fmt, ap);
+    /* the header is held by the cork and goes out in one segment with the body beginning */
+    fl_corked = (wstk_sock_set_cork(sock, true) == WSTK_STATUS_SUCCESS);
+
+    // send blob
+    if(!rcount) {
+        /* the body is written directly, everything before goes first */
+        if((status = http_flush(conn)) == WSTK_STATUS_SUCCESS) {
+            status = http_send_blob(sock, &mbuf, rcallback, NULL, udata, 0, blen);
+        }
     } else {
-        status = wstk_tcp_printf(sock, "Content-Length: 0\r\n\r\n");
+        for(i = 0; i < rcount && status == WSTK_STATUS_SUCCESS; i++) {
+            if(rcount > 1) {
+                status = wstk_mbuf_write_mem(conn->obuf, parts->buf + pofs[i], pofs[i + 1] - pofs[i]);
+            }
+            if(status == WSTK_STATUS_SUCCESS) {
+                status = http_flush(conn);
+            }
+            if(status == WSTK_STATUS_SUCCESS) {
+                status = http_send_blob(sock, &mbuf, rcallback, scallback, udata, ranges[i].start, ranges[i].len);
+            }
+        }
+        if(status == WSTK_STATUS_SUCCESS && rcount > 1) {
+            if((status = wstk_mbuf_write_mem(conn->obuf, parts->buf + pofs[rcount], wstk_mbuf_end(parts) - pofs[rcount])) == WSTK_STATUS_SUCCESS) {
+                status = http_written(conn);
+            }
+        }
+    }
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_tcp_srv_conn_close(conn->tcp_conn);
     }
 out:
+    if(fl_corked) {
+        wstk_sock_set_cork(sock, false);
+    }
+    wstk_mem_deref(parts);
+    wstk_mem_deref(mbuf);
     return status;
 }
 
-
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // public
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -543,7 +1412,7 @@ wstk_status_t wstk_httpd_create(wstk_httpd_t **srv, wstk_sockaddr_t *address, ui
         goto out;
     }
 
-    if((status = wstk_hash_init(&srv_local->servlets)) != WSTK_STATUS_SUCCESS) {
+    if((status = wstk_httpd_router_create(&srv_local->servlets)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
@@ -619,7 +1488,7 @@ wstk_status_t wstk_httpsd_create(wstk_httpd_t **srv, wstk_sockaddr_t *address, c
         goto out;
     }
 
-    if((status = wstk_hash_init(&srv_local->servlets)) != WSTK_STATUS_SUCCESS) {
+    if((status = wstk_httpd_router_create(&srv_local->servlets)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
@@ -730,33 +1599,30 @@ wstk_status_t wstk_httpd_register_servlet(wstk_httpd_t *srv, const char *path, w
         return WSTK_STATUS_DESTROYED;
     }
 
-    wstk_mutex_lock(srv->mutex);
-    container = wstk_hash_find(srv->servlets, path);
-    if(!container) {
-        status = wstk_mem_zalloc((void *)&container, sizeof(servlet_container_t), desctuctor__servlet_container_t);
-        if(status == WSTK_STATUS_SUCCESS) {
-            container->server = srv;
-            container->handler = handler;
-            container->path = wstk_str_dup(path);
-            container->udata = udata;
-            container->fl_adestroy_udata = auto_destroy;
-
-            status = wstk_mutex_create(&container->mutex);
-            if(status == WSTK_STATUS_SUCCESS) {
-                status = wstk_hash_insert_ex(srv->servlets, container->path, container, true);
-            }
-        }
-    } else {
-        status = WSTK_STATUS_ALREADY_EXISTS;
+    status = wstk_mem_zalloc((void *)&container, sizeof(servlet_container_t), desctuctor__servlet_container_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
     }
-    wstk_mutex_unlock(srv->mutex);
 
-    if(status != WSTK_STATUS_SUCCESS) {
-        wstk_mem_deref(container);
-    } else {
+    container->server = srv;
+    container->handler = handler;
+    container->path = wstk_str_dup(path);
+    container->udata = udata;
+
+    if((status = wstk_mutex_create(&container->mutex)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_httpd_router_add(srv->servlets, path, container)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    container->fl_adestroy_udata = auto_destroy;
+
 #ifdef WSTK_HTTPD_DEBUG
-        WSTK_DBG_PRINT("servlet registered: container=%p (path=%s, udata=%p, destroy_udata=%d)", container, container->path, container->udata, container->fl_adestroy_udata);
+    WSTK_DBG_PRINT("servlet registered: container=%p (path=%s, udata=%p, destroy_udata=%d)", container, container->path, container->udata, container->fl_adestroy_udata);
 #endif
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(container);
     }
     return status;
 }
@@ -771,6 +1637,8 @@ wstk_status_t wstk_httpd_register_servlet(wstk_httpd_t *srv, const char *path, w
  **/
 wstk_status_t wstk_httpd_unregister_servlet(wstk_httpd_t *srv, const char *path) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
+    servlet_container_t *container = NULL;
+    uint32_t spins = 0;
 
     if(!srv || !path) {
         return WSTK_STATUS_INVALID_PARAM;
@@ -779,9 +1647,13 @@ wstk_status_t wstk_httpd_unregister_servlet(wstk_httpd_t *srv, const char *path)
         return WSTK_STATUS_SUCCESS;
     }
 
-    wstk_mutex_lock(srv->mutex);
-    wstk_hash_delete(srv->servlets, path);
-    wstk_mutex_unlock(srv->mutex);
+    /* the performing requests keep it, wait for them as before */
+    if(wstk_httpd_router_del(srv->servlets, path, (void *)&container) == WSTK_STATUS_SUCCESS) {
+        while(scontainer_refs_count(container) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
+        }
+        wstk_mem_deref(container);
+    }
 
     return status;
 }
@@ -881,7 +1753,8 @@ out:
  **/
 wstk_status_t wstk_httpd_creply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype, const char *fmt, ...) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_mbuf_t *mbuf = NULL;
+    wstk_mbuf_t *mbuf = NULL, *zbuf = NULL, *body = NULL;
+    const char *xhdrs = "";
     char tbuff[128] = {0};
     const char *reason_local = (reason ? reason : wstk_httpd_reason_by_code(scode));
     const char *keep_alive_str;
@@ -910,21 +1783,37 @@ wstk_status_t wstk_httpd_creply(wstk_http_conn_t *conn, uint32_t scode, const ch
         goto out;
     }
 
+    /* compressed if the client accepts it and it's worth it (otherwise goes as is) */
+    body = mbuf;
+    if(conn->server->compress_min && mbuf->end >= conn->server->compress_min && wstk_httpd_ctype_is_compressible(ctype)) {
+        xhdrs = HTTPD_VARY_HDR;
+        if((conn->codings & (WSTK_HTTPD_CODING_GZIP | WSTK_HTTPD_CODING_DEFLATE)) && wstk_mbuf_alloc(&zbuf, mbuf->end / 2) == WSTK_STATUS_SUCCESS) {
+            bool fl_gzip = (conn->codings & WSTK_HTTPD_CODING_GZIP);
+            if(wstk_deflate_mbuf(zbuf, mbuf->buf, mbuf->end, (fl_gzip ? WSTK_DEFLATE_GZIP : WSTK_DEFLATE_ZLIB), conn->server->compress_level) == WSTK_STATUS_SUCCESS && zbuf->end < mbuf->end) {
+                xhdrs = (fl_gzip ? "Content-Encoding: gzip\r\n" HTTPD_VARY_HDR : "Content-Encoding: deflate\r\n" HTTPD_VARY_HDR);
+                body = zbuf;
+            }
+        }
+    }
+
     keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
     status = wstk_httpd_reply(conn, scode, reason_local,
                 "Last-Modified: %s\r\n"
                 "Connection: %s\r\n"
                 "Content-Type: %s\r\n"
+                "%s"
                 "Content-Length: %zu\r\n"
                 "\r\n"
                 "%b",
                 (char *)tbuff,
                 keep_alive_str,
                 ctype,
-                mbuf->end,
-                mbuf->buf, mbuf->end
+                xhdrs,
+                body->end,
+                body->buf, body->end
             );
 out:
+    wstk_mem_deref(zbuf);
     wstk_mem_deref(mbuf);
     return status;
 }
@@ -944,72 +1833,218 @@ out:
  * @return sucesss or some error
  **/
 wstk_status_t wstk_httpd_breply(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, void *udata) {
+    return wstk_httpd_breply2(conn, NULL, scode, reason, ctype, blen, mtime, rcallback, NULL, udata);
+}
+
+/**
+ * BLOB reply to the request
+ * the same as wstk_httpd_breply() plus (for 200 and GET/HEAD):
+ *  - 304 by If-None-Match / If-Modified-Since
+ *  - 206 by Range (single and multipart/byteranges) and If-Range, if the reader is seekable (416 if nothing is satisfiable)
+ *  - no body for HEAD
+ * wstk_file_read() is seekable by itself (wstk_file_seek)
+ *
+ * @param conn      - the connection
+ * @param msg       - the request or NULL
+ * @param scode     - http code
+ * @param reason    - http msg
+ * @param ctype     - content type
+ * @param blen      - blob length
+ * @param mtime     - modified time
+ * @param rcallback - reader callback
+ * @param scallback - seek callback or NULL
+ * @param udata     - reader function user data
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_breply2(wstk_http_conn_t *conn, wstk_http_msg_t *msg, uint32_t scode, const char *reason, const char *ctype, size_t blen, time_t mtime, wstk_httpd_blob_reader_callback_t rcallback, wstk_httpd_blob_seek_callback_t scallback, void *udata) {
+    return http_breply(conn, msg, scode, reason, ctype, NULL, blen, mtime, rcallback, scallback, udata);
+}
+
+/**
+ * Formatted output to the connection
+ * goes to the output buffer (as well as the replies), see wstk_httpd_flush()
+ * while a stream is open (see wstk_httpd_stream_begin) it's framed as the chunks
+ *
+ * @param conn      - the connection
+ * @param fmt       - formatted string
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_printf(wstk_http_conn_t *conn, const char *fmt, ...) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    const char *keep_alive_str;
-    const char *reason_local = (reason ? reason : wstk_httpd_reason_by_code(scode));
-    wstk_mbuf_t *mbuf = NULL;
-    wstk_socket_t *sock = NULL;
-    char tbuff[128] = {0};
+    va_list ap;
 
-    if(!conn || !conn->server || !rcallback) {
+    if(!conn || !conn->server || !fmt) {
         return WSTK_STATUS_INVALID_PARAM;
     }
     if(conn->server->fl_destroyed) {
         return WSTK_STATUS_DESTROYED;
     }
 
-    if((status = wstk_tcp_srv_conn_socket(conn->tcp_conn, &sock)) != WSTK_STATUS_SUCCESS) {
+    if((status = stream_chunk_open(conn)) != WSTK_STATUS_SUCCESS) {
         return status;
     }
-    if(!sock) {
-        return WSTK_STATUS_FALSE;
+
+    va_start(ap, fmt);
+    status = http_vprintf(conn, fmt, ap);
+    va_end(ap);
+
+    if(status == WSTK_STATUS_SUCCESS) {
+        status = http_written(conn);
     }
+    return status;
+}
 
-    // send header
-    if((status = wstk_time_to_str_rfc822(mtime, (char *)tbuff, sizeof(tbuff))) != WSTK_STATUS_SUCCESS) {
-        goto out;
+/**
+ * Send out everything collected in the output buffer
+ * while a servlet is performing the replies are held and sent when it returns,
+ * call this to send them earlier (e.g. before writing to the socket directly)
+ *
+ * @param conn      - the connection
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_flush(wstk_http_conn_t *conn) {
+    if(!conn || !conn->server) {
+        return WSTK_STATUS_INVALID_PARAM;
     }
-    keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
-    status = wstk_httpd_reply(conn, scode, reason_local,
-                "Last-Modified: %s\r\n"
-                "Connection: %s\r\n"
-                "Content-Type: %s\r\n"
-                "Content-Length: %zu\r\n"
-                "\r\n",
-                (char *)tbuff,
-                keep_alive_str,
-                ctype,
-                blen
-            );
-    if(status != WSTK_STATUS_SUCCESS) {
-        goto out;
+    if(conn->server->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
     }
 
-    if(!blen) {
-        goto out;
+    return http_flush(conn);
+}
+
+/**
+ * Start a streaming reply, the length isn't known in advance (Transfer-Encoding: chunked)
+ * the content goes by wstk_httpd_stream_write() / wstk_httpd_printf(), every flush sends a chunk,
+ * the connection stays alive after wstk_httpd_stream_end() (HTTP/1.0 clients get the plain content and the connection is closed)
+ *
+ * @param conn      - the connection
+ * @param scode     - http code
+ * @param reason    - http msg or NULL
+ * @param ctype     - content type
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_stream_begin(wstk_http_conn_t *conn, uint32_t scode, const char *reason, const char *ctype) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    const char *reason_local = (reason ? reason : wstk_httpd_reason_by_code(scode));
+    const char *keep_alive_str;
+
+    if(!conn || !conn->server || !ctype) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->server->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(conn->fl_stream) {
+        return WSTK_STATUS_BUSY;
     }
 
-    // send blob
-    if((status = wstk_mbuf_alloc(&mbuf, HTTPD_BLOB_WRITE_BUFFER_SIZE)) != WSTK_STATUS_SUCCESS) {
-        goto out;
+    if(conn->fl_http10) {
+        wstk_tcp_srv_conn_close(conn->tcp_conn); /* the end of content is the end of connection */
+        status = http_format(conn, scode, reason_local,
+                    "Connection: close\r\n"
+                    "Content-Type: %s\r\n"
+                    "\r\n",
+                    ctype
+                );
+    } else {
+        keep_alive_str = (wstk_tcp_srv_conn_is_closed(conn->tcp_conn) ? "close" : "keep-alive");
+        status = http_format(conn, scode, reason_local,
+                    "Connection: %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "Transfer-Encoding: chunked\r\n"
+                    "\r\n",
+                    keep_alive_str,
+                    ctype
+                );
+    }
+    if(status != WSTK_STATUS_SUCCESS) {
+        return status;
     }
-    while(true) {
-        wstk_mbuf_clean(mbuf);
 
-        status = rcallback(udata, mbuf);
-        if(status == WSTK_STATUS_NODATA)  { status = WSTK_STATUS_SUCCESS; break; }
-        if(status != WSTK_STATUS_SUCCESS) { break; }
-        if(!wstk_mbuf_pos(mbuf) && !wstk_mbuf_end(mbuf)) { break; }
+    conn->fl_stream = true;
+    conn->fl_chunk_open = false;
 
-        wstk_mbuf_set_pos(mbuf, 0);
-        status = wstk_tcp_write(sock, mbuf, WSTK_WR_TIMEOUT(blen));
-        if(status != WSTK_STATUS_SUCCESS) {
-            wstk_tcp_srv_conn_close(conn->tcp_conn);
+    return http_written(conn);
+}
+
+/**
+ * Write to the stream
+ * the data are collected in the output buffer, see wstk_httpd_stream_begin()
+ *
+ * @param conn      - the connection
+ * @param data      - the data
+ * @param len       - data length
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_stream_write(wstk_http_conn_t *conn, const void *data, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    const uint8_t *p = (const uint8_t *)data;
+    size_t n = 0;
+
+    if(!conn || !conn->server || (!data && len)) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->server->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(!conn->fl_stream) {
+        return WSTK_STATUS_FALSE;
+    }
+
+    while(len > 0) {
+        if((status = stream_chunk_open(conn)) != WSTK_STATUS_SUCCESS) {
             break;
         }
+        n = MIN(len, HTTPD_WRITE_BUFFER_MAX);
+        if((status = http_printf(conn, "%b", p, n)) != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+        if((status = http_written(conn)) != WSTK_STATUS_SUCCESS) {
+            break;
+        }
+        p += n;
+        len -= n;
     }
-out:
-    wstk_mem_deref(mbuf);
+
+    return status;
+}
+
+/**
+ * Finish the stream (the last chunk)
+ * it's done by the server if the servlet didn't call it
+ *
+ * @param conn      - the connection
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_stream_end(wstk_http_conn_t *conn) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if(!conn || !conn->server) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(!conn->fl_stream) {
+        return WSTK_STATUS_FALSE;
+    }
+
+    status = stream_chunk_close(conn);
+    conn->fl_stream = false;
+
+    if(status == WSTK_STATUS_SUCCESS && !conn->fl_http10) {
+        status = http_printf(conn, "0\r\n\r\n");
+    }
+    if(status == WSTK_STATUS_SUCCESS) {
+        status = http_written(conn);
+    } else {
+        wstk_tcp_srv_conn_close(conn->tcp_conn);
+    }
+
     return status;
 }
 
@@ -1135,6 +2170,161 @@ wstk_status_t wstk_httpd_set_ident(wstk_httpd_t *srv, const char *server_name) {
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Set the number of reactors (polling threads) of the underlying tcp server
+ * Should be called before: wstk_httpd_start()
+ *
+ * @param srv       - the server
+ * @param n         - reactors amount
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_reactors(wstk_httpd_t *srv, uint32_t n) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    return wstk_tcp_srv_set_reactors(srv->tcp_server, n);
+}
+
+/**
+ * Use epoll in edge-triggered mode in the underlying tcp server (default: level-triggered)
+ * Should be called before: wstk_httpd_start()
+ *
+ * @param srv       - the server
+ * @param enable    - true/false
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_edge_triggered(wstk_httpd_t *srv, bool enable) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    return wstk_tcp_srv_set_edge_triggered(srv->tcp_server, enable);
+}
+
+/**
+ * Pin each connection to one worker thread of the underlying tcp server
+ * Should be called before: wstk_httpd_start()
+ *
+ * @param srv       - the server
+ * @param threads   - workers amount (0 = number of processors)
+ * @param cpu_pin   - bind the threads to the processors
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_affinity(wstk_httpd_t *srv, uint32_t threads, bool cpu_pin) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    return wstk_tcp_srv_set_affinity(srv->tcp_server, threads, cpu_pin);
+}
+
+/**
+ * Set the connections output queue watermarks and policy of the underlying tcp server
+ * (the queue is used by the websockets, the http replies are written by the worker)
+ *
+ * @param srv       - the server
+ * @param high      - high watermark in bytes (0 = unlimited)
+ * @param low       - low watermark in bytes
+ * @param policy    - block/drop/close
+ * @param timeout   - the block policy timeout in seconds
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_outq(wstk_httpd_t *srv, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy, uint32_t timeout) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    return wstk_tcp_srv_set_outq(srv->tcp_server, high, low, policy, timeout);
+}
+
+/**
+ * Enable the static content cache
+ * the files from www_home up to max_file_size are kept in memory with the pre-rendered headers,
+ * the changes are noticed by mtime/size in ttl.
+ * Should be called before: wstk_httpd_start()
+ *
+ * @param srv           - the server
+ * @param max_size      - memory limit (0 = disable the cache)
+ * @param max_file_size - bigger files are not cached (0 = 256K)
+ * @param ttl           - seconds between the file checks (0 = 2s)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_cache(wstk_httpd_t *srv, size_t max_size, size_t max_file_size, uint32_t ttl) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(srv->fl_ready) {
+        return WSTK_STATUS_BUSY;
+    }
+
+    srv->cache = wstk_mem_deref(srv->cache);
+    if(max_size) {
+        status = wstk_httpd_cache_create(&srv->cache, max_size, max_file_size, ttl);
+    }
+
+    return status;
+}
+
+/**
+ * Enable the response compression
+ * the replies of wstk_httpd_creply() (and so JSON-RPC) from min_size are deflated (gzip/deflate by Accept-Encoding),
+ * the static files of a compressible type go as the precompressed siblings (file.br, file.gz) if they exist,
+ * the hot ones are kept gzip'ed in the cache (see wstk_httpd_set_cache).
+ * Should be called before: wstk_httpd_start()
+ *
+ * @param srv           - the server
+ * @param min_size      - the smaller replies go as is (0 = don't compress, needs zlib: WSTK_USE_ZLIB)
+ * @param level         - 1..9 or -1 (default)
+ * @param precompressed - look for the precompressed siblings of the files
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_httpd_set_compression(wstk_httpd_t *srv, size_t min_size, int level, bool precompressed) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(srv->fl_ready) {
+        return WSTK_STATUS_BUSY;
+    }
+
+    if(min_size && !wstk_deflate_is_supported()) {
+        log_warn("Compression is not supported (built without zlib)");
+        min_size = 0;
+    }
+
+    srv->compress_min = min_size;
+    srv->compress_level = level;
+    srv->fl_precompressed = precompressed;
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Set authenticator
  *
@@ -1179,7 +2369,7 @@ wstk_status_t wstk_httpd_set_authenticator(wstk_httpd_t *srv, wstk_httpd_authent
 wstk_status_t wstk_httpd_autheticate(wstk_http_conn_t *conn, wstk_http_msg_t *msg, wstk_httpd_sec_ctx_t *ctx) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     wstk_sockaddr_t *peer = NULL;
-    const char *hdr_auth=NULL, *hdr_sid=NULL, *hdr_tok=NULL;
+    wstk_pl_t hdr_auth = {0}, hdr_sid = {0}, hdr_tok = {0};
     const char *clogin = NULL, *cpass = NULL, *ctoken = NULL;
     wstk_httpd_auth_request_t auth_req = {0};
     wstk_httpd_auth_response_t auth_rsp = {0};
@@ -1201,23 +2391,23 @@ wstk_status_t wstk_httpd_autheticate(wstk_http_conn_t *conn, wstk_http_msg_t *ms
     }
 
     wstk_tcp_srv_conn_peer(conn->tcp_conn, &peer);
-    wstk_http_msg_header_get(msg, "X-SESSION-ID", &hdr_sid);
+    if(wstk_http_msg_header_get_pl(msg, "X-SESSION-ID", &hdr_sid) == WSTK_STATUS_SUCCESS) {
+        wstk_pl_strdup(&xsession, &hdr_sid);
+    }
 
     /* workaround for websocket */
-    if(wstk_http_msg_header_get(msg, "Sec-WebSocket-Protocol", &hdr_tok) == WSTK_STATUS_SUCCESS) {
-        if(hdr_tok) {
-            wstk_pl_t p1 = {0};
-            if(wstk_regex(hdr_tok, strlen(hdr_tok), "x-session, [^]+", &p1) == WSTK_STATUS_SUCCESS) {
-                wstk_pl_strdup(&xtoken, &p1);
-            } else if(wstk_regex(hdr_tok, strlen(hdr_tok), "x-token, [^]+", &p1) == WSTK_STATUS_SUCCESS) {
-                wstk_pl_strdup(&xtoken, &p1);
-            }
+    if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_SEC_WEBSOCKET_PROTOCOL, &hdr_tok) == WSTK_STATUS_SUCCESS) {
+        wstk_pl_t p1 = {0};
+        if(wstk_regex(hdr_tok.p, hdr_tok.l, "x-session, [^]+", &p1) == WSTK_STATUS_SUCCESS) {
+            wstk_pl_strdup(&xtoken, &p1);
+        } else if(wstk_regex(hdr_tok.p, hdr_tok.l, "x-token, [^]+", &p1) == WSTK_STATUS_SUCCESS) {
+            wstk_pl_strdup(&xtoken, &p1);
         }
     }
 
-    if(wstk_http_msg_header_get(msg, "Authorization", &hdr_auth) == WSTK_STATUS_SUCCESS && hdr_auth) {
+    if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_AUTHORIZATION, &hdr_auth) == WSTK_STATUS_SUCCESS) {
         wstk_pl_t p1 = {0};
-        if(wstk_regex(hdr_auth, strlen(hdr_auth), "Basic [^]+", &p1) == WSTK_STATUS_SUCCESS) {
+        if(wstk_regex(hdr_auth.p, hdr_auth.l, "Basic [^]+", &p1) == WSTK_STATUS_SUCCESS) {
             if(wstk_base64_decode_str(p1.p, p1.l, &bbuf, &blen) == WSTK_STATUS_SUCCESS) {
                 uint32_t x = 0;
                 for(x=0; x <= blen; x++) {
@@ -1228,7 +2418,7 @@ wstk_status_t wstk_httpd_autheticate(wstk_http_conn_t *conn, wstk_http_msg_t *ms
                     cpass = (char *)bbuf + x + 1;
                 }
             }
-        } else if(wstk_regex(hdr_auth, strlen(hdr_auth), "Bearer [^]+", &p1) == WSTK_STATUS_SUCCESS) {
+        } else if(wstk_regex(hdr_auth.p, hdr_auth.l, "Bearer [^]+", &p1) == WSTK_STATUS_SUCCESS) {
             if(wstk_pl_strdup(&bbuf, &p1) == WSTK_STATUS_SUCCESS) {
                 ctoken = bbuf;
             }
@@ -1238,7 +2428,7 @@ wstk_status_t wstk_httpd_autheticate(wstk_http_conn_t *conn, wstk_http_msg_t *ms
     auth_req.msg = msg;
     auth_req.conn = conn;
     auth_req.peer = peer;
-    auth_req.session = (hdr_sid ? hdr_sid : xsession);
+    auth_req.session = xsession;
     auth_req.token = (ctoken ? ctoken : xtoken);
     auth_req.login = clogin;
     auth_req.password = cpass;
@@ -169,7 +169,11 @@ void *wstk_mem_ref(void *mem) {
     WSTK_DBG_PRINT("mem-ref: mem=%p [dh=%p, refs=%d, size=%d]\n", m, m->dh, m->refs, (uint32_t)m->size);
 #endif
 
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&m->refs, 1);
+#else
     ++m->refs;
+#endif
     return mem;
 }
 
@@ -187,9 +191,17 @@ void *wstk_mem_deref(void *mem) {
     WSTK_DBG_PRINT("mem-deref: mem=%p [dh=%p, refs=%d, size=%d]\n", m, m->dh, m->refs, (uint32_t)m->size);
 #endif
 
+#ifdef WSTK_HAVE_ATOMIC
+    /* acq_rel: the last owner sees all the writes made by the others before the destructor */
+    /* (!= 1 rather than > 1: a nested deref from the destructor must not free it twice)    */
+    if(wstk_atomic_acq_sub(&m->refs, 1) != 1) {
+        return NULL;
+    }
+#else
     if(--m->refs > 0) {
         return NULL;
     }
+#endif
 
     if(m->dh) {
         m->dh(mem);
@@ -8,10 +8,22 @@
 #include <wstk-str.h>
 #include <pthread.h>
 
+/* the timed waits don't follow the wall clock (darwin has no condattr clock) */
+#if defined(CLOCK_MONOTONIC) && !defined(WSTK_OS_DARWIN)
+#define WSTK_COND_CLOCK CLOCK_MONOTONIC
+#define WSTK_HAVE_COND_CLOCK
+#else
+#define WSTK_COND_CLOCK CLOCK_REALTIME
+#endif
+
 struct wstk_mutex_s {
     pthread_mutex_t hmtx;
 };
 
+struct wstk_cond_s {
+    pthread_cond_t  hcond;
+};
+
 static void destructor__wstk_mutex_t(void *data) {
     wstk_mutex_t *mtx = data;
     int err = 0;
@@ -27,6 +39,17 @@ static void destructor__wstk_mutex_t(void *data) {
 #endif
 }
 
+static void destructor__wstk_cond_t(void *data) {
+    wstk_cond_t *cond = data;
+    int err = 0;
+
+    if(!cond) { return; }
+
+    if((err = pthread_cond_destroy(&cond->hcond)) != 0) {
+        log_error("Couldn't destroy cond handler (err=%i)", err);
+    }
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // public
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -112,4 +135,91 @@ wstk_status_t wstk_mutex_unlock(wstk_mutex_t *mtx) {
     return WSTK_STATUS_SUCCESS;
 }
 
+wstk_status_t wstk_cond_create(wstk_cond_t **cond) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_cond_t *cond_local = NULL;
+    pthread_condattr_t *pattr = NULL;
+#ifdef WSTK_HAVE_COND_CLOCK
+    pthread_condattr_t attr;
+#endif
+    int err;
+
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&cond_local, sizeof(wstk_cond_t), destructor__wstk_cond_t);
+    if(status !=  WSTK_STATUS_SUCCESS) { goto out; }
+
+#ifdef WSTK_HAVE_COND_CLOCK
+    if((err = pthread_condattr_init(&attr)) != 0) {
+        log_error("pthread_condattr_init() failed (err=%i)", err);
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+    pattr = &attr;
+
+    if((err = pthread_condattr_setclock(pattr, WSTK_COND_CLOCK)) != 0) {
+        log_error("pthread_condattr_setclock() failed (err=%i)", err);
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+#endif
+
+    if((err = pthread_cond_init(&cond_local->hcond, pattr)) != 0) {
+        log_error("pthread_cond_init() failed (err=%i)", err);
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
 
+    *cond = cond_local;
+out:
+    if(pattr) {
+        pthread_condattr_destroy(pattr);
+    }
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(cond_local);
+    }
+    return status;
+}
+
+wstk_status_t wstk_cond_wait(wstk_cond_t *cond, wstk_mutex_t *mtx, uint32_t timeout) {
+    struct timespec ts = { 0 };
+    int err;
+
+    if(!cond || !mtx) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if(!timeout) {
+        err = pthread_cond_wait(&cond->hcond, &mtx->hmtx);
+    } else {
+        clock_gettime(WSTK_COND_CLOCK, &ts);
+        ts.tv_sec += (timeout / 1000);
+        ts.tv_nsec += (timeout % 1000) * 1000000L;
+        if(ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        err = pthread_cond_timedwait(&cond->hcond, &mtx->hmtx, &ts);
+    }
+
+    if(err == ETIMEDOUT) {
+        return WSTK_STATUS_TIMEOUT;
+    }
+
+    return (err == 0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
+
+wstk_status_t wstk_cond_signal(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    return (pthread_cond_signal(&cond->hcond) == 0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
+
+wstk_status_t wstk_cond_broadcast(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    return (pthread_cond_broadcast(&cond->hcond) == 0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
@@ -12,6 +12,24 @@ struct wstk_mutex_s {
     unsigned long hmtx;
 };
 
+/* event semaphore based, a post wakes all the waiters (callers have to recheck their condition) */
+struct wstk_cond_s {
+    unsigned long hev;
+};
+
+static void destructor__wstk_cond_t(void *data) {
+    wstk_cond_t *cond = data;
+    ULONG err;
+
+    if(!cond) { return; }
+
+    if(cond->hev) {
+        if((err = DosCloseEventSem(cond->hev)) != 0) {
+            log_error("DosCloseEventSem: err=%d", err);
+        }
+    }
+}
+
 static void destructor__wstk_mutex_t(void *data) {
     wstk_mutex_t *mtx = data;
     ULONG err;
@@ -106,3 +124,66 @@ wstk_status_t wstk_mutex_unlock(wstk_mutex_t *mtx) {
 
     return WSTK_STATUS_SUCCESS;
 }
+
+wstk_status_t wstk_cond_create(wstk_cond_t **cond) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_cond_t *cond_local = NULL;
+    ULONG err;
+
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&cond_local, sizeof(wstk_cond_t), destructor__wstk_cond_t);
+    if(status !=  WSTK_STATUS_SUCCESS) { goto out; }
+
+    if((err = DosCreateEventSem(NULL, &(cond_local->hev), 0, FALSE)) != 0) {
+        log_error("DosCreateEventSem: err=%d", err);
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+
+    *cond = cond_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(cond_local);
+    }
+    return status;
+}
+
+wstk_status_t wstk_cond_wait(wstk_cond_t *cond, wstk_mutex_t *mtx, uint32_t timeout) {
+    ULONG err, cnt = 0;
+
+    if(!cond || !mtx) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    /* a post can be reset by another waiter, so the infinite wait is limited */
+    DosReleaseMutexSem(mtx->hmtx);
+    err = DosWaitEventSem(cond->hev, (timeout ? timeout : 1000));
+    DosRequestMutexSem(mtx->hmtx, SEM_INDEFINITE_WAIT);
+    DosResetEventSem(cond->hev, &cnt);
+
+    if(err == ERROR_TIMEOUT) {
+        return (timeout ? WSTK_STATUS_TIMEOUT : WSTK_STATUS_SUCCESS);
+    }
+
+    return (err == 0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
+
+wstk_status_t wstk_cond_signal(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    DosPostEventSem(cond->hev);
+    return WSTK_STATUS_SUCCESS;
+}
+
+wstk_status_t wstk_cond_broadcast(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    DosPostEventSem(cond->hev);
+    return WSTK_STATUS_SUCCESS;
+}
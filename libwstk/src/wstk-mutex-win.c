@@ -11,6 +11,23 @@ struct wstk_mutex_s {
     CRITICAL_SECTION  cs;
 };
 
+/* semaphore based, waiters counter is protected by the user mutex */
+struct wstk_cond_s {
+    HANDLE            hsem;
+    uint32_t          waiters;
+};
+
+static void destructor__wstk_cond_t(void *data) {
+    wstk_cond_t *cond = data;
+
+    if(!cond) { return; }
+
+    if(cond->hsem) {
+        CloseHandle(cond->hsem);
+        cond->hsem = NULL;
+    }
+}
+
 static void destructor__wstk_mutex_t(void *data) {
     wstk_mutex_t *mtx = data;
     int err = 0;
@@ -82,3 +99,72 @@ wstk_status_t wstk_mutex_unlock(wstk_mutex_t *mtx) {
     LeaveCriticalSection(&mtx->cs);
     return WSTK_STATUS_SUCCESS;
 }
+
+wstk_status_t wstk_cond_create(wstk_cond_t **cond) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_cond_t *cond_local = NULL;
+
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&cond_local, sizeof(wstk_cond_t), destructor__wstk_cond_t);
+    if(status !=  WSTK_STATUS_SUCCESS) { goto out; }
+
+    cond_local->hsem = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+    if(!cond_local->hsem) {
+        log_error("CreateSemaphore() failed (err=%d)", (int)GetLastError());
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+
+    *cond = cond_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(cond_local);
+    }
+    return status;
+}
+
+wstk_status_t wstk_cond_wait(wstk_cond_t *cond, wstk_mutex_t *mtx, uint32_t timeout) {
+    DWORD rc = 0;
+
+    if(!cond || !mtx) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    cond->waiters++;
+    LeaveCriticalSection(&mtx->cs);
+    rc = WaitForSingleObject(cond->hsem, (timeout ? timeout : INFINITE));
+    EnterCriticalSection(&mtx->cs);
+    if(cond->waiters) cond->waiters--;
+
+    if(rc == WAIT_TIMEOUT) {
+        return WSTK_STATUS_TIMEOUT;
+    }
+
+    return (rc == WAIT_OBJECT_0 ? WSTK_STATUS_SUCCESS : WSTK_STATUS_FALSE);
+}
+
+wstk_status_t wstk_cond_signal(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if(cond->waiters) {
+        ReleaseSemaphore(cond->hsem, 1, NULL);
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+wstk_status_t wstk_cond_broadcast(wstk_cond_t *cond) {
+    if(!cond) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if(cond->waiters) {
+        ReleaseSemaphore(cond->hsem, cond->waiters, NULL);
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
@@ -3,6 +3,7 @@
  ** (C)2024 aks
  **/
 #include <wstk-net.h>
+#include <wstk-poll.h>
 #include <wstk-log.h>
 #include <wstk-mem.h>
 #include <wstk-time.h>
@@ -23,6 +24,10 @@ static void desctuctor__wstk_socket_t(void *ptr) {
     WSTK_DBG_PRINT("destroying socket: sock=%p (fd=%d, type=%d, proto=%d, ssl-ctx=%p, udate=%p, udata_destroy=%d)", sock, sock->fd, sock->type, sock->proto, sock->ssl_ctx, sock->udata, sock->fl_adestroy_udata);
 #endif
 
+    if(sock->twheel) {
+        wstk_poll_twheel_del(sock->twheel, sock);
+    }
+
     if(sock->fd) {
         shutdown(sock->fd, SHUT_RDWR);
         close(sock->fd);
@@ -269,10 +274,46 @@ wstk_status_t wstk_sock_set_nodelay(wstk_socket_t *sock, bool val) {
         return WSTK_STATUS_DESTROYED;
     }
 
-    if(setsockopt(sock->fd, SOL_SOCKET, TCP_NODELAY, (void *) &r, sizeof(r)) < 0) {
+    if(setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, (void *) &r, sizeof(r)) < 0) {
+        sock->err = errno;
+        return WSTK_STATUS_FALSE;
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Set/Clear TCP_CORK (TCP_NOPUSH on bsd)
+ * while it's set the partial frames are held, clearing it flushes them
+ *
+ * @param sock          - the socket
+ * @param val           - true/fale
+ *
+ * @return succes or error
+ **/
+wstk_status_t wstk_sock_set_cork(wstk_socket_t *sock, bool val) {
+    int r = val;
+
+    if(!sock) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(sock->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+#if defined(TCP_CORK)
+    if(setsockopt(sock->fd, IPPROTO_TCP, TCP_CORK, (void *) &r, sizeof(r)) < 0) {
+        sock->err = errno;
+        return WSTK_STATUS_FALSE;
+    }
+#elif defined(TCP_NOPUSH)
+    if(setsockopt(sock->fd, IPPROTO_TCP, TCP_NOPUSH, (void *) &r, sizeof(r)) < 0) {
         sock->err = errno;
         return WSTK_STATUS_FALSE;
     }
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
 
     return WSTK_STATUS_SUCCESS;
 }
@@ -337,6 +378,10 @@ wstk_status_t wstk_sock_set_expiry(wstk_socket_t *sock, uint32_t timeout) {
         return WSTK_STATUS_DESTROYED;
     }
 
+    if(sock->twheel) {
+        return wstk_poll_twheel_reschedule(sock->twheel, sock, (timeout ? wstk_time_epoch_now() + timeout : 0));
+    }
+
     sock->expiry = (timeout ? wstk_time_epoch_now() + timeout : 0);
     return WSTK_STATUS_SUCCESS;
 }
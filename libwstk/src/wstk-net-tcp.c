@@ -10,6 +10,13 @@
 #include <wstk-fmt.h>
 #include <wstk-pl.h>
 
+#ifdef WSTK_HAVE_SENDFILE
+#include <sys/sendfile.h>
+#include <poll.h>
+#endif
+
+#define TCP_READ_SPACE_MIN  4096
+
 #ifdef WSTK_OS_WIN
  #define close closesocket
  #define BUF_CAST (char *)
@@ -339,6 +346,71 @@ out:
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Send a part of the file by the kernel (without copying it through the userspace)
+ * does one attempt as well as wstk_tcp_write(), the offset is moved on the sent amount.
+ * Doesn't work with ssl sockets (returns WSTK_STATUS_NOT_IMPL as well as on the systems without sendfile)
+ *
+ * @param sock      - socket
+ * @param fd        - file descriptor
+ * @param offset    - the file offset
+ * @param len       - bytes to send
+ * @param timeout   - 0 or time in seconds to wait for
+ *
+ * @return succes or error
+ **/
+wstk_status_t wstk_tcp_sendfile(wstk_socket_t *sock, int fd, size_t *offset, size_t len, uint32_t timeout) {
+#ifdef WSTK_HAVE_SENDFILE
+    off_t ofs = 0;
+    ssize_t rc = 0;
+
+    if(!sock || !offset || fd < 0 || sock->proto != IPPROTO_TCP) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(sock->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(sock->ssl_ctx) {
+        return WSTK_STATUS_NOT_IMPL;
+    }
+    if(!len) {
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    /* poll() rather than select(), the fd can be above FD_SETSIZE here */
+    if(timeout > 0) {
+        struct pollfd pfd = {0};
+        int err = 0;
+
+        pfd.fd = sock->fd;
+        pfd.events = POLLOUT;
+
+        err = poll(&pfd, 1, (int)(timeout * 1000));
+        if(err < 0) {
+            return WSTK_STATUS_FALSE;
+        }
+        if(err == 0) {
+            return WSTK_STATUS_NODATA;
+        }
+    }
+
+    ofs = (off_t) *offset;
+    rc = sendfile(sock->fd, fd, &ofs, len);
+    if(rc < 0) {
+        sock->err = WSTK_SOCK_ERROR;
+        return (sock->err == EINVAL || sock->err == ENOSYS ? WSTK_STATUS_NOT_IMPL : WSTK_STATUS_FALSE);
+    }
+    if(rc == 0) {
+        return WSTK_STATUS_FALSE; /* the file is shorter than expected */
+    }
+
+    *offset += rc;
+    return WSTK_STATUS_SUCCESS;
+#else
+    return WSTK_STATUS_NOT_IMPL;
+#endif
+}
+
 /**
  * Read data from the socket into mbuf
  * The buffer will be growing, during new data feeds, if you want to have a fixed size, set mbuf->pos=0 before a call
@@ -352,8 +424,7 @@ out:
  **/
 wstk_status_t wstk_tcp_read(wstk_socket_t *sock, wstk_mbuf_t *mbuf, uint32_t timeout) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    char *ptr = NULL;
-    size_t rsz = 0;
+    size_t space = 0, total = 0;
     int rc = 0, sel_rc = 0;
 
     if(!mbuf || !sock || sock->proto != IPPROTO_TCP) {
@@ -363,17 +434,6 @@ wstk_status_t wstk_tcp_read(wstk_socket_t *sock, wstk_mbuf_t *mbuf, uint32_t tim
         return WSTK_STATUS_DESTROYED;
     }
 
-    status = wstk_sock_get_bytes_to_read(sock, &rsz);
-    if(status != WSTK_STATUS_SUCCESS) { return status; }
-    if(!rsz && !timeout) { return WSTK_STATUS_NODATA; }
-
-    if(wstk_mbuf_space(mbuf) < rsz) {
-        status = wstk_mbuf_resize(mbuf, (mbuf->size + MAX(rsz, 4096)) );
-        if(status != WSTK_STATUS_SUCCESS) { return status; }
-    }
-    ptr = (char *)wstk_mbuf_buf(mbuf);
-
-    soselect:
     if(timeout > 0) {
         struct timeval tv = {0};
         fd_set fdset;
@@ -393,33 +453,48 @@ wstk_status_t wstk_tcp_read(wstk_socket_t *sock, wstk_mbuf_t *mbuf, uint32_t tim
         }
     }
 
-    rc = recv(sock->fd, ptr, rsz, 0);
-    if(rc < 0) {
-        sock->err = WSTK_SOCK_ERROR;
-        if(sock->err == EAGAIN || sock->err == EWOULDBLOCK) {
-            wstk_goto_status(WSTK_STATUS_NODATA, out);
-        }
-        if(sock->err == EPIPE) {
-            wstk_goto_status(WSTK_STATUS_CONN_DISCON, out);
+    /* no FIONREAD, reads till a short read (that's everything the socket has for now) */
+    while(true) {
+        if(wstk_mbuf_space(mbuf) < TCP_READ_SPACE_MIN) {
+            status = wstk_mbuf_resize(mbuf, (mbuf->size + MAX(total, TCP_READ_SPACE_MIN)));
+            if(status != WSTK_STATUS_SUCCESS) { break; }
         }
-        status = WSTK_STATUS_FALSE;
-    } else {
+        space = wstk_mbuf_space(mbuf);
+
+        rc = recv(sock->fd, BUF_CAST wstk_mbuf_buf(mbuf), space, 0);
         if(rc > 0) {
             mbuf->pos += rc;
             mbuf->end = mbuf->pos;
-            sock->rderr = 0;
-        } else {
-            sock->err = WSTK_SOCK_ERROR;
-            if(sock->err == EAGAIN || sock->err == EWOULDBLOCK) {
-                status = WSTK_STATUS_CONN_DISCON;
-            } else {
-                if(sel_rc && !rc) { sock->rderr++; }
-                if(sock->rderr > 10) { status = WSTK_STATUS_CONN_DISCON; }
-                else { status = WSTK_STATUS_NODATA; }
+            total += rc;
+            if((size_t)rc < space) {
+                break;
             }
+            continue;
+        }
+        if(rc == 0) {
+            status = WSTK_STATUS_CONN_DISCON;
+            break;
+        }
+
+        sock->err = WSTK_SOCK_ERROR;
+        if(sock->err == EINTR) {
+            continue;
+        }
+        if(sock->err == EAGAIN || sock->err == EWOULDBLOCK) {
+            status = WSTK_STATUS_NODATA;
+        } else if(sock->err == EPIPE || sock->err == ECONNRESET) {
+            status = WSTK_STATUS_CONN_DISCON;
+        } else {
+            status = WSTK_STATUS_FALSE;
         }
+        break;
     }
-out:
+
+    /* got something, eof/error will be seen on the next call */
+    if(total) {
+        status = WSTK_STATUS_SUCCESS;
+    }
+
     return status;
 }
 
@@ -15,7 +15,12 @@
 
 #ifdef WSTK_HAVE_EPOLL
 #include <sys/epoll.h>
+#ifndef EPOLLRDHUP
+ #define EPOLLRDHUP 0x2000
 #endif
+#endif
+
+#define POLL_EPOLL_EVENTS_MAX 256
 
 struct wstk_poll_epoll_s {
 #ifdef WSTK_HAVE_EPOLL
@@ -23,6 +28,7 @@ struct wstk_poll_epoll_s {
 #endif
     wstk_mutex_t            *mutex;
     wstk_inthash_t          *sockets;
+    wstk_poll_twheel_t      *twheel;
     wstk_list_t             *slist1;
     wstk_list_t             *slist2;
     void                    *udata;
@@ -31,6 +37,8 @@ struct wstk_poll_epoll_s {
     uint32_t                flags;
     uint32_t                size;
     uint32_t                timeout;
+    uint32_t                events_max;
+    bool                    fl_edge;
     bool                    fl_polling;
     bool                    fl_destroyed;
 };
@@ -73,18 +81,23 @@ static void destructor__wstk_poll_epoll_t(void *data) {
             wstk_hash_index_t *hidx = NULL;
             wstk_socket_t *sock = NULL;
 
-            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
-                wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
+            const void *key = NULL;
+
+            /* the deletion breaks the iterator, so it starts over for each socket (the fd can be closed already) */
+            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_first_iter(poll->sockets, hidx)) {
+                wstk_hash_this(hidx, &key, NULL, (void *)&sock);
+                wstk_core_inthash_delete(poll->sockets, *(uint32_t *)key);
 
                 if(!sock) { continue; }
 
-                wstk_core_inthash_delete(poll->sockets, sock->fd);
+                wstk_poll_twheel_del(poll->twheel, sock);
                 poll->handler(sock, WSTK_POLL_ESCLOSED, poll->udata);
             }
         }
         poll->sockets = wstk_mem_deref(poll->sockets);
     }
 
+    poll->twheel = wstk_mem_deref(poll->twheel);
     poll->slist1 = wstk_mem_deref(poll->slist1);
     poll->slist2 = wstk_mem_deref(poll->slist2);
     poll->events = wstk_mem_deref(poll->events);
@@ -95,6 +108,26 @@ static void destructor__wstk_poll_epoll_t(void *data) {
 #endif
 }
 
+static uint32_t poll_socket_events(wstk_poll_epoll_t *poll, wstk_socket_t *socket) {
+    uint32_t events = 0;
+
+    if(socket->pmask & WSTK_POLL_MREAD)  {
+        events |= EPOLLIN;
+    }
+    if(socket->pmask & WSTK_POLL_MWRITE) {
+        events |= EPOLLOUT;
+    }
+    if(socket->pmask & WSTK_POLL_MEXCEPT) {
+        events |= EPOLLERR;
+    }
+    /* listeners stay level-triggered, accept takes one connection per call */
+    if(poll->fl_edge && !(socket->pmask & WSTK_POLL_MLISTENER)) {
+        events |= (EPOLLET | EPOLLRDHUP);
+    }
+
+    return events;
+}
+
 static wstk_status_t poll_socket_add_perform(wstk_poll_epoll_t *poll, wstk_socket_t *socket) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     struct epoll_event event = {0};
@@ -110,16 +143,7 @@ static wstk_status_t poll_socket_add_perform(wstk_poll_epoll_t *poll, wstk_socke
         status = wstk_inthash_insert(poll->sockets, socket->fd, socket);
         if(status == WSTK_STATUS_SUCCESS) {
             event.data.ptr = socket;
-
-            if(socket->pmask & WSTK_POLL_MREAD)  {
-                event.events |= EPOLLIN;
-            }
-            if(socket->pmask & WSTK_POLL_MWRITE) {
-                event.events |= EPOLLOUT;
-            }
-            if(socket->pmask & WSTK_POLL_MEXCEPT) {
-                event.events |= EPOLLERR;
-            }
+            event.events = poll_socket_events(poll, socket);
 
             if(epoll_ctl(poll->epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
                 err = errno;
@@ -127,7 +151,9 @@ static wstk_status_t poll_socket_add_perform(wstk_poll_epoll_t *poll, wstk_socke
                 status = WSTK_STATUS_FALSE;
             }
         }
-        if(status != WSTK_STATUS_SUCCESS) {
+        if(status == WSTK_STATUS_SUCCESS) {
+            wstk_poll_twheel_add(poll->twheel, socket);
+        } else {
             wstk_core_inthash_delete(poll->sockets, fd);
         }
     }
@@ -262,6 +288,9 @@ wstk_status_t wstk_poll_epoll_create(wstk_poll_epoll_t **poll, uint32_t size, ui
     if((status = wstk_inthash_init(&pvt->sockets)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
+    if((status = wstk_poll_twheel_create(&pvt->twheel)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
 
     if((status = wstk_list_create(&pvt->slist1)) != WSTK_STATUS_SUCCESS) {
         goto out;
@@ -275,6 +304,8 @@ wstk_status_t wstk_poll_epoll_create(wstk_poll_epoll_t **poll, uint32_t size, ui
     pvt->handler = handler;
     pvt->flags = flags;
     pvt->udata = udata;
+    pvt->fl_edge = (flags & WSTK_POLL_FEDGE_TRIGGERED);
+    pvt->events_max = MIN(pvt->size, POLL_EPOLL_EVENTS_MAX);
 
     pvt->epfd = -1;
     pvt->epfd = epoll_create(pvt->size);
@@ -283,7 +314,7 @@ wstk_status_t wstk_poll_epoll_create(wstk_poll_epoll_t **poll, uint32_t size, ui
         wstk_goto_status(WSTK_STATUS_FALSE, out);
     }
 
-    status = wstk_mem_zalloc((void *)&pvt->events, (pvt->size * sizeof(*pvt->events)), NULL);
+    status = wstk_mem_zalloc((void *)&pvt->events, (pvt->events_max * sizeof(*pvt->events)), NULL);
     if(status != WSTK_STATUS_SUCCESS) {
         goto out;
     }
@@ -329,6 +360,9 @@ wstk_status_t wstk_poll_epoll_del(wstk_poll_epoll_t *poll, wstk_socket_t *socket
         return WSTK_STATUS_DESTROYED;
     }
 
+    /* stop expiry tracking right away, the deletion can be deferred */
+    wstk_poll_twheel_del(poll->twheel, socket);
+
     if(poll->fl_polling) {
         status = poll_deferred_action(poll, socket, 2);
     } else {
@@ -338,11 +372,31 @@ wstk_status_t wstk_poll_epoll_del(wstk_poll_epoll_t *poll, wstk_socket_t *socket
     return status;
 }
 
+/* applies the changed socket mask, safe to call from any thread (doesn't touch the sockets map) */
+wstk_status_t wstk_poll_epoll_update(wstk_poll_epoll_t *poll, wstk_socket_t *socket) {
+    struct epoll_event event = {0};
+
+    if(!poll || !socket) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(poll->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    event.data.ptr = socket;
+    event.events = poll_socket_events(poll, socket);
+
+    /* not there yet (a deferred add picks the mask up) or already deleted */
+    if(epoll_ctl(poll->epfd, EPOLL_CTL_MOD, socket->fd, &event) < 0) {
+        return WSTK_STATUS_FALSE;
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_hash_index_t *hidx = NULL;
-    time_t curr_ts = 0;
-    uint32_t psz=0, fds=0;
+    uint32_t psz=0;
     int rc = 0, event = 0;
 
     if(!poll) {
@@ -365,13 +419,12 @@ wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll) {
     }
 
     poll->fl_polling = true;
-    fds = wstk_hash_size(poll->sockets);
 
 #ifdef WSTK_POLL_DEBUG
-    WSTK_DBG_PRINT("polling-perform: [poll=%p, fds=%d]", poll, fds);
+    WSTK_DBG_PRINT("polling-perform: [poll=%p, events-max=%d]", poll, poll->events_max);
 #endif
 
-    rc = epoll_wait(poll->epfd, poll->events, fds, (poll->timeout ? (poll->timeout * 1000): -1));
+    rc = epoll_wait(poll->epfd, poll->events, poll->events_max, (poll->timeout ? (poll->timeout * 1000): -1));
     if(rc < 0 || poll->fl_destroyed) {
         poll->fl_polling = false;
         return WSTK_STATUS_FALSE;
@@ -384,7 +437,18 @@ wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll) {
 
             event = 0x0;
             if(sock) {
-                if(eev->events & EPOLLIN) {
+                if(poll->fl_edge && !(sock->pmask & WSTK_POLL_MLISTENER)) {
+                    /* edge-triggered: no FIONREAD, RDHUP comes with EPOLLIN and the reader gets eof (recv = 0) after the data, */
+                    /* the socket is closed here only when there is nothing to read anymore */
+                    if(eev->events & EPOLLIN) {
+                        event |= WSTK_POLL_EREAD;
+                    }
+                    if(!(sock->pmask & WSTK_POLL_MRDLOCK)) {
+                        if((eev->events & EPOLLHUP) || ((eev->events & EPOLLRDHUP) && !(eev->events & EPOLLIN))) {
+                            event |= WSTK_POLL_ESCLOSED;
+                        }
+                    }
+                } else if(eev->events & EPOLLIN) {
                     event |= WSTK_POLL_EREAD;
                     if(!(sock->pmask & WSTK_POLL_MLISTENER) && !(sock->pmask & WSTK_POLL_MRDLOCK)) {
                         size_t rd = 0;
@@ -407,17 +471,7 @@ wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll) {
     }
 
     /* who expired */
-    curr_ts = wstk_time_epoch_now();
-    for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
-        wstk_socket_t *sock = NULL;
-        wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
-
-        if(!sock) { continue; }
-
-        if(sock->expiry && sock->expiry <= curr_ts) {
-            poll->handler(sock, WSTK_POLL_ESEXPIRED, poll->udata);
-        }
-    }
+    wstk_poll_twheel_perform(poll->twheel, poll->handler, poll->udata);
 
     poll->fl_polling = false;
 
@@ -461,6 +515,9 @@ wstk_status_t wstk_poll_epoll_add(wstk_poll_epoll_t *poll, wstk_socket_t *socket
 wstk_status_t wstk_poll_epoll_del(wstk_poll_epoll_t *poll, wstk_socket_t *socket) {
     return WSTK_STATUS_UNSUPPORTED;
 }
+wstk_status_t wstk_poll_epoll_update(wstk_poll_epoll_t *poll, wstk_socket_t *socket) {
+    return WSTK_STATUS_UNSUPPORTED;
+}
 wstk_status_t wstk_poll_epoll_polling(wstk_poll_epoll_t *poll) {
     return WSTK_STATUS_UNSUPPORTED;
 }
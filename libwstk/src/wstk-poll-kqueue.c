@@ -23,6 +23,7 @@ struct wstk_poll_kqueue_s {
 #endif
     wstk_mutex_t            *mutex;
     wstk_inthash_t          *sockets;
+    wstk_poll_twheel_t      *twheel;
     wstk_list_t             *slist1;
     wstk_list_t             *slist2;
     void                    *udata;
@@ -73,18 +74,23 @@ static void destructor__wstk_poll_kqueue_t(void *data) {
             wstk_hash_index_t *hidx = NULL;
             wstk_socket_t *sock = NULL;
 
-            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
-                wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
+            const void *key = NULL;
+
+            /* the deletion breaks the iterator, so it starts over for each socket (the fd can be closed already) */
+            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_first_iter(poll->sockets, hidx)) {
+                wstk_hash_this(hidx, &key, NULL, (void *)&sock);
+                wstk_core_inthash_delete(poll->sockets, *(uint32_t *)key);
 
                 if(!sock) { continue; }
 
-                wstk_core_inthash_delete(poll->sockets, sock->fd);
+                wstk_poll_twheel_del(poll->twheel, sock);
                 poll->handler(sock, WSTK_POLL_ESCLOSED, poll->udata);
             }
         }
         poll->sockets = wstk_mem_deref(poll->sockets);
     }
 
+    poll->twheel = wstk_mem_deref(poll->twheel);
     poll->slist1 = wstk_mem_deref(poll->slist1);
     poll->slist2 = wstk_mem_deref(poll->slist2);
     poll->events = wstk_mem_deref(poll->events);
@@ -125,7 +131,9 @@ static wstk_status_t poll_socket_add_perform(wstk_poll_kqueue_t *poll, wstk_sock
                 status = WSTK_STATUS_FALSE;
             }
         }
-        if(status != WSTK_STATUS_SUCCESS) {
+        if(status == WSTK_STATUS_SUCCESS) {
+            wstk_poll_twheel_add(poll->twheel, socket);
+        } else {
             wstk_core_inthash_delete(poll->sockets, fd);
         }
     }
@@ -261,6 +269,9 @@ wstk_status_t wstk_poll_kqueue_create(wstk_poll_kqueue_t **poll, uint32_t size,
     if((status = wstk_inthash_init(&pvt->sockets)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
+    if((status = wstk_poll_twheel_create(&pvt->twheel)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
     if((status = wstk_list_create(&pvt->slist1)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
@@ -331,6 +342,9 @@ wstk_status_t wstk_poll_kqueue_del(wstk_poll_kqueue_t *poll, wstk_socket_t *sock
         return WSTK_STATUS_DESTROYED;
     }
 
+    /* stop expiry tracking right away, the deletion can be deferred */
+    wstk_poll_twheel_del(poll->twheel, socket);
+
     if(poll->fl_polling) {
         status = poll_deferred_action(poll, socket, 2);
     } else {
@@ -340,11 +354,31 @@ wstk_status_t wstk_poll_kqueue_del(wstk_poll_kqueue_t *poll, wstk_socket_t *sock
     return status;
 }
 
+/* applies the changed socket mask (the filters are added/deleted one by one, a missing one isn't an error) */
+wstk_status_t wstk_poll_kqueue_update(wstk_poll_kqueue_t *poll, wstk_socket_t *socket) {
+    struct kevent kev = { 0 };
+    int fd = 0;
+
+    if(!poll || !socket) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(poll->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    fd = socket->fd;
+    EV_SET(&kev, fd, EVFILT_READ, ((socket->pmask & WSTK_POLL_MREAD) ? (EV_ADD|EV_CLEAR) : EV_DELETE), 0, 0, socket);
+    kevent(poll->kqfd, &kev, 1, NULL, 0, NULL);
+
+    EV_SET(&kev, fd, EVFILT_WRITE, ((socket->pmask & WSTK_POLL_MWRITE) ? (EV_ADD|EV_CLEAR) : EV_DELETE), 0, 0, socket);
+    kevent(poll->kqfd, &kev, 1, NULL, 0, NULL);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 wstk_status_t wstk_poll_kqueue_polling(wstk_poll_kqueue_t *poll) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     struct timespec tv = { 0 }, *tv_ptr = NULL;
-    wstk_hash_index_t *hidx = NULL;
-    time_t curr_ts = 0;
     uint32_t psz=0, fds=0;
     int rc = 0, event = 0;
 
@@ -421,17 +455,7 @@ wstk_status_t wstk_poll_kqueue_polling(wstk_poll_kqueue_t *poll) {
     }
 
     /* who expired */
-    curr_ts = wstk_time_epoch_now();
-    for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
-        wstk_socket_t *sock = NULL;
-        wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
-
-        if(!sock) { continue; }
-
-        if(sock->expiry && sock->expiry <= curr_ts) {
-            poll->handler(sock, WSTK_POLL_ESEXPIRED, poll->udata);
-        }
-    }
+    wstk_poll_twheel_perform(poll->twheel, poll->handler, poll->udata);
 
     poll->fl_polling = false;
 
@@ -476,6 +500,9 @@ wstk_status_t wstk_poll_kqueue_add(wstk_poll_kqueue_t *poll, wstk_socket_t *sock
 wstk_status_t wstk_poll_kqueue_del(wstk_poll_kqueue_t *poll, wstk_socket_t *socket) {
     return WSTK_STATUS_UNSUPPORTED;
 }
+wstk_status_t wstk_poll_kqueue_update(wstk_poll_kqueue_t *poll, wstk_socket_t *socket) {
+    return WSTK_STATUS_UNSUPPORTED;
+}
 wstk_status_t wstk_poll_kqueue_polling(wstk_poll_kqueue_t *poll) {
     return WSTK_STATUS_UNSUPPORTED;
 }
@@ -14,6 +14,7 @@
 
 struct wstk_poll_select_s {
     wstk_inthash_t          *sockets;
+    wstk_poll_twheel_t      *twheel;
     wstk_list_t             *slist1;
     wstk_list_t             *slist2;
     void                    *udata;
@@ -21,6 +22,7 @@ struct wstk_poll_select_s {
     uint32_t                size;
     uint32_t                timeout;
     uint32_t                flags;
+    int                     wakefd[2];      // self-pipe, interrupts select()
     bool                    fl_polling;
     bool                    fl_destroyed;
 };
@@ -54,21 +56,31 @@ static void destructor__wstk_poll_select_t(void *data) {
             wstk_hash_index_t *hidx = NULL;
             wstk_socket_t *sock = NULL;
 
-            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
-                wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
+            const void *key = NULL;
+
+            /* the deletion breaks the iterator, so it starts over for each socket (the fd can be closed already) */
+            for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_first_iter(poll->sockets, hidx)) {
+                wstk_hash_this(hidx, &key, NULL, (void *)&sock);
+                wstk_core_inthash_delete(poll->sockets, *(uint32_t *)key);
 
                 if(!sock) { continue; }
 
-                wstk_core_inthash_delete(poll->sockets, sock->fd);
+                wstk_poll_twheel_del(poll->twheel, sock);
                 poll->handler(sock, WSTK_POLL_ESCLOSED, poll->udata);
             }
         }
         poll->sockets = wstk_mem_deref(poll->sockets);
     }
 
+    poll->twheel = wstk_mem_deref(poll->twheel);
     poll->slist1 = wstk_mem_deref(poll->slist1);
     poll->slist2 = wstk_mem_deref(poll->slist2);
 
+#ifndef WSTK_OS_WIN
+    if(poll->wakefd[0] >= 0) { close(poll->wakefd[0]); }
+    if(poll->wakefd[1] >= 0) { close(poll->wakefd[1]); }
+#endif
+
 #ifdef WSTK_POLL_DEBUG
     WSTK_DBG_PRINT("poll destroyed: poll=%p ", poll);
 #endif
@@ -85,6 +97,9 @@ static wstk_status_t poll_socket_add_perform(wstk_poll_select_t *poll, wstk_sock
         status = WSTK_STATUS_ALREADY_EXISTS;
     } else {
         status = wstk_inthash_insert(poll->sockets, socket->fd, socket);
+        if(status == WSTK_STATUS_SUCCESS) {
+            wstk_poll_twheel_add(poll->twheel, socket);
+        }
     }
 
     return status;
@@ -154,6 +169,25 @@ uint32_t wstk_poll_select_max_size() {
     return FD_SETSIZE;
 }
 
+/* wakes up the polling (there is no way to do it on windows, select() sleeps till the timeout there) */
+wstk_status_t wstk_poll_select_interrupt(wstk_poll_select_t *poll) {
+    if(!poll) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(poll->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+#ifndef WSTK_OS_WIN
+    if(poll->wakefd[1] >= 0) {
+        /* full pipe means it's already woken up */
+        if(write(poll->wakefd[1], "w", 1) < 0 && errno != EAGAIN) {
+            return WSTK_STATUS_FALSE;
+        }
+    }
+#endif
+    return WSTK_STATUS_SUCCESS;
+}
+
 bool wstk_poll_select_is_empty(wstk_poll_select_t *poll) {
     if(!poll || poll->fl_destroyed) {
         return false;
@@ -197,10 +231,14 @@ wstk_status_t wstk_poll_select_create(wstk_poll_select_t **poll, uint32_t size,
     if(status != WSTK_STATUS_SUCCESS) {
         goto out;
     }
+    pvt->wakefd[0] = pvt->wakefd[1] = -1;
 
     if((status = wstk_inthash_init(&pvt->sockets)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
+    if((status = wstk_poll_twheel_create(&pvt->twheel)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
 
     if((status = wstk_list_create(&pvt->slist1)) != WSTK_STATUS_SUCCESS) {
         goto out;
@@ -209,6 +247,18 @@ wstk_status_t wstk_poll_select_create(wstk_poll_select_t **poll, uint32_t size,
         goto out;
     }
 
+#ifndef WSTK_OS_WIN
+    if(pipe(pvt->wakefd) != 0) {
+        log_error("Unable to create pipe (err=%d)", errno);
+        pvt->wakefd[0] = pvt->wakefd[1] = -1;
+        wstk_goto_status(WSTK_STATUS_FALSE, out);
+    }
+    for(int i = 0; i < 2; i++) {
+        fcntl(pvt->wakefd[i], F_SETFL, fcntl(pvt->wakefd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(pvt->wakefd[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
     if(size > FD_SETSIZE)  {
         size = FD_SETSIZE;
     }
@@ -260,6 +310,9 @@ wstk_status_t wstk_poll_select_del(wstk_poll_select_t *poll, wstk_socket_t *sock
         return WSTK_STATUS_DESTROYED;
     }
 
+    /* stop expiry tracking right away, the deletion can be deferred */
+    wstk_poll_twheel_del(poll->twheel, socket);
+
     if(poll->fl_polling) {
         status = poll_socket_deferred_action(poll, socket, 2);
     } else {
@@ -274,7 +327,6 @@ wstk_status_t wstk_poll_select_polling(wstk_poll_select_t *poll) {
     struct timeval tv = { 0 }, *tv_ptr = NULL;
     wstk_hash_index_t *hidx = NULL;
     fd_set rdset = {0}, wrset = {0}, exset = {0};
-    time_t curr_ts = 0;
     uint32_t psz = 0;
     int rc = 0, event = 0, maxfd = 0;
 
@@ -331,6 +383,11 @@ wstk_status_t wstk_poll_select_polling(wstk_poll_select_t *poll) {
         }
     }
 
+    if(poll->wakefd[0] >= 0) {
+        FD_SET(poll->wakefd[0], &rdset);
+        maxfd = MAX(maxfd, poll->wakefd[0]);
+    }
+
 #ifdef WSTK_POLL_DEBUG
     WSTK_DBG_PRINT("polling-perform: [poll=%p, maxfd=%d]", poll, maxfd);
 #endif
@@ -341,7 +398,13 @@ wstk_status_t wstk_poll_select_polling(wstk_poll_select_t *poll) {
         return WSTK_STATUS_FALSE;
     }
 
-    curr_ts = wstk_time_epoch_now();
+#ifndef WSTK_OS_WIN
+    if(rc > 0 && poll->wakefd[0] >= 0 && FD_ISSET(poll->wakefd[0], &rdset)) {
+        char tmp[64];
+        while(read(poll->wakefd[0], tmp, sizeof(tmp)) > 0);
+    }
+#endif
+
     for(hidx = wstk_hash_first_iter(poll->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
         wstk_socket_t *sock = NULL;
         wstk_hash_this(hidx, NULL, NULL, (void *)&sock);
@@ -349,10 +412,6 @@ wstk_status_t wstk_poll_select_polling(wstk_poll_select_t *poll) {
         if(!sock) { continue; }
         event = 0x0;
 
-        if(sock->expiry && sock->expiry <= curr_ts) {
-            event |= WSTK_POLL_ESEXPIRED;
-        }
-
         if(rc > 0) {
             if(FD_ISSET(sock->fd, &rdset)) {
                 event |= WSTK_POLL_EREAD;
@@ -375,6 +434,9 @@ wstk_status_t wstk_poll_select_polling(wstk_poll_select_t *poll) {
         }
     }
 
+    /* who expired */
+    wstk_poll_twheel_perform(poll->twheel, poll->handler, poll->udata);
+
     poll->fl_polling = false;
 
     if(!wstk_list_is_empty(poll->slist2)) {
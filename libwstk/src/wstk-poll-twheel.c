@@ -0,0 +1,320 @@
+/**
+ ** Sockets expiry wheel (shared by the poll backends)
+ **
+ ** one second slots, a socket lives in the slot of its expiry;
+ ** prolonging the expiry doesn't move the socket, it's relinked lazily when its old slot comes up
+ **
+ ** (C)2024 aks
+ **/
+#include <wstk-poll.h>
+#include <wstk-log.h>
+#include <wstk-mem.h>
+#include <wstk-mutex.h>
+#include <wstk-time.h>
+
+#define TWHEEL_SLOTS        256     // power of 2
+#define TWHEEL_SLOT(ts)     ((uint32_t)(ts) & (TWHEEL_SLOTS - 1))
+
+struct wstk_poll_twheel_s {
+    wstk_mutex_t            *mutex;
+    wstk_socket_t           *slots[TWHEEL_SLOTS];
+    wstk_socket_t           *expired;       // sockets being fired by perform (tw_fnext links)
+    time_t                  last_ts;
+    uint32_t                count;
+    bool                    fl_destroyed;
+};
+
+static void twheel_link(wstk_poll_twheel_t *twheel, wstk_socket_t *sock) {
+    uint32_t slot = TWHEEL_SLOT(sock->expiry);
+    wstk_socket_t *head = twheel->slots[slot];
+
+    sock->tw_prev = NULL;
+    sock->tw_next = head;
+    if(head) { head->tw_prev = sock; }
+    twheel->slots[slot] = sock;
+
+    sock->tw_slot = slot;
+    sock->fl_twlinked = true;
+    twheel->count++;
+}
+
+static void twheel_unlink(wstk_poll_twheel_t *twheel, wstk_socket_t *sock) {
+    wstk_socket_t *prev = (wstk_socket_t *)sock->tw_prev;
+    wstk_socket_t *next = (wstk_socket_t *)sock->tw_next;
+
+    if(!sock->fl_twlinked) {
+        return;
+    }
+
+    if(prev) {
+        prev->tw_next = next;
+    } else {
+        twheel->slots[sock->tw_slot] = next;
+    }
+    if(next) {
+        next->tw_prev = prev;
+    }
+
+    sock->tw_prev = NULL;
+    sock->tw_next = NULL;
+    sock->fl_twlinked = false;
+    if(twheel->count) twheel->count--;
+}
+
+static void twheel_unfire(wstk_poll_twheel_t *twheel, wstk_socket_t *sock) {
+    wstk_socket_t **pp = &twheel->expired;
+
+    if(!sock->fl_twfiring) {
+        return;
+    }
+    for(; *pp; pp = (wstk_socket_t **)&(*pp)->tw_fnext) {
+        if(*pp == sock) {
+            *pp = (wstk_socket_t *)sock->tw_fnext;
+            break;
+        }
+    }
+
+    sock->tw_fnext = NULL;
+    sock->fl_twfiring = false;
+}
+
+static void destructor__wstk_poll_twheel_t(void *data) {
+    wstk_poll_twheel_t *twheel = (wstk_poll_twheel_t *)data;
+
+    if(!twheel || twheel->fl_destroyed) {
+        return;
+    }
+    twheel->fl_destroyed = true;
+
+    wstk_mutex_lock(twheel->mutex);
+    for(uint32_t i = 0; i < TWHEEL_SLOTS; i++) {
+        while(twheel->slots[i]) {
+            wstk_socket_t *sock = twheel->slots[i];
+            twheel_unlink(twheel, sock);
+            sock->twheel = NULL;
+        }
+    }
+    while(twheel->expired) {
+        wstk_socket_t *sock = twheel->expired;
+        twheel_unfire(twheel, sock);
+        sock->twheel = NULL;
+    }
+    wstk_mutex_unlock(twheel->mutex);
+
+    twheel->mutex = wstk_mem_deref(twheel->mutex);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// public
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/**
+ * Create a new wheel
+ *
+ * @param twheel    - the wheel
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_twheel_create(wstk_poll_twheel_t **twheel) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_poll_twheel_t *twheel_local = NULL;
+
+    if(!twheel) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    status = wstk_mem_zalloc((void *)&twheel_local, sizeof(wstk_poll_twheel_t), destructor__wstk_poll_twheel_t);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    if((status = wstk_mutex_create(&twheel_local->mutex)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    twheel_local->last_ts = wstk_time_epoch_now();
+    *twheel = twheel_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(twheel_local);
+    }
+    return status;
+}
+
+/**
+ * Attach the socket to the wheel
+ * (the wheel doesn't take a reference)
+ *
+ * @param twheel    - the wheel
+ * @param socket    - the socket
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_twheel_add(wstk_poll_twheel_t *twheel, wstk_socket_t *socket) {
+    if(!twheel || !socket) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(twheel->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(twheel->mutex);
+    if(socket->twheel && socket->twheel != twheel) {
+        wstk_mutex_unlock(twheel->mutex);
+        return WSTK_STATUS_ALREADY_EXISTS;
+    }
+    socket->twheel = twheel;
+    if(socket->expiry && !socket->fl_twlinked) {
+        twheel_link(twheel, socket);
+    }
+    wstk_mutex_unlock(twheel->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Detach the socket
+ *
+ * @param twheel    - the wheel
+ * @param socket    - the socket
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_twheel_del(wstk_poll_twheel_t *twheel, wstk_socket_t *socket) {
+    if(!twheel || !socket) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(twheel->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(twheel->mutex);
+    if(socket->twheel == twheel) {
+        twheel_unlink(twheel, socket);
+        twheel_unfire(twheel, socket);
+        socket->twheel = NULL;
+    }
+    wstk_mutex_unlock(twheel->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Change the socket expiry (uses by wstk_sock_set_expiry)
+ * O(1), prolongation just updates the field
+ *
+ * @param twheel    - the wheel
+ * @param socket    - the socket
+ * @param expiry    - new expiry (epoch) or 0
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_twheel_reschedule(wstk_poll_twheel_t *twheel, wstk_socket_t *socket, time_t expiry) {
+    time_t old_expiry = 0;
+
+    if(!twheel || !socket) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(twheel->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(twheel->mutex);
+    old_expiry = socket->expiry;
+    socket->expiry = expiry;
+
+    if(socket->twheel == twheel) {
+        if(!expiry) {
+            twheel_unlink(twheel, socket);
+        } else if(!socket->fl_twlinked) {
+            twheel_link(twheel, socket);
+        } else if(expiry < old_expiry) {
+            twheel_unlink(twheel, socket);
+            twheel_link(twheel, socket);
+        }
+    }
+    wstk_mutex_unlock(twheel->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Visit the slots passed since the last call
+ * and fire the handler (WSTK_POLL_ESEXPIRED) for the expired sockets
+ *
+ * @param twheel    - the wheel
+ * @param handler   - poll handler
+ * @param udata     - handler udata
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_twheel_perform(wstk_poll_twheel_t *twheel, wstk_poll_handler_t handler, void *udata) {
+    time_t curr_ts = 0, ts = 0;
+
+    if(!twheel || !handler) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(twheel->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    curr_ts = wstk_time_epoch_now();
+
+    wstk_mutex_lock(twheel->mutex);
+    if(!twheel->count) {
+        twheel->last_ts = curr_ts;
+        wstk_mutex_unlock(twheel->mutex);
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    /* the current slot is visited each time, the others once */
+    ts = ((curr_ts - twheel->last_ts) >= TWHEEL_SLOTS ? (curr_ts - TWHEEL_SLOTS + 1) : twheel->last_ts);
+    for(; ts <= curr_ts; ts++) {
+        uint32_t slot = TWHEEL_SLOT(ts);
+        wstk_socket_t *sock = twheel->slots[slot];
+
+        while(sock) {
+            wstk_socket_t *next = (wstk_socket_t *)sock->tw_next;
+
+            if(sock->expiry <= curr_ts) {
+                twheel_unlink(twheel, sock);
+                if(!sock->fl_twfiring) {
+                    sock->tw_fnext = twheel->expired;
+                    sock->fl_twfiring = true;
+                    twheel->expired = sock;
+                }
+            } else if(TWHEEL_SLOT(sock->expiry) != slot) {
+                twheel_unlink(twheel, sock);
+                twheel_link(twheel, sock);
+            }
+            sock = next;
+        }
+    }
+    twheel->last_ts = curr_ts;
+    wstk_mutex_unlock(twheel->mutex);
+
+    /* the workers can prolong (relink) or detach these sockets meanwhile, so the chain has its own links */
+    /* and is kept by the wheel (wstk_poll_twheel_del takes a socket off), the deadline is checked once again */
+    while(true) {
+        wstk_socket_t *sock = NULL;
+        bool fl_fire = false;
+
+        wstk_mutex_lock(twheel->mutex);
+        if((sock = twheel->expired) == NULL) {
+            wstk_mutex_unlock(twheel->mutex);
+            break;
+        }
+        twheel_unfire(twheel, sock);
+
+        if(sock->twheel == twheel && sock->expiry && sock->expiry <= curr_ts) {
+            twheel_unlink(twheel, sock);
+            fl_fire = true;
+        }
+        wstk_mutex_unlock(twheel->mutex);
+
+        if(fl_fire) {
+            handler(sock, WSTK_POLL_ESEXPIRED, udata);
+        }
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
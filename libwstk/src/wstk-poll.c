@@ -162,6 +162,35 @@ wstk_status_t wstk_poll_del(wstk_poll_t *poll, wstk_socket_t *socket) {
     return status;
 }
 
+/**
+ * Apply the changed socket mask (MREAD/MWRITE)
+ * select reads the mask on each cycle (it's only woken up), epoll/kqueue change the registration.
+ * Can be called from any thread.
+ *
+ * @param poll     - the poll
+ * @param socket   - the socket
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_poll_update(wstk_poll_t *poll, wstk_socket_t *socket) {
+    if(!poll || !socket || socket->fl_destroyed) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(poll->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    if(poll->method == WSTK_POLL_SELECT) {
+        return wstk_poll_select_interrupt((wstk_poll_select_t *)poll->pvt);
+    } else if(poll->method == WSTK_POLL_EPOLL) {
+        return wstk_poll_epoll_update((wstk_poll_epoll_t *)poll->pvt, socket);
+    } else if(poll->method == WSTK_POLL_KQUEUE) {
+        return wstk_poll_kqueue_update((wstk_poll_kqueue_t *)poll->pvt, socket);
+    }
+
+    return WSTK_STATUS_UNSUPPORTED;
+}
+
 /**
  * Polling
  *
@@ -311,7 +340,7 @@ wstk_poll_auto_conf_t wstk_poll_auto_conf(wstk_polling_method_e method, uint32_t
             conf.method = WSTK_POLL_KQUEUE;
         }
 
-        if(method == WSTK_POLL_AUTO) {
+        if(conf.method == WSTK_POLL_AUTO) {
             if(wstk_poll_select_is_supported()) {
                 conf.method = WSTK_POLL_SELECT;
             }
@@ -346,6 +375,8 @@ wstk_status_t wstk_poll_interrupt(wstk_poll_t *poll) {
         return wstk_poll_epoll_interrupt((wstk_poll_epoll_t *)poll->pvt);
     } else if(poll->method == WSTK_POLL_KQUEUE) {
         return wstk_poll_kqueue_interrupt((wstk_poll_kqueue_t *)poll->pvt);
+    } else if(poll->method == WSTK_POLL_SELECT) {
+        return wstk_poll_select_interrupt((wstk_poll_select_t *)poll->pvt);
     }
 
     return WSTK_STATUS_SUCCESS;
@@ -7,15 +7,95 @@
 #include <wstk-mutex.h>
 #include <wstk-mem.h>
 
+#define QUEUE_CACHE_LINE 64
+
+/* lock-free ring cell (D.Vyukov's bounded mpmc queue) */
+typedef struct {
+    size_t          seq;
+    void            *data;
+} queue_cell_t;
+
 struct wstk_queue_s {
     wstk_mutex_t    *mutex;
     void            **data;
+    queue_cell_t    *cells;
     uint32_t        size;
-    uint32_t        in;
-    uint32_t        out;
+    uint32_t        out;        // ring head (mutex mode)
+    uint32_t        len;        // items in the ring (mutex mode)
+    uint32_t        mask;       // lock-free mode
+    uint32_t        flags;
+    bool            fl_lockfree;
     bool            fl_destroyed;
+    /* lock-free mode, producers and consumers positions on the own lines */
+    char            pad0[QUEUE_CACHE_LINE];
+    size_t          enqueue_pos;
+    char            pad1[QUEUE_CACHE_LINE - sizeof(size_t)];
+    size_t          dequeue_pos;
+    char            pad2[QUEUE_CACHE_LINE - sizeof(size_t)];
 };
 
+#ifdef WSTK_HAVE_ATOMIC
+static wstk_status_t lf_push(wstk_queue_t *queue, void *data) {
+    queue_cell_t *cell = NULL;
+    size_t pos = wstk_atomic_rlx(&queue->enqueue_pos);
+
+    while(true) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = wstk_atomic_acq(&cell->seq);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if(dif == 0) {
+            if(wstk_atomic_rlx_cas(&queue->enqueue_pos, &pos, pos + 1)) {
+                break;
+            }
+        } else if(dif < 0) {
+            return WSTK_STATUS_NOSPACE;
+        } else {
+            pos = wstk_atomic_rlx(&queue->enqueue_pos);
+        }
+    }
+
+    cell->data = data;
+    wstk_atomic_rls_set(&cell->seq, pos + 1);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+static wstk_status_t lf_pop(wstk_queue_t *queue, void **data) {
+    queue_cell_t *cell = NULL;
+    size_t pos = wstk_atomic_rlx(&queue->dequeue_pos);
+
+    while(true) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = wstk_atomic_acq(&cell->seq);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if(dif == 0) {
+            if(wstk_atomic_rlx_cas(&queue->dequeue_pos, &pos, pos + 1)) {
+                break;
+            }
+        } else if(dif < 0) {
+            return WSTK_STATUS_NODATA;
+        } else {
+            pos = wstk_atomic_rlx(&queue->dequeue_pos);
+        }
+    }
+
+    *data = cell->data;
+    cell->data = NULL;
+    wstk_atomic_rls_set(&cell->seq, pos + queue->mask + 1);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+static uint32_t lf_len(wstk_queue_t *queue) {
+    size_t deq = wstk_atomic_acq(&queue->dequeue_pos);
+    size_t enq = wstk_atomic_acq(&queue->enqueue_pos);
+
+    return (enq > deq ? (uint32_t)(enq - deq) : 0);
+}
+#endif
+
 static void destructor__wstk_queue_t(void *data) {
     wstk_queue_t *queue = (wstk_queue_t *)data;
 
@@ -25,18 +105,26 @@ static void destructor__wstk_queue_t(void *data) {
     queue->fl_destroyed = true;
 
 #ifdef WSTK_QUEUE_DEBUG
-    WSTK_DBG_PRINT("destroying queue: queue=%p (len=%d)", queue, queue->in);
+    WSTK_DBG_PRINT("destroying queue: queue=%p (len=%d, lockfree=%d)", queue, queue->len, queue->fl_lockfree);
 #endif
 
-    wstk_mutex_lock(queue->mutex);
-    if(queue->in) {
-        for(uint32_t i = 0; i <= queue->in; i++) {
-            void *dp = queue->data[i];
+    if(queue->fl_lockfree) {
+        if(queue->cells) {
+            for(uint32_t i = 0; i <= queue->mask; i++) {
+                void *dp = queue->cells[i].data;
+                if(dp) { wstk_mem_deref(dp); }
+            }
+        }
+    } else {
+        wstk_mutex_lock(queue->mutex);
+        for(uint32_t i = 0; i < queue->len; i++) {
+            void *dp = queue->data[(queue->out + i) % queue->size];
             if(dp) { wstk_mem_deref(dp); }
         }
+        wstk_mutex_unlock(queue->mutex);
     }
-    wstk_mutex_unlock(queue->mutex);
 
+    queue->cells = wstk_mem_deref(queue->cells);
     queue->data = wstk_mem_deref(queue->data);
     queue->mutex = wstk_mem_deref(queue->mutex);
 
@@ -58,6 +146,19 @@ static void destructor__wstk_queue_t(void *data) {
  * @return success ot some error
  **/
 wstk_status_t wstk_queue_create(wstk_queue_t **queue, uint32_t size) {
+    return wstk_queue_create_ex(queue, size, 0x0);
+}
+
+/**
+ * Create a new queue
+ *
+ * @param queue - a new queue
+ * @param size  - the size (the lock-free queue rounds it up to a power of 2)
+ * @param flags - WSTK_QUEUE_LOCKFREE or 0 (the mutex based one)
+ *
+ * @return success ot some error
+ **/
+wstk_status_t wstk_queue_create_ex(wstk_queue_t **queue, uint32_t size, uint32_t flags) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     wstk_queue_t *qlocal = NULL;
 
@@ -68,21 +169,48 @@ wstk_status_t wstk_queue_create(wstk_queue_t **queue, uint32_t size) {
     status = wstk_mem_zalloc((void *)&qlocal, sizeof(wstk_queue_t), destructor__wstk_queue_t);
     if(status != WSTK_STATUS_SUCCESS) { goto out; }
 
-    if((status = wstk_mutex_create(&qlocal->mutex)) != WSTK_STATUS_SUCCESS) {
-        goto out;
-    }
+    qlocal->flags = flags;
 
-    status = wstk_mem_zalloc((void *)&qlocal->data, sizeof(void *) * (size + 1), NULL);
-    if(status != WSTK_STATUS_SUCCESS) {
-        goto out;
+#ifdef WSTK_HAVE_ATOMIC
+    qlocal->fl_lockfree = (flags & WSTK_QUEUE_LOCKFREE);
+#else
+    if(flags & WSTK_QUEUE_LOCKFREE) {
+        log_warn("Atomics aren't available, the mutex based queue will be used");
     }
+#endif
+
+    if(qlocal->fl_lockfree) {
+        uint32_t capacity = 2;
+
+        while(capacity < size && capacity < 0x80000000) {
+            capacity <<= 1;
+        }
+
+        status = wstk_mem_zalloc((void *)&qlocal->cells, sizeof(queue_cell_t) * capacity, NULL);
+        if(status != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        for(uint32_t i = 0; i < capacity; i++) {
+            qlocal->cells[i].seq = i;
+        }
+
+        qlocal->mask = (capacity - 1);
+        qlocal->size = capacity;
+    } else {
+        if((status = wstk_mutex_create(&qlocal->mutex)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
 
-    qlocal->in = 0;
-    qlocal->out = 0;
-    qlocal->size = size;
+        status = wstk_mem_zalloc((void *)&qlocal->data, sizeof(void *) * size, NULL);
+        if(status != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+
+        qlocal->size = size;
+    }
 
 #ifdef WSTK_QUEUE_DEBUG
-    WSTK_DBG_PRINT("queue created: queue=%p (size=%d)", queue, qlocal->size);
+    WSTK_DBG_PRINT("queue created: queue=%p (size=%d, lockfree=%d)", qlocal, qlocal->size, qlocal->fl_lockfree);
 #endif
 
     *queue = qlocal;
@@ -108,8 +236,14 @@ bool wstk_queue_is_empty(wstk_queue_t *queue) {
         return false;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        return (lf_len(queue) == 0);
+    }
+#endif
+
     wstk_mutex_lock(queue->mutex);
-    result = (queue->in == 0);
+    result = (queue->len == 0);
     wstk_mutex_unlock(queue->mutex);
 
     return result;
@@ -129,8 +263,14 @@ bool wstk_queue_is_full(wstk_queue_t *queue) {
         return false;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        return (lf_len(queue) >= queue->size);
+    }
+#endif
+
     wstk_mutex_lock(queue->mutex);
-    result = (queue->in >= queue->size);
+    result = (queue->len >= queue->size);
     wstk_mutex_unlock(queue->mutex);
 
     return result;
@@ -154,10 +294,16 @@ wstk_status_t wstk_queue_push(wstk_queue_t *queue, void *data) {
         return WSTK_STATUS_DESTROYED;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        return lf_push(queue, data);
+    }
+#endif
+
     wstk_mutex_lock(queue->mutex);
-    if(queue->in < queue->size) {
-        queue->data[queue->in] = data;
-        queue->in++;
+    if(queue->len < queue->size) {
+        queue->data[(queue->out + queue->len) % queue->size] = data;
+        queue->len++;
 
         status = WSTK_STATUS_SUCCESS;
     }
@@ -184,17 +330,19 @@ wstk_status_t wstk_queue_pop(wstk_queue_t *queue, void **data) {
         return WSTK_STATUS_DESTROYED;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        return lf_pop(queue, data);
+    }
+#endif
+
     wstk_mutex_lock(queue->mutex);
-    if(queue->in > 0) {
+    if(queue->len > 0) {
         *data = queue->data[queue->out];
 
         queue->data[queue->out] = NULL;
-        queue->out++;
-
-        if(queue->out > queue->in || queue->out >= queue->size) {
-            queue->in = 0;
-            queue->out = 0;
-        }
+        queue->out = (queue->out + 1) % queue->size;
+        queue->len--;
 
         status = WSTK_STATUS_SUCCESS;
     }
@@ -203,8 +351,115 @@ wstk_status_t wstk_queue_pop(wstk_queue_t *queue, void **data) {
     return status;
 }
 
+/**
+ * Push several items at once
+ * (the mutex based queue takes the lock once)
+ *
+ * @param queue     - the queue
+ * @param items     - items to push
+ * @param count     - items count
+ * @param pushed    - how many items have been pushed (can be NULL)
+ *
+ * @return success if at least one item was pushed or some error
+ **/
+wstk_status_t wstk_queue_push_n(wstk_queue_t *queue, void **items, uint32_t count, uint32_t *pushed) {
+    uint32_t n = 0;
+
+    if(!queue || !items) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(queue->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        while(n < count) {
+            if(!items[n] || lf_push(queue, items[n]) != WSTK_STATUS_SUCCESS) {
+                break;
+            }
+            n++;
+        }
+        goto out;
+    }
+#endif
+
+    wstk_mutex_lock(queue->mutex);
+    while(n < count && queue->len < queue->size) {
+        if(!items[n]) {
+            break;
+        }
+        queue->data[(queue->out + queue->len) % queue->size] = items[n];
+        queue->len++;
+        n++;
+    }
+    wstk_mutex_unlock(queue->mutex);
+
+#ifdef WSTK_HAVE_ATOMIC
+out:
+#endif
+    if(pushed) {
+        *pushed = n;
+    }
+
+    return (n || !count ? WSTK_STATUS_SUCCESS : WSTK_STATUS_NOSPACE);
+}
+
+/**
+ * Pop several items at once
+ * (the mutex based queue takes the lock once)
+ *
+ * @param queue     - the queue
+ * @param items     - buffer for the items
+ * @param count     - buffer size
+ * @param popped    - how many items have been taken
+ *
+ * @return success if at least one item was taken or some error
+ **/
+wstk_status_t wstk_queue_pop_n(wstk_queue_t *queue, void **items, uint32_t count, uint32_t *popped) {
+    uint32_t n = 0;
+
+    if(!queue || !items || !popped) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(queue->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        while(n < count) {
+            if(lf_pop(queue, &items[n]) != WSTK_STATUS_SUCCESS) {
+                break;
+            }
+            n++;
+        }
+        goto out;
+    }
+#endif
+
+    wstk_mutex_lock(queue->mutex);
+    while(n < count && queue->len > 0) {
+        items[n] = queue->data[queue->out];
+
+        queue->data[queue->out] = NULL;
+        queue->out = (queue->out + 1) % queue->size;
+        queue->len--;
+        n++;
+    }
+    wstk_mutex_unlock(queue->mutex);
+
+#ifdef WSTK_HAVE_ATOMIC
+out:
+#endif
+    *popped = n;
+
+    return (n ? WSTK_STATUS_SUCCESS : WSTK_STATUS_NODATA);
+}
+
 /**
  * Get current queue length
+ * (approximate for the lock-free queue)
  *
  * @param queue - the queue
  * @param len   - curr len
@@ -219,8 +474,15 @@ wstk_status_t wstk_queue_len(wstk_queue_t *queue, uint32_t *len) {
         return WSTK_STATUS_DESTROYED;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    if(queue->fl_lockfree) {
+        *len = lf_len(queue);
+        return WSTK_STATUS_SUCCESS;
+    }
+#endif
+
     wstk_mutex_lock(queue->mutex);
-    *len = queue->in;
+    *len = queue->len;
     wstk_mutex_unlock(queue->mutex);
 
     return WSTK_STATUS_SUCCESS;
@@ -51,25 +51,46 @@ static wstk_status_t sentry_refs(service_entry_t *entry) {
     if(!entry || entry->fl_destroyed)  {
         return WSTK_STATUS_FALSE;
     }
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&entry->refs, 1);
+#else
     if(entry->mutex) {
         wstk_mutex_lock(entry->mutex);
         entry->refs++;
         wstk_mutex_unlock(entry->mutex);
     }
+#endif
     return WSTK_STATUS_SUCCESS;
 }
 static void sentry_derefs(service_entry_t *entry) {
     if(!entry)  { return; }
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&entry->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&entry->refs, &v, v - 1));
+#else
     if(entry->mutex) {
         wstk_mutex_lock(entry->mutex);
         if(entry->refs > 0) entry->refs--;
         wstk_mutex_unlock(entry->mutex);
     }
+#endif
+}
+static uint32_t sentry_refs_count(service_entry_t *entry) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&entry->refs);
+#else
+    uint32_t refs = 0;
+    if(!entry->mutex) { return entry->refs; }
+    wstk_mutex_lock(entry->mutex);
+    refs = entry->refs;
+    wstk_mutex_unlock(entry->mutex);
+    return refs;
+#endif
 }
 
 static void desctuctor__service_entry_t(void *ptr) {
     service_entry_t *entry = (service_entry_t *)ptr;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!entry || entry->fl_destroyed) {
         return;
@@ -77,21 +98,11 @@ static void desctuctor__service_entry_t(void *ptr) {
     entry->fl_destroyed = true;
 
 #ifdef WSTK_SERVLET_JSONRPC_DEBUG
-    WSTK_DBG_PRINT("destroying service: service=%p (name=%s, refs=%d, udata=%p, destroy_udata=%d)", entry, entry->name, entry->refs, entry->udata, entry->fl_adestroy_udata);
+    WSTK_DBG_PRINT("destroying service: service=%p (name=%s, refs=%d, udata=%p, destroy_udata=%d)", entry, entry->name, sentry_refs_count(entry), entry->udata, entry->fl_adestroy_udata);
 #endif
 
-    if(entry->mutex) {
-        while(floop) {
-            wstk_mutex_lock(entry->mutex);
-            floop = (entry->refs > 0);
-            wstk_mutex_unlock(entry->mutex);
-
-            WSTK_SCHED_YIELD(0);
-        }
-    }
-
-    if(entry->refs) {
-        log_warn("Lost references (refs=%d)", entry->refs);
+    while(sentry_refs_count(entry) > 0) {
+        WSTK_SCHED_BACKOFF(spins);
     }
 
     if(entry->udata && entry->fl_adestroy_udata) {
@@ -99,6 +110,7 @@ static void desctuctor__service_entry_t(void *ptr) {
     }
 
     entry->name = wstk_mem_deref(entry->name);
+    entry->mutex = wstk_mem_deref(entry->mutex);
 
 #ifdef WSTK_SERVLET_JSONRPC_DEBUG
     WSTK_DBG_PRINT("service destroyed: service=%p", entry);
@@ -107,6 +119,7 @@ static void desctuctor__service_entry_t(void *ptr) {
 
 static void desctuctor__wstk_servlet_jsonrpc_t(void *ptr) {
     wstk_servlet_jsonrpc_t *servlet = (wstk_servlet_jsonrpc_t *)ptr;
+    uint32_t spins = 0;
     bool floop = true;
 
     if(!servlet || servlet->fl_destroyed) {
@@ -124,7 +137,7 @@ static void desctuctor__wstk_servlet_jsonrpc_t(void *ptr) {
             floop = (servlet->refs > 0);
             wstk_mutex_unlock(servlet->mutex);
 
-            wstk_msleep(250);
+            if(floop) { WSTK_SCHED_BACKOFF(spins); }
         }
     }
 
@@ -42,6 +42,7 @@ typedef struct {
 
 static void desctuctor__wstk_servlet_upload_t(void *ptr) {
     wstk_servlet_upload_t *servlet = (wstk_servlet_upload_t *)ptr;
+    uint32_t spins = 0;
     bool floop = true;
 
     if(!servlet || servlet->fl_destroyed) {
@@ -59,7 +60,7 @@ static void desctuctor__wstk_servlet_upload_t(void *ptr) {
             floop = (servlet->refs > 0);
             wstk_mutex_unlock(servlet->mutex);
 
-            WSTK_SCHED_YIELD(0);
+            if(floop) { WSTK_SCHED_BACKOFF(spins); }
         }
     }
 
@@ -18,8 +18,16 @@
 #include <wstk-base64.h>
 #include <wstk-sha1.h>
 #include <wstk-hashtable.h>
+#include <wstk-deflate.h>
+#include <wstk-fmt.h>
 
 #define WEBSOCK_CONTENT_MAX_LENGTH  1048576  // 1Mb
+#define WEBSOCK_MSG_BUFFER_KEEP     65536    // the bigger assembling buffer is dropped after the message
+#define WEBSOCK_CONTROL_MAX_LENGTH  125
+#define WEBSOCK_FRAME_HDR_MAX       10       // server frames aren't masked
+#define WEBSOCK_DEFLATE_HDR_RSV1    0x40     // the first frame of a compressed message
+#define WEBSOCK_DEFLATE_EXT_MAX     256      // negotiated parameters (the response)
+#define WEBSOCK_INFLATE_MEM_EXTRA   7168     // inflate state besides the window
 #define WEBSOCK_ATTR__WS_CONN       "ws-conn-sys"
 
 static const uint8_t magic[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
@@ -27,29 +35,66 @@ static const char *WS_BAD_REQUEST_MSG = "Bad request (websock)";
 
 struct wstk_servlet_websock_s {
     wstk_mutex_t                        *mutex;
-    wstk_inthash_t                      *sockets;   // websockets (con-id > wstk_http_conn_t)
+    wstk_inthash_t                      *sockets;   // websockets (con-id > websock_tcp_conn_ws_attr_t)
     uint32_t                            refs;
     bool                                fl_destroyed;
+    // permessage-deflate
+    size_t                              deflate_min_size;
+    size_t                              deflate_mem_max;
+    int                                 deflate_level;
+    bool                                fl_deflate;
+    bool                                fl_deflate_no_context;
     //
     wstk_servlet_websock_on_close_t     hnd_on_close;
     wstk_servlet_websock_on_accept_t    hnd_on_accept;
     wstk_servlet_websock_on_message_t   hnd_on_message;
 };
 
+/* permessage-deflate (RFC 7692) of the connection */
+typedef struct {
+    wstk_mutex_t            *mutex;         // the messages are compressed and written in order
+    wstk_deflate_stream_t   *tx;            // compressor (NULL till the message or without context takeover)
+    wstk_deflate_stream_t   *rx;            // decompressor (used by the worker)
+    wstk_mbuf_t             *rx_buf;        // the inflated message
+    size_t                  min_size;       // the smaller messages are sent as is
+    int                     level;
+    int                     tx_wbits;       // server_max_window_bits
+    int                     rx_wbits;       // client_max_window_bits
+    bool                    tx_no_context;  // server_no_context_takeover
+    bool                    rx_no_context;  // client_no_context_takeover
+} websock_deflate_t;
+
+/* broadcast recipient */
+typedef struct {
+    wstk_http_conn_t        *http_conn;     // taken
+    wstk_httpd_sec_ctx_t    *sec_ctx;       // referenced
+} websock_peer_t;
+
 /* helper struct */
 typedef struct {
     wstk_http_conn_t        *http_conn;
     wstk_tcp_srv_conn_t     *tcp_conn;
     wstk_servlet_websock_t  *servlet;
     wstk_httpd_sec_ctx_t    *sec_ctx;
+    websock_deflate_t       *deflate;       // NULL if not negotiated
+    wstk_mbuf_t             *msg;           // the message being assembled (unmasked payloads of its frames)
+    wstk_websock_hdr_t      msg_hdr;        // the first frame of the message
+    wstk_websock_hdr_t      frame_hdr;      // the data frame which payload is being read
+    uint64_t                frame_left;     // its bytes to come
+    uint64_t                frame_offset;   // its bytes already read (the mask position)
     uint32_t                conn_id;
     bool                    fl_destroyed;
     bool                    fl_registered;
     bool                    fl_chnd_called;
+    bool                    fl_msg;         // a message is being assembled
+    bool                    fl_frame;       // the payload of frame_hdr is being read
 } websock_tcp_conn_ws_attr_t;
 
-static wstk_status_t ws_reg(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *sec_ctx);
+static wstk_status_t ws_reg(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *sec_ctx, websock_deflate_t *deflate);
 static void ws_unreg(wstk_http_conn_t *conn);
+static wstk_status_t ws_frame_encode(wstk_mbuf_t **frame, websock_opcode_e opcode, const uint8_t *data, size_t len);
+static wstk_status_t ws_frame_send(wstk_http_conn_t *conn, wstk_mbuf_t *frame);
+static wstk_status_t ws_frame_vsend(wstk_http_conn_t *conn, websock_opcode_e opcode, websock_scode_e scode, const char *fmt, va_list ap);
 
 // ---------------------------------------------------------------------------------------------------------------------
 static void desctuctor__websock_tcp_conn_ws_attr_t(void *ptr) {
@@ -65,8 +110,11 @@ static void desctuctor__websock_tcp_conn_ws_attr_t(void *ptr) {
 #endif
 
     if(attr->fl_registered) {
+        /* the id is the peer address hash, a newer connection can have it already */
         wstk_mutex_lock(servlet->mutex);
-        wstk_core_inthash_delete(servlet->sockets, attr->conn_id);
+        if(wstk_core_inthash_find(servlet->sockets, attr->conn_id) == attr) {
+            wstk_core_inthash_delete(servlet->sockets, attr->conn_id);
+        }
         wstk_mutex_unlock(servlet->mutex);
     }
 
@@ -78,10 +126,11 @@ static void desctuctor__websock_tcp_conn_ws_attr_t(void *ptr) {
         }
     }
 
-    if(attr->sec_ctx) {
-        wstk_httpd_sec_ctx_clean(attr->sec_ctx);
-        attr->sec_ctx = wstk_mem_deref(attr->sec_ctx);
-    }
+    /* cleaned on the last deref (a broadcast can still hold it) */
+    attr->sec_ctx = wstk_mem_deref(attr->sec_ctx);
+
+    attr->msg = wstk_mem_deref(attr->msg);
+    attr->deflate = wstk_mem_deref(attr->deflate);
 
 #ifdef WSTK_SERVLET_WEBSOCK_DEBUG
     WSTK_DBG_PRINT("websocket unregistered: conn=%p", attr->http_conn);
@@ -90,6 +139,7 @@ static void desctuctor__websock_tcp_conn_ws_attr_t(void *ptr) {
 
 static void desctuctor__wstk_servlet_websock_t(void *ptr) {
     wstk_servlet_websock_t *servlet = (wstk_servlet_websock_t *)ptr;
+    uint32_t spins = 0;
     bool floop = true;
 
     if(!servlet || servlet->fl_destroyed) {
@@ -107,7 +157,7 @@ static void desctuctor__wstk_servlet_websock_t(void *ptr) {
             floop = (servlet->refs > 0);
             wstk_mutex_unlock(servlet->mutex);
 
-            WSTK_SCHED_YIELD(0);
+            if(floop) { WSTK_SCHED_BACKOFF(spins); }
         }
     }
 
@@ -128,15 +178,466 @@ static void desctuctor__wstk_servlet_websock_t(void *ptr) {
 #endif
 }
 
+static void desctuctor__websock_deflate_t(void *ptr) {
+    websock_deflate_t *deflate = (websock_deflate_t *)ptr;
+
+    if(!deflate) {
+        return;
+    }
+
+    deflate->tx = wstk_mem_deref(deflate->tx);
+    deflate->rx = wstk_mem_deref(deflate->rx);
+    deflate->rx_buf = wstk_mem_deref(deflate->rx_buf);
+    deflate->mutex = wstk_mem_deref(deflate->mutex);
+}
+
+/* the state kept between the messages (zlib: deflate (1 << (wbits + 2)) + (1 << (mem_level + 9)), inflate 1 << wbits + 7K) */
+static size_t ws_deflate_mem(websock_deflate_t *params) {
+    size_t mem = 0;
+
+    if(!params->tx_no_context) {
+        mem += ((size_t)1 << (params->tx_wbits + 3));
+    }
+    if(!params->rx_no_context) {
+        mem += ((size_t)1 << params->rx_wbits) + WEBSOCK_INFLATE_MEM_EXTRA;
+    }
+    return mem;
+}
+
+/* the parameter value (can be quoted) */
+static int ws_deflate_wbits(const char *p, size_t l) {
+    int val = 0;
+
+    if(l >= 2 && p[0] == '"' && p[l - 1] == '"') {
+        p++; l -= 2;
+    }
+    if(l < 1 || l > 2 || p[0] < '0' || p[0] > '9' || (l == 2 && (p[1] < '0' || p[1] > '9'))) {
+        return -1;
+    }
+
+    val = (l == 2 ? (p[0] - '0') * 10 + (p[1] - '0') : p[0] - '0');
+    return (val >= 8 && val <= 15 ? val : -1);
+}
+
+/*
+ * Sec-WebSocket-Extensions: the first acceptable permessage-deflate offer,
+ * the windows are narrowed and the context takeover is dropped to fit the servlet memory limit
+ */
+static bool ws_deflate_negotiate(wstk_servlet_websock_t *servlet, wstk_http_msg_t *msg, websock_deflate_t *params, char *rsp, size_t rsp_len) {
+    const char *ptr = NULL, *end = NULL, *tok = NULL, *val = NULL;
+    size_t tlen = 0, vlen = 0;
+    int srv_wbits = 0, cli_wbits = 0, w = 0;
+    bool srv_nct = false, cli_nct = false, fl_offer = false, fl_bad = false;
+    bool fl_srv_wbits = false, fl_cli_wbits = false, fl_cli_wbits_val = false;
+
+    if(!msg->hdr_common[WSTK_HTTP_HDR_SEC_WEBSOCKET_EXTENSIONS].l) {
+        return false;
+    }
+
+    ptr = msg->hdr_common[WSTK_HTTP_HDR_SEC_WEBSOCKET_EXTENSIONS].p;
+    end = ptr + msg->hdr_common[WSTK_HTTP_HDR_SEC_WEBSOCKET_EXTENSIONS].l;
+    while(ptr < end) {
+        /* the extension name or the parameter */
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t')) { ptr++; }
+        for(tok = ptr; ptr < end && *ptr != ',' && *ptr != ';' && *ptr != '=' && *ptr != ' ' && *ptr != '\t'; ptr++);
+        tlen = (ptr - tok);
+        while(ptr < end && (*ptr == ' ' || *ptr == '\t')) { ptr++; }
+
+        val = NULL; vlen = 0;
+        if(ptr < end && *ptr == '=') {
+            for(ptr++; ptr < end && (*ptr == ' ' || *ptr == '\t'); ptr++);
+            for(val = ptr; ptr < end && *ptr != ',' && *ptr != ';' && *ptr != ' ' && *ptr != '\t'; ptr++);
+            vlen = (ptr - val);
+            while(ptr < end && (*ptr == ' ' || *ptr == '\t')) { ptr++; }
+        }
+
+        if(!fl_offer) {
+            fl_offer = true;
+            fl_bad = !(tlen == 18 && strncasecmp(tok, "permessage-deflate", 18) == 0) || val;
+            srv_nct = cli_nct = fl_srv_wbits = fl_cli_wbits = fl_cli_wbits_val = false;
+            srv_wbits = cli_wbits = 0;
+        } else if(!fl_bad) {
+            if(tlen == 26 && strncasecmp(tok, "server_no_context_takeover", 26) == 0) {
+                fl_bad = (srv_nct || val);
+                srv_nct = true;
+            } else if(tlen == 26 && strncasecmp(tok, "client_no_context_takeover", 26) == 0) {
+                fl_bad = (cli_nct || val);
+                cli_nct = true;
+            } else if(tlen == 22 && strncasecmp(tok, "server_max_window_bits", 22) == 0) {
+                /* zlib doesn't make the raw streams with the 256 bytes window */
+                srv_wbits = (val ? ws_deflate_wbits(val, vlen) : -1);
+                fl_bad = (fl_srv_wbits || srv_wbits < 9);
+                fl_srv_wbits = true;
+            } else if(tlen == 22 && strncasecmp(tok, "client_max_window_bits", 22) == 0) {
+                cli_wbits = (val ? ws_deflate_wbits(val, vlen) : 15);
+                fl_bad = (fl_cli_wbits || cli_wbits < 0);
+                fl_cli_wbits = true;
+                fl_cli_wbits_val = (val != NULL);
+            } else {
+                fl_bad = true;
+            }
+        }
+
+        if(ptr < end && *ptr == ';') {
+            ptr++;
+            continue;
+        }
+        if(ptr < end && *ptr != ',') {
+            /* garbage, skip the offer */
+            fl_bad = true;
+            for(; ptr < end && *ptr != ','; ptr++);
+        }
+        ptr++;
+
+        /* the end of the offer */
+        fl_offer = false;
+        if(fl_bad) {
+            continue;
+        }
+
+        params->tx_wbits = (fl_srv_wbits ? srv_wbits : 15);
+        params->rx_wbits = (fl_cli_wbits ? MAX(cli_wbits, 9) : 15);
+        params->tx_no_context = (srv_nct || servlet->fl_deflate_no_context);
+        params->rx_no_context = (cli_nct || servlet->fl_deflate_no_context);
+
+        if(servlet->deflate_mem_max) {
+            while(ws_deflate_mem(params) > servlet->deflate_mem_max && !params->tx_no_context && params->tx_wbits > 9) {
+                params->tx_wbits--;
+            }
+            while(ws_deflate_mem(params) > servlet->deflate_mem_max && !params->rx_no_context && fl_cli_wbits && params->rx_wbits > 9) {
+                params->rx_wbits--;
+            }
+            if(ws_deflate_mem(params) > servlet->deflate_mem_max) {
+                params->tx_no_context = true;
+            }
+            if(ws_deflate_mem(params) > servlet->deflate_mem_max) {
+                params->rx_no_context = true;
+            }
+        }
+
+        w = wstk_snprintf(rsp, rsp_len, "permessage-deflate%s%s", (params->tx_no_context ? "; server_no_context_takeover" : ""), (params->rx_no_context ? "; client_no_context_takeover" : ""));
+        if(w > 0 && (fl_srv_wbits || params->tx_wbits < 15)) {
+            w += wstk_snprintf(rsp + w, rsp_len - w, "; server_max_window_bits=%d", params->tx_wbits);
+        }
+        if(w > 0 && fl_cli_wbits && (fl_cli_wbits_val || params->rx_wbits < 15)) {
+            w += wstk_snprintf(rsp + w, rsp_len - w, "; client_max_window_bits=%d", params->rx_wbits);
+        }
+        return (w > 0 && (size_t)w < rsp_len);
+    }
+
+    return false;
+}
+
+/* sends the message (compresses if it's worth), the frames are queued in the order of the compression */
+static wstk_status_t ws_deflate_send(websock_deflate_t *deflate, wstk_http_conn_t *conn, websock_opcode_e opcode, const uint8_t *data, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *frame = NULL;
+    size_t clen = 0, start = 0;
+
+    wstk_mutex_lock(deflate->mutex);
+
+    if(len < deflate->min_size) {
+        if((status = ws_frame_encode(&frame, opcode, data, len)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+    } else {
+        if(!deflate->tx && (status = wstk_deflate_stream_create(&deflate->tx, WSTK_DEFLATE_RAW, deflate->level, deflate->tx_wbits, MAX(deflate->tx_wbits - 7, 1))) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if((status = wstk_mbuf_alloc(&frame, WEBSOCK_FRAME_HDR_MAX + (len >> 1) + 64)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+
+        /* the payload goes after the biggest header, without the trailing 00 00 ff ff */
+        wstk_mbuf_set_pos(frame, WEBSOCK_FRAME_HDR_MAX);
+        if((status = wstk_deflate_stream_write(deflate->tx, frame, data, len, true)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        clen = wstk_mbuf_end(frame) - WEBSOCK_FRAME_HDR_MAX - 4;
+
+        if(clen > 0xffff)   { start = 0; }
+        else if(clen > 125) { start = WEBSOCK_FRAME_HDR_MAX - 4; }
+        else { start = WEBSOCK_FRAME_HDR_MAX - 2; }
+
+        wstk_mbuf_set_pos(frame, start);
+        if((status = wstk_websock_encode(frame, true, opcode, false, clen)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        frame->buf[start] |= WEBSOCK_DEFLATE_HDR_RSV1;
+
+        wstk_mbuf_set_end(frame, WEBSOCK_FRAME_HDR_MAX + clen);
+        wstk_mbuf_set_pos(frame, start);
+
+        if(deflate->tx_no_context) {
+            deflate->tx = wstk_mem_deref(deflate->tx);
+        }
+    }
+
+    if((status = ws_frame_send(conn, frame)) != WSTK_STATUS_SUCCESS) {
+        /* the peer's window is out of sync */
+        wstk_tcp_srv_conn_close(conn->tcp_conn);
+    }
+
+out:
+    wstk_mutex_unlock(deflate->mutex);
+    wstk_mem_deref(frame);
+    return status;
+}
+
+static wstk_status_t ws_deflate_vsend(websock_deflate_t *deflate, wstk_http_conn_t *conn, websock_opcode_e opcode, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *mb = NULL;
+
+    if((status = wstk_mbuf_alloc(&mb, 2048)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+    if(!fmt || (status = wstk_mbuf_vprintf(mb, fmt, ap)) == WSTK_STATUS_SUCCESS) {
+        status = ws_deflate_send(deflate, conn, opcode, mb->buf, wstk_mbuf_end(mb));
+    }
+
+    wstk_mem_deref(mb);
+    return status;
+}
+
+/* close with the status code (the onClose handler is performed from the destructor) */
+static void ws_close(wstk_http_conn_t *conn, websock_scode_e scode, const char *fmt, ...) {
+    va_list ap;
+
+    /* the connection is shut down when the queue is written out */
+    va_start(ap, fmt);
+    ws_frame_vsend(conn, WEBSOCK_CLOSE, scode, fmt, ap);
+    va_end(ap);
+
+    wstk_tcp_srv_conn_close(conn->tcp_conn);
+    ws_unreg(conn);
+}
+
+static void ws_msg_perform(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, websock_tcp_conn_ws_attr_t *attr, wstk_websock_hdr_t *hdr, wstk_mbuf_t *mbuf) {
+    wstk_servlet_websock_conn_t websock_conn = {0};
+
+    if(!servlet->hnd_on_message) {
+        return;
+    }
+
+    websock_conn.header = hdr;
+    websock_conn.sec_ctx = attr->sec_ctx;
+    websock_conn.http_conn = conn;
+
+    servlet->hnd_on_message(&websock_conn, mbuf);
+}
+
+/* the compressed message, the handler gets the inflated one */
+static wstk_status_t ws_msg_inflate(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, websock_tcp_conn_ws_attr_t *attr, wstk_websock_hdr_t *hdr, const uint8_t *data, size_t len) {
+    static const uint8_t tail[] = { 0x00, 0x00, 0xff, 0xff };
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    websock_deflate_t *deflate = attr->deflate;
+
+    if(!deflate->rx && (status = wstk_inflate_stream_create(&deflate->rx, WSTK_DEFLATE_RAW, deflate->rx_wbits)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(!deflate->rx_buf && (status = wstk_mbuf_alloc(&deflate->rx_buf, MIN(len * 4, WEBSOCK_MSG_BUFFER_KEEP) + 1)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    wstk_mbuf_rewind(deflate->rx_buf);
+    if((status = wstk_inflate_stream_write(deflate->rx, deflate->rx_buf, data, len, WEBSOCK_CONTENT_MAX_LENGTH)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_inflate_stream_write(deflate->rx, deflate->rx_buf, tail, sizeof(tail), WEBSOCK_CONTENT_MAX_LENGTH - wstk_mbuf_end(deflate->rx_buf) + 1)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(wstk_mbuf_end(deflate->rx_buf) > WEBSOCK_CONTENT_MAX_LENGTH) {
+        wstk_goto_status(WSTK_STATUS_NOSPACE, out);
+    }
+
+    if(deflate->rx_no_context) {
+        deflate->rx = wstk_mem_deref(deflate->rx);
+    }
+
+    hdr->rsv1 = 0;
+    hdr->len = wstk_mbuf_end(deflate->rx_buf);
+
+    wstk_mbuf_set_pos(deflate->rx_buf, 0);
+    ws_msg_perform(servlet, conn, attr, hdr, deflate->rx_buf);
+
+    if(deflate->rx_buf && wstk_mbuf_size(deflate->rx_buf) > WEBSOCK_MSG_BUFFER_KEEP) {
+        deflate->rx_buf = wstk_mem_deref(deflate->rx_buf);
+    }
+out:
+    if(status == WSTK_STATUS_NOSPACE) {
+        log_error("Message is to big (inflated > %d)", WEBSOCK_CONTENT_MAX_LENGTH);
+        ws_close(conn, WEBSOCK_MESSAGE_TOO_BIG, NULL);
+    } else if(status == WSTK_STATUS_INVALID_VALUE) {
+        log_error("Unable to inflate websock msg");
+        ws_close(conn, WEBSOCK_INVALID_PAYLOAD, NULL);
+    } else if(status != WSTK_STATUS_SUCCESS) {
+        log_error("Unable to inflate websock msg (status=%d)", (int)status);
+        ws_close(conn, WEBSOCK_INTERNAL_ERROR, NULL);
+    }
+    return status;
+}
+
+/* the assembled message */
+static void ws_msg_complete(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, websock_tcp_conn_ws_attr_t *attr) {
+    attr->msg_hdr.fin = 1;
+    attr->msg_hdr.len = wstk_mbuf_end(attr->msg);
+    attr->fl_msg = false;
+
+    wstk_mbuf_set_pos(attr->msg, 0);
+    if(attr->msg_hdr.rsv1) {
+        ws_msg_inflate(servlet, conn, attr, &attr->msg_hdr, wstk_mbuf_buf(attr->msg), wstk_mbuf_end(attr->msg));
+    } else {
+        ws_msg_perform(servlet, conn, attr, &attr->msg_hdr, attr->msg);
+    }
+
+    if(attr->msg && wstk_mbuf_size(attr->msg) > WEBSOCK_MSG_BUFFER_KEEP) {
+        attr->msg = wstk_mem_deref(attr->msg);
+    } else if(attr->msg) {
+        wstk_mbuf_rewind(attr->msg);
+    }
+}
+
+/*
+ * perform the frame at conn->buffer->pos (or the next part of the payload being read)
+ * returns NODATA if the rest of the frame is to come (pos is left at its start)
+ */
+static wstk_status_t ws_frame_perform(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, websock_tcp_conn_ws_attr_t *attr) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *mbuf = conn->buffer;
+    wstk_websock_hdr_t hdr = { 0 };
+    size_t start = mbuf->pos, end = 0, n = 0;
+
+    /* the payload of a big frame as it comes */
+    if(attr->fl_frame) {
+        n = (size_t)MIN((uint64_t)wstk_mbuf_left(mbuf), attr->frame_left);
+        end = wstk_mbuf_end(attr->msg);
+
+        if((status = wstk_mbuf_write_mem(attr->msg, wstk_mbuf_buf(mbuf), n)) != WSTK_STATUS_SUCCESS) {
+            log_error("Unable to write message (status=%d)", (int)status);
+            ws_close(conn, WEBSOCK_INTERNAL_ERROR, NULL);
+            return status;
+        }
+        if(attr->frame_hdr.mask) {
+            wstk_websock_mask(attr->msg->buf + end, n, attr->frame_hdr.mkey, (size_t)attr->frame_offset);
+        }
+        wstk_mbuf_advance(mbuf, n);
+
+        attr->frame_left -= n;
+        attr->frame_offset += n;
+        if(attr->frame_left > 0) {
+            return WSTK_STATUS_SUCCESS;
+        }
+
+        attr->fl_frame = false;
+        if(attr->frame_hdr.fin) {
+            ws_msg_complete(servlet, conn, attr);
+        }
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    status = wstk_websock_decode_hdr(&hdr, mbuf);
+    if(status == WSTK_STATUS_NODATA) {
+        wstk_mbuf_set_pos(mbuf, start);
+        return status;
+    }
+    /* rsv1 is the compressed message (the first frame of it) */
+    if(status != WSTK_STATUS_SUCCESS || hdr.rsv2 || hdr.rsv3 || (hdr.rsv1 && (!attr->deflate || hdr.opcode == WEBSOCK_CONT || hdr.opcode >= WEBSOCK_CLOSE))) {
+        log_error("Unable to decode websock msg");
+        ws_close(conn, WEBSOCK_PROTOCOL_ERROR, NULL);
+        return WSTK_STATUS_FALSE;
+    }
+
+    /* control frames (can be between the fragments), they are small and performed at once */
+    if(hdr.opcode >= WEBSOCK_CLOSE) {
+        if(!hdr.fin || hdr.len > WEBSOCK_CONTROL_MAX_LENGTH) {
+            ws_close(conn, WEBSOCK_PROTOCOL_ERROR, NULL);
+            return WSTK_STATUS_FALSE;
+        }
+        if(wstk_mbuf_left(mbuf) < hdr.len) {
+            wstk_mbuf_set_pos(mbuf, start);
+            return WSTK_STATUS_NODATA;
+        }
+        if(hdr.mask) {
+            wstk_websock_mask(wstk_mbuf_buf(mbuf), (size_t)hdr.len, hdr.mkey, 0);
+        }
+
+        if(hdr.opcode == WEBSOCK_PING) {
+            wstk_servlet_websock_send(conn, WEBSOCK_PONG, "%b", wstk_mbuf_buf(mbuf), (size_t)hdr.len);
+        } else if(hdr.opcode == WEBSOCK_CLOSE) {
+            /* NOTE: the handler will be performed from the destructor */
+            wstk_servlet_websock_send(conn, WEBSOCK_CLOSE, "%b", wstk_mbuf_buf(mbuf), (size_t)hdr.len);
+            wstk_tcp_srv_conn_close(conn->tcp_conn);
+            ws_unreg(conn);
+        }
+
+        wstk_mbuf_advance(mbuf, (size_t)hdr.len);
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    /* data frames: the first one is TEXT/BIN, the rest are CONT */
+    if((hdr.opcode == WEBSOCK_CONT) != attr->fl_msg || (hdr.opcode != WEBSOCK_CONT && hdr.opcode != WEBSOCK_TEXT && hdr.opcode != WEBSOCK_BIN)) {
+        log_error("Unexpected websock frame (opcode=%d, fragmented=%d)", (int)hdr.opcode, (int)attr->fl_msg);
+        ws_close(conn, WEBSOCK_PROTOCOL_ERROR, NULL);
+        return WSTK_STATUS_FALSE;
+    }
+    if(hdr.len > WEBSOCK_CONTENT_MAX_LENGTH || (attr->fl_msg && wstk_mbuf_end(attr->msg) + hdr.len > WEBSOCK_CONTENT_MAX_LENGTH)) {
+        log_error("Message is to big (%d > %d)", (uint32_t)hdr.len, WEBSOCK_CONTENT_MAX_LENGTH);
+        ws_close(conn, WEBSOCK_MESSAGE_TOO_BIG, NULL);
+        return WSTK_STATUS_FALSE;
+    }
+
+    /* the whole message in the buffer, performed in place (the handler sees only the payload) */
+    if(hdr.fin && !attr->fl_msg && wstk_mbuf_left(mbuf) >= hdr.len) {
+        end = wstk_mbuf_end(mbuf);
+        if(hdr.mask) {
+            wstk_websock_mask(wstk_mbuf_buf(mbuf), (size_t)hdr.len, hdr.mkey, 0);
+        }
+
+        start = mbuf->pos;
+        if(hdr.rsv1) {
+            status = ws_msg_inflate(servlet, conn, attr, &hdr, wstk_mbuf_buf(mbuf), (size_t)hdr.len);
+        } else {
+            wstk_mbuf_set_end(mbuf, start + (size_t)hdr.len);
+            ws_msg_perform(servlet, conn, attr, &hdr, mbuf);
+            wstk_mbuf_set_end(mbuf, end);
+        }
+        wstk_mbuf_set_pos(mbuf, start + (size_t)hdr.len);
+
+        return status;
+    }
+
+    /* a fragment or a frame bigger than the buffer, goes to the message */
+    if(!attr->fl_msg) {
+        if(!attr->msg && (status = wstk_mbuf_alloc(&attr->msg, MIN(hdr.len, WEBSOCK_MSG_BUFFER_KEEP) + 1)) != WSTK_STATUS_SUCCESS) {
+            log_error("Unable to allocate buffer");
+            ws_close(conn, WEBSOCK_INTERNAL_ERROR, NULL);
+            return status;
+        }
+        wstk_mbuf_rewind(attr->msg);
+        attr->msg_hdr = hdr;
+        attr->fl_msg = true;
+    }
+
+    attr->frame_hdr = hdr;
+    attr->frame_left = hdr.len;
+    attr->frame_offset = 0;
+    attr->fl_frame = (hdr.len > 0);
+
+    if(!attr->fl_frame && hdr.fin) {
+        ws_msg_complete(servlet, conn, attr);
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg, void *udata) {
     wstk_servlet_websock_t *servlet = (wstk_servlet_websock_t *)udata;
     wstk_status_t status = 0;
-    const char *hdr_val = NULL, *ws_key = NULL;
-    wstk_mbuf_t *buffer = NULL;
-    wstk_websock_hdr_t ws_hdr = { 0 };
+    wstk_pl_t hdr_val = {0}, ws_key = {0};
     wstk_httpd_sec_ctx_t sec_ctx = {0};
-    wstk_servlet_websock_conn_t websock_conn = {0};
     websock_tcp_conn_ws_attr_t *ws_conn_attr = NULL;
+    websock_deflate_t *deflate = NULL;
+    char deflate_ext[WEBSOCK_DEFLATE_EXT_MAX] = {0};
     int ws_hits = 0;
 
     if(!servlet) {
@@ -151,13 +652,13 @@ static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg
             wstk_httpd_ereply(conn, 400, WS_BAD_REQUEST_MSG);
             return;
         }
-        if(wstk_http_msg_header_get(msg, "Connection", &hdr_val) == WSTK_STATUS_SUCCESS || wstk_strstr(hdr_val, "Upgrade")) {
+        if(wstk_http_msg_header_has_token(msg, WSTK_HTTP_HDR_CONNECTION, "upgrade")) {
             ws_hits++;
         }
-        if(wstk_http_msg_header_get(msg, "Upgrade", &hdr_val) == WSTK_STATUS_SUCCESS || wstk_str_equal(hdr_val, "websocket", false)) {
+        if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_UPGRADE, &hdr_val) == WSTK_STATUS_SUCCESS && wstk_pl_strcasecmp(&hdr_val, "websocket") == 0) {
             ws_hits++;
         }
-        if(wstk_http_msg_header_get(msg, "Sec-WebSocket-Version", &hdr_val) == WSTK_STATUS_SUCCESS && wstk_str_equal(hdr_val, "13", false)) {
+        if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_SEC_WEBSOCKET_VERSION, &hdr_val) == WSTK_STATUS_SUCCESS && wstk_pl_strcmp(&hdr_val, "13") == 0) {
             ws_hits++;
         }
         if(ws_hits < 3) {
@@ -165,24 +666,41 @@ static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg
             return;
         }
 
-        if(wstk_http_msg_header_get(msg, "Sec-WebSocket-Key", &ws_key) == WSTK_STATUS_SUCCESS && ws_key) {
+        if(wstk_http_msg_header_common(msg, WSTK_HTTP_HDR_SEC_WEBSOCKET_KEY, &ws_key) == WSTK_STATUS_SUCCESS) {
             char digest[WSTK_SHA1_DIGEST_SIZE] = {0};
             wstk_sha1_t sha = {0};
             char *akey = NULL;
 
             wstk_sha1_init(&sha);
-            wstk_sha1_update(&sha, (uint8_t *)ws_key, strlen(ws_key));
+            wstk_sha1_update(&sha, (uint8_t *)ws_key.p, ws_key.l);
             wstk_sha1_update(&sha, magic, sizeof(magic) - 1);
             wstk_sha1_final(&sha, (uint8_t *)digest);
 
+            /* permessage-deflate */
+            if(servlet->fl_deflate) {
+                if(wstk_mem_zalloc((void *)&deflate, sizeof(websock_deflate_t), desctuctor__websock_deflate_t) == WSTK_STATUS_SUCCESS) {
+                    deflate->level = servlet->deflate_level;
+                    deflate->min_size = servlet->deflate_min_size;
+                    if(!ws_deflate_negotiate(servlet, msg, deflate, deflate_ext, sizeof(deflate_ext)) || wstk_mutex_create(&deflate->mutex) != WSTK_STATUS_SUCCESS) {
+                        deflate = wstk_mem_deref(deflate);
+                    }
+                }
+            }
+
             if(wstk_base64_encode_str(digest, sizeof(digest), &akey, NULL) == WSTK_STATUS_SUCCESS) {
                 status = wstk_httpd_reply(conn, 101, "Switching Protocols",
                                                             "Upgrade: websocket\r\n"
                                                             "Connection: Upgrade\r\n"
                                                             "Sec-WebSocket-Accept: %s\r\n"
+                                                            "%s%s%s"
                                                             "\r\n",
-                                                            akey
+                                                            akey,
+                                                            (deflate ? "Sec-WebSocket-Extensions: " : ""), (deflate ? deflate_ext : ""), (deflate ? "\r\n" : "")
                                         );
+                /* the frames are written directly, so the handshake goes first */
+                if(status == WSTK_STATUS_SUCCESS) {
+                    status = wstk_httpd_flush(conn);
+                }
                 conn->websock = (status == WSTK_STATUS_SUCCESS ? true : false);
             }
             wstk_mem_deref(akey);
@@ -197,7 +715,7 @@ static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg
                 sock_allow = servlet->hnd_on_accept(conn, &sec_ctx);
             }
             if(sock_allow) {
-                if((status = ws_reg(servlet, conn, &sec_ctx)) != WSTK_STATUS_SUCCESS) {
+                if((status = ws_reg(servlet, conn, &sec_ctx, deflate)) != WSTK_STATUS_SUCCESS) {
                     log_error("Unable to register websock (conn=%p, status=%d)", conn, (int)status);
                     conn->websock = false;
                     wstk_httpd_sec_ctx_clean(&sec_ctx);
@@ -211,6 +729,7 @@ static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg
         } else {
             wstk_httpd_ereply(conn, 400, WS_BAD_REQUEST_MSG);
         }
+        wstk_mem_deref(deflate);
         return;
     }
 
@@ -219,109 +738,35 @@ static void servlet_perform_handler(wstk_http_conn_t *conn, wstk_http_msg_t *msg
         log_error("Unable to get connection buffer");
         conn->websock = false;
         wstk_httpd_ereply(conn, 500, NULL);
-        goto out;
+        return;
     }
 
-    if(wstk_tcp_srv_conn_attr_get(conn->tcp_conn, WEBSOCK_ATTR__WS_CONN, (void *)&ws_conn_attr) != WSTK_STATUS_SUCCESS) {
+    if(wstk_tcp_srv_conn_attr_get(conn->tcp_conn, WEBSOCK_ATTR__WS_CONN, (void *)&ws_conn_attr) != WSTK_STATUS_SUCCESS || !ws_conn_attr) {
         log_error("Unable to get ws-attr");
         conn->websock = false;
         wstk_httpd_ereply(conn, 500, NULL);
-        goto out;
+        return;
     }
 
+    /* every frame in the buffer, a partial one waits for the next read (the worker never waits for the socket) */
     wstk_mbuf_set_pos(conn->buffer, 0);
-    status = wstk_websock_decode(&ws_hdr, conn->buffer);
-    if(status == WSTK_STATUS_NODATA) { goto out; }
-    if(status != WSTK_STATUS_SUCCESS) {
-        log_error("Unable to decode websock msg");
-        wstk_httpd_ereply(conn, 400, WS_BAD_REQUEST_MSG);
-        ws_unreg(conn);
-        goto out;
-    }
-
-    if(ws_hdr.opcode == WEBSOCK_PING) {
-        wstk_servlet_websock_send(conn, WEBSOCK_PONG, "%b", wstk_mbuf_buf(conn->buffer), wstk_mbuf_left(conn->buffer));
-        goto out;
-    }
-    if(ws_hdr.opcode == WEBSOCK_PONG) {
-        goto out;
-    }
-
-    if(ws_hdr.opcode == WEBSOCK_CLOSE) {
-        /* NOTE: the handler will be performed from the destructor */
-        wstk_servlet_websock_send(conn, WEBSOCK_CLOSE, "%b", wstk_mbuf_buf(conn->buffer), wstk_mbuf_left(conn->buffer));
-        wstk_tcp_srv_conn_close(conn->tcp_conn);
-        ws_unreg(conn);
-        goto out;
-    }
-
-    if(ws_hdr.len > WEBSOCK_CONTENT_MAX_LENGTH) {
-        log_error("Message is to big (%d > %d)", (uint32_t)ws_hdr.len, WEBSOCK_CONTENT_MAX_LENGTH);
-        ws_unreg(conn);
-        wstk_httpd_ereply(conn, 400, WS_BAD_REQUEST_MSG);
-        goto out;
-    }
-
-    if(ws_hdr.len > wstk_mbuf_left(conn->buffer)) {
-        if(wstk_mbuf_alloc(&buffer, ws_hdr.len) != WSTK_STATUS_SUCCESS) {
-            log_error("Unable to allocate buffer");
-            ws_unreg(conn);
-            wstk_httpd_ereply(conn, 500, NULL);
-            goto out;
-        }
-        /* read first part and more */
-        wstk_mbuf_write_mem(buffer, wstk_mbuf_buf(conn->buffer), wstk_mbuf_left(conn->buffer));
-
-        if(wstk_httpd_conn_rdlock(conn, true) == WSTK_STATUS_SUCCESS) {
-            while(true) {
-                status = wstk_httpd_read(conn, buffer, WSTK_RD_TIMEOUT(ws_hdr.len));
-                if(servlet->fl_destroyed || buffer->pos >= ws_hdr.len)  {
-                    break;
-                }
-                if(status == WSTK_STATUS_CONN_DISCON || status == WSTK_STATUS_CONN_EXPIRE)  {
-                    break;
-                }
-            }
-            wstk_httpd_conn_rdlock(conn, false);
-        } else {
-            status = WSTK_STATUS_LOCK_FAIL;
-            log_error("Unable to lock connection (rdlock)");
-        }
-
-        if(!WSTK_RW_ACCEPTABLE(status)) {
-            log_error("Unable to read the whole message (status=%d)", (int)status);
-            ws_unreg(conn);
-            wstk_httpd_ereply(conn, 500, NULL);
-            goto out;
+    while(wstk_mbuf_left(conn->buffer) > 0 && conn->websock) {
+        if(servlet->fl_destroyed || wstk_tcp_srv_conn_is_closed(conn->tcp_conn)) {
+            break;
         }
-
-        if(servlet->hnd_on_message) {
-            websock_conn.header = &ws_hdr;
-            websock_conn.sec_ctx = ws_conn_attr->sec_ctx;
-            websock_conn.http_conn = conn;
-
-            wstk_mbuf_set_pos(buffer, 0);
-            servlet->hnd_on_message(&websock_conn, buffer);
+        status = ws_frame_perform(servlet, conn, ws_conn_attr);
+        if(status == WSTK_STATUS_NODATA) {
+            wstk_tcp_srv_conn_keep_unread(conn->tcp_conn, true);
+            break;
         }
-
-    } else {
-        if(servlet->hnd_on_message) {
-            websock_conn.header = &ws_hdr;
-            websock_conn.sec_ctx = ws_conn_attr->sec_ctx;
-            websock_conn.http_conn = conn;
-
-            servlet->hnd_on_message(&websock_conn, conn->buffer);
+        if(status != WSTK_STATUS_SUCCESS) {
+            break;
         }
     }
-
-out:
-    if(buffer) {
-        wstk_mem_deref(buffer);
-    }
 }
 
 /* helper to catch tcp_conn destroy */
-static wstk_status_t ws_reg(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *sec_ctx) {
+static wstk_status_t ws_reg(wstk_servlet_websock_t *servlet, wstk_http_conn_t *conn, wstk_httpd_sec_ctx_t *sec_ctx, websock_deflate_t *deflate) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     websock_tcp_conn_ws_attr_t *attr = NULL;
 
@@ -339,13 +784,14 @@ static wstk_status_t ws_reg(wstk_servlet_websock_t *servlet, wstk_http_conn_t *c
     attr->conn_id = conn->conn_id;
     attr->tcp_conn = conn->tcp_conn;
     attr->http_conn = conn;
+    attr->deflate = wstk_mem_ref(deflate);
 
     status = wstk_tcp_srv_conn_attr_add(conn->tcp_conn, WEBSOCK_ATTR__WS_CONN, attr, true);
     if(status == WSTK_STATUS_SUCCESS) {
         attr->fl_registered = true;
 
         wstk_mutex_lock(servlet->mutex);
-        status = wstk_inthash_insert(servlet->sockets, attr->conn_id, conn);
+        status = wstk_inthash_insert(servlet->sockets, attr->conn_id, attr);
         wstk_mutex_unlock(servlet->mutex);
     }
 
@@ -365,6 +811,47 @@ out:
     return status;
 }
 
+/* a server frame (header + payload), it's encoded once and written to many sockets */
+static wstk_status_t ws_frame_encode(wstk_mbuf_t **frame, websock_opcode_e opcode, const uint8_t *data, size_t len) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *frame_local = NULL;
+
+    if((status = wstk_mbuf_alloc(&frame_local, WEBSOCK_FRAME_HDR_MAX + len)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_websock_encode(frame_local, true, opcode, false, len)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if(len && (status = wstk_mbuf_write_mem(frame_local, data, len)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    wstk_mbuf_set_pos(frame_local, 0);
+    *frame = frame_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(frame_local);
+    }
+    return status;
+}
+
+/* the whole frame goes to the connection queue (the frame is referenced, so it can be shared) */
+static wstk_status_t ws_frame_send(wstk_http_conn_t *conn, wstk_mbuf_t *frame) {
+    return wstk_tcp_srv_conn_send(conn->tcp_conn, frame, false);
+}
+
+static wstk_status_t ws_frame_vsend(wstk_http_conn_t *conn, websock_opcode_e opcode, websock_scode_e scode, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *frame = NULL;
+
+    if((status = wstk_websock_vencode(&frame, opcode, scode, true, fmt, ap)) == WSTK_STATUS_SUCCESS) {
+        status = ws_frame_send(conn, frame);
+    }
+
+    wstk_mem_deref(frame);
+    return status;
+}
+
 /* clear websock flag and delete from registry */
 static void ws_unreg(wstk_http_conn_t *conn) {
     conn->websock = false;
@@ -480,6 +967,40 @@ wstk_status_t wstk_servlet_websock_set_on_message(wstk_servlet_websock_t *servle
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Configure permessage-deflate (RFC 7692)
+ * applies to the new connections, the offers are accepted if the server is built with zlib
+ *
+ * @param servlet       - the servlet
+ * @param enable        - accept the extension
+ * @param level         - 1..9 or -1 (default)
+ * @param min_size      - the smaller messages are sent uncompressed
+ * @param mem_max       - the compression state a connection keeps between the messages (0 - no limit),
+ *                        the windows are narrowed and then the context takeover is dropped to fit it
+ * @param no_context    - no context takeover in both directions (nothing is kept, but small messages compress worse)
+ *
+ * @return sucesss, WSTK_STATUS_NOT_IMPL (built without zlib) or some error
+ **/
+wstk_status_t wstk_servlet_websock_set_deflate(wstk_servlet_websock_t *servlet, bool enable, int level, size_t min_size, size_t mem_max, bool no_context) {
+    if(!servlet) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(servlet->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(enable && !wstk_deflate_is_supported()) {
+        return WSTK_STATUS_NOT_IMPL;
+    }
+
+    servlet->deflate_level = level;
+    servlet->deflate_min_size = min_size;
+    servlet->deflate_mem_max = mem_max;
+    servlet->fl_deflate_no_context = no_context;
+    servlet->fl_deflate = enable;
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Send message
  * send message to the client by connection, usually uses from handlers
@@ -493,7 +1014,8 @@ wstk_status_t wstk_servlet_websock_set_on_message(wstk_servlet_websock_t *servle
  **/
 wstk_status_t wstk_servlet_websock_send(wstk_http_conn_t *conn, websock_opcode_e opcode, const char *fmt, ...) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_socket_t *sock = NULL;
+    websock_tcp_conn_ws_attr_t *attr = NULL;
+    websock_deflate_t *deflate = NULL;
     va_list ap;
 
     if(!conn) {
@@ -504,17 +1026,22 @@ wstk_status_t wstk_servlet_websock_send(wstk_http_conn_t *conn, websock_opcode_e
         return WSTK_STATUS_CONN_DISCON;
     }
 
-    if((status = wstk_tcp_srv_conn_socket(conn->tcp_conn, &sock)) != WSTK_STATUS_SUCCESS) {
-        return status;
-    }
-    if(!sock) {
-        return WSTK_STATUS_INVALID_PARAM;
+    /* data messages can be compressed */
+    if(opcode == WEBSOCK_TEXT || opcode == WEBSOCK_BIN) {
+        if(wstk_tcp_srv_conn_attr_get(conn->tcp_conn, WEBSOCK_ATTR__WS_CONN, (void *)&attr) == WSTK_STATUS_SUCCESS && attr) {
+            deflate = wstk_mem_ref(attr->deflate);
+        }
     }
 
     va_start(ap, fmt);
-    status = wstk_websock_vsend(sock, opcode, 0, true, fmt, ap);
+    if(deflate) {
+        status = ws_deflate_vsend(deflate, conn, opcode, fmt, ap);
+    } else {
+        status = ws_frame_vsend(conn, opcode, 0, fmt, ap);
+    }
     va_end(ap);
 
+    wstk_mem_deref(deflate);
     return status;
 }
 
@@ -532,7 +1059,8 @@ wstk_status_t wstk_servlet_websock_send(wstk_http_conn_t *conn, websock_opcode_e
  **/
 wstk_status_t wstk_servlet_websock_send2(wstk_servlet_websock_t *servlet, uint32_t conn_id, websock_opcode_e opcode, const char *fmt, ...) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_socket_t *sock = NULL;
+    websock_tcp_conn_ws_attr_t *attr = NULL;
+    websock_deflate_t *deflate = NULL;
     wstk_http_conn_t *http_conn = NULL;
     va_list ap;
 
@@ -544,22 +1072,120 @@ wstk_status_t wstk_servlet_websock_send2(wstk_servlet_websock_t *servlet, uint32
     }
 
     wstk_mutex_lock(servlet->mutex);
-    http_conn = wstk_core_inthash_find(servlet->sockets, conn_id);
-    if(http_conn) {
-        status = wstk_httpd_conn_take(http_conn);
+    attr = wstk_core_inthash_find(servlet->sockets, conn_id);
+    if(attr) {
+        /* taken through the tcp conn (see: wstk_servlet_websock_broadcast()) */
+        status = wstk_tcp_srv_conn_take(attr->tcp_conn);
+        http_conn = (status == WSTK_STATUS_SUCCESS ? attr->http_conn : NULL);
+        if(status == WSTK_STATUS_SUCCESS && (opcode == WEBSOCK_TEXT || opcode == WEBSOCK_BIN)) {
+            deflate = wstk_mem_ref(attr->deflate);
+        }
+    } else {
+        status = WSTK_STATUS_NOT_FOUND;
     }
     wstk_mutex_unlock(servlet->mutex);
 
     if(status == WSTK_STATUS_SUCCESS) {
-        status = wstk_tcp_srv_conn_socket(http_conn->tcp_conn, &sock);
-        if(status == WSTK_STATUS_SUCCESS) {
-            va_start(ap, fmt);
-            status = wstk_websock_vsend(sock, opcode, 0, true, fmt, ap);
-            va_end(ap);
+        va_start(ap, fmt);
+        if(deflate) {
+            status = ws_deflate_vsend(deflate, http_conn, opcode, fmt, ap);
+        } else {
+            status = ws_frame_vsend(http_conn, opcode, 0, fmt, ap);
         }
+        va_end(ap);
 
+        wstk_mem_deref(deflate);
         wstk_httpd_conn_release(http_conn);
     }
 
     return status;
 }
+
+/**
+ * Send the message to many connections
+ * the frame is encoded once and the same one is put into the connections output queues (taken under the lock, queued without it),
+ * the slow ones are handled by the queue policy (see: wstk_httpd_set_outq()) and counted as dropped
+ *
+ * @param servlet   - the servlet
+ * @param filter    - NULL (all) or the handler that selects the connections
+ * @param udata     - filter user data
+ * @param opcode    - ws opcode
+ * @param mbuf      - the payload (pos...end)
+ * @param delivered - the number of the connections the frame was queued to (can be NULL)
+ * @param dropped   - the number of failed ones (can be NULL)
+ *
+ * @return success or error
+ **/
+wstk_status_t wstk_servlet_websock_broadcast(wstk_servlet_websock_t *servlet, wstk_servlet_websock_filter_t filter, void *udata, websock_opcode_e opcode, wstk_mbuf_t *mbuf, uint32_t *delivered, uint32_t *dropped) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_hash_index_t *hidx = NULL;
+    websock_peer_t *peers = NULL, *peer = NULL;
+    websock_tcp_conn_ws_attr_t *attr = NULL;
+    wstk_mbuf_t *frame = NULL;
+    uint32_t count = 0, i = 0, ok = 0, failed = 0;
+
+    if(!servlet || !mbuf) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(servlet->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    if((status = ws_frame_encode(&frame, opcode, wstk_mbuf_buf(mbuf), wstk_mbuf_left(mbuf))) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    /* the snapshot, the connections stay taken and the sec_ctx referenced till they're written */
+    wstk_mutex_lock(servlet->mutex);
+    if((count = wstk_hash_size(servlet->sockets)) > 0) {
+        status = wstk_mem_zalloc((void *)&peers, count * sizeof(websock_peer_t), NULL);
+        if(status == WSTK_STATUS_SUCCESS) {
+            count = 0;
+            for(hidx = wstk_hash_first_iter(servlet->sockets, hidx); hidx; hidx = wstk_hash_next(&hidx)) {
+                wstk_hash_this(hidx, NULL, NULL, (void *)&attr);
+                /* the tcp conn is alive while the attr is here, the http conn is its attribute as well (can be gone already) */
+                if(attr && wstk_tcp_srv_conn_take(attr->tcp_conn) == WSTK_STATUS_SUCCESS) {
+                    peers[count].http_conn = attr->http_conn;
+                    peers[count].sec_ctx = wstk_mem_ref(attr->sec_ctx);
+                    count++;
+                }
+            }
+        }
+    }
+    wstk_mutex_unlock(servlet->mutex);
+
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    for(i = 0; i < count; i++) {
+        peer = &peers[i];
+
+        if(!peer->http_conn->websock || wstk_tcp_srv_conn_is_closed(peer->http_conn->tcp_conn)) {
+            failed++;
+            goto next;
+        }
+
+        if(filter && !filter(peer->http_conn, peer->sec_ctx, udata)) {
+            goto next;
+        }
+
+        /* the shared frame isn't compressed, the queue keeps it whole between the compressed ones */
+        if(ws_frame_send(peer->http_conn, frame) == WSTK_STATUS_SUCCESS) {
+            ok++;
+        } else {
+            failed++;
+        }
+next:
+        wstk_mem_deref(peer->sec_ctx);
+        wstk_httpd_conn_release(peer->http_conn);
+    }
+
+out:
+    if(delivered) { *delivered = ok; }
+    if(dropped) { *dropped = failed; }
+
+    wstk_mem_deref(peers);
+    wstk_mem_deref(frame);
+    return status;
+}
@@ -20,16 +20,45 @@
 #include <wstk-time.h>
 
 #define TCP_SRV_DEFAULT_POLL_TIMEOUT    60  // seconds
+#define TCP_SRV_MAX_REACTORS            64
+#define TCP_SRV_DEFAULT_OUTQ_HIGH       (1024 * 1024)
+#define TCP_SRV_DEFAULT_OUTQ_LOW        (256 * 1024)
+#define TCP_SRV_DEFAULT_OUTQ_TIMEOUT    10  // seconds
+
+/* packed into conn->refs, edge-triggered poll: data arrived while a worker held the connection */
+#define CONN_RD_PENDING                 (1u << 31)
+#define CONN_REFS(v)                    ((v) & ~CONN_RD_PENDING)
+
+typedef struct {
+    wstk_tcp_srv_t              *server;
+    wstk_mutex_t                *mutex_clients;
+    wstk_inthash_t              *clients;       // clients id > conn
+    wstk_socket_t               *sock;          // listener (own or shared with the reactor #0)
+    wstk_poll_t                 *poll;
+    wstk_thread_t               *thread;        // polling thread
+    wstk_polling_method_e       pmethod;
+    uint32_t                    id;             // reactor index
+    bool                        fl_shared_sock;
+    bool                        fl_stop;        // the polling thread should leave (the start failed)
+    bool                        fl_edge;        // poll works in edge-triggered mode (epoll)
+    bool                        fl_wr_edge;     // the write interest is registered once and EWRITE comes on the transitions (epoll-et, kqueue)
+    bool                        fl_ready;
+} tcp_srv_reactor_t;
+
+/* the output queue entry, the mbuf can be shared between the connections (the own cursor) */
+typedef struct conn_outq_entry_s {
+    struct conn_outq_entry_s    *next;
+    wstk_mbuf_t                 *mbuf;
+    size_t                      pos;
+    size_t                      end;
+} conn_outq_entry_t;
 
 struct wstk_tcp_srv_s {
     wstk_mutex_t                *mutex;
-    wstk_mutex_t                *mutex_clients;
     wstk_mutex_t                *mutex_attributes;
-    wstk_inthash_t              *clients;       // clients id > conn
-    wstk_socket_t               *sock;
     wstk_worker_t               *worker_gc;
     wstk_worker_t               *worker_tcp;
-    wstk_poll_t                 *poll;
+    tcp_srv_reactor_t           *reactors;
     wstk_hash_t                 *attributes;    // key => attributes_entry_t
     wstk_sockaddr_t             laddr;
     wstk_tcp_srv_handler_t      handler;
@@ -41,6 +70,16 @@ struct wstk_tcp_srv_s {
     uint32_t                    max_threads;
     uint32_t                    connections;
     uint32_t                    buffer_size;
+    uint32_t                    poll_size;
+    uint32_t                    poll_timeout;
+    uint32_t                    reactors_count;
+    uint32_t                    reactors_ready;
+    size_t                      outq_high;      // the connections output queue defaults
+    size_t                      outq_low;
+    uint32_t                    outq_timeout;
+    wstk_tcp_srv_outq_policy_e  outq_policy;
+    bool                        fl_cpu_pin;     // bind the reactors (and the affinity workers) to the processors
+    bool                        fl_edge_triggered; // epoll in edge-triggered mode (see wstk_tcp_srv_set_edge_triggered)
     bool                        fl_destroyed;
     bool                        fl_ready;
 };
@@ -48,15 +87,28 @@ struct wstk_tcp_srv_s {
 struct wstk_tcp_srv_conn_s {
     wstk_mutex_t                *mutex;
     wstk_tcp_srv_t              *server;
+    tcp_srv_reactor_t           *reactor;
     wstk_mbuf_t                 *mbuf;
     wstk_socket_t               *sock;
     wstk_hash_t                 *attributes;    // key => attributes_entry_t
+    conn_outq_entry_t           *outq_head;     // output queue (under the mutex), drained by the reactor
+    conn_outq_entry_t           *outq_tail;
+    wstk_cond_t                 *outq_cond;     // the block policy waiters (created on demand)
+    wstk_tcp_srv_on_drain_t     on_drain;
+    void                        *on_drain_udata;
     wstk_sockaddr_t             peer;
+    size_t                      outq_size;      // queued bytes
+    size_t                      outq_high;
+    size_t                      outq_low;
+    wstk_tcp_srv_outq_policy_e  outq_policy;
     uint32_t                    id;
     uint32_t                    refs;
     bool                        fl_enpolled;    // true when srv-refs been increased
     bool                        fl_destroyed;
     bool                        fl_do_close;
+    bool                        fl_keep_unread; // the next read appends to mbuf[pos...end]
+    bool                        fl_outq_above;  // went above the high watermark, on_drain is due below the low one
+    bool                        fl_outq_linger; // closing, the socket is shut down when the queue is written out
 };
 
 typedef struct {
@@ -66,6 +118,13 @@ typedef struct {
 
 static wstk_status_t srv_refs(wstk_tcp_srv_t *srv);
 static void srv_derefs(wstk_tcp_srv_t *srv);
+static uint32_t srv_refs_count(wstk_tcp_srv_t *srv);
+static void conn_derefs(wstk_tcp_srv_conn_t *conn);
+static uint32_t conn_refs_count(wstk_tcp_srv_conn_t *conn);
+static void conn_outq_clear(wstk_tcp_srv_conn_t *conn);
+static bool conn_outq_linger(wstk_tcp_srv_conn_t *conn);
+static void reactors_stop(wstk_tcp_srv_t *srv);
+static void reactors_free(wstk_tcp_srv_t *srv);
 
 // -----------------------------------------------------------------------------------------------------------------------
 static void desctuctor__attributes_entry_t(void *ptr) {
@@ -84,15 +143,25 @@ static void desctuctor__attributes_entry_t(void *ptr) {
 #endif
 }
 
+static void desctuctor__conn_outq_entry_t(void *ptr) {
+    conn_outq_entry_t *entry = (conn_outq_entry_t *)ptr;
+
+    if(!entry) { return; }
+    entry->mbuf = wstk_mem_deref(entry->mbuf);
+}
+
 static void desctuctor__wstk_tcp_srv_conn_t(void *ptr) {
     wstk_tcp_srv_conn_t *conn = (wstk_tcp_srv_conn_t *)ptr;
     wstk_tcp_srv_t *srv = (conn ? conn->server : NULL);
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!conn || !srv || conn->fl_destroyed) {
         return;
     }
     conn->fl_destroyed = true;
+#ifdef WSTK_HAVE_ATOMIC_FENCE
+    wstk_atomic_fence_seq(); /* before the refs are checked (see conn_refs) */
+#endif
 
     /* interrupt polling */
     if(conn->sock && !conn->sock->fl_destroyed) {
@@ -100,26 +169,29 @@ static void desctuctor__wstk_tcp_srv_conn_t(void *ptr) {
     }
 
 #ifdef WSTK_TCP_SRV_DEBUG
-    WSTK_DBG_PRINT("destroying connection: conn=%p (srv=%p, sock=%p, refs=%d)", conn, srv, conn->sock, conn->refs);
+    WSTK_DBG_PRINT("destroying connection: conn=%p (srv=%p, sock=%p, refs=%d)", conn, srv, conn->sock, conn_refs_count(conn));
 #endif
 
-    /* delete connection from clients map */
-    wstk_mutex_lock(srv->mutex_clients);
-    wstk_core_inthash_delete(srv->clients, conn->id);
-    wstk_mutex_unlock(srv->mutex_clients);
-
+    /* release the block policy waiters */
     if(conn->mutex) {
-        while(floop) {
-            wstk_mutex_lock(conn->mutex);
-            floop = (conn->refs > 0);
-            wstk_mutex_unlock(conn->mutex);
-
-            WSTK_SCHED_YIELD(0);
+        wstk_mutex_lock(conn->mutex);
+        if(conn->outq_cond) {
+            wstk_cond_broadcast(conn->outq_cond);
         }
+        wstk_mutex_unlock(conn->mutex);
     }
 
-    if(conn->refs) {
-        log_warn("Lost references (refs=%d)", conn->refs);
+    /* delete connection from the reactor clients map */
+    if(conn->reactor) {
+        wstk_mutex_lock(conn->reactor->mutex_clients);
+        wstk_core_inthash_delete(conn->reactor->clients, conn->id);
+        wstk_mutex_unlock(conn->reactor->mutex_clients);
+    }
+
+    if(conn->mutex) {
+        while(conn_refs_count(conn) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
+        }
     }
 
     if(conn->attributes) {
@@ -128,6 +200,13 @@ static void desctuctor__wstk_tcp_srv_conn_t(void *ptr) {
         wstk_mutex_unlock(conn->mutex);
     }
 
+    if(conn->mutex) {
+        wstk_mutex_lock(conn->mutex);
+        conn_outq_clear(conn);
+        conn->outq_cond = wstk_mem_deref(conn->outq_cond);
+        wstk_mutex_unlock(conn->mutex);
+    }
+
     if(conn->fl_enpolled) {
         srv_derefs(srv);
     }
@@ -143,7 +222,7 @@ static void desctuctor__wstk_tcp_srv_conn_t(void *ptr) {
 
 static void desctuctor__wstk_tcp_srv_t(void *ptr) {
     wstk_tcp_srv_t *srv = (wstk_tcp_srv_t *)ptr;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!srv || srv->fl_destroyed) {
         return;
@@ -153,47 +232,28 @@ static void desctuctor__wstk_tcp_srv_t(void *ptr) {
     srv->fl_destroyed = true;
 
 #ifdef WSTK_TCP_SRV_DEBUG
-    WSTK_DBG_PRINT("destroying server: srv=%p (id=0x%x, refs=%d, sock=%p)", srv, srv->id, srv->refs, srv->sock);
+    WSTK_DBG_PRINT("destroying server: srv=%p (id=0x%x, refs=%d, reactors=%d)", srv, srv->id, srv_refs_count(srv), srv->reactors_count);
 #endif
 
     // interrupt polling
-    if(srv->sock) {
-        wstk_sock_close_fd(srv->sock);
-    }
-    if(srv->poll) {
-        wstk_poll_interrupt(srv->poll);
-    }
+    reactors_stop(srv);
 
     if(srv->mutex) {
-        while(floop) {
-            wstk_mutex_lock(srv->mutex);
-            floop = (srv->refs > 0);
-            wstk_mutex_unlock(srv->mutex);
-
-            WSTK_SCHED_YIELD(0);
+        while(srv_refs_count(srv) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
         }
     }
 
-    if(srv->refs) {
-        log_warn("Lost references (refs=%d)", srv->refs);
-    }
-
     if(srv->attributes) {
         wstk_mutex_lock(srv->mutex_attributes);
         srv->attributes = wstk_mem_deref(srv->attributes);
         wstk_mutex_unlock(srv->mutex_attributes);
     }
 
-    if(srv->clients) {
-        wstk_mutex_lock(srv->mutex_clients);
-        srv->clients = wstk_mem_deref(srv->clients);
-        wstk_mutex_unlock(srv->mutex_clients);
-    }
+    reactors_free(srv);
 
-    srv->sock = wstk_mem_deref(srv->sock);
     srv->worker_gc = wstk_mem_deref(srv->worker_gc);
     srv->worker_tcp = wstk_mem_deref(srv->worker_tcp);
-    srv->mutex_clients = wstk_mem_deref(srv->mutex_clients);
     srv->mutex_attributes = wstk_mem_deref(srv->mutex_attributes);
     srv->mutex = wstk_mem_deref(srv->mutex);
 
@@ -202,54 +262,467 @@ static void desctuctor__wstk_tcp_srv_t(void *ptr) {
 #endif
 }
 
+/*
+ * refs are atomic where it's possible (no mutex traffic on the requests path),
+ * the releases are acq_rel so that the destructor (waits for 0) sees the last owner's writes
+ */
 static wstk_status_t srv_refs(wstk_tcp_srv_t *srv) {
     if(!srv || srv->fl_destroyed)  {
         return WSTK_STATUS_FALSE;
     }
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&srv->refs, 1);
+#else
     if(srv->mutex) {
         wstk_mutex_lock(srv->mutex);
         srv->refs++;
         wstk_mutex_unlock(srv->mutex);
     }
+#endif
     return WSTK_STATUS_SUCCESS;
 }
 static void srv_derefs(wstk_tcp_srv_t *srv) {
     if(!srv)  { return; }
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&srv->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&srv->refs, &v, v - 1));
+#else
     if(srv->mutex) {
         wstk_mutex_lock(srv->mutex);
         if(srv->refs > 0) srv->refs--;
         wstk_mutex_unlock(srv->mutex);
     }
+#endif
+}
+static uint32_t srv_refs_count(wstk_tcp_srv_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&srv->refs);
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(srv->mutex);
+    refs = srv->refs;
+    wstk_mutex_unlock(srv->mutex);
+    return refs;
+#endif
 }
+/* closes the listeners, interrupts the polls and waits for the started polling threads */
+static void reactors_stop(wstk_tcp_srv_t *srv) {
+    uint32_t spins = 0;
+
+    if(!srv->reactors) {
+        return;
+    }
+
+    for(uint32_t i = 0; i < srv->reactors_count; i++) {
+        tcp_srv_reactor_t *reactor = &srv->reactors[i];
+
+        reactor->fl_stop = true;
+        if(reactor->sock && !reactor->fl_shared_sock) {
+            wstk_sock_close_fd(reactor->sock);
+        }
+        if(reactor->poll) {
+            wstk_poll_interrupt(reactor->poll);
+        }
+    }
+
+    for(uint32_t i = 0; i < srv->reactors_count; i++) {
+        tcp_srv_reactor_t *reactor = &srv->reactors[i];
+
+        if(reactor->thread) {
+            while(!wstk_thread_is_finished(reactor->thread)) {
+                WSTK_SCHED_BACKOFF(spins);
+            }
+            reactor->thread = wstk_mem_deref(reactor->thread);
+        }
+    }
+}
+
+static void reactors_free(wstk_tcp_srv_t *srv) {
+    if(!srv->reactors) {
+        return;
+    }
+
+    for(uint32_t i = 0; i < srv->reactors_count; i++) {
+        tcp_srv_reactor_t *reactor = &srv->reactors[i];
+
+        if(reactor->clients) {
+            wstk_mutex_lock(reactor->mutex_clients);
+            reactor->clients = wstk_mem_deref(reactor->clients);
+            wstk_mutex_unlock(reactor->mutex_clients);
+        }
+
+        reactor->thread = wstk_mem_deref(reactor->thread);
+        reactor->poll = wstk_mem_deref(reactor->poll);
+        reactor->sock = wstk_mem_deref(reactor->sock);
+        reactor->mutex_clients = wstk_mem_deref(reactor->mutex_clients);
+    }
+
+    srv->reactors = wstk_mem_deref(srv->reactors);
+    srv->reactors_ready = 0;
+}
+
 static wstk_status_t conn_refs(wstk_tcp_srv_conn_t *conn) {
     if(!conn || conn->fl_destroyed)  {
         return WSTK_STATUS_FALSE;
     }
+#ifdef WSTK_HAVE_ATOMIC
+    /* counted first, then checked: the destructor sets the flag and then waits for the refs */
+    wstk_atomic_seq_add(&conn->refs, 1);
+    if(wstk_atomic_seq(&conn->fl_destroyed)) {
+        conn_derefs(conn);
+        return WSTK_STATUS_FALSE;
+    }
+#else
     if(conn->mutex) {
         wstk_mutex_lock(conn->mutex);
         conn->refs++;
         wstk_mutex_unlock(conn->mutex);
     }
+#endif
     return WSTK_STATUS_SUCCESS;
 }
 static void conn_derefs(wstk_tcp_srv_conn_t *conn) {
     if(!conn)  { return; }
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&conn->refs);
+    while(CONN_REFS(v) > 0 && !wstk_atomic_seq_cas(&conn->refs, &v, v - 1));
+#else
     if(conn->mutex) {
         wstk_mutex_lock(conn->mutex);
-        if(conn->refs > 0) conn->refs--;
+        if(CONN_REFS(conn->refs) > 0) conn->refs--;
         wstk_mutex_unlock(conn->mutex);
     }
+#endif
+}
+static uint32_t conn_refs_count(wstk_tcp_srv_conn_t *conn) {
+#ifdef WSTK_HAVE_ATOMIC
+    return CONN_REFS(wstk_atomic_acq(&conn->refs));
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(conn->mutex);
+    refs = CONN_REFS(conn->refs);
+    wstk_mutex_unlock(conn->mutex);
+    return refs;
+#endif
+}
+/* reactor: marks the read as pending if a worker holds the connection, returns false if it's free */
+static bool conn_set_pending_if_busy(wstk_tcp_srv_conn_t *conn, bool fl_edge) {
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&conn->refs);
+
+    while(CONN_REFS(v) > 0) {
+        if(!fl_edge || (v & CONN_RD_PENDING)) {
+            return true;
+        }
+        if(wstk_atomic_seq_cas(&conn->refs, &v, v | CONN_RD_PENDING)) {
+            return true;
+        }
+    }
+    return false;
+#else
+    bool busy = false;
+
+    wstk_mutex_lock(conn->mutex);
+    if(CONN_REFS(conn->refs) > 0) {
+        if(fl_edge) conn->refs |= CONN_RD_PENDING;
+        busy = true;
+    }
+    wstk_mutex_unlock(conn->mutex);
+
+    return busy;
+#endif
+}
+/* returns true (and keeps the reference) if the poll has skipped a read event meanwhile */
+static bool conn_derefs_unless_pending(wstk_tcp_srv_conn_t *conn) {
+    bool fl_valid = (!conn->fl_destroyed && !conn->fl_do_close && !conn->server->fl_destroyed);
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&conn->refs);
+
+    while(true) {
+        if((v & CONN_RD_PENDING) && fl_valid) {
+            if(wstk_atomic_seq_cas(&conn->refs, &v, v & ~CONN_RD_PENDING)) {
+                return true;
+            }
+        } else {
+            uint32_t nv = (v & ~CONN_RD_PENDING);
+            nv = (nv > 0 ? nv - 1 : 0);
+            if(wstk_atomic_seq_cas(&conn->refs, &v, nv)) {
+                return false;
+            }
+        }
+    }
+#else
+    bool pending = false;
+
+    wstk_mutex_lock(conn->mutex);
+    if((conn->refs & CONN_RD_PENDING) && fl_valid) {
+        pending = true;
+    } else if(CONN_REFS(conn->refs) > 0) {
+        conn->refs--;
+    }
+    conn->refs &= ~CONN_RD_PENDING;
+    wstk_mutex_unlock(conn->mutex);
+
+    return pending;
+#endif
+}
+
+/* connections counter (shared between the reactors) */
+static wstk_status_t srv_conn_slot_take(wstk_tcp_srv_t *srv) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&srv->connections);
+
+    while(true) {
+        if(srv->max_conns && v >= srv->max_conns) {
+            status = WSTK_STATUS_NOSPACE;
+            break;
+        }
+        if(wstk_atomic_rlx_cas(&srv->connections, &v, v + 1)) {
+            break;
+        }
+    }
+#else
+    wstk_mutex_lock(srv->mutex);
+    if(srv->max_conns && srv->connections >= srv->max_conns) {
+        status = WSTK_STATUS_NOSPACE;
+    } else {
+        srv->connections++;
+    }
+    wstk_mutex_unlock(srv->mutex);
+#endif
+
+    return status;
+}
+static void srv_conn_slot_release(wstk_tcp_srv_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&srv->connections);
+    while(v > 0 && !wstk_atomic_rlx_cas(&srv->connections, &v, v - 1));
+#else
+    wstk_mutex_lock(srv->mutex);
+    if(srv->connections) srv->connections--;
+    wstk_mutex_unlock(srv->mutex);
+#endif
+}
+
+/* reads into the connection buffer, the unread tail (if the handler asked to keep it) goes in front of the new data */
+static wstk_status_t conn_read(wstk_tcp_srv_conn_t *conn) {
+    wstk_status_t st = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *mbuf = conn->mbuf;
+
+    if(!conn->fl_keep_unread) {
+        wstk_mbuf_set_pos(mbuf, 0);
+        st = wstk_tcp_read(conn->sock, mbuf, 0);
+    } else {
+        if(mbuf->pos) {
+            wstk_mbuf_shift(mbuf, -((ssize_t)mbuf->pos));
+        }
+        wstk_mbuf_set_pos(mbuf, mbuf->end);
+
+        st = wstk_tcp_read(conn->sock, mbuf, 0);
+        wstk_mbuf_set_pos(mbuf, 0);
+
+        /* nothing new, stays till the next attempt */
+        if(st == WSTK_STATUS_SUCCESS) {
+            conn->fl_keep_unread = false;
+        }
+    }
+
+    /* the peer has gone (eof), after the shutdown the poll reports HUP (the edge-triggered one doesn't repeat RDHUP) */
+    if(st == WSTK_STATUS_CONN_DISCON) {
+        conn->fl_do_close = true;
+        if(!conn_outq_linger(conn)) {
+            shutdown(conn->sock->fd, SHUT_RDWR);
+        }
+    }
+
+    return st;
+}
+
+/*
+ * the output queue, everything is under conn->mutex:
+ * the sender writes straight to the socket while the queue is empty and puts there what the socket didn't take,
+ * the reactor writes the queue out on EWRITE (edge-triggered epoll, kqueue: edges, select and level-triggered epoll: MWRITE is set while there is something)
+ */
+static void conn_outq_clear(wstk_tcp_srv_conn_t *conn) {
+    conn_outq_entry_t *entry = conn->outq_head, *next = NULL;
+
+    while(entry) {
+        next = entry->next;
+        wstk_mem_deref(entry);
+        entry = next;
+    }
+
+    conn->outq_head = conn->outq_tail = NULL;
+    conn->outq_size = 0;
+}
+
+/* writes till the socket is full, returns false if the connection is broken */
+static bool conn_outq_write(wstk_tcp_srv_conn_t *conn, uint8_t *data, size_t len, size_t *written) {
+    wstk_mbuf_t view = { .buf = data, .size = len, .pos = 0, .end = len };
+    wstk_status_t st = WSTK_STATUS_SUCCESS;
+    bool fl_ok = true;
+
+    while(view.pos < view.end) {
+        st = wstk_tcp_write(conn->sock, &view, 0);
+        if(st == WSTK_STATUS_SUCCESS) {
+            continue;
+        }
+        if(st == WSTK_STATUS_FALSE && (conn->sock->err == EAGAIN || conn->sock->err == EWOULDBLOCK)) {
+            break;
+        }
+        if(st == WSTK_STATUS_FALSE && conn->sock->err == EINTR) {
+            continue;
+        }
+        fl_ok = false;
+        break;
+    }
+
+    *written = view.pos;
+    return fl_ok;
+}
+
+/* the rest of the data: mbuf[pos...end] */
+static wstk_status_t conn_outq_push(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf, size_t pos, bool copy) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    conn_outq_entry_t *entry = NULL;
+    size_t len = (wstk_mbuf_end(mbuf) - pos);
+
+    if((status = wstk_mem_zalloc((void *)&entry, sizeof(conn_outq_entry_t), desctuctor__conn_outq_entry_t)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    if(copy) {
+        if((status = wstk_mbuf_alloc(&entry->mbuf, len)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if((status = wstk_mbuf_write_mem(entry->mbuf, mbuf->buf + pos, len)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        entry->pos = 0;
+        entry->end = len;
+    } else {
+        entry->mbuf = wstk_mem_ref(mbuf);
+        entry->pos = pos;
+        entry->end = wstk_mbuf_end(mbuf);
+    }
+
+    if(conn->outq_tail) {
+        conn->outq_tail->next = entry;
+    } else {
+        conn->outq_head = entry;
+    }
+    conn->outq_tail = entry;
+    conn->outq_size += len;
+
+    if(conn->outq_high && conn->outq_size > conn->outq_high) {
+        conn->fl_outq_above = true;
+    }
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(entry);
+    }
+    return status;
+}
+
+/* a part of the stream is lost, nothing else can go after it */
+static void conn_outq_abort(wstk_tcp_srv_conn_t *conn) {
+    conn_outq_clear(conn);
+    conn->fl_do_close = true;
+
+    if(!conn->sock->fl_destroyed) {
+        shutdown(conn->sock->fd, SHUT_RDWR);
+    }
+}
+
+/* reactor (EWRITE) */
+static void conn_outq_drain(wstk_tcp_srv_conn_t *conn) {
+    wstk_tcp_srv_on_drain_t on_drain = NULL;
+    conn_outq_entry_t *entry = NULL;
+    void *on_drain_udata = NULL;
+    size_t wr = 0, total = 0;
+    bool fl_ok = true;
+
+    wstk_mutex_lock(conn->mutex);
+    if(!conn->outq_head) {
+        goto out;
+    }
+
+    while((entry = conn->outq_head) != NULL) {
+        fl_ok = conn_outq_write(conn, entry->mbuf->buf + entry->pos, (entry->end - entry->pos), &wr);
+        entry->pos += wr;
+        conn->outq_size -= wr;
+        total += wr;
+
+        if(!fl_ok || entry->pos < entry->end) {
+            break;
+        }
+        if(!(conn->outq_head = entry->next)) {
+            conn->outq_tail = NULL;
+        }
+        wstk_mem_deref(entry);
+    }
+
+    if(!fl_ok) {
+        conn_outq_abort(conn);
+    } else if(total) {
+        /* the peer takes the data, it's alive */
+        wstk_sock_set_expiry(conn->sock, conn->server->max_idle);
+    }
+
+    if(!conn->outq_head) {
+        if(!conn->reactor->fl_wr_edge) {
+            conn->sock->pmask &= ~WSTK_POLL_MWRITE;
+            /* select picks the mask up by itself */
+            if(conn->reactor->pmethod != WSTK_POLL_SELECT) {
+                wstk_poll_update(conn->reactor->poll, conn->sock);
+            }
+        }
+        if(conn->fl_outq_linger) {
+            conn->fl_outq_linger = false;
+            shutdown(conn->sock->fd, SHUT_RDWR);
+        }
+    }
+
+    if(conn->outq_size <= conn->outq_low) {
+        if(conn->outq_cond) {
+            wstk_cond_broadcast(conn->outq_cond);
+        }
+        if(conn->fl_outq_above && fl_ok) {
+            conn->fl_outq_above = false;
+            on_drain = conn->on_drain;
+            on_drain_udata = conn->on_drain_udata;
+        }
+    }
+out:
+    wstk_mutex_unlock(conn->mutex);
+
+    if(on_drain) {
+        on_drain(conn, on_drain_udata);
+    }
+}
+
+/* the worker is going to shut the connection down, returns true if it has to wait for the queue */
+static bool conn_outq_linger(wstk_tcp_srv_conn_t *conn) {
+    bool fl_linger = false;
+
+    wstk_mutex_lock(conn->mutex);
+    if(conn->outq_head) {
+        conn->fl_outq_linger = fl_linger = true;
+    }
+    wstk_mutex_unlock(conn->mutex);
+
+    return fl_linger;
 }
 
-/* called in the polling, reads data from socket and if OK perform it */
 static wstk_status_t polling_read_and_perform(wstk_tcp_srv_t *srv, wstk_tcp_srv_conn_t *conn) {
     wstk_status_t st = WSTK_STATUS_NODATA;
 
-    wstk_mbuf_set_pos(conn->mbuf, 0);
-    st = wstk_tcp_read(conn->sock, conn->mbuf, 0);
+    st = conn_read(conn);
     if(st == WSTK_STATUS_SUCCESS && conn->mbuf->end > 0) {
         conn_refs(conn);
-        if((st = wstk_worker_perform(srv->worker_tcp, conn)) != WSTK_STATUS_SUCCESS) {
+        if((st = wstk_worker_perform_key(srv->worker_tcp, conn->id, conn)) != WSTK_STATUS_SUCCESS) {
             log_error("Unable to enqueue connection (conn=%p, sock=%p, st=%d)", conn, conn->sock, (int)st);
             conn_derefs(conn);
         }
@@ -258,10 +731,11 @@ static wstk_status_t polling_read_and_perform(wstk_tcp_srv_t *srv, wstk_tcp_srv_
     return st;
 }
 
-/* the main server thread responsible for polling */
+/* reactor thread, each one has its own poll, listener and clients map */
 static void polling_thread(wstk_thread_t *th, void *udata) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
-    wstk_tcp_srv_t *srv = (wstk_tcp_srv_t *)udata;
+    tcp_srv_reactor_t *reactor = (tcp_srv_reactor_t *)udata;
+    wstk_tcp_srv_t *srv = (reactor ? reactor->server : NULL);
 
     if(!srv) {
         log_error("opps! (srv == null)");
@@ -270,63 +744,78 @@ static void polling_thread(wstk_thread_t *th, void *udata) {
 
     srv_refs(srv);
 
-#ifdef WSTK_UDP_SRV_DEBUG
-    WSTK_DBG_PRINT("polling-thread started: thread=%p (wait for worker ready...)", th);
+#ifdef WSTK_TCP_SRV_DEBUG
+    WSTK_DBG_PRINT("polling-thread started: thread=%p, reactor=%d (wait for worker ready...)", th, reactor->id);
 #endif
 
+    if(srv->fl_cpu_pin) {
+        uint32_t cpus = 1;
+        wstk_thread_cpus(&cpus);
+        wstk_thread_bind_cpu(reactor->id % cpus);
+    }
+
     while(true) {
         if(wstk_worker_is_ready(srv->worker_tcp)) {
             break;
         }
-        if(srv->fl_destroyed) {
+        if(srv->fl_destroyed || reactor->fl_stop) {
             break;
         }
         WSTK_SCHED_YIELD(0);
     }
-    if(srv->fl_destroyed) {
+    if(srv->fl_destroyed || reactor->fl_stop) {
         goto out;
     }
 
     /* adding listener socket to the poll */
-    wstk_sock_set_expiry(srv->sock, 0);
-    wstk_sock_set_pmask(srv->sock, (WSTK_POLL_MREAD | WSTK_POLL_MLISTENER));
-
-    if((status = wstk_poll_add(srv->poll, srv->sock)) != WSTK_STATUS_SUCCESS) {
+    if((status = wstk_poll_add(reactor->poll, reactor->sock)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    srv->fl_ready = true;
-    while(!srv->fl_destroyed) {
-        if(wstk_poll_is_empty(srv->poll))  {
+    wstk_mutex_lock(srv->mutex);
+    reactor->fl_ready = true;
+    srv->reactors_ready++;
+    srv->fl_ready = (srv->reactors_ready >= srv->reactors_count);
+    wstk_mutex_unlock(srv->mutex);
+
+    while(!srv->fl_destroyed && !reactor->fl_stop) {
+        if(wstk_poll_is_empty(reactor->poll))  {
             wstk_msleep(1000);
         } else {
-            wstk_poll_polling(srv->poll);
+            wstk_poll_polling(reactor->poll);
         }
     }
 
 out:
+    wstk_mutex_lock(srv->mutex);
+    if(reactor->fl_ready) {
+        reactor->fl_ready = false;
+        if(srv->reactors_ready) srv->reactors_ready--;
+    }
     srv->fl_ready = false;
+    wstk_mutex_unlock(srv->mutex);
 
     if(status != WSTK_STATUS_SUCCESS) {
-        log_warn("terminated with status: %d", (int)status);
+        log_warn("terminated with status: %d (reactor=%d)", (int)status, reactor->id);
     }
 
     /* destroyng poll */
-    srv->poll = wstk_mem_deref(srv->poll);
+    reactor->poll = wstk_mem_deref(reactor->poll);
 
     srv_derefs(srv);
 
-#ifdef WSTK_UDP_SRV_DEBUG
-    WSTK_DBG_PRINT("polling-thread finished: thread=%p", th);
+#ifdef WSTK_TCP_SRV_DEBUG
+    WSTK_DBG_PRINT("polling-thread finished: thread=%p, reactor=%d", th, reactor->id);
 #endif
 }
 
 static void poll_handler(wstk_socket_t *socket, int event, void *udata) {
-    wstk_tcp_srv_t *srv = (wstk_tcp_srv_t *)udata;
+    tcp_srv_reactor_t *reactor = (tcp_srv_reactor_t *)udata;
+    wstk_tcp_srv_t *srv = reactor->server;
 
 #ifdef WSTK_TCP_SRV_DEBUG
-    WSTK_DBG_PRINT("poll_handler: srv=%p, listener-sock=%p, curr-sock=%p, conn=%p, event=0x%x [EREAD=%d, EWRITE=%d, ECLOSED=%d, ESEXPIED=%d]",
-                srv, srv->sock, socket, socket->udata, event,
+    WSTK_DBG_PRINT("poll_handler: srv=%p, reactor=%d, listener-sock=%p, curr-sock=%p, conn=%p, event=0x%x [EREAD=%d, EWRITE=%d, ECLOSED=%d, ESEXPIED=%d]",
+                srv, reactor->id, reactor->sock, socket, socket->udata, event,
                 event & WSTK_POLL_EREAD,
                 event & WSTK_POLL_EWRITE,
                 event & WSTK_POLL_ESCLOSED,
@@ -338,19 +827,16 @@ static void poll_handler(wstk_socket_t *socket, int event, void *udata) {
         wstk_tcp_srv_conn_t *conn = (wstk_tcp_srv_conn_t *)socket->udata;
 
         /* delete socket from the poll */
-        wstk_poll_del(srv->poll, socket);
+        wstk_poll_del(reactor->poll, socket);
 
         /* don't touch the listener socket,                 */
         /* this will be destroyed in the server destructor  */
         if(socket->pmask & WSTK_POLL_MLISTENER) {
-            if(srv->connections) {
-                srv->connections--;
-            }
             return;
         }
 
         /* using gc for the locked connections */
-        if(conn && conn->refs > 0) {
+        if(conn && conn_refs_count(conn) > 0) {
             if(wstk_worker_perform(srv->worker_gc, socket) != WSTK_STATUS_SUCCESS) {
                 wstk_mem_deref(socket);
             }
@@ -358,42 +844,43 @@ static void poll_handler(wstk_socket_t *socket, int event, void *udata) {
             wstk_mem_deref(socket);
         }
 
-        if(srv->connections) {
-            srv->connections--;
-        }
-
+        srv_conn_slot_release(srv);
         return;
     }
 
-    if(srv->sock == socket) {
+    if(reactor->sock == socket) {
         wstk_socket_t *csock = NULL;
         wstk_tcp_srv_conn_t *conn = NULL;
 
         if(wstk_tcp_accept(socket, &csock, 0) == WSTK_STATUS_SUCCESS) {
-            if(srv->max_conns && srv->connections >= srv->max_conns) {
+            if(srv_conn_slot_take(srv) != WSTK_STATUS_SUCCESS) {
                 log_error("Too many connections (rejected)");
                 wstk_mem_deref(csock);
                 return;
             }
             if(wstk_mem_zalloc((void *)&conn, sizeof(wstk_tcp_srv_conn_t), desctuctor__wstk_tcp_srv_conn_t) != WSTK_STATUS_SUCCESS) {
                 log_error("Unable to allocate memory");
+                srv_conn_slot_release(srv);
                 wstk_mem_deref(csock);
                 return;
             }
             if(wstk_mutex_create(&conn->mutex) != WSTK_STATUS_SUCCESS) {
                 log_error("Unable to create mutex");
+                srv_conn_slot_release(srv);
                 wstk_mem_deref(conn);
                 wstk_mem_deref(csock);
                 return;
             }
             if(wstk_mbuf_alloc(&conn->mbuf, srv->buffer_size) != WSTK_STATUS_SUCCESS) {
                 log_error("Unable to allocate memory");
+                srv_conn_slot_release(srv);
                 wstk_mem_deref(conn);
                 wstk_mem_deref(csock);
                 return;
             }
             if(wstk_hash_init(&conn->attributes) != WSTK_STATUS_SUCCESS) {
                 log_error("Unable to create attributes");
+                srv_conn_slot_release(srv);
                 wstk_mem_deref(conn);
                 wstk_mem_deref(csock);
                 return;
@@ -401,24 +888,28 @@ static void poll_handler(wstk_socket_t *socket, int event, void *udata) {
 
             conn->sock = csock;
             conn->server = srv;
+            conn->reactor = reactor;
+            conn->outq_high = srv->outq_high;
+            conn->outq_low = srv->outq_low;
+            conn->outq_policy = srv->outq_policy;
             wstk_sock_get_peer(csock, &conn->peer);
             wstk_sa_hash(&conn->peer, &conn->id);
 
             wstk_sock_set_udata(csock, conn, true);
-            wstk_sock_set_pmask(csock, WSTK_POLL_MREAD);
+            wstk_sock_set_pmask(csock, (reactor->fl_wr_edge ? (WSTK_POLL_MREAD | WSTK_POLL_MWRITE) : WSTK_POLL_MREAD));
             wstk_sock_set_expiry(csock, srv->max_idle);
 
-            /* add connection into clients map */
-            wstk_mutex_lock(srv->mutex_clients);
-            wstk_inthash_insert(srv->clients, conn->id, conn);
-            wstk_mutex_unlock(srv->mutex_clients);
+            /* add connection into the reactor clients map */
+            wstk_mutex_lock(reactor->mutex_clients);
+            wstk_inthash_insert(reactor->clients, conn->id, conn);
+            wstk_mutex_unlock(reactor->mutex_clients);
 
-            if(wstk_poll_add(srv->poll, csock) != WSTK_STATUS_SUCCESS) {
+            if(wstk_poll_add(reactor->poll, csock) != WSTK_STATUS_SUCCESS) {
                 log_error("Unable to add socket to the poll");
-                wstk_mem_deref(conn);
+                srv_conn_slot_release(srv);
+                wstk_mem_deref(csock);
             } else {
                 srv_refs(srv);
-                srv->connections++;
                 conn->fl_enpolled = true;
 
                 polling_read_and_perform(srv, conn);
@@ -427,13 +918,18 @@ static void poll_handler(wstk_socket_t *socket, int event, void *udata) {
         return;
     }
 
-    if(event && WSTK_POLL_EREAD) {
+    if(event & WSTK_POLL_EWRITE) {
+        conn_outq_drain((wstk_tcp_srv_conn_t *)socket->udata);
+    }
+
+    if(event & WSTK_POLL_EREAD) {
         wstk_tcp_srv_conn_t *conn = (wstk_tcp_srv_conn_t *)socket->udata;
 
         /* always udaptes expiry */
         wstk_sock_set_expiry(conn->sock, conn->server->max_idle);
 
-        if(!conn->refs) {
+        /* the edge won't be repeated, so the worker picks the data up when it's done */
+        if(!conn_set_pending_if_busy(conn, reactor->fl_edge)) {
             polling_read_and_perform(srv, conn);
         }
     }
@@ -453,17 +949,22 @@ static void gc_worker_handler(wstk_worker_t *worker, void *qdata) {
 static void tcp_worker_handler(wstk_worker_t *worker, void *data) {
     wstk_tcp_srv_conn_t *conn = (wstk_tcp_srv_conn_t *)data;
     wstk_tcp_srv_t *srv = conn->server;
+    bool fl_perform = true;
 
-    if(!srv->fl_destroyed) {
-        srv->handler(conn, conn->mbuf);
-        if(!conn->fl_destroyed && !conn->sock->fl_destroyed) {
-            if(conn->fl_do_close) {
-                shutdown(conn->sock->fd, SHUT_RDWR);
+    while(true) {
+        if(fl_perform && !srv->fl_destroyed) {
+            srv->handler(conn, conn->mbuf);
+            if(!conn->fl_destroyed && !conn->sock->fl_destroyed) {
+                if(conn->fl_do_close && !conn_outq_linger(conn)) {
+                    shutdown(conn->sock->fd, SHUT_RDWR);
+                }
             }
         }
+        if(!conn_derefs_unless_pending(conn)) {
+            break;
+        }
+        fl_perform = (conn_read(conn) == WSTK_STATUS_SUCCESS && conn->mbuf->end > 0);
     }
-
-    conn_derefs(conn);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -499,17 +1000,10 @@ wstk_status_t wstk_tcp_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address
     if((status = wstk_mutex_create(&srv_local->mutex)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
-    if((status = wstk_mutex_create(&srv_local->mutex_clients)) != WSTK_STATUS_SUCCESS) {
-        goto out;
-    }
     if((status = wstk_mutex_create(&srv_local->mutex_attributes)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
-    if((status = wstk_inthash_init(&srv_local->clients)) != WSTK_STATUS_SUCCESS) {
-        goto out;
-    }
-
     wstk_sa_init(&srv_local->laddr, AF_UNSPEC);
     if((status = wstk_sa_cpy(&srv_local->laddr, address)) != WSTK_STATUS_SUCCESS) {
        goto out;
@@ -522,6 +1016,10 @@ wstk_status_t wstk_tcp_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address
     srv_local->max_conns = (max_conns ? max_conns : 1023);      // +1 for listener
     srv_local->buffer_size = (buffer_size ? buffer_size : 8192);
     srv_local->polling_method = ((srv_local->max_conns + 1) <= 1024 ? WSTK_POLL_SELECT : WSTK_POLL_AUTO);
+    srv_local->outq_high = TCP_SRV_DEFAULT_OUTQ_HIGH;
+    srv_local->outq_low = TCP_SRV_DEFAULT_OUTQ_LOW;
+    srv_local->outq_timeout = TCP_SRV_DEFAULT_OUTQ_TIMEOUT;
+    srv_local->outq_policy = WSTK_TCP_SRV_OUTQ_BLOCK;
 
     /* poll auto-conf */
     poll_size = (srv_local->max_conns + 1);
@@ -537,6 +1035,9 @@ wstk_status_t wstk_tcp_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address
 
     srv_local->polling_method = poll_aconf.method;
     srv_local->max_threads = srv_local->max_conns;
+    srv_local->poll_size = poll_size;
+    srv_local->poll_timeout = poll_timeout;
+    srv_local->reactors_count = 1;
 
     /* workers and polls */
     status = wstk_worker_create(&srv_local->worker_gc, 1, 10, srv_local->max_conns, 25, gc_worker_handler);
@@ -545,9 +1046,6 @@ wstk_status_t wstk_tcp_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *address
     status = wstk_worker_create(&srv_local->worker_tcp, 3, srv_local->max_threads, (srv_local->max_conns + 64), 45, tcp_worker_handler);
     if(status != WSTK_STATUS_SUCCESS) { goto out; }
 
-    status = wstk_poll_create(&srv_local->poll, srv_local->polling_method, poll_size, poll_timeout, 0x0, poll_handler, srv_local);
-    if(status != WSTK_STATUS_SUCCESS) { goto out; }
-
     status = wstk_hash_init(&srv_local->attributes);
     if(status != WSTK_STATUS_SUCCESS) { goto out; }
 
@@ -586,6 +1084,137 @@ wstk_status_t wstk_tcp_ssl_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *add
     return WSTK_STATUS_NOT_IMPL;
 }
 
+/**
+ * Set the number of reactors (polling threads)
+ * each reactor has its own poll, clients map and listener socket (SO_REUSEPORT),
+ * on systems without balancing by the kernel, the reactors share the one listener:
+ * it's registered in every poll, so each new connection wakes all the reactors and only one of them
+ * gets it by accept() (the others get EAGAIN), keep the reactors amount small there.
+ * Should be called before: wstk_tcp_srv_start()
+ *
+ * @param srv   - the server instance
+ * @param n     - reactors amount (default: 1)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_set_reactors(wstk_tcp_srv_t *srv, uint32_t n) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(srv->reactors) {
+        return WSTK_STATUS_BUSY;
+    }
+
+    srv->reactors_count = (n ? MIN(n, TCP_SRV_MAX_REACTORS) : 1);
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Use epoll in edge-triggered mode (EPOLLET|EPOLLRDHUP, the other polls aren't affected)
+ * the sockets are registered once and the reactor gets one event per readiness change,
+ * the data that arrives while a worker holds the connection is picked up by that worker.
+ * Should be called before: wstk_tcp_srv_start()
+ *
+ * @param srv       - the server instance
+ * @param enable    - true/false (default: false, level-triggered)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_set_edge_triggered(wstk_tcp_srv_t *srv, bool enable) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(srv->reactors) {
+        return WSTK_STATUS_BUSY;
+    }
+
+    srv->fl_edge_triggered = enable;
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Pin each connection to one worker thread
+ * the worker is replaced by a fixed pool where a connection is always handled by the same thread
+ * (chosen by the connection id), optionally the reactors and the workers are bound to the processors.
+ * The servlets that hold a thread for a long time (websockets, etc) delay the other connections of this thread.
+ * Should be called before: wstk_tcp_srv_start()
+ *
+ * @param srv       - the server instance
+ * @param threads   - workers amount (0 = number of processors)
+ * @param cpu_pin   - bind the threads to the processors
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_set_affinity(wstk_tcp_srv_t *srv, uint32_t threads, bool cpu_pin) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_worker_t *worker = NULL;
+    uint32_t flags = WSTK_WORKER_AFFINITY;
+
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(srv->reactors) {
+        return WSTK_STATUS_BUSY;
+    }
+
+    if(!threads) {
+        wstk_thread_cpus(&threads);
+    }
+    if(cpu_pin) {
+        flags |= WSTK_WORKER_CPU_PIN;
+    }
+
+    status = wstk_worker_create_ex(&worker, threads, threads, (srv->max_conns + 64), 45, flags, tcp_worker_handler);
+    if(status != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+
+    wstk_mem_deref(srv->worker_tcp);
+    srv->worker_tcp = worker;
+    srv->max_threads = threads;
+    srv->fl_cpu_pin = cpu_pin;
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Set the output queue defaults for the new connections (see: wstk_tcp_srv_conn_send())
+ * the queue is written out by the reactor, when it goes above the high watermark the policy is applied to the senders,
+ * on_drain is called when it gets back below the low one.
+ *
+ * @param srv       - the server instance
+ * @param high      - high watermark in bytes (0 = unlimited, default: 1MB)
+ * @param low       - low watermark in bytes (should be less than high, default: 256KB)
+ * @param policy    - block/drop/close (default: block)
+ * @param timeout   - the block policy timeout in seconds (default: 10s)
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_set_outq(wstk_tcp_srv_t *srv, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy, uint32_t timeout) {
+    if(!srv) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(srv->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    srv->outq_high = high;
+    srv->outq_low = (!high || low < high ? low : (high / 2));
+    srv->outq_policy = policy;
+    srv->outq_timeout = (timeout ? timeout : TCP_SRV_DEFAULT_OUTQ_TIMEOUT);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Start server instance
  *
@@ -595,6 +1224,8 @@ wstk_status_t wstk_tcp_ssl_srv_create(wstk_tcp_srv_t **srv, wstk_sockaddr_t *add
  **/
 wstk_status_t wstk_tcp_srv_start(wstk_tcp_srv_t *srv) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
+    tcp_srv_reactor_t *reactor = NULL;
+    wstk_polling_method_e pmethod = WSTK_POLL_AUTO;
 
     if(!srv) {
         return WSTK_STATUS_INVALID_PARAM;
@@ -602,27 +1233,76 @@ wstk_status_t wstk_tcp_srv_start(wstk_tcp_srv_t *srv) {
     if(srv->fl_destroyed) {
         return WSTK_STATUS_DESTROYED;
     }
-    if(srv->fl_ready) {
+    if(srv->fl_ready || srv->reactors) {
         return WSTK_STATUS_SUCCESS;
     }
 
-    status = wstk_tcp_listen(&srv->sock, &srv->laddr, 5);
-    if(status == WSTK_STATUS_SUCCESS) {
-        status = wstk_thread_create(NULL, polling_thread, srv, 0x0);
-    } else {
-        log_error("Unable to start listener (status=%d)", (int) status);
+    status = wstk_mem_zalloc((void *)&srv->reactors, (sizeof(tcp_srv_reactor_t) * srv->reactors_count), NULL);
+    if(status != WSTK_STATUS_SUCCESS) {
+        goto out;
     }
 
-#ifdef WSTK_TCP_SRV_DEBUG
-    if(status == WSTK_STATUS_SUCCESS) {
-        WSTK_DBG_PRINT("server started: srv=%p", srv);
-    }
+    for(uint32_t i = 0; i < srv->reactors_count; i++) {
+        reactor = &srv->reactors[i];
+        reactor->id = i;
+        reactor->server = srv;
+
+        if((status = wstk_mutex_create(&reactor->mutex_clients)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if((status = wstk_inthash_init(&reactor->clients)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+
+        status = wstk_poll_create(&reactor->poll, srv->polling_method, srv->poll_size, srv->poll_timeout, (srv->fl_edge_triggered ? WSTK_POLL_FEDGE_TRIGGERED : 0x0), poll_handler, reactor);
+        if(status != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        if(wstk_poll_method(reactor->poll, &pmethod) == WSTK_STATUS_SUCCESS) {
+            reactor->pmethod = pmethod;
+            reactor->fl_edge = (pmethod == WSTK_POLL_EPOLL && srv->fl_edge_triggered);
+            reactor->fl_wr_edge = (reactor->fl_edge || pmethod == WSTK_POLL_KQUEUE);
+        }
+
+#ifdef WSTK_HAVE_REUSEPORT
+        status = wstk_tcp_listen(&reactor->sock, &srv->laddr, 5);
+#else
+        if(i == 0) {
+            status = wstk_tcp_listen(&reactor->sock, &srv->laddr, 5);
+        } else {
+            /* all the polls wake up on a new connection, one of the reactors wins the accept */
+            reactor->sock = wstk_mem_ref(srv->reactors[0].sock);
+            reactor->fl_shared_sock = true;
+        }
 #endif
+        if(status != WSTK_STATUS_SUCCESS) {
+            log_error("Unable to start listener (status=%d, reactor=%d)", (int) status, i);
+            goto out;
+        }
+        if(!reactor->fl_shared_sock) {
+            wstk_sock_set_expiry(reactor->sock, 0);
+            wstk_sock_set_pmask(reactor->sock, (WSTK_POLL_MREAD | WSTK_POLL_MLISTENER));
+        }
+    }
 
+    for(uint32_t i = 0; i < srv->reactors_count; i++) {
+        if((status = wstk_thread_create(&srv->reactors[i].thread, polling_thread, &srv->reactors[i], 0x0)) != WSTK_STATUS_SUCCESS) {
+            log_error("Unable to start reactor (status=%d, reactor=%d)", (int) status, i);
+            goto out;
+        }
+    }
+
+#ifdef WSTK_TCP_SRV_DEBUG
+    WSTK_DBG_PRINT("server started: srv=%p (reactors=%d)", srv, srv->reactors_count);
+#endif
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        reactors_stop(srv);
+        reactors_free(srv);
+    }
     return status;
 }
 
-
 /**
  * Get instance id
  *
@@ -905,6 +1585,17 @@ wstk_status_t wstk_tcp_srv_conn_write(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mb
         return WSTK_STATUS_DESTROYED;
     }
 
+    /* mustn't get ahead of the queued data */
+    wstk_mutex_lock(conn->mutex);
+    if(conn->outq_head) {
+        if((status = conn_outq_push(conn, mbuf, wstk_mbuf_pos(mbuf), true)) == WSTK_STATUS_SUCCESS) {
+            wstk_mbuf_set_pos(mbuf, wstk_mbuf_end(mbuf));
+        }
+        wstk_mutex_unlock(conn->mutex);
+        return status;
+    }
+    wstk_mutex_unlock(conn->mutex);
+
     status = wstk_tcp_write(conn->sock, mbuf, timeout);
     if(status == WSTK_STATUS_CONN_DISCON) {
         conn->fl_do_close = true;
@@ -913,6 +1604,173 @@ wstk_status_t wstk_tcp_srv_conn_write(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mb
     return status;
 }
 
+/**
+ * Send data through the connection output queue
+ * writes straight to the socket while the queue is empty, the rest is queued and written out by the reactor,
+ * so the sender doesn't wait for a slow reader and the messages of the concurrent senders don't interleave.
+ * Above the high watermark the connection policy is applied (block, drop or close).
+ *
+ * @param conn  - the connection
+ * @param mbuf  - the data (pos...end), the buffer isn't changed
+ * @param copy  - true: the queued rest is copied (the caller reuses the buffer),
+ *                false: the buffer is referenced and mustn't be changed after (can be shared by many connections)
+ *
+ * @return sucesss, WSTK_STATUS_NOSPACE (dropped), WSTK_STATUS_TIMEOUT (blocked too long), WSTK_STATUS_CONN_DISCON or some error
+ **/
+wstk_status_t wstk_tcp_srv_conn_send(wstk_tcp_srv_conn_t *conn, wstk_mbuf_t *mbuf, bool copy) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    uint64_t deadline = 0, now = 0;
+    size_t len = 0, wr = 0;
+    bool fl_arm = false;
+
+    if(!conn || !mbuf) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(!(len = wstk_mbuf_left(mbuf))) {
+        return WSTK_STATUS_SUCCESS;
+    }
+
+    wstk_mutex_lock(conn->mutex);
+
+    /* the empty queue takes a message of any size */
+    if(conn->outq_size && conn->outq_high && (conn->outq_size + len) > conn->outq_high) {
+        conn->fl_outq_above = true;
+
+        if(conn->outq_policy == WSTK_TCP_SRV_OUTQ_DROP) {
+            wstk_goto_status(WSTK_STATUS_NOSPACE, out);
+        }
+        if(conn->outq_policy == WSTK_TCP_SRV_OUTQ_CLOSE) {
+            conn_outq_abort(conn);
+            wstk_goto_status(WSTK_STATUS_CONN_DISCON, out);
+        }
+
+        if(!conn->outq_cond && (status = wstk_cond_create(&conn->outq_cond)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+
+        deadline = wstk_time_micro_now() + ((uint64_t)conn->server->outq_timeout * 1000000);
+        while(conn->outq_size > conn->outq_low) {
+            if(conn->fl_destroyed || conn->fl_do_close) {
+                wstk_goto_status(WSTK_STATUS_CONN_DISCON, out);
+            }
+            if((now = wstk_time_micro_now()) >= deadline) {
+                wstk_goto_status(WSTK_STATUS_TIMEOUT, out);
+            }
+            wstk_cond_wait(conn->outq_cond, conn->mutex, MAX(((deadline - now) / 1000), 1));
+        }
+    }
+
+    if(conn->fl_destroyed || conn->fl_do_close || conn->fl_outq_linger) {
+        wstk_goto_status(WSTK_STATUS_CONN_DISCON, out);
+    }
+
+    if(!conn->outq_head) {
+        if(!conn_outq_write(conn, wstk_mbuf_buf(mbuf), len, &wr)) {
+            conn_outq_abort(conn);
+            wstk_goto_status(WSTK_STATUS_CONN_DISCON, out);
+        }
+        if(wr == len) {
+            goto out;
+        }
+        fl_arm = !conn->reactor->fl_wr_edge;
+    }
+
+    if((status = conn_outq_push(conn, mbuf, (wstk_mbuf_pos(mbuf) + wr), copy)) != WSTK_STATUS_SUCCESS) {
+        fl_arm = false;
+        if(wr) { conn_outq_abort(conn); }
+        goto out;
+    }
+
+    /* select, level-triggered epoll: asks for EWRITE while there is something (under the lock, the reactor clears it the same way) */
+    if(fl_arm) {
+        conn->sock->pmask |= WSTK_POLL_MWRITE;
+        wstk_poll_update(conn->reactor->poll, conn->sock);
+    }
+out:
+    wstk_mutex_unlock(conn->mutex);
+
+    return status;
+}
+
+/**
+ * Set the connection output queue watermarks and policy (the server defaults: wstk_tcp_srv_set_outq())
+ *
+ * @param conn      - the connection
+ * @param high      - high watermark in bytes (0 = unlimited)
+ * @param low       - low watermark in bytes
+ * @param policy    - block/drop/close
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_conn_set_outq(wstk_tcp_srv_conn_t *conn, size_t high, size_t low, wstk_tcp_srv_outq_policy_e policy) {
+    if(!conn) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(conn->mutex);
+    conn->outq_high = high;
+    conn->outq_low = (!high || low < high ? low : (high / 2));
+    conn->outq_policy = policy;
+    wstk_mutex_unlock(conn->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Set the handler that is called when the output queue goes back below the low watermark
+ * (after it's been above the high one), it's called from the reactor, so should be quick
+ *
+ * @param conn      - the connection
+ * @param handler   - the handler or NULL
+ * @param udata     - user data
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_conn_set_on_drain(wstk_tcp_srv_conn_t *conn, wstk_tcp_srv_on_drain_t handler, void *udata) {
+    if(!conn) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(conn->mutex);
+    conn->on_drain = handler;
+    conn->on_drain_udata = udata;
+    wstk_mutex_unlock(conn->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/**
+ * Get the amount of the queued bytes
+ *
+ * @param conn  - the connection
+ * @param size  - the size
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_conn_outq_size(wstk_tcp_srv_conn_t *conn, size_t *size) {
+    if(!conn || !size) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    wstk_mutex_lock(conn->mutex);
+    *size = conn->outq_size;
+    wstk_mutex_unlock(conn->mutex);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Put attribute
  *
@@ -1037,7 +1895,7 @@ wstk_status_t wstk_tcp_srv_conn_attr_add(wstk_tcp_srv_conn_t *conn, const char *
         return WSTK_STATUS_INVALID_PARAM;
     }
     if(conn->fl_destroyed) {
-        return WSTK_STATUS_SUCCESS;
+        return WSTK_STATUS_DESTROYED; /* not taken, the value stays with the caller */
     }
 
     wstk_mutex_lock(conn->mutex);
@@ -1141,14 +1999,22 @@ wstk_tcp_srv_conn_t *wstk_tcp_srv_lookup_conn(wstk_tcp_srv_t *srv, uint32_t id)
         return NULL;
     }
 
-    wstk_mutex_lock(srv->mutex_clients);
-    conn = wstk_core_inthash_find(srv->clients, id);
-    if(conn) {
-        if(conn_refs(conn) != WSTK_STATUS_SUCCESS) {
-            conn = NULL;
+    if(!srv->reactors) {
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < srv->reactors_count && !conn; i++) {
+        tcp_srv_reactor_t *reactor = &srv->reactors[i];
+
+        wstk_mutex_lock(reactor->mutex_clients);
+        conn = wstk_core_inthash_find(reactor->clients, id);
+        if(conn) {
+            if(conn_refs(conn) != WSTK_STATUS_SUCCESS) {
+                conn = NULL;
+            }
         }
+        wstk_mutex_unlock(reactor->mutex_clients);
     }
-    wstk_mutex_unlock(srv->mutex_clients);
 
     return conn;
 }
@@ -1182,6 +2048,28 @@ wstk_status_t wstk_tcp_srv_conn_release(wstk_tcp_srv_conn_t *conn) {
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * Keep the unprocessed part of the buffer (mbuf[pos...end]) for the next read,
+ * the new data will be appended to it and the handler gets the whole thing from the position 0
+ * the flag is cleared by a successful read, so the handler sets it each time it needs
+ *
+ * @param conn  - the connection
+ * @param flag  - true/false
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_tcp_srv_conn_keep_unread(wstk_tcp_srv_conn_t *conn, bool flag) {
+    if(!conn) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(conn->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+
+    conn->fl_keep_unread = flag;
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Protect the socket from reading on the polling
  * this only set/clear flag: WSTK_POLL_MRDLOCK
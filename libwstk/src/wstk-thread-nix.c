@@ -2,6 +2,9 @@
  **
  ** (C)2019 aks
  **/
+#if defined(WSTK_OS_LINUX) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE    // pthread_setaffinity_np
+#endif
 #include <wstk-thread.h>
 #include <wstk-mutex.h>
 #include <wstk-sleep.h>
@@ -206,3 +209,41 @@ bool wstk_thread_is_canceled(wstk_thread_t *th) {
 
     return (th->cancel_req > 0);
 }
+
+wstk_status_t wstk_thread_cpus(uint32_t *cpus) {
+    long n = 0;
+
+    if(!cpus) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    *cpus = (n > 0 ? (uint32_t)n : 1);
+    return WSTK_STATUS_SUCCESS;
+}
+
+wstk_status_t wstk_thread_bind_cpu(uint32_t cpu) {
+#ifdef WSTK_HAVE_CPU_AFFINITY
+    cpu_set_t cset;
+    int err = 0;
+
+    if(cpu >= CPU_SETSIZE) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    CPU_ZERO(&cset);
+    CPU_SET(cpu, &cset);
+
+    if((err = pthread_setaffinity_np(pthread_self(), sizeof(cset), &cset)) != 0) {
+        log_warn("pthread_setaffinity_np() failed (cpu=%d, err=%d)", cpu, err);
+        return WSTK_STATUS_FALSE;
+    }
+
+    return WSTK_STATUS_SUCCESS;
+#else
+    return WSTK_STATUS_UNSUPPORTED;
+#endif
+}
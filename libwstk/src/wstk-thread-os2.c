@@ -201,3 +201,16 @@ bool wstk_thread_is_canceled(wstk_thread_t *th) {
 
     return (th->cancel_req > 0);
 }
+
+wstk_status_t wstk_thread_cpus(uint32_t *cpus) {
+    if(!cpus) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    *cpus = 1;
+    return WSTK_STATUS_SUCCESS;
+}
+
+wstk_status_t wstk_thread_bind_cpu(uint32_t cpu) {
+    return WSTK_STATUS_UNSUPPORTED;
+}
@@ -212,3 +212,29 @@ bool wstk_thread_is_canceled(wstk_thread_t *th) {
 
     return (th->cancel_req > 0);
 }
+
+wstk_status_t wstk_thread_cpus(uint32_t *cpus) {
+    SYSTEM_INFO si = { 0 };
+
+    if(!cpus) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    GetSystemInfo(&si);
+    *cpus = (si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+wstk_status_t wstk_thread_bind_cpu(uint32_t cpu) {
+    if(cpu >= (sizeof(DWORD_PTR) * 8)) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if(!SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1 << cpu))) {
+        log_warn("SetThreadAffinityMask() failed (cpu=%d, err=%d)", cpu, (int)GetLastError());
+        return WSTK_STATUS_FALSE;
+    }
+
+    return WSTK_STATUS_SUCCESS;
+}
@@ -162,6 +162,56 @@ wstk_status_t wstk_time_to_str_rfc822(time_t time, char *buf, size_t buf_len) {
     return status;
 }
 
+/**
+ * Str RFC822 to time (UTC)
+ * Wed, 21 Oct 2015 07:28:00 GMT
+ *
+ * @param time      - the result
+ * @param str       - the string
+ * @param str_len   - string length
+ *
+ * @return succes or error
+ **/
+wstk_status_t wstk_time_from_str_rfc822(time_t *time, const char *str, size_t str_len) {
+    char tbuf[WSTK_TIME_RFC822_STRING_SIZE] = {0};
+    char mon[4] = {0};
+    const char *ptr = NULL;
+    int day = 0, year = 0, hour = 0, min = 0, sec = 0;
+    int64_t y = 0, m = 0, era = 0, yoe = 0, doy = 0, doe = 0;
+    uint32_t i = 0;
+
+    if(!time || !str || !str_len) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(str_len >= sizeof(tbuf)) {
+        return WSTK_STATUS_INVALID_VALUE;
+    }
+
+    memcpy(tbuf, str, str_len);
+    ptr = ((ptr = strchr(tbuf, ',')) ? ptr + 1 : tbuf);
+
+    if(sscanf(ptr, "%d %3s %d %d:%d:%d", &day, mon, &year, &hour, &min, &sec) != 6) {
+        return WSTK_STATUS_INVALID_VALUE;
+    }
+    for(i = 0; i < ARRAY_SIZE(monv); i++) {
+        if(strcasecmp(mon, monv[i]) == 0) { break; }
+    }
+    if(i >= ARRAY_SIZE(monv) || day < 1 || day > 31 || year < 1970 || hour > 23 || min > 59 || sec > 60) {
+        return WSTK_STATUS_INVALID_VALUE;
+    }
+
+    /* days from the civil date (without timegm, it isn't everywhere) */
+    y = year - (i < 2);
+    m = i + 1;
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    *time = (time_t)((era * 146097 + doe - 719468) * 86400 + hour * 3600 + min * 60 + sec);
+    return WSTK_STATUS_SUCCESS;
+}
+
 /**
  * Time to string
  * DD-MM-YYYY HH:MM:SS
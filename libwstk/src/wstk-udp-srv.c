@@ -68,6 +68,46 @@ static void desctuctor__attributes_entry_t(void *ptr) {
 #endif
 }
 
+/* refs and connections counter are atomic where it's possible */
+static void srv_refs(wstk_udp_srv_t *srv, bool fl_conn) {
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&srv->refs, 1);
+    if(fl_conn) wstk_atomic_rlx_add(&srv->connections, 1);
+#else
+    wstk_mutex_lock(srv->mutex);
+    srv->refs++;
+    if(fl_conn) srv->connections++;
+    wstk_mutex_unlock(srv->mutex);
+#endif
+}
+static void srv_derefs(wstk_udp_srv_t *srv, bool fl_conn) {
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = 0;
+    if(fl_conn) {
+        v = wstk_atomic_rlx(&srv->connections);
+        while(v > 0 && !wstk_atomic_rlx_cas(&srv->connections, &v, v - 1));
+    }
+    v = wstk_atomic_rlx(&srv->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&srv->refs, &v, v - 1));
+#else
+    wstk_mutex_lock(srv->mutex);
+    if(srv->refs) srv->refs--;
+    if(fl_conn && srv->connections) srv->connections--;
+    wstk_mutex_unlock(srv->mutex);
+#endif
+}
+static uint32_t srv_refs_count(wstk_udp_srv_t *srv) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&srv->refs);
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(srv->mutex);
+    refs = srv->refs;
+    wstk_mutex_unlock(srv->mutex);
+    return refs;
+#endif
+}
+
 static void desctuctor__wstk_udp_srv_conn_t(void *ptr) {
     wstk_udp_srv_conn_t *conn = (wstk_udp_srv_conn_t *)ptr;
     wstk_udp_srv_t *srv = (conn ? conn->server : NULL);
@@ -83,10 +123,7 @@ static void desctuctor__wstk_udp_srv_conn_t(void *ptr) {
 #endif
 
     if(conn->fl_enqueued) {
-        wstk_mutex_lock(srv->mutex);
-        if(srv->refs) srv->refs--;
-        if(srv->connections) srv->connections--;
-        wstk_mutex_unlock(srv->mutex);
+        srv_derefs(srv, true);
     }
 
     if(conn->udata && conn->fl_adestroy_udata) {
@@ -103,7 +140,7 @@ static void desctuctor__wstk_udp_srv_conn_t(void *ptr) {
 
 static void desctuctor__wstk_udp_srv_t(void *ptr) {
     wstk_udp_srv_t *srv = (wstk_udp_srv_t *)ptr;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!srv || srv->fl_destroyed) {
         return;
@@ -113,7 +150,7 @@ static void desctuctor__wstk_udp_srv_t(void *ptr) {
     srv->fl_destroyed = true;
 
 #ifdef WSTK_UDP_SRV_DEBUG
-    WSTK_DBG_PRINT("destroying server: srv=%p (id=0x%x, refs=%d, sock=%p)", srv, srv->id, srv->refs, srv->sock);
+    WSTK_DBG_PRINT("destroying server: srv=%p (id=0x%x, refs=%d, sock=%p)", srv, srv->id, srv_refs_count(srv), srv->sock);
 #endif
 
     // interrupt polling
@@ -122,19 +159,11 @@ static void desctuctor__wstk_udp_srv_t(void *ptr) {
     }
 
     if(srv->mutex) {
-        while(floop) {
-            wstk_mutex_lock(srv->mutex);
-            floop = (srv->refs > 0);
-            wstk_mutex_unlock(srv->mutex);
-
-            WSTK_SCHED_YIELD(0);
+        while(srv_refs_count(srv) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
         }
     }
 
-    if(srv->refs) {
-        log_warn("Lost references (refs=%d)", srv->refs);
-    }
-
     if(srv->attributes) {
         srv->attributes = wstk_mem_deref(srv->attributes);
     }
@@ -161,9 +190,7 @@ static void polling_thread(wstk_thread_t *th, void *udata) {
         return;
     }
 
-    wstk_mutex_lock(srv->mutex);
-    srv->refs++;
-    wstk_mutex_unlock(srv->mutex);
+    srv_refs(srv, false);
 
 #ifdef WSTK_UDP_SRV_DEBUG
     WSTK_DBG_PRINT("polling-thread started: thread=%p (wait for worker ready...)", th);
@@ -242,10 +269,7 @@ static void polling_thread(wstk_thread_t *th, void *udata) {
                     continue;
                 }
 
-                wstk_mutex_lock(srv->mutex);
-                srv->refs++;
-                srv->connections++;
-                wstk_mutex_unlock(srv->mutex);
+                srv_refs(srv, true);
 
                 conn->fl_enqueued = true;
                 wstk_mbuf_set_pos(conn->mbuf, 0);
@@ -265,9 +289,7 @@ out:
 
     wstk_mem_deref(mbuf);
 
-    wstk_mutex_lock(srv->mutex);
-    if(srv->refs) srv->refs--;
-    wstk_mutex_unlock(srv->mutex);
+    srv_derefs(srv, false);
 
 #ifdef WSTK_UDP_SRV_DEBUG
     WSTK_DBG_PRINT("polling-thread finished: thread=%p", th);
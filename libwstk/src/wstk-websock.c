@@ -11,21 +11,169 @@
 #include <wstk-rand.h>
 #include <wstk-endian.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+ #include <emmintrin.h>
+ #define WEBSOCK_MASK_SSE2
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+ #include <immintrin.h>
+ #define WEBSOCK_MASK_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define WEBSOCK_MASK_NEON
+#endif
+
+/* xor with key[i % 4], the key is already rotated to the data start */
+typedef void (*websock_mask_kernel_t)(uint8_t *data, size_t len, const uint8_t *key);
+
+static void mask_word(uint8_t *data, size_t len, const uint8_t *key);
+static websock_mask_kernel_t mask_kernel = mask_word;
+static const char *mask_kernel_name = "word";
+
+/* 8 bytes at a time (aligned), the tail byte by byte */
+static void mask_word(uint8_t *data, size_t len, const uint8_t *key) {
+    uint8_t kbuf[8];
+    uint64_t k64 = 0, w = 0;
+    size_t i = 0, j = 0;
+
+    for(; i < len && ((uintptr_t)(data + i) & 7); i++) {
+        data[i] ^= key[i & 3];
+    }
+
+    for(j = 0; j < sizeof(kbuf); j++) {
+        kbuf[j] = key[(i + j) & 3];
+    }
+    memcpy(&k64, kbuf, sizeof(k64));
+
+    for(; i + 8 <= len; i += 8) {
+        memcpy(&w, data + i, sizeof(w));
+        w ^= k64;
+        memcpy(data + i, &w, sizeof(w));
+    }
+
+    for(; i < len; i++) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+#ifdef WEBSOCK_MASK_SSE2
+static void mask_sse2(uint8_t *data, size_t len, const uint8_t *key) {
+    uint8_t kbuf[16];
+    __m128i k, v0, v1, v2, v3;
+    size_t i = 0;
+
+    for(i = 0; i < sizeof(kbuf); i++) {
+        kbuf[i] = key[i & 3];
+    }
+    k = _mm_loadu_si128((const __m128i *)kbuf);
+
+    for(i = 0; i + 64 <= len; i += 64) {
+        v0 = _mm_loadu_si128((const __m128i *)(data + i));
+        v1 = _mm_loadu_si128((const __m128i *)(data + i + 16));
+        v2 = _mm_loadu_si128((const __m128i *)(data + i + 32));
+        v3 = _mm_loadu_si128((const __m128i *)(data + i + 48));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v0, k));
+        _mm_storeu_si128((__m128i *)(data + i + 16), _mm_xor_si128(v1, k));
+        _mm_storeu_si128((__m128i *)(data + i + 32), _mm_xor_si128(v2, k));
+        _mm_storeu_si128((__m128i *)(data + i + 48), _mm_xor_si128(v3, k));
+    }
+    for(; i + 16 <= len; i += 16) {
+        v0 = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v0, k));
+    }
+
+    /* i % 4 == 0, the key stays the same */
+    mask_word(data + i, len - i, key);
+}
+#endif
+
+#ifdef WEBSOCK_MASK_AVX2
+__attribute__((target("avx2")))
+static void mask_avx2(uint8_t *data, size_t len, const uint8_t *key) {
+    uint8_t kbuf[32];
+    __m256i k, v0, v1;
+    size_t i = 0;
+
+    for(i = 0; i < sizeof(kbuf); i++) {
+        kbuf[i] = key[i & 3];
+    }
+    k = _mm256_loadu_si256((const __m256i *)kbuf);
+
+    for(i = 0; i + 64 <= len; i += 64) {
+        v0 = _mm256_loadu_si256((const __m256i *)(data + i));
+        v1 = _mm256_loadu_si256((const __m256i *)(data + i + 32));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v0, k));
+        _mm256_storeu_si256((__m256i *)(data + i + 32), _mm256_xor_si256(v1, k));
+    }
+    for(; i + 32 <= len; i += 32) {
+        v0 = _mm256_loadu_si256((const __m256i *)(data + i));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v0, k));
+    }
+
+    mask_word(data + i, len - i, key);
+}
+#endif
+
+#ifdef WEBSOCK_MASK_NEON
+static void mask_neon(uint8_t *data, size_t len, const uint8_t *key) {
+    uint8_t kbuf[16];
+    uint8x16_t k;
+    size_t i = 0;
+
+    for(i = 0; i < sizeof(kbuf); i++) {
+        kbuf[i] = key[i & 3];
+    }
+    k = vld1q_u8(kbuf);
+
+    for(i = 0; i + 32 <= len; i += 32) {
+        vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), k));
+        vst1q_u8(data + i + 16, veorq_u8(vld1q_u8(data + i + 16), k));
+    }
+    for(; i + 16 <= len; i += 16) {
+        vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), k));
+    }
+
+    mask_word(data + i, len - i, key);
+}
+#endif
+
+/* picks the masking kernel for this cpu */
+wstk_status_t wstk_pvt_websock_init() {
+#if defined(WEBSOCK_MASK_AVX2)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        mask_kernel = mask_avx2;
+        mask_kernel_name = "avx2";
+        return WSTK_STATUS_SUCCESS;
+    }
+#endif
+#if defined(WEBSOCK_MASK_SSE2)
+    mask_kernel = mask_sse2;
+    mask_kernel_name = "sse2";
+#elif defined(WEBSOCK_MASK_NEON)
+    mask_kernel = mask_neon;
+    mask_kernel_name = "neon";
+#endif
+    return WSTK_STATUS_SUCCESS;
+}
+
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // public
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 /**
  * Decode websock header
+ * only the header (with the mask key), the payload can be incomplete,
+ * mb->pos points to the payload on success
  *
- * @param hdr
- * @param mb
+ * @param hdr   - the header
+ * @param mb    - the frame
  *
- * @return success or error
+ * @return success, NODATA (the header is incomplete) or error
  **/
-wstk_status_t wstk_websock_decode(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb) {
-    uint8_t v, *p;
-    size_t i;
+wstk_status_t wstk_websock_decode_hdr(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb) {
+    uint8_t v;
 
     if(wstk_mbuf_left(mb) < 2) {
         return WSTK_STATUS_NODATA;
@@ -64,27 +212,76 @@ wstk_status_t wstk_websock_decode(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb) {
     }
 
     if(hdr->mask) {
-        if(wstk_mbuf_left(mb) < (4 + hdr->len)) {
+        if(wstk_mbuf_left(mb) < 4) {
             return WSTK_STATUS_NODATA;
         }
+        wstk_mbuf_read_mem(mb, hdr->mkey, 4);
+    }
 
-        wstk_mbuf_read_u8(mb, &hdr->mkey[0]);
-        wstk_mbuf_read_u8(mb, &hdr->mkey[1]);
-        wstk_mbuf_read_u8(mb, &hdr->mkey[2]);
-        wstk_mbuf_read_u8(mb, &hdr->mkey[3]);
+    return WSTK_STATUS_SUCCESS;
+}
 
-        for (i=0, p=wstk_mbuf_buf(mb); i<hdr->len; i++) {
-            p[i] = p[i] ^ hdr->mkey[i%4];
-        }
-    } else {
-        if(wstk_mbuf_left(mb) < hdr->len) {
-            return WSTK_STATUS_NODATA;
-        }
+/**
+ * Decode websock header
+ * the whole frame should be in the buffer, the payload is unmasked
+ *
+ * @param hdr
+ * @param mb
+ *
+ * @return success or error
+ **/
+wstk_status_t wstk_websock_decode(wstk_websock_hdr_t *hdr, wstk_mbuf_t *mb) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+
+    if((status = wstk_websock_decode_hdr(hdr, mb)) != WSTK_STATUS_SUCCESS) {
+        return status;
+    }
+    if(wstk_mbuf_left(mb) < hdr->len) {
+        return WSTK_STATUS_NODATA;
+    }
+
+    if(hdr->mask) {
+        wstk_websock_mask(wstk_mbuf_buf(mb), hdr->len, hdr->mkey, 0);
     }
 
     return WSTK_STATUS_SUCCESS;
 }
 
+/**
+ * (Un)mask the payload
+ * the part of the payload that starts from 'offset',
+ * the kernel (sse2/avx2/neon or 8 bytes words) is chosen by wstk_core_init()
+ *
+ * @param data      - the data
+ * @param len       - the data length
+ * @param mkey      - mask key
+ * @param offset    - the data offset in the payload
+ *
+ **/
+void wstk_websock_mask(uint8_t *data, size_t len, const uint8_t *mkey, size_t offset) {
+    uint8_t key[4];
+
+    if(!data || !len) {
+        return;
+    }
+
+    key[0] = mkey[offset & 3];
+    key[1] = mkey[(offset + 1) & 3];
+    key[2] = mkey[(offset + 2) & 3];
+    key[3] = mkey[(offset + 3) & 3];
+
+    mask_kernel(data, len, key);
+}
+
+/**
+ * The masking kernel in use
+ *
+ * @return word, sse2, avx2 or neon
+ **/
+const char *wstk_websock_mask_kernel() {
+    return mask_kernel_name;
+}
+
 
 /**
  * Encode websock header
@@ -126,8 +323,6 @@ wstk_status_t wstk_websock_encode(wstk_mbuf_t *mb, bool fin, websock_opcode_e op
 
     if(mask) {
         uint8_t mkey[4];
-        uint8_t *p;
-        size_t i;
 
         wstk_rand_bytes(mkey, sizeof(mkey));
 
@@ -135,9 +330,7 @@ wstk_status_t wstk_websock_encode(wstk_mbuf_t *mb, bool fin, websock_opcode_e op
             goto out;
         }
 
-        for (i=0, p=wstk_mbuf_buf(mb); i<len; i++) {
-            p[i] = p[i] ^ mkey[i%4];
-        }
+        wstk_websock_mask(wstk_mbuf_buf(mb), len, mkey, 0);
     }
 
 out:
@@ -145,17 +338,24 @@ out:
 }
 
 /**
+ * Encode the message into a new frame (pos points to the frame start)
  *
+ * @param frame     - a new frame
+ * @param opcode    - ws opcode
+ * @param scode     - 0 or the status code (close)
+ * @param server    - server to client (not masked)
+ * @param fmt       - formatted msg or NULL
+ * @param ap        - params
  *
+ * @return success or error
  **/
-wstk_status_t wstk_websock_vsend(wstk_socket_t *sock, websock_opcode_e opcode, websock_scode_e scode, bool server, const char *fmt, va_list ap) {
+wstk_status_t wstk_websock_vencode(wstk_mbuf_t **frame, websock_opcode_e opcode, websock_scode_e scode, bool server, const char *fmt, va_list ap) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     const size_t hsz = (server ? 10 : 14);
     wstk_mbuf_t *mb = NULL;
     size_t len, start;
-    int err = 0;
 
-    if(!sock) {
+    if(!frame) {
         return WSTK_STATUS_INVALID_PARAM;
     }
 
@@ -186,9 +386,30 @@ wstk_status_t wstk_websock_vsend(wstk_socket_t *sock, websock_opcode_e opcode, w
     }
 
     mb->pos = start;
-    status = wstk_tcp_write(sock, mb, 0);
-
+    *frame = mb;
 out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(mb);
+    }
+    return status;
+}
+
+/**
+ *
+ *
+ **/
+wstk_status_t wstk_websock_vsend(wstk_socket_t *sock, websock_opcode_e opcode, websock_scode_e scode, bool server, const char *fmt, va_list ap) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    wstk_mbuf_t *mb = NULL;
+
+    if(!sock) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+
+    if((status = wstk_websock_vencode(&mb, opcode, scode, server, fmt, ap)) == WSTK_STATUS_SUCCESS) {
+        status = wstk_tcp_write(sock, mb, 0);
+    }
+
     wstk_mem_deref(mb);
     return status;
 }
@@ -11,18 +11,49 @@
 #include <wstk-queue.h>
 #include <wstk-time.h>
 #include <wstk-mem.h>
+#include <wstk-atomic.h>
 
-#define WORKER_SUB_TH_DELAY     250
 #define WORKER_MAIN_TH_DELAY    250
 #define WORKER_DEF_QUEUE_SIZE   128
+#define WORKER_DEQUE_MIN_SIZE   64
+#define WORKER_CACHE_LINE       64
+
+#if defined(WSTK_HAVE_ATOMIC) && defined(WSTK_HAVE_ATOMIC_FENCE)
+ #define WORKER_HAVE_STEALING
+#endif
 
 typedef enum {
     WTF_USE_IDLE = (1<<0)
 } worker_th_flags_e;
 
+/* Chase-Lev deque (N.M.Le et al. weak memory model version), the owner pushes/takes at the bottom, thieves steal from the top */
+typedef struct {
+    wstk_worker_t           *worker;
+    void                    **buf;
+    int64_t                 mask;
+    uint32_t                id;
+    char                    pad0[WORKER_CACHE_LINE];
+    int64_t                 top;
+    char                    pad1[WORKER_CACHE_LINE - sizeof(int64_t)];
+    int64_t                 bottom;
+    char                    pad2[WORKER_CACHE_LINE - sizeof(int64_t)];
+} worker_deque_t;
+
+/* affinity mode, the own queue of a sub-thread */
+typedef struct {
+    wstk_queue_t            *queue;
+    wstk_cond_t             *cond;
+    uint32_t                id;
+    bool                    fl_waiting;     // the sub-thread sleeps on cond (see slot_waiting_set)
+} worker_slot_t;
+
 struct wstk_worker_s {
     wstk_mutex_t            *mutex;
-    wstk_queue_t            *jobsq;
+    wstk_cond_t             *cond_jobs;     // idle sub-threads wait here
+    wstk_cond_t             *cond_main;     // main thread waits here (queue grows, sub-thread leaves)
+    wstk_queue_t            *jobsq;         // shared queue (the injector in the stealing mode)
+    worker_deque_t          **deques;       // stealing mode, one per sub-thread
+    worker_slot_t           **slots;        // affinity mode, one per sub-thread
     wstk_worker_handler_t   handler;
     uint32_t                id;
     uint32_t                idle;
@@ -31,6 +62,17 @@ struct wstk_worker_s {
     uint32_t                idle_threads;
     uint32_t                min_threads;
     uint32_t                max_threads;
+    uint32_t                waiters;        // sub-threads sleeping on cond_jobs (see waiters_inc)
+    uint32_t                wakeups;        // signals sent but not taken yet
+    uint32_t                deques_count;
+    uint32_t                deques_used;
+    uint32_t                slots_count;
+    uint32_t                slots_used;
+    uint32_t                cpus;
+    uint32_t                flags;
+    bool                    fl_main_wakeup;
+    bool                    fl_stealing;
+    bool                    fl_affinity;
     bool                    fl_destroyed;
     bool                    fl_ready;
 };
@@ -38,33 +80,297 @@ struct wstk_worker_s {
 static void worker_main_thead(wstk_thread_t *th, void *qdata);
 static void worker_sub_thread(wstk_thread_t *th, void *qdata);
 
-static wstk_status_t subth_inc(wstk_worker_t *worker) {
-    if(!worker || worker->fl_destroyed)  {
+#ifdef WORKER_HAVE_STEALING
+/* deque of the current sub-thread */
+static __thread worker_deque_t *th_deque = NULL;
+
+static void destructor__worker_deque_t(void *data) {
+    worker_deque_t *dq = (worker_deque_t *)data;
+
+    if(!dq) { return; }
+
+    if(dq->buf) {
+        for(int64_t i = dq->top; i < dq->bottom; i++) {
+            void *dp = dq->buf[i & dq->mask];
+            if(dp) { wstk_mem_deref(dp); }
+        }
+    }
+    dq->buf = wstk_mem_deref(dq->buf);
+}
+
+static wstk_status_t deque_create(worker_deque_t **deque, wstk_worker_t *worker, uint32_t id, uint32_t size) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    worker_deque_t *dq = NULL;
+    uint32_t cap = WORKER_DEQUE_MIN_SIZE;
+
+    while(cap < size) { cap <<= 1; }
+
+    status = wstk_mem_zalloc((void *)&dq, sizeof(worker_deque_t), destructor__worker_deque_t);
+    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+
+    status = wstk_mem_zalloc((void *)&dq->buf, cap * sizeof(void *), NULL);
+    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+
+    dq->worker = worker;
+    dq->mask = (cap - 1);
+    dq->id = id;
+
+    *deque = dq;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(dq);
+    }
+    return status;
+}
+
+/* owner only */
+static wstk_status_t deque_push(worker_deque_t *dq, void *data) {
+    int64_t b = wstk_atomic_rlx(&dq->bottom);
+    int64_t t = wstk_atomic_acq(&dq->top);
+
+    if(b - t > dq->mask) {
+        return WSTK_STATUS_NOSPACE;
+    }
+
+    wstk_atomic_rlx_set(&dq->buf[b & dq->mask], data);
+    wstk_atomic_rls_set(&dq->bottom, b + 1);
+
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* owner only */
+static wstk_status_t deque_take(worker_deque_t *dq, void **data) {
+    int64_t b = wstk_atomic_rlx(&dq->bottom) - 1;
+    int64_t t = 0;
+    void *x = NULL;
+
+    wstk_atomic_rlx_set(&dq->bottom, b);
+    wstk_atomic_fence_seq();
+    t = wstk_atomic_rlx(&dq->top);
+
+    if(t > b) {
+        wstk_atomic_rlx_set(&dq->bottom, b + 1);
+        return WSTK_STATUS_NODATA;
+    }
+
+    x = wstk_atomic_rlx(&dq->buf[b & dq->mask]);
+    if(t == b) {
+        /* the last one, race with thieves */
+        bool fl_won = wstk_atomic_seq_cas(&dq->top, &t, t + 1);
+        wstk_atomic_rlx_set(&dq->bottom, b + 1);
+        if(!fl_won) {
+            return WSTK_STATUS_NODATA;
+        }
+    }
+
+    *data = x;
+    return WSTK_STATUS_SUCCESS;
+}
+
+/* any thread */
+static wstk_status_t deque_steal(worker_deque_t *dq, void **data) {
+    int64_t t = wstk_atomic_acq(&dq->top);
+    int64_t b = 0;
+    void *x = NULL;
+
+    wstk_atomic_fence_seq();
+    b = wstk_atomic_acq(&dq->bottom);
+
+    if(t >= b) {
+        return WSTK_STATUS_NODATA;
+    }
+
+    x = wstk_atomic_rlx(&dq->buf[t & dq->mask]);
+    if(!wstk_atomic_seq_cas(&dq->top, &t, t + 1)) {
         return WSTK_STATUS_FALSE;
     }
-    wstk_mutex_lock(worker->mutex);
-    worker->sub_threads++;
-    wstk_mutex_unlock(worker->mutex);
 
+    *data = x;
     return WSTK_STATUS_SUCCESS;
 }
-static void subth_dec(wstk_worker_t *worker) {
-    if(!worker)  { return; }
+
+static bool deque_is_empty(worker_deque_t *dq) {
+    return (wstk_atomic_acq(&dq->top) >= wstk_atomic_acq(&dq->bottom));
+}
+
+/* own deque, then the injector, then the others deques */
+static wstk_status_t stealing_next_job(wstk_worker_t *worker, worker_deque_t *dq, void **data) {
+    uint32_t start = (dq ? dq->id + 1 : 0);
+
+    if(dq && deque_take(dq, data) == WSTK_STATUS_SUCCESS) {
+        return WSTK_STATUS_SUCCESS;
+    }
+    if(wstk_queue_pop(worker->jobsq, data) == WSTK_STATUS_SUCCESS) {
+        return WSTK_STATUS_SUCCESS;
+    }
+    for(uint32_t i = 0; i < worker->deques_count; i++) {
+        worker_deque_t *victim = worker->deques[(start + i) % worker->deques_count];
+        if(victim == dq) { continue; }
+        if(deque_steal(victim, data) == WSTK_STATUS_SUCCESS) {
+            return WSTK_STATUS_SUCCESS;
+        }
+    }
+
+    return WSTK_STATUS_NODATA;
+}
+#endif
+
+static void destructor__worker_slot_t(void *data) {
+    worker_slot_t *slot = (worker_slot_t *)data;
+
+    slot->queue = wstk_mem_deref(slot->queue);
+    slot->cond = wstk_mem_deref(slot->cond);
+}
+
+static wstk_status_t slot_create(worker_slot_t **slot, uint32_t id, uint32_t size) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    worker_slot_t *slot_local = NULL;
+    uint32_t qflags = 0;
+
+#ifdef WSTK_HAVE_ATOMIC
+    qflags = WSTK_QUEUE_LOCKFREE;
+#endif
+
+    status = wstk_mem_zalloc((void *)&slot_local, sizeof(worker_slot_t), destructor__worker_slot_t);
+    if(status != WSTK_STATUS_SUCCESS) { goto out; }
+
+    if((status = wstk_queue_create_ex(&slot_local->queue, size, qflags)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_cond_create(&slot_local->cond)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+
+    slot_local->id = id;
+    *slot = slot_local;
+out:
+    if(status != WSTK_STATUS_SUCCESS) {
+        wstk_mem_deref(slot_local);
+    }
+    return status;
+}
+
+/* wake all sleeping sub-threads (should be called under the worker mutex) */
+static void worker_wakeup_all(wstk_worker_t *worker) {
+    wstk_cond_broadcast(worker->cond_jobs);
+    for(uint32_t i = 0; i < worker->slots_count; i++) {
+        wstk_cond_signal(worker->slots[i]->cond);
+    }
+}
+
+/* nothing to do for sub-threads (should be called under the worker mutex) */
+static bool worker_jobs_empty(wstk_worker_t *worker, worker_slot_t *slot) {
+    if(slot) {
+        return wstk_queue_is_empty(slot->queue);
+    }
+    if(!wstk_queue_is_empty(worker->jobsq)) {
+        return false;
+    }
+#ifdef WORKER_HAVE_STEALING
+    if(worker->fl_stealing) {
+        for(uint32_t i = 0; i < worker->deques_count; i++) {
+            if(!deque_is_empty(worker->deques[i])) { return false; }
+        }
+    }
+#endif
+    return true;
+}
+
+/*
+ * the sleepers are counted under the mutex, in the stealing mode the submitters check the counter without it:
+ * the sleeper counts itself and checks the jobs again, the submitter adds the job and checks the counter
+ * (one of them always sees the other), the signal is still sent under the mutex
+ */
+static void waiters_inc(wstk_worker_t *worker) {
+#ifdef WORKER_HAVE_STEALING
+    wstk_atomic_seq_add(&worker->waiters, 1);
+    wstk_atomic_fence_seq();
+#else
+    worker->waiters++;
+#endif
+}
+static void waiters_dec(wstk_worker_t *worker) {
+#ifdef WORKER_HAVE_STEALING
+    wstk_atomic_seq_sub(&worker->waiters, 1);
+#else
+    if(worker->waiters) worker->waiters--;
+#endif
+}
+static bool waiters_any(wstk_worker_t *worker) {
+#ifdef WORKER_HAVE_STEALING
+    wstk_atomic_fence_seq();
+    return (wstk_atomic_seq(&worker->waiters) > 0);
+#else
+    return true;
+#endif
+}
+
+/* the same for the affinity mode slots: the sub-thread sets the flag and checks its queue again, the submitter pushes and checks the flag */
+static void slot_waiting_set(worker_slot_t *slot, bool waiting) {
+#ifdef WORKER_HAVE_STEALING
+    wstk_atomic_seq_set(&slot->fl_waiting, waiting);
+    wstk_atomic_fence_seq();
+#else
+    slot->fl_waiting = waiting;
+#endif
+}
+static bool slot_waiting(worker_slot_t *slot) {
+#ifdef WORKER_HAVE_STEALING
+    wstk_atomic_fence_seq();
+    return wstk_atomic_seq(&slot->fl_waiting);
+#else
+    return true;
+#endif
+}
+
+/* a job has been added, wake an idle sub-thread or let the main one launch a new */
+static void worker_wakeup_one(wstk_worker_t *worker) {
+    /* the stealing pool is fixed, the mutex is needed only if someone sleeps */
+    if(worker->fl_stealing && !waiters_any(worker)) {
+        return;
+    }
 
     wstk_mutex_lock(worker->mutex);
-    if(worker->sub_threads > 0) worker->sub_threads--;
+    if(worker->waiters > worker->wakeups) {
+        worker->wakeups++;
+        wstk_cond_signal(worker->cond_jobs);
+    } else if(worker->sub_threads < worker->max_threads && !worker->fl_main_wakeup) {
+        worker->fl_main_wakeup = true;
+        wstk_cond_signal(worker->cond_main);
+    }
     wstk_mutex_unlock(worker->mutex);
 }
-static wstk_status_t idleth_inc(wstk_worker_t *worker) {
+
+static wstk_status_t worker_next_job(wstk_worker_t *worker, worker_slot_t *slot, void **data) {
+    if(slot) {
+        return wstk_queue_pop(slot->queue, data);
+    }
+#ifdef WORKER_HAVE_STEALING
+    if(worker->fl_stealing) {
+        return stealing_next_job(worker, th_deque, data);
+    }
+#endif
+    return wstk_queue_pop(worker->jobsq, data);
+}
+
+static wstk_status_t subth_inc(wstk_worker_t *worker) {
     if(!worker || worker->fl_destroyed)  {
         return WSTK_STATUS_FALSE;
     }
     wstk_mutex_lock(worker->mutex);
-    worker->idle_threads++;
+    worker->sub_threads++;
     wstk_mutex_unlock(worker->mutex);
 
     return WSTK_STATUS_SUCCESS;
 }
+static void subth_dec(wstk_worker_t *worker) {
+    if(!worker)  { return; }
+
+    wstk_mutex_lock(worker->mutex);
+    if(worker->sub_threads > 0) worker->sub_threads--;
+    wstk_cond_signal(worker->cond_main);
+    wstk_mutex_unlock(worker->mutex);
+}
 static void idleth_dec(wstk_worker_t *worker) {
     if(!worker)  { return; }
 
@@ -78,18 +384,38 @@ static wstk_status_t worker_refs(wstk_worker_t *worker) {
         return WSTK_STATUS_FALSE;
     }
 
+#ifdef WSTK_HAVE_ATOMIC
+    wstk_atomic_rlx_add(&worker->refs, 1);
+#else
     wstk_mutex_lock(worker->mutex);
     worker->refs++;
     wstk_mutex_unlock(worker->mutex);
+#endif
 
     return WSTK_STATUS_SUCCESS;
 }
 static void worker_derefs(wstk_worker_t *worker) {
     if(!worker)  { return; }
 
+#ifdef WSTK_HAVE_ATOMIC
+    uint32_t v = wstk_atomic_rlx(&worker->refs);
+    while(v > 0 && !wstk_atomic_seq_cas(&worker->refs, &v, v - 1));
+#else
     wstk_mutex_lock(worker->mutex);
     if(worker->refs) worker->refs--;
     wstk_mutex_unlock(worker->mutex);
+#endif
+}
+static uint32_t worker_refs_count(wstk_worker_t *worker) {
+#ifdef WSTK_HAVE_ATOMIC
+    return wstk_atomic_acq(&worker->refs);
+#else
+    uint32_t refs = 0;
+    wstk_mutex_lock(worker->mutex);
+    refs = worker->refs;
+    wstk_mutex_unlock(worker->mutex);
+    return refs;
+#endif
 }
 
 static wstk_status_t worker_sub_thread_launch(wstk_worker_t *worker, uint32_t flags) {
@@ -112,7 +438,7 @@ out:
 
 static void destructor__wstk_worker_t(void *data) {
     wstk_worker_t *worker = (wstk_worker_t *)data;
-    bool floop = true;
+    uint32_t spins = 0;
 
     if(!worker || worker->fl_destroyed) {
         return;
@@ -121,24 +447,38 @@ static void destructor__wstk_worker_t(void *data) {
     worker->fl_ready = false;
 
 #ifdef WSTK_WORKER_DEBUG
-    WSTK_DBG_PRINT("destroying worker: worker=%p (refs=%d, sub-threds=%d)", worker, worker->refs, worker->sub_threads);
+    WSTK_DBG_PRINT("destroying worker: worker=%p (refs=%d, sub-threds=%d)", worker, worker_refs_count(worker), worker->sub_threads);
 #endif
 
     if(worker->mutex) {
-        while(floop) {
-            wstk_mutex_lock(worker->mutex);
-            floop = (worker->refs > 0);
-            wstk_mutex_unlock(worker->mutex);
+        wstk_mutex_lock(worker->mutex);
+        worker_wakeup_all(worker);
+        wstk_cond_broadcast(worker->cond_main);
+        wstk_mutex_unlock(worker->mutex);
+    }
 
-            WSTK_SCHED_YIELD(0);
+    if(worker->mutex) {
+        while(worker_refs_count(worker) > 0) {
+            WSTK_SCHED_BACKOFF(spins);
         }
     }
 
-    if(worker->refs) {
-        log_warn("Lost references (refs=%d, sub_threads=%d)", worker->refs, worker->sub_threads);
+    if(worker->deques) {
+        for(uint32_t i = 0; i < worker->deques_count; i++) {
+            wstk_mem_deref(worker->deques[i]);
+        }
+        worker->deques = wstk_mem_deref(worker->deques);
+    }
+    if(worker->slots) {
+        for(uint32_t i = 0; i < worker->slots_count; i++) {
+            wstk_mem_deref(worker->slots[i]);
+        }
+        worker->slots = wstk_mem_deref(worker->slots);
     }
 
     worker->jobsq = wstk_mem_deref(worker->jobsq);
+    worker->cond_jobs = wstk_mem_deref(worker->cond_jobs);
+    worker->cond_main = wstk_mem_deref(worker->cond_main);
     worker->mutex = wstk_mem_deref(worker->mutex);
 
 #ifdef WSTK_WORKER_DEBUG
@@ -150,7 +490,6 @@ static void worker_main_thead(wstk_thread_t *th, void *qdata) {
     wstk_worker_t *worker = (wstk_worker_t *)qdata;
     wstk_status_t status = WSTK_STATUS_FALSE;
     bool fl_run_workers = false;
-    bool floop = true;
     uint32_t qlen=0, herr = 0;
 
     worker_refs(worker);
@@ -202,7 +541,13 @@ static void worker_main_thead(wstk_thread_t *th, void *qdata) {
         }
 
         timer:
-        WSTK_SCHED_YIELD(WORKER_MAIN_TH_DELAY);
+        /* sleep until wstk_worker_perform() finds no idle thread, retry soon if min threads aren't there */
+        wstk_mutex_lock(worker->mutex);
+        if(!worker->fl_main_wakeup && !worker->fl_destroyed) {
+            wstk_cond_wait(worker->cond_main, worker->mutex, (worker->sub_threads < worker->min_threads ? WORKER_MAIN_TH_DELAY : 0));
+        }
+        worker->fl_main_wakeup = false;
+        wstk_mutex_unlock(worker->mutex);
     }
 
     if(herr) {
@@ -213,13 +558,12 @@ static void worker_main_thead(wstk_thread_t *th, void *qdata) {
     WSTK_DBG_PRINT("main-thread stopping: thread=%p (sub_threads=%d, idle_threads=%d)", th, worker->sub_threads, worker->idle_threads);
 #endif
 
-    for(floop = true; floop;) {
-        wstk_mutex_lock(worker->mutex);
-        floop = (worker->sub_threads > 0);
-        wstk_mutex_unlock(worker->mutex);
-
-        WSTK_SCHED_YIELD(0);
+    wstk_mutex_lock(worker->mutex);
+    while(worker->sub_threads > 0) {
+        worker_wakeup_all(worker);
+        wstk_cond_wait(worker->cond_main, worker->mutex, WORKER_MAIN_TH_DELAY);
     }
+    wstk_mutex_unlock(worker->mutex);
 
     worker_derefs(worker);
 
@@ -235,6 +579,8 @@ static void worker_sub_thread(wstk_thread_t *th, void *qdata) {
     uint32_t th_flags = 0, th_id = 0;
     time_t expiry = 0;
     void *pop = NULL;
+    worker_slot_t *slot = NULL;
+    int32_t th_index = -1;
     bool fl_idle = false;
 
     worker_refs(worker);
@@ -246,12 +592,30 @@ static void worker_sub_thread(wstk_thread_t *th, void *qdata) {
     wstk_thread_id(th, &th_id);
     wstk_thread_uflags(th, &th_flags);
 
-    while(!worker->fl_destroyed) {
-        if(!worker->fl_ready) {
-            goto timer;
+#ifdef WORKER_HAVE_STEALING
+    if(worker->fl_stealing) {
+        wstk_mutex_lock(worker->mutex);
+        if(worker->deques_used < worker->deques_count) {
+            th_index = worker->deques_used;
+            th_deque = worker->deques[worker->deques_used++];
         }
+        wstk_mutex_unlock(worker->mutex);
+    }
+#endif
+    if(worker->fl_affinity) {
+        wstk_mutex_lock(worker->mutex);
+        if(worker->slots_used < worker->slots_count) {
+            th_index = worker->slots_used;
+            slot = worker->slots[worker->slots_used++];
+        }
+        wstk_mutex_unlock(worker->mutex);
+    }
+    if(th_index >= 0 && (worker->flags & WSTK_WORKER_CPU_PIN)) {
+        wstk_thread_bind_cpu(th_index % worker->cpus);
+    }
 
-        while(wstk_queue_pop(worker->jobsq, &pop) == WSTK_STATUS_SUCCESS) {
+    while(!worker->fl_destroyed) {
+        while(worker_next_job(worker, slot, &pop) == WSTK_STATUS_SUCCESS) {
             if(worker->fl_destroyed) {
                break;
             }
@@ -266,19 +630,45 @@ static void worker_sub_thread(wstk_thread_t *th, void *qdata) {
             break;
         }
 
-        if(expiry) {
-            if(expiry <= wstk_time_epoch_now()) {
+        if(th_flags & WTF_USE_IDLE) {
+            time_t now = wstk_time_epoch_now();
+            if(!expiry) {
+                expiry = (now + worker->idle);
+            } else if(expiry <= now) {
                 break;
             }
-        } else {
-            if(th_flags & WTF_USE_IDLE) {
-                expiry = (wstk_time_epoch_now() + worker->idle);
-            }
         }
 
-        timer:
-        if(!fl_idle) { fl_idle = true; idleth_inc(worker); }
-        WSTK_SCHED_YIELD(WORKER_SUB_TH_DELAY);
+        /* block until a job comes (or the idle time is over) */
+        wstk_mutex_lock(worker->mutex);
+        if(!fl_idle) {
+            fl_idle = true;
+            worker->idle_threads++;
+        }
+        if(!worker->fl_destroyed && worker_jobs_empty(worker, slot)) {
+            uint32_t timeout = 0;
+            if(expiry) {
+                time_t now = wstk_time_epoch_now();
+                timeout = (expiry > now ? (expiry - now) * 1000 : 1);
+            }
+            if(slot) {
+                /* the keyed submitters don't take the mutex if the flag isn't set, so the queue is checked once again after setting it */
+                slot_waiting_set(slot, true);
+                if(wstk_queue_is_empty(slot->queue)) {
+                    wstk_cond_wait(slot->cond, worker->mutex, timeout);
+                }
+                slot_waiting_set(slot, false);
+            } else {
+                /* the stealing mode submitters don't take the mutex, so the jobs are checked once again after counting in */
+                waiters_inc(worker);
+                if(worker_jobs_empty(worker, NULL)) {
+                    wstk_cond_wait(worker->cond_jobs, worker->mutex, timeout);
+                }
+                waiters_dec(worker);
+                if(worker->wakeups) worker->wakeups--;
+            }
+        }
+        wstk_mutex_unlock(worker->mutex);
     }
 
     if(fl_idle) {
@@ -286,6 +676,10 @@ static void worker_sub_thread(wstk_thread_t *th, void *qdata) {
         fl_idle = false;
     }
 
+#ifdef WORKER_HAVE_STEALING
+    th_deque = NULL;
+#endif
+
     subth_dec(worker);
     worker_derefs(worker);
 
@@ -310,6 +704,29 @@ static void worker_sub_thread(wstk_thread_t *th, void *qdata) {
  * @return sucesss or some error
  **/
 wstk_status_t wstk_worker_create(wstk_worker_t **worker, uint32_t min, uint32_t max, uint32_t qsize, uint32_t idle, wstk_worker_handler_t handler) {
+    return wstk_worker_create_ex(worker, min, max, qsize, idle, 0, handler);
+}
+
+/**
+ * Create a new worker (extended version)
+ * WSTK_WORKER_STEALING: a fixed pool of 'max' threads, each one has an own deque,
+ * wstk_worker_perform() from a sub-thread keeps the job in its deque, the others go through the shared queue,
+ * idle threads steal from the busy ones
+ * WSTK_WORKER_AFFINITY: a fixed pool of 'max' threads, each one has an own queue,
+ * wstk_worker_perform_key() sends the jobs with the same key to the same thread
+ * WSTK_WORKER_CPU_PIN: (with one of the above) binds the sub-threads to the processors
+ *
+ * @param worker   - a new worker
+ * @param min      - min workers amount (ignored in the stealing mode)
+ * @param max      - max workers amount
+ * @param qsize    - queue size (and each deque size in the stealing mode)
+ * @param idle     - workers idle time (seconds) before terminated (by def 45sec)
+ * @param flags    - WSTK_WORKER_*
+ * @param handler  - function to called to process queue data
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_worker_create_ex(wstk_worker_t **worker, uint32_t min, uint32_t max, uint32_t qsize, uint32_t idle, uint32_t flags, wstk_worker_handler_t handler) {
     wstk_status_t status = WSTK_STATUS_SUCCESS;
     wstk_worker_t *worker_local = NULL;
 
@@ -319,6 +736,9 @@ wstk_status_t wstk_worker_create(wstk_worker_t **worker, uint32_t min, uint32_t
     if(max < min || !max ) {
         return WSTK_STATUS_INVALID_PARAM;
     }
+    if((flags & WSTK_WORKER_STEALING) && (flags & WSTK_WORKER_AFFINITY)) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
 
     if(!qsize) {
         qsize = WORKER_DEF_QUEUE_SIZE;
@@ -333,10 +753,62 @@ wstk_status_t wstk_worker_create(wstk_worker_t **worker, uint32_t min, uint32_t
         goto out;
     }
 
-    if((status = wstk_queue_create(&worker_local->jobsq, qsize)) != WSTK_STATUS_SUCCESS) {
+    if((status = wstk_cond_create(&worker_local->cond_jobs)) != WSTK_STATUS_SUCCESS) {
+        goto out;
+    }
+    if((status = wstk_cond_create(&worker_local->cond_main)) != WSTK_STATUS_SUCCESS) {
         goto out;
     }
 
+    worker_local->flags = flags;
+#ifdef WORKER_HAVE_STEALING
+    worker_local->fl_stealing = (flags & WSTK_WORKER_STEALING);
+#else
+    if(flags & WSTK_WORKER_STEALING) {
+        log_warn("Atomics aren't available, the shared queue will be used");
+    }
+#endif
+
+    if(worker_local->fl_stealing) {
+#ifdef WORKER_HAVE_STEALING
+        if((status = wstk_queue_create_ex(&worker_local->jobsq, qsize, WSTK_QUEUE_LOCKFREE)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        status = wstk_mem_zalloc((void *)&worker_local->deques, max * sizeof(worker_deque_t *), NULL);
+        if(status != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        for(uint32_t i = 0; i < max; i++) {
+            if((status = deque_create(&worker_local->deques[i], worker_local, i, qsize)) != WSTK_STATUS_SUCCESS) {
+                goto out;
+            }
+            worker_local->deques_count++;
+        }
+        min = max;
+#endif
+    } else if(flags & WSTK_WORKER_AFFINITY) {
+        if((status = wstk_queue_create(&worker_local->jobsq, qsize)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        status = wstk_mem_zalloc((void *)&worker_local->slots, max * sizeof(worker_slot_t *), NULL);
+        if(status != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+        for(uint32_t i = 0; i < max; i++) {
+            if((status = slot_create(&worker_local->slots[i], i, qsize)) != WSTK_STATUS_SUCCESS) {
+                goto out;
+            }
+            worker_local->slots_count++;
+        }
+        worker_local->fl_affinity = true;
+        min = max;
+    } else {
+        if((status = wstk_queue_create(&worker_local->jobsq, qsize)) != WSTK_STATUS_SUCCESS) {
+            goto out;
+        }
+    }
+
+    wstk_thread_cpus(&worker_local->cpus);
     worker_local->idle = (idle > 0 ? idle : 45);
     worker_local->handler = handler;
     worker_local->min_threads = min;
@@ -348,9 +820,9 @@ wstk_status_t wstk_worker_create(wstk_worker_t **worker, uint32_t min, uint32_t
     }
 
 #ifdef WSTK_WORKER_DEBUG
-    WSTK_DBG_PRINT("worker created: worker=%p (min=%d, max=%d, qsize=%d, idle=%d, handler=%p)",
+    WSTK_DBG_PRINT("worker created: worker=%p (min=%d, max=%d, qsize=%d, idle=%d, stealing=%d, affinity=%d, handler=%p)",
               worker_local, worker_local->min_threads, worker_local->max_threads,
-              qsize, worker_local->idle, worker_local->handler
+              qsize, worker_local->idle, worker_local->fl_stealing, worker_local->fl_affinity, worker_local->handler
     );
 #endif
 
@@ -380,9 +852,64 @@ wstk_status_t wstk_worker_perform(wstk_worker_t *worker, void *data) {
     if(worker->fl_destroyed) {
         return WSTK_STATUS_DESTROYED;
     }
+    if(worker->fl_affinity) {
+        return wstk_worker_perform_key(worker, (uint32_t)((uintptr_t)data >> 4), data);
+    }
+
+    if((status = worker_refs(worker)) == WSTK_STATUS_SUCCESS) {
+        status = WSTK_STATUS_FALSE;
+#ifdef WORKER_HAVE_STEALING
+        /* from the own sub-thread, keep it local */
+        if(worker->fl_stealing && th_deque && th_deque->worker == worker) {
+            status = deque_push(th_deque, data);
+        }
+#endif
+        if(status != WSTK_STATUS_SUCCESS) {
+            status = wstk_queue_push(worker->jobsq, data);
+        }
+        if(status == WSTK_STATUS_SUCCESS) {
+            worker_wakeup_one(worker);
+        }
+        worker_derefs(worker);
+    }
+
+    return status;
+}
+
+/**
+ * Add data to the queue of the thread selected by the key
+ * (in the affinity mode, the jobs with the same key are processed by the same thread one by one)
+ * in the other modes it's the same as wstk_worker_perform()
+ *
+ * @param worker   - a worker
+ * @param key      - some key (connection id, etc)
+ * @param data     - a certain data for this worker
+ *
+ * @return sucesss or some error
+ **/
+wstk_status_t wstk_worker_perform_key(wstk_worker_t *worker, uint32_t key, void *data) {
+    wstk_status_t status = WSTK_STATUS_SUCCESS;
+    worker_slot_t *slot = NULL;
+
+    if(!worker || !worker->fl_ready) {
+        return WSTK_STATUS_INVALID_PARAM;
+    }
+    if(worker->fl_destroyed) {
+        return WSTK_STATUS_DESTROYED;
+    }
+    if(!worker->fl_affinity) {
+        return wstk_worker_perform(worker, data);
+    }
 
     if((status = worker_refs(worker)) == WSTK_STATUS_SUCCESS) {
-        status = wstk_queue_push(worker->jobsq, data);
+        slot = worker->slots[key % worker->slots_count];
+        status = wstk_queue_push(slot->queue, data);
+        if(status == WSTK_STATUS_SUCCESS && slot_waiting(slot)) {
+            /* the sub-thread is in the wait or hasn't released the mutex yet */
+            wstk_mutex_lock(worker->mutex);
+            wstk_cond_signal(slot->cond);
+            wstk_mutex_unlock(worker->mutex);
+        }
         worker_derefs(worker);
     }
 